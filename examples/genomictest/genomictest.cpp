@@ -6,8 +6,10 @@
  *  Based on tinyTest.cpp by Andrew Rambaut.
  */
 #include <cstring>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstdarg>
 #include <iostream>
 #include <iomanip>
 #include <vector>
@@ -72,6 +74,19 @@ void abort(std::string msg) {
 	std::exit(1);
 }
 
+// failed checks and created instances, for the exit status
+static int errorCount = 0;
+static int instanceCount = 0;
+
+void reportError(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stdout, "error: ");
+    vfprintf(stdout, format, args);
+    va_end(args);
+    errorCount++;
+}
+
 double* getRandomTipPartials( int nsites, int stateCount )
 {
 	double *partials = (double*) calloc(sizeof(double), nsites * stateCount); // 'malloc' was a bug
@@ -94,6 +109,30 @@ int* getRandomTipStates( int nsites, int stateCount )
 	return states;
 }
 
+int* getRandomTipStateMasks( int nsites, int stateCount )
+{
+	// About one site in twenty is ambiguous between two states
+	int *masks = (int*) calloc(sizeof(int), nsites);
+	for( int i=0; i<nsites; i++ )
+	{
+		masks[i] = 1 << (gt_rand()%stateCount);
+		if (gt_rand()%20 == 0)
+			masks[i] |= 1 << (gt_rand()%stateCount);
+	}
+	return masks;
+}
+
+double* getTipPartialsFromStateMasks( const int* masks, int nsites, int stateCount )
+{
+	double *partials = (double*) calloc(sizeof(double), nsites * stateCount);
+	for( int i=0; i<nsites; i++ )
+	{
+		for( int s=0; s<stateCount; s++ )
+			partials[i*stateCount+s] = ((masks[i] >> s) & 1) ? 1.0 : 0.0;
+	}
+	return partials;
+}
+
 void printTiming(double timingValue,
                  int timePrecision,
                  bool printSpeedup,
@@ -113,6 +152,87 @@ double getTimeDiff(struct timeval t1,
     return ((t2.tv_sec - t1.tv_sec) + (double)(t2.tv_usec-t1.tv_usec)/1000000.0);
 }
 
+// calculates the lnL at the root, or across the edge to the last tip if unrooted
+double calculateLogL(int instance,
+                     bool unrooted,
+                     bool calcderivs,
+                     int* rootIndices,
+                     int* lastTipIndices,
+                     int* edgeIndicesD1,
+                     int* edgeIndicesD2,
+                     int* categoryWeightsIndices,
+                     int* stateFrequencyIndices,
+                     int* cumulativeScalingFactorIndices,
+                     int eigenCount) {
+    double logL = 0.0;
+    if (!unrooted) {
+        beagleCalculateRootLogLikelihoods(instance, rootIndices, categoryWeightsIndices,
+                                          stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                          eigenCount, &logL);
+    } else {
+        double deriv1 = 0.0, deriv2 = 0.0;
+        beagleCalculateEdgeLogLikelihoods(instance, rootIndices, lastTipIndices, lastTipIndices,
+                                          (calcderivs ? edgeIndicesD1 : NULL),
+                                          (calcderivs ? edgeIndicesD2 : NULL),
+                                          categoryWeightsIndices, stateFrequencyIndices,
+                                          cumulativeScalingFactorIndices, eigenCount, &logL,
+                                          (calcderivs ? &deriv1 : NULL),
+                                          (calcderivs ? &deriv2 : NULL));
+    }
+    return logL;
+}
+
+// recomputes the transition matrices, unless they are set directly, the partials and the
+//  scale factors of an instance for the given edge lengths
+void updateInstance(int instance,
+                    bool setmatrix,
+                    bool matrixFree,
+                    bool calcderivs,
+                    bool manualScaling,
+                    bool autoScaling,
+                    bool dynamicScaling,
+                    int* edgeIndices,
+                    int* edgeIndicesD1,
+                    int* edgeIndicesD2,
+                    double* edgeLengths,
+                    int edgeCount,
+                    int* operations,
+                    int internalCount,
+                    int* scalingFactorsIndices,
+                    int* cumulativeScalingFactorIndices,
+                    int eigenCount) {
+    if (!setmatrix) {
+        for (int eigenIndex=0; eigenIndex < eigenCount; eigenIndex++) {
+            beagleUpdateTransitionMatrices(instance, eigenIndex, &edgeIndices[eigenIndex*edgeCount],
+                                           (calcderivs ? &edgeIndicesD1[eigenIndex*edgeCount] : NULL),
+                                           (calcderivs ? &edgeIndicesD2[eigenIndex*edgeCount] : NULL),
+                                           edgeLengths, edgeCount);
+        }
+    }
+    if (matrixFree) {
+        std::vector<double> operationEdgeLengths(2 * internalCount);
+        for (int j = 0; j < internalCount; j++) {
+            operationEdgeLengths[2 * j] = edgeLengths[operations[BEAGLE_OP_COUNT * j + 4]];
+            operationEdgeLengths[2 * j + 1] = edgeLengths[operations[BEAGLE_OP_COUNT * j + 6]];
+        }
+        beagleUpdatePartialsByEdgeLengths(instance, 0, (BeagleOperation*)operations, internalCount,
+                                          &operationEdgeLengths[0], BEAGLE_OP_NONE);
+    } else {
+        beagleUpdatePartials(instance, (BeagleOperation*)operations, internalCount*eigenCount,
+                             (dynamicScaling ? internalCount : BEAGLE_OP_NONE));
+    }
+    for (int eigenIndex=0; eigenIndex < eigenCount; eigenIndex++) {
+        if (manualScaling && operations[1] != BEAGLE_OP_NONE) {
+            beagleResetScaleFactors(instance, cumulativeScalingFactorIndices[eigenIndex]);
+            beagleAccumulateScaleFactors(instance, &scalingFactorsIndices[eigenIndex*internalCount],
+                                         internalCount, cumulativeScalingFactorIndices[eigenIndex]);
+        } else if (autoScaling) {
+            beagleAccumulateScaleFactors(instance, &scalingFactorsIndices[eigenIndex*internalCount],
+                                         internalCount, BEAGLE_OP_NONE);
+        }
+    }
+}
+
 void runBeagle(int resource, 
                int stateCount, 
                int ntaxa, 
@@ -136,7 +256,28 @@ void runBeagle(int resource,
                bool eigencomplex,
                bool ievectrans,
                bool setmatrix,
-               bool opencl)
+               bool opencl,
+               bool memoryMapped,
+               bool blockedTraversal,
+               bool patternMajor,
+               bool ambiguous,
+               bool dirtyTracking,
+               int matrixCacheSize,
+               bool rateMatrix,
+               bool matrixFree,
+               bool projectEdge,
+               bool edgeBatch,
+               bool optimize,
+               bool checkpoint,
+               bool cloneTest,
+               bool tipDataTest,
+               bool zeroWeightsTest,
+               bool exponentScalers,
+               bool fusedRoot,
+               bool fusedMatrices,
+               bool siteBuffers,
+               bool partialsBuffers,
+               bool kernelCounters)
 {
     
     int edgeCount = ntaxa*2-2;
@@ -144,6 +285,20 @@ void runBeagle(int resource,
     int partialCount = ((ntaxa+internalCount)-compactTipCount)*eigenCount;
     int scaleCount = ((manualScaling || dynamicScaling) ? ntaxa : 0);
     
+    int matrixBufferCount = (calcderivs ? (3*edgeCount*eigenCount) : edgeCount*eigenCount);
+    long requirementFlags = (opencl ? BEAGLE_FLAG_FRAMEWORK_OPENCL : 0) |
+                (memoryMapped ? BEAGLE_FLAG_MEMORY_MAPPED : 0) |
+                (blockedTraversal ? BEAGLE_FLAG_TRAVERSAL_BLOCKED : 0) |
+                (patternMajor ? BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR : 0) |
+                (ievectrans ? BEAGLE_FLAG_INVEVEC_TRANSPOSED : BEAGLE_FLAG_INVEVEC_STANDARD) |
+                (logscalers ? BEAGLE_FLAG_SCALERS_LOG : BEAGLE_FLAG_SCALERS_RAW) |
+                (eigencomplex ? BEAGLE_FLAG_EIGEN_COMPLEX : BEAGLE_FLAG_EIGEN_REAL) |
+                (dynamicScaling ? BEAGLE_FLAG_SCALING_DYNAMIC : 0) |
+                (autoScaling ? BEAGLE_FLAG_SCALING_AUTO : 0) |
+                (requireDoublePrecision ? BEAGLE_FLAG_PRECISION_DOUBLE : BEAGLE_FLAG_PRECISION_SINGLE) |
+                (requireSSE ? BEAGLE_FLAG_VECTOR_SSE :
+                		  (requireAVX ? BEAGLE_FLAG_VECTOR_AVX : BEAGLE_FLAG_VECTOR_NONE));
+
     BeagleInstanceDetails instDetails;
     
     // create an instance of the BEAGLE library
@@ -154,26 +309,19 @@ void runBeagle(int resource,
 				stateCount,		  /**< Number of states in the continuous-time Markov chain (input) */
 				nsites,			  /**< Number of site patterns to be handled by the instance (input) */
 				eigenCount,		          /**< Number of rate matrix eigen-decomposition buffers to allocate (input) */
-                (calcderivs ? (3*edgeCount*eigenCount) : edgeCount*eigenCount),/**< Number of rate matrix buffers (input) */
+                matrixBufferCount,/**< Number of rate matrix buffers (input) */
                 rateCategoryCount,/**< Number of rate categories */
                 scaleCount*eigenCount,          /**< scaling buffers */
 				&resource,		  /**< List of potential resource on which this instance is allowed (input, NULL implies no restriction */
 				1,			      /**< Length of resourceList list (input) */
                 0,         /**< Bit-flags indicating preferred implementation charactertistics, see BeagleFlags (input) */
-                (opencl ? BEAGLE_FLAG_FRAMEWORK_OPENCL : 0) |
-                (ievectrans ? BEAGLE_FLAG_INVEVEC_TRANSPOSED : BEAGLE_FLAG_INVEVEC_STANDARD) |
-                (logscalers ? BEAGLE_FLAG_SCALERS_LOG : BEAGLE_FLAG_SCALERS_RAW) |
-                (eigencomplex ? BEAGLE_FLAG_EIGEN_COMPLEX : BEAGLE_FLAG_EIGEN_REAL) |
-                (dynamicScaling ? BEAGLE_FLAG_SCALING_DYNAMIC : 0) |
-                (autoScaling ? BEAGLE_FLAG_SCALING_AUTO : 0) |
-                (requireDoublePrecision ? BEAGLE_FLAG_PRECISION_DOUBLE : BEAGLE_FLAG_PRECISION_SINGLE) |
-                (requireSSE ? BEAGLE_FLAG_VECTOR_SSE :
-                		  (requireAVX ? BEAGLE_FLAG_VECTOR_AVX : BEAGLE_FLAG_VECTOR_NONE)),	  /**< Bit-flags indicating required implementation characteristics, see BeagleFlags (input) */
+                requirementFlags,	  /**< Bit-flags indicating required implementation characteristics, see BeagleFlags (input) */
 				&instDetails);
     if (instance < 0) {
 	    fprintf(stderr, "Failed to obtain BEAGLE instance\n\n");
 	    return;
     }
+    instanceCount++;
         
     int rNumber = instDetails.resourceNumber;
     fprintf(stdout, "Using resource %i:\n", rNumber);
@@ -182,21 +330,73 @@ void runBeagle(int resource,
     
     if (!(instDetails.flags & BEAGLE_FLAG_SCALING_AUTO))
         autoScaling = false;
+
+    if (dirtyTracking && beagleSetDirtyTracking(instance, 1) != BEAGLE_SUCCESS) {
+        fprintf(stdout, "\tDirty tracking is not available, all operations are recomputed\n");
+        dirtyTracking = false;
+    }
+
+    if (exponentScalers && beagleSetExponentScalers(instance, 1) != BEAGLE_SUCCESS) {
+        fprintf(stdout, "\tExponent scalers are not available, scale factors are kept as reals\n");
+        exponentScalers = false;
+    }
+    
+    if (matrixCacheSize > 0 && beagleSetTransitionMatrixCacheSize(instance, matrixCacheSize) != BEAGLE_SUCCESS) {
+        fprintf(stdout, "\tTransition matrix cache is not available\n");
+        matrixCacheSize = 0;
+    }
+
+    if (kernelCounters && beagleSetKernelCounting(instance, 1) != BEAGLE_SUCCESS) {
+        fprintf(stdout, "\tKernel counting is not available\n");
+        kernelCounters = false;
+    }
     
+    // with tipdata the tips are set in a store that the instance is then given; the store
+    //  has no state masks, so ambiguous compact tips are set there as partials
+    int tipData = -1;
+    if (tipDataTest)
+        tipData = beagleCreateTipData(ntaxa, stateCount, nsites);
+
     // set the sequences for each tip using partial likelihood arrays
 	gt_srand(randomSeed);	// fix the random seed...
     for(int i=0; i<ntaxa; i++)
     {
-        if (i >= compactTipCount) {
+        if (ambiguous) {
+            int* tmpMasks = getRandomTipStateMasks(nsites, stateCount);
+            if (i >= compactTipCount || tipDataTest) {
+                double* tmpPartials = getTipPartialsFromStateMasks(tmpMasks, nsites, stateCount);
+                if (tipDataTest)
+                    beagleSetTipDataPartials(tipData, i, tmpPartials);
+                else
+                    beagleSetTipPartials(instance, i, tmpPartials);
+                free(tmpPartials);
+            } else {
+                beagleSetTipStateMasks(instance, i, tmpMasks);
+            }
+            free(tmpMasks);
+        } else if (i >= compactTipCount) {
             double* tmpPartials = getRandomTipPartials(nsites, stateCount);
-            beagleSetTipPartials(instance, i, tmpPartials);
+            if (tipDataTest)
+                beagleSetTipDataPartials(tipData, i, tmpPartials);
+            else
+                beagleSetTipPartials(instance, i, tmpPartials);
             free(tmpPartials);
         } else {
             int* tmpStates = getRandomTipStates(nsites, stateCount);
-            beagleSetTipStates(instance, i, tmpStates);
+            if (tipDataTest)
+                beagleSetTipDataStates(tipData, i, tmpStates);
+            else
+                beagleSetTipStates(instance, i, tmpStates);
             free(tmpStates);                
         }
     }
+
+    if (tipDataTest && beagleSetTipData(instance, tipData) != BEAGLE_SUCCESS) {
+        fprintf(stdout, "\tTip data store is not available\n");
+        beagleFinalizeTipData(tipData);
+        beagleFinalizeInstance(instance);
+        return;
+    }
     
 #ifdef _WIN32
 	std::vector<double> rates(rateCategoryCount);
@@ -217,8 +417,6 @@ void runBeagle(int resource,
     }    
 
     beagleSetPatternWeights(instance, patternWeights);
-    
-    free(patternWeights);
 	
     // create base frequency array
 
@@ -235,12 +433,14 @@ void runBeagle(int resource,
     double weights[rateCategoryCount];
 #endif
 
+    std::vector<double> allCategoryWeights;
     for (int eigenIndex=0; eigenIndex < eigenCount; eigenIndex++) {
         for (int i = 0; i < rateCategoryCount; i++) {
             weights[i] = gt_rand() / (double) GT_RAND_MAX;
         } 
     
         beagleSetCategoryWeights(instance, eigenIndex, &weights[0]);
+        allCategoryWeights.insert(allCategoryWeights.end(), &weights[0], &weights[0] + rateCategoryCount);
     }
     
     double* eval;
@@ -392,7 +592,55 @@ void runBeagle(int resource,
             
         beagleSetStateFrequencies(instance, eigenIndex, &freqs[0]);
         
-        if (!setmatrix) {
+        std::vector<double> qmat;
+        if (rateMatrix || matrixFree) {
+            // rebuild Q = evec * diag(eval) * ivec (with 2 x 2 blocks for complex conjugate
+            //  pairs) for BEAGLE to exponentiate
+            std::vector<double> lambda(stateCount * stateCount, 0.0);
+            for (int i = 0; i < stateCount; i++) {
+                lambda[i * stateCount + i] = eval[i];
+                if (eigencomplex && eval[stateCount + i] != 0.0) {
+                    lambda[(i + 1) * stateCount + i + 1] = eval[i + 1];
+                    lambda[i * stateCount + i + 1] = eval[stateCount + i];
+                    lambda[(i + 1) * stateCount + i] = -eval[stateCount + i];
+                    i++;
+                }
+            }
+            qmat.assign(stateCount * stateCount, 0.0);
+            for (int i = 0; i < stateCount; i++) {
+                for (int j = 0; j < stateCount; j++) {
+                    double sum = 0.0;
+                    for (int k = 0; k < stateCount; k++) {
+                        for (int m = 0; m < stateCount; m++) {
+                            double ivecMJ = (ievectrans ? ivec[j * stateCount + m] : ivec[m * stateCount + j]);
+                            sum += evec[i * stateCount + k] * lambda[k * stateCount + m] * ivecMJ;
+                        }
+                    }
+                    qmat[i * stateCount + j] = sum;
+                }
+            }
+        }
+        
+        if (matrixFree) {
+            std::vector<int> rows, columns;
+            std::vector<double> rates;
+            for (int i = 0; i < stateCount; i++) {
+                for (int j = 0; j < stateCount; j++) {
+                    if (i != j && qmat[i * stateCount + j] > 0.0) {
+                        rows.push_back(i);
+                        columns.push_back(j);
+                        rates.push_back(qmat[i * stateCount + j]);
+                    }
+                }
+            }
+            beagleSetSparseRateMatrix(instance, eigenIndex, (int) rates.size(), &rows[0], &columns[0], &rates[0]);
+        }
+        
+        if (setmatrix) {
+            // transition matrices are set directly
+        } else if (rateMatrix) {
+            beagleSetRateMatrix(instance, eigenIndex, &qmat[0]);
+        } else {
             // set the Eigen decomposition
             beagleSetEigenDecomposition(instance, eigenIndex, &evec[0], &ivec[0], &eval[0]);
         }
@@ -488,10 +736,30 @@ void runBeagle(int resource,
             }
         }
         
+        if (dirtyTracking && i > 0 && !setmatrix) {
+            // Propose a new length for one edge and reject it, so that this rep only
+            //  recomputes the matrices and partials along the path from that edge to the root
+            int edge = i % edgeCount;
+            double oldEdgeLength = edgeLengths[edge];
+            edgeLengths[edge] *= 2.0;
+            for (int eigenIndex=0; eigenIndex < eigenCount; eigenIndex++) {
+                beagleUpdateTransitionMatrices(instance, eigenIndex,
+                                               &edgeIndices[eigenIndex*edgeCount],
+                                               (calcderivs ? &edgeIndicesD1[eigenIndex*edgeCount] : NULL),
+                                               (calcderivs ? &edgeIndicesD2[eigenIndex*edgeCount] : NULL),
+                                               edgeLengths, edgeCount);
+            }
+            beagleUpdatePartials(instance, (BeagleOperation*)operations, internalCount*eigenCount,
+                                 (dynamicScaling ? internalCount : BEAGLE_OP_NONE));
+            edgeLengths[edge] = oldEdgeLength;
+        }
+
         gettimeofday(&time1,NULL);
 
         for (int eigenIndex=0; eigenIndex < eigenCount; eigenIndex++) {
-            if (!setmatrix) {
+            if (fusedMatrices) {
+                // the transition matrices are computed with the partials below
+            } else if (!setmatrix) {
                 // tell BEAGLE to populate the transition matrices for the above edge lengths
                 beagleUpdateTransitionMatrices(instance,     // instance
                                                eigenIndex,             // eigenIndex
@@ -522,10 +790,30 @@ void runBeagle(int resource,
         gettimeofday(&time2, NULL);
         
         // update the partials
-        beagleUpdatePartials( instance,      // instance
-                        (BeagleOperation*)operations,     // operations
-                        internalCount*eigenCount,              // operationCount
-                        (dynamicScaling ? internalCount : BEAGLE_OP_NONE));             // cumulative scaling index
+        if (matrixFree) {
+            std::vector<double> operationEdgeLengths(2 * internalCount);
+            for (int j = 0; j < internalCount; j++) {
+                operationEdgeLengths[2 * j] = edgeLengths[operations[BEAGLE_OP_COUNT * j + 4]];
+                operationEdgeLengths[2 * j + 1] = edgeLengths[operations[BEAGLE_OP_COUNT * j + 6]];
+            }
+            beagleUpdatePartialsByEdgeLengths(instance, 0, (BeagleOperation*)operations, internalCount,
+                                              &operationEdgeLengths[0], BEAGLE_OP_NONE);
+        } else if (fusedMatrices) {
+            std::vector<int> operationEigenIndices(internalCount, 0);
+            std::vector<double> operationEdgeLengths(2 * internalCount);
+            for (int j = 0; j < internalCount; j++) {
+                operationEdgeLengths[2 * j] = edgeLengths[operations[BEAGLE_OP_COUNT * j + 4]];
+                operationEdgeLengths[2 * j + 1] = edgeLengths[operations[BEAGLE_OP_COUNT * j + 6]];
+            }
+            beagleUpdateMatricesAndPartials(instance, (BeagleOperation*)operations, internalCount,
+                                            &operationEigenIndices[0], &operationEdgeLengths[0],
+                                            (dynamicScaling ? internalCount : BEAGLE_OP_NONE));
+        } else {
+            beagleUpdatePartials( instance,      // instance
+                            (BeagleOperation*)operations,     // operations
+                            internalCount*eigenCount,              // operationCount
+                            (dynamicScaling ? internalCount : BEAGLE_OP_NONE));             // cumulative scaling index
+        }
 
         gettimeofday(&time3, NULL);
 
@@ -584,17 +872,17 @@ void runBeagle(int resource,
         }
         
         if (!(logL - logL == 0.0))
-            fprintf(stdout, "error: invalid lnL\n");
+            reportError("invalid lnL\n");
         
         if (i > 0 && abs(logL - previousLogL) > MAX_DIFF)
-            fprintf(stdout, "error: large lnL difference between reps\n");
+            reportError("large lnL difference between reps\n");
         
         if (calcderivs) {
             if (!(deriv1 - deriv1 == 0.0) || !(deriv2 - deriv2 == 0.0))
-                fprintf(stdout, "error: invalid deriv\n");
+                reportError("invalid deriv\n");
             
             if (i > 0 && ((abs(deriv1 - previousDeriv1) > MAX_DIFF) || (abs(deriv2 - previousDeriv2) > MAX_DIFF)) )
-                fprintf(stdout, "error: large deriv difference between reps\n");
+                reportError("large deriv difference between reps\n");
         }
 
         previousLogL = logL;
@@ -615,6 +903,495 @@ void runBeagle(int resource,
     else
         fprintf(stdout, "logL = %.5f d1 = %.5f d2 = %.5f\n", logL, deriv1, deriv2);
     
+    if (matrixCacheSize > 0) {
+        long matrixCacheHits, matrixCacheMisses;
+        beagleGetTransitionMatrixCacheStatistics(instance, &matrixCacheHits, &matrixCacheMisses);
+        fprintf(stdout, "transition matrix cache: %ld hits, %ld misses\n", matrixCacheHits, matrixCacheMisses);
+    }
+
+    if (projectEdge) {
+        // evaluate the last edge again from partials projected onto the eigenbasis, and check
+        //  the derivatives against central differences
+        const double edgeLength = edgeLengths[lastTipIndices[0]];
+        const double h = 1e-3;
+        double projectedLogL = 0.0, projectedDeriv1 = 0.0, projectedDeriv2 = 0.0;
+        double logLPlus = 0.0, logLMinus = 0.0;
+        beagleProjectEdgePartials(instance, rootIndices[0], lastTipIndices[0], 0,
+                                  categoryWeightsIndices[0], stateFrequencyIndices[0],
+                                  cumulativeScalingFactorIndices[0]);
+        beagleCalculateProjectedEdgeLogLikelihoods(instance, edgeLength + h, &logLPlus, NULL, NULL);
+        beagleCalculateProjectedEdgeLogLikelihoods(instance, edgeLength - h, &logLMinus, NULL, NULL);
+        beagleCalculateProjectedEdgeLogLikelihoods(instance, edgeLength, &projectedLogL,
+                                                   &projectedDeriv1, &projectedDeriv2);
+        fprintf(stdout, "projected edge: logL = %.5f d1 = %.5f d2 = %.5f\n", projectedLogL, projectedDeriv1,
+                projectedDeriv2);
+        const double differenceDeriv1 = (logLPlus - logLMinus) / (2 * h);
+        const double differenceDeriv2 = (logLPlus - 2 * projectedLogL + logLMinus) / (h * h);
+        if (!(fabs(projectedLogL - logL) <= MAX_DIFF))
+            reportError("large lnL difference for the projected edge\n");
+        if (!(fabs(projectedDeriv1 - differenceDeriv1) <= MAX_DIFF * (1 + fabs(differenceDeriv1))) ||
+            !(fabs(projectedDeriv2 - differenceDeriv2) <= MAX_DIFF * (1 + fabs(differenceDeriv2))))
+            reportError("projected edge derivatives differ from central differences\n");
+    }
+
+    if (edgeBatch) {
+        // evaluate every edge below the root as a candidate attachment against the root
+        //  partials in one call, and check each against a single-edge evaluation
+        int* batchParentIndices = new int[edgeCount];
+        int* batchWeightsIndices = new int[edgeCount];
+        int* batchFrequencyIndices = new int[edgeCount];
+        int* batchScalingIndices = new int[edgeCount];
+        double* batchLogL = new double[edgeCount];
+        double* batchDeriv1 = new double[edgeCount];
+        double* batchDeriv2 = new double[edgeCount];
+        for (int e = 0; e < edgeCount; e++) {
+            batchParentIndices[e] = rootIndices[0];
+            batchWeightsIndices[e] = categoryWeightsIndices[0];
+            batchFrequencyIndices[e] = stateFrequencyIndices[0];
+            batchScalingIndices[e] = cumulativeScalingFactorIndices[0];
+        }
+        int batchCode = beagleCalculateIndependentEdgeLogLikelihoods(instance, batchParentIndices, edgeIndices,
+                                                                     edgeIndices,
+                                                                     (calcderivs ? edgeIndicesD1 : NULL),
+                                                                     (calcderivs ? edgeIndicesD2 : NULL),
+                                                                     batchWeightsIndices, batchFrequencyIndices,
+                                                                     batchScalingIndices, edgeCount,
+                                                                     batchLogL,
+                                                                     (calcderivs ? batchDeriv1 : NULL),
+                                                                     (calcderivs ? batchDeriv2 : NULL));
+        if (batchCode != BEAGLE_SUCCESS)
+            reportError("edge batch returned %d\n", batchCode);
+        double maxDifference = 0.0;
+        for (int e = 0; e < edgeCount; e++) {
+            double edgeLogL = 0.0, edgeDeriv1 = 0.0, edgeDeriv2 = 0.0;
+            beagleCalculateEdgeLogLikelihoods(instance, &batchParentIndices[e], &edgeIndices[e], &edgeIndices[e],
+                                              (calcderivs ? &edgeIndicesD1[e] : NULL),
+                                              (calcderivs ? &edgeIndicesD2[e] : NULL),
+                                              &batchWeightsIndices[e], &batchFrequencyIndices[e],
+                                              &batchScalingIndices[e], 1, &edgeLogL,
+                                              (calcderivs ? &edgeDeriv1 : NULL),
+                                              (calcderivs ? &edgeDeriv2 : NULL));
+            double difference = fabs(batchLogL[e] - edgeLogL);
+            if (calcderivs) {
+                difference = std::max(difference, fabs(batchDeriv1[e] - edgeDeriv1) / (1 + fabs(edgeDeriv1)));
+                difference = std::max(difference, fabs(batchDeriv2[e] - edgeDeriv2) / (1 + fabs(edgeDeriv2)));
+            }
+            if (!(difference <= maxDifference))
+                maxDifference = difference;
+        }
+        fprintf(stdout, "edge batch: %d edges, max difference = %g\n", edgeCount, maxDifference);
+        if (!(maxDifference <= MAX_DIFF))
+            reportError("edge batch differs from single edge evaluations\n");
+        delete[] batchParentIndices;
+        delete[] batchWeightsIndices;
+        delete[] batchFrequencyIndices;
+        delete[] batchScalingIndices;
+        delete[] batchLogL;
+        delete[] batchDeriv1;
+        delete[] batchDeriv2;
+    }
+
+    if (optimize) {
+        // optimize every edge below the root as a candidate attachment against the root
+        //  partials, and check each optimum is a stationary point no worse than the start
+        const double minEdgeLength = 1e-8;
+        const double maxEdgeLength = 10.0;
+        int* optimizeParentIndices = new int[edgeCount];
+        int* optimizeScalingIndices = new int[edgeCount];
+        double* optimizedLengths = new double[edgeCount];
+        double* optimizedLogL = new double[edgeCount];
+        for (int e = 0; e < edgeCount; e++) {
+            optimizeParentIndices[e] = rootIndices[0];
+            optimizeScalingIndices[e] = cumulativeScalingFactorIndices[0];
+            optimizedLengths[e] = edgeLengths[e];
+        }
+        int optimizeCode = beagleOptimizeEdgeLengths(instance, optimizeParentIndices, edgeIndices, 0,
+                                                     categoryWeightsIndices[0], stateFrequencyIndices[0],
+                                                     optimizeScalingIndices, edgeCount, minEdgeLength,
+                                                     maxEdgeLength, 1e-8, 100, optimizedLengths, optimizedLogL);
+        if (optimizeCode != BEAGLE_SUCCESS)
+            reportError("edge optimization returned %d\n", optimizeCode);
+        double logLGain = 0.0;
+        for (int e = 0; e < edgeCount; e++) {
+            double startLogL = 0.0, endLogL = 0.0, endDeriv1 = 0.0, endDeriv2 = 0.0;
+            beagleProjectEdgePartials(instance, rootIndices[0], edgeIndices[e], 0, categoryWeightsIndices[0],
+                                      stateFrequencyIndices[0], cumulativeScalingFactorIndices[0]);
+            beagleCalculateProjectedEdgeLogLikelihoods(instance, edgeLengths[e], &startLogL, NULL, NULL);
+            beagleCalculateProjectedEdgeLogLikelihoods(instance, optimizedLengths[e], &endLogL,
+                                                       &endDeriv1, &endDeriv2);
+            logLGain += optimizedLogL[e] - startLogL;
+            const bool atBound = ((optimizedLengths[e] <= minEdgeLength && endDeriv1 <= 0.0) ||
+                                  (optimizedLengths[e] >= maxEdgeLength && endDeriv1 >= 0.0));
+            if (!(fabs(optimizedLogL[e] - endLogL) <= MAX_DIFF) || !(optimizedLogL[e] >= startLogL - MAX_DIFF))
+                reportError("optimized lnL of edge %d is wrong\n", e);
+            if (!atBound && !(fabs(endDeriv1) <= MAX_DIFF * (1 + fabs(endDeriv2))))
+                reportError("optimized length of edge %d is not stationary\n", e);
+        }
+        fprintf(stdout, "optimized edges: %d edges, lnL gain = %.5f\n", edgeCount, logLGain);
+        delete[] optimizeParentIndices;
+        delete[] optimizeScalingIndices;
+        delete[] optimizedLengths;
+        delete[] optimizedLogL;
+    }
+
+    if (checkpoint) {
+        // save the instance, restore it into a new one with the same arguments, and check that
+        //  the new one gives the same lnL from the restored partials and Eigen decompositions
+        const char* checkpointFile = "genomictest.checkpoint";
+        double restoredLogL = 0.0;
+        BeagleInstanceDetails restoredDetails;
+        int restored = beagleCreateInstance(ntaxa, partialCount, compactTipCount, stateCount, nsites,
+                                            eigenCount, matrixBufferCount, rateCategoryCount,
+                                            scaleCount*eigenCount, &resource, 1, 0, requirementFlags,
+                                            &restoredDetails);
+        if (beagleSaveInstance(instance, checkpointFile) != BEAGLE_SUCCESS ||
+            beagleRestoreInstance(restored, checkpointFile) != BEAGLE_SUCCESS) {
+            reportError("checkpoint could not be saved and restored\n");
+        } else {
+            if (!setmatrix && !matrixFree) {
+                for (int eigenIndex=0; eigenIndex < eigenCount; eigenIndex++) {
+                    beagleUpdateTransitionMatrices(restored, eigenIndex, &edgeIndices[eigenIndex*edgeCount],
+                                                   (calcderivs ? &edgeIndicesD1[eigenIndex*edgeCount] : NULL),
+                                                   (calcderivs ? &edgeIndicesD2[eigenIndex*edgeCount] : NULL),
+                                                   edgeLengths, edgeCount);
+                }
+            }
+            restoredLogL = calculateLogL(restored, unrooted, calcderivs, rootIndices, lastTipIndices,
+                                         edgeIndicesD1, edgeIndicesD2, categoryWeightsIndices,
+                                         stateFrequencyIndices, cumulativeScalingFactorIndices, eigenCount);
+            fprintf(stdout, "checkpoint: restored logL = %.5f\n", restoredLogL);
+            if (!(fabs(restoredLogL - logL) <= MAX_DIFF))
+                reportError("restored instance gives a different lnL\n");
+        }
+        beagleFinalizeInstance(restored);
+        remove(checkpointFile);
+    }
+
+    if (cloneTest) {
+        // clone the instance and have the clone recompute its partials, first for doubled edge
+        //  lengths, checking that the instance still gives its own lnL, and then for the
+        //  original ones with doubled pattern weights, checking the clone gives twice the lnL
+        BeagleInstanceDetails cloneDetails;
+        int cloned = beagleCloneInstance(instance, &cloneDetails);
+        if (cloned < 0) {
+            reportError("instance could not be cloned\n");
+        } else {
+            double clonedLogL = calculateLogL(cloned, unrooted, calcderivs, rootIndices, lastTipIndices,
+                                              edgeIndicesD1, edgeIndicesD2, categoryWeightsIndices,
+                                              stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                              eigenCount);
+            if (!(fabs(clonedLogL - logL) <= MAX_DIFF))
+                reportError("clone gives a different lnL\n");
+
+            double* clonePatternWeights = (double*) malloc(sizeof(double) * nsites);
+            for (int k = 0; k < nsites; k++)
+                clonePatternWeights[k] = 2.0 * patternWeights[k];
+            double* cloneEdgeLengths = new double[edgeCount];
+            for (int pass = 0; pass < 2; pass++) {
+                for (int e = 0; e < edgeCount; e++)
+                    cloneEdgeLengths[e] = (pass == 0 ? 2.0 : 1.0) * edgeLengths[e];
+                if (pass == 1)
+                    beagleSetPatternWeights(cloned, clonePatternWeights);
+                updateInstance(cloned, setmatrix, matrixFree, calcderivs, manualScaling, autoScaling,
+                               dynamicScaling, edgeIndices, edgeIndicesD1, edgeIndicesD2, cloneEdgeLengths,
+                               edgeCount, operations, internalCount, scalingFactorsIndices,
+                               cumulativeScalingFactorIndices, eigenCount);
+                double passLogL = calculateLogL(cloned, unrooted, calcderivs, rootIndices, lastTipIndices,
+                                                edgeIndicesD1, edgeIndicesD2, categoryWeightsIndices,
+                                                stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                                eigenCount);
+                if (pass == 0) {
+                    double instanceLogL = calculateLogL(instance, unrooted, calcderivs, rootIndices,
+                                                        lastTipIndices, edgeIndicesD1, edgeIndicesD2,
+                                                        categoryWeightsIndices, stateFrequencyIndices,
+                                                        cumulativeScalingFactorIndices, eigenCount);
+                    if (!(fabs(instanceLogL - logL) <= MAX_DIFF))
+                        reportError("writes to the clone changed the instance\n");
+                } else {
+                    fprintf(stdout, "clone: logL = %.5f, with doubled pattern weights = %.5f\n",
+                            clonedLogL, passLogL);
+                    if (!(fabs(passLogL - 2.0 * logL) <= 2.0 * MAX_DIFF))
+                        reportError("clone with doubled pattern weights gives a wrong lnL\n");
+                }
+            }
+            free(clonePatternWeights);
+            delete[] cloneEdgeLengths;
+            beagleFinalizeInstance(cloned);
+        }
+    }
+
+    if (tipDataTest) {
+        // give a clone of the instance other tips and then the store again, which it takes
+        //  from the store and the buffers the instance converted, checking it gives the lnL
+        //  of the instance again once the store is finalized
+        BeagleInstanceDetails cloneDetails;
+        int cloned = beagleCloneInstance(instance, &cloneDetails);
+        if (cloned < 0) {
+            reportError("instance could not be cloned\n");
+        } else {
+            for (int i = 0; i < ntaxa; i++) {
+                if (i >= compactTipCount) {
+                    double* tmpPartials = getRandomTipPartials(nsites, stateCount);
+                    beagleSetTipPartials(cloned, i, tmpPartials);
+                    free(tmpPartials);
+                } else {
+                    int* tmpStates = getRandomTipStates(nsites, stateCount);
+                    beagleSetTipStates(cloned, i, tmpStates);
+                    free(tmpStates);
+                }
+            }
+            if (beagleSetTipData(cloned, tipData) != BEAGLE_SUCCESS)
+                reportError("tip data could not be set on the clone\n");
+            beagleFinalizeTipData(tipData);
+            tipData = -1;
+            updateInstance(cloned, setmatrix, matrixFree, calcderivs, manualScaling, autoScaling,
+                           dynamicScaling, edgeIndices, edgeIndicesD1, edgeIndicesD2, edgeLengths,
+                           edgeCount, operations, internalCount, scalingFactorsIndices,
+                           cumulativeScalingFactorIndices, eigenCount);
+            double tipDataLogL = calculateLogL(cloned, unrooted, calcderivs, rootIndices, lastTipIndices,
+                                               edgeIndicesD1, edgeIndicesD2, categoryWeightsIndices,
+                                               stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                               eigenCount);
+            fprintf(stdout, "tipdata: logL = %.5f\n", tipDataLogL);
+            if (!(fabs(tipDataLogL - logL) <= MAX_DIFF))
+                reportError("tips from the store give a different lnL\n");
+            beagleFinalizeInstance(cloned);
+        }
+        if (tipData >= 0)
+            beagleFinalizeTipData(tipData);
+    }
+
+    if (zeroWeightsTest) {
+        // weight the first category and runs of patterns zero; a clone that keeps the partials
+        //  computed with every weight gives the reference lnL for the instance recomputing its
+        //  partials, which must give its own lnL again once the weights are restored
+        BeagleInstanceDetails cloneDetails;
+        int cloned = beagleCloneInstance(instance, &cloneDetails);
+        if (cloned < 0) {
+            reportError("instance could not be cloned\n");
+        } else {
+            double* zeroPatternWeights = (double*) malloc(sizeof(double) * nsites);
+            for (int k = 0; k < nsites; k++)
+                zeroPatternWeights[k] = ((k / 16) % 3 == 0 || k % 7 == 0 ? 0.0 : patternWeights[k]);
+            std::vector<double> zeroCategoryWeights(allCategoryWeights);
+            if (rateCategoryCount > 1) {
+                for (int eigenIndex=0; eigenIndex < eigenCount; eigenIndex++)
+                    zeroCategoryWeights[eigenIndex * rateCategoryCount] = 0.0;
+            }
+            double zeroWeightsLogL = 0.0;
+            for (int pass = 0; pass < 3; pass++) {
+                int target = (pass == 0 ? cloned : instance);
+                const double* passPatternWeights = (pass < 2 ? zeroPatternWeights : patternWeights);
+                const double* passCategoryWeights = (pass < 2 ? &zeroCategoryWeights[0] : &allCategoryWeights[0]);
+                beagleSetPatternWeights(target, passPatternWeights);
+                for (int eigenIndex=0; eigenIndex < eigenCount; eigenIndex++)
+                    beagleSetCategoryWeights(target, eigenIndex, passCategoryWeights + eigenIndex * rateCategoryCount);
+                if (pass > 0)
+                    updateInstance(target, setmatrix, matrixFree, calcderivs, manualScaling, autoScaling,
+                                   dynamicScaling, edgeIndices, edgeIndicesD1, edgeIndicesD2, edgeLengths,
+                                   edgeCount, operations, internalCount, scalingFactorsIndices,
+                                   cumulativeScalingFactorIndices, eigenCount);
+                double passLogL = calculateLogL(target, unrooted, calcderivs, rootIndices, lastTipIndices,
+                                                edgeIndicesD1, edgeIndicesD2, categoryWeightsIndices,
+                                                stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                                eigenCount);
+                if (pass == 0) {
+                    zeroWeightsLogL = passLogL;
+                } else if (pass == 1) {
+                    fprintf(stdout, "zeroweights: logL = %.5f, reference = %.5f\n", passLogL, zeroWeightsLogL);
+                    if (!(fabs(passLogL - zeroWeightsLogL) <= MAX_DIFF))
+                        reportError("zero weights give a wrong lnL\n");
+                } else if (!(fabs(passLogL - logL) <= MAX_DIFF)) {
+                    reportError("restored weights give a different lnL\n");
+                }
+            }
+            free(zeroPatternWeights);
+            beagleFinalizeInstance(cloned);
+        }
+    }
+
+    if (fusedRoot) {
+        // integrate the root partials straight from the children of the root without storing
+        //  them; under manual scaling the root factors are added to the accumulated factors of
+        //  the nodes below it as the root is rescaled
+        int rootOperation[BEAGLE_OP_COUNT];
+        memcpy(rootOperation, &operations[BEAGLE_OP_COUNT*(internalCount-1)], sizeof(rootOperation));
+        rootOperation[0] = BEAGLE_OP_NONE;
+        if (manualScaling) {
+            rootOperation[1] = scalingFactorsIndices[internalCount-1];
+            rootOperation[2] = BEAGLE_OP_NONE;
+            beagleResetScaleFactors(instance, cumulativeScalingFactorIndices[0]);
+            beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount-1,
+                                         cumulativeScalingFactorIndices[0]);
+        }
+        double fusedLogL = 0.0;
+        if (beagleCalculateRootLogLikelihoodsByOperation(instance, (BeagleOperation*)rootOperation,
+                                                         categoryWeightsIndices[0], stateFrequencyIndices[0],
+                                                         cumulativeScalingFactorIndices[0],
+                                                         &fusedLogL) != BEAGLE_SUCCESS) {
+            reportError("root partials could not be integrated by operation\n");
+        } else {
+            fprintf(stdout, "fusedroot: logL = %.5f\n", fusedLogL);
+            if (!(fabs(fusedLogL - logL) <= MAX_DIFF))
+                reportError("integrating by operation gives a different lnL\n");
+        }
+    }
+
+    if (siteBuffers) {
+        // have the integration write site values into our own buffers, whose weighted sums
+        //  must give the lnL and derivatives again
+        std::vector<double> siteLogLikelihoods(nsites, 0.0);
+        std::vector<double> siteFirstDerivatives(nsites, 0.0);
+        std::vector<double> siteSecondDerivatives(nsites, 0.0);
+        bool siteDerivs = (unrooted && calcderivs);
+        if (beagleSetSiteBuffers(instance, &siteLogLikelihoods[0],
+                                 (siteDerivs ? &siteFirstDerivatives[0] : NULL),
+                                 (siteDerivs ? &siteSecondDerivatives[0] : NULL)) != BEAGLE_SUCCESS) {
+            reportError("site buffers could not be set\n");
+        } else {
+            double siteBuffersLogL = calculateLogL(instance, unrooted, calcderivs, rootIndices, lastTipIndices,
+                                                   edgeIndicesD1, edgeIndicesD2, categoryWeightsIndices,
+                                                   stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                                   eigenCount);
+            double sumLogL = 0.0, sumDeriv1 = 0.0, sumDeriv2 = 0.0;
+            for (int k = 0; k < nsites; k++) {
+                sumLogL += siteLogLikelihoods[k] * patternWeights[k];
+                sumDeriv1 += siteFirstDerivatives[k] * patternWeights[k];
+                sumDeriv2 += siteSecondDerivatives[k] * patternWeights[k];
+            }
+            fprintf(stdout, "sitebuffers: logL = %.5f, sum over sites = %.5f\n", siteBuffersLogL, sumLogL);
+            if (!(fabs(siteBuffersLogL - logL) <= MAX_DIFF) || !(fabs(sumLogL - logL) <= MAX_DIFF))
+                reportError("site buffers give a different lnL\n");
+            if (siteDerivs && (!(fabs(sumDeriv1 - deriv1) <= MAX_DIFF * (1 + fabs(deriv1))) ||
+                               !(fabs(sumDeriv2 - deriv2) <= MAX_DIFF * (1 + fabs(deriv2)))))
+                reportError("site buffers give different derivatives\n");
+            beagleSetSiteBuffers(instance, NULL, NULL, NULL);
+        }
+    }
+
+    if (partialsBuffers) {
+        // give a clone other tip partials, which it keeps as compact states, and then the tip
+        //  partials of the instance, alternately copied and in our own 32-byte aligned memory,
+        //  which it reads in place where it can
+        BeagleInstanceDetails cloneDetails;
+        int cloned = beagleCloneInstance(instance, &cloneDetails);
+        if (cloned < 0) {
+            reportError("instance could not be cloned\n");
+        } else {
+            const int partialsSize = stateCount * nsites * rateCategoryCount;
+            std::vector<double> memory((ntaxa - compactTipCount) * partialsSize + 4);
+            double* tipPartials = &memory[0];
+            while (((size_t) tipPartials) % 32 != 0)
+                tipPartials++;
+            bool ok = true;
+            for (int i = compactTipCount; i < ntaxa && ok; i++) {
+                double* tmpPartials = getRandomTipPartials(nsites, stateCount);
+                ok = (beagleSetTipPartials(cloned, i, tmpPartials) == BEAGLE_SUCCESS);
+                free(tmpPartials);
+            }
+            for (int i = compactTipCount; i < ntaxa && ok; i++) {
+                double* partials = tipPartials + (i - compactTipCount) * partialsSize;
+                ok = (beagleGetPartials(instance, i, BEAGLE_OP_NONE, partials) == BEAGLE_SUCCESS);
+                if (ok && i % 2 == 0)
+                    ok = (beagleSetPartials(cloned, i, partials) == BEAGLE_SUCCESS);
+                else if (ok)
+                    ok = (beagleSetPartialsBuffer(cloned, i, partials) == BEAGLE_SUCCESS);
+            }
+            if (!ok) {
+                reportError("partials buffers could not be set\n");
+            } else {
+                updateInstance(cloned, setmatrix, matrixFree, calcderivs, manualScaling, autoScaling,
+                               dynamicScaling, edgeIndices, edgeIndicesD1, edgeIndicesD2, edgeLengths,
+                               edgeCount, operations, internalCount, scalingFactorsIndices,
+                               cumulativeScalingFactorIndices, eigenCount);
+                double buffersLogL = calculateLogL(cloned, unrooted, calcderivs, rootIndices, lastTipIndices,
+                                                   edgeIndicesD1, edgeIndicesD2, categoryWeightsIndices,
+                                                   stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                                   eigenCount);
+                fprintf(stdout, "partialsbuffers: logL = %.5f\n", buffersLogL);
+                if (!(fabs(buffersLogL - logL) <= MAX_DIFF))
+                    reportError("partials buffers give a different lnL\n");
+            }
+            beagleFinalizeInstance(cloned);
+        }
+    }
+
+    if (kernelCounters) {
+        // every run computes partials and integrates them, so both must have been counted
+        const char* kernelNames[BEAGLE_KERNEL_CLASS_COUNT] = {"transMats", "statesStates", "statesPartials",
+                                                              "partialsPartials", "rescale", "root", "edge",
+                                                              "derivatives"};
+        BeagleKernelCounters counters[BEAGLE_KERNEL_CLASS_COUNT];
+        beagleGetKernelCounters(instance, counters);
+        long partialsCalls = 0;
+        for (int i = 0; i < BEAGLE_KERNEL_CLASS_COUNT; i++) {
+            if (counters[i].callCount == 0)
+                continue;
+            fprintf(stdout, "kernel %-16s %8ld calls %10.6f s %10.2f M elements/s %8.3f GFLOPS %8.3f GB/s\n",
+                    kernelNames[i], counters[i].callCount, counters[i].seconds,
+                    counters[i].elementCount / counters[i].seconds / 1.0e6,
+                    counters[i].flopCount / counters[i].seconds / 1.0e9,
+                    counters[i].byteCount / counters[i].seconds / 1.0e9);
+            if (i >= BEAGLE_KERNEL_STATES_STATES && i <= BEAGLE_KERNEL_PARTIALS_PARTIALS)
+                partialsCalls += counters[i].callCount;
+        }
+        if (partialsCalls == 0 || counters[BEAGLE_KERNEL_ROOT].callCount + counters[BEAGLE_KERNEL_EDGE].callCount +
+                                  counters[BEAGLE_KERNEL_DERIVATIVES].callCount == 0)
+            reportError("kernels were not counted\n");
+        beagleResetKernelCounters(instance);
+        beagleGetKernelCounters(instance, counters);
+        for (int i = 0; i < BEAGLE_KERNEL_CLASS_COUNT; i++) {
+            if (counters[i].callCount != 0 || counters[i].seconds != 0.0)
+                reportError("kernel counters were not reset\n");
+        }
+    }
+
+    if (exponentScalers) {
+        // accumulate the scale exponents of all nodes over and over until the cumulative
+        //  exponents leave 16 bits, which must be reported rather than wrap around, and then
+        //  accumulate them once again, which must give the lnL back; trees too small to
+        //  have been rescaled have no exponents to overflow
+        beagleResetScaleFactors(instance, cumulativeScalingFactorIndices[0]);
+        double unscaledLogL = calculateLogL(instance, unrooted, false, rootIndices, lastTipIndices,
+                                            edgeIndicesD1, edgeIndicesD2, categoryWeightsIndices,
+                                            stateFrequencyIndices, cumulativeScalingFactorIndices, eigenCount);
+        if (fabs(unscaledLogL - logL) <= MAX_DIFF) {
+            fprintf(stdout, "exponentscalers: no pattern was rescaled\n");
+        } else {
+            int accumulateCode = BEAGLE_SUCCESS;
+            int repeats = 0;
+            while (accumulateCode == BEAGLE_SUCCESS && repeats <= 32768) {
+                accumulateCode = beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount,
+                                                              cumulativeScalingFactorIndices[0]);
+                repeats++;
+            }
+            double overflowLogL = 0.0;
+            int overflowCode;
+            if (!unrooted) {
+                overflowCode = beagleCalculateRootLogLikelihoods(instance, rootIndices, categoryWeightsIndices,
+                                                                 stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                                                 eigenCount, &overflowLogL);
+            } else {
+                overflowCode = beagleCalculateEdgeLogLikelihoods(instance, rootIndices, lastTipIndices,
+                                                                 lastTipIndices, NULL, NULL, categoryWeightsIndices,
+                                                                 stateFrequencyIndices, cumulativeScalingFactorIndices,
+                                                                 eigenCount, &overflowLogL, NULL, NULL);
+            }
+            fprintf(stdout, "exponentscalers: overflow after %d accumulations\n", repeats);
+            if (accumulateCode != BEAGLE_ERROR_FLOATING_POINT || overflowCode != BEAGLE_ERROR_FLOATING_POINT)
+                reportError("overflowed scale exponents were not reported\n");
+        }
+
+        beagleResetScaleFactors(instance, cumulativeScalingFactorIndices[0]);
+        beagleAccumulateScaleFactors(instance, scalingFactorsIndices, internalCount,
+                                     cumulativeScalingFactorIndices[0]);
+        double resetLogL = calculateLogL(instance, unrooted, calcderivs, rootIndices, lastTipIndices,
+                                         edgeIndicesD1, edgeIndicesD2, categoryWeightsIndices,
+                                         stateFrequencyIndices, cumulativeScalingFactorIndices, eigenCount);
+        if (!(fabs(resetLogL - logL) <= MAX_DIFF))
+            reportError("reset scale exponents give a different lnL\n");
+    }
+
     std::cout.setf(std::ios::showpoint);
     std::cout.setf(std::ios::floatfield, std::ios::fixed);
     int timePrecision = 6;
@@ -649,6 +1426,8 @@ void runBeagle(int resource,
     }
     std::cout << "\n";
     
+    free(patternWeights);
+
 	beagleFinalizeInstance(instance);
 }
 
@@ -677,6 +1456,9 @@ void printFlags(long inFlags) {
     if (inFlags & BEAGLE_FLAG_FRAMEWORK_CPU)      fprintf(stdout, " FRAMEWORK_CPU");
     if (inFlags & BEAGLE_FLAG_FRAMEWORK_CUDA)     fprintf(stdout, " FRAMEWORK_CUDA");
     if (inFlags & BEAGLE_FLAG_FRAMEWORK_OPENCL)   fprintf(stdout, " FRAMEWORK_OPENCL");
+    if (inFlags & BEAGLE_FLAG_MEMORY_MAPPED)      fprintf(stdout, " MEMORY_MAPPED");
+    if (inFlags & BEAGLE_FLAG_TRAVERSAL_BLOCKED)  fprintf(stdout, " TRAVERSAL_BLOCKED");
+    if (inFlags & BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR) fprintf(stdout, " PARTIALS_PATTERN_MAJOR");
 }
 
 void printResourceList() {
@@ -701,9 +1483,30 @@ void printResourceList() {
 
 void helpMessage() {
 	std::cerr << "Usage:\n\n";
-	std::cerr << "genomictest [--help] [--resourcelist] [--states <integer>] [--taxa <integer>] [--sites <integer>] [--rates <integer>] [--manualscale] [--autoscale] [--dynamicscale] [--rsrc <integer>] [--reps <integer>] [--doubleprecision] [--SSE] [--AVX] [--compact-tips] [--seed <integer>] [--rescale-frequency <integer>] [--full-timing] [--unrooted] [--calcderivs] [--logscalers] [--eigencount <integer>] [--eigencomplex] [--ievectrans] [--setmatrix] [--opencl]\n\n";
+	std::cerr << "genomictest [--help] [--resourcelist] [--states <integer>] [--taxa <integer>] [--sites <integer>] [--rates <integer>] [--manualscale] [--autoscale] [--dynamicscale] [--rsrc <integer>] [--reps <integer>] [--doubleprecision] [--SSE] [--AVX] [--compact-tips] [--seed <integer>] [--rescale-frequency <integer>] [--full-timing] [--unrooted] [--calcderivs] [--logscalers] [--eigencount <integer>] [--eigencomplex] [--ievectrans] [--setmatrix] [--opencl] [--mmap] [--blocked] [--patternmajor] [--ambiguous] [--dirty] [--matrixcache <integer>] [--ratematrix] [--matrixfree] [--projectedge] [--edgebatch] [--optimize] [--checkpoint] [--clone] [--tipdata] [--zeroweights] [--exponentscalers] [--fusedroot] [--fusedmatrices] [--sitebuffers] [--partialsbuffers] [--kernelcounters]\n\n";
     std::cerr << "If --help is specified, this usage message is shown\n\n";
     std::cerr << "If --manualscale, --autoscale, or --dynamicscale is specified, BEAGLE will rescale the partials during computation\n\n";
+    std::cerr << "If --mmap is specified, partials and scale buffers are kept in a memory-mapped scratch file (in BEAGLE_SCRATCH_DIR or TMPDIR)\n\n";
+    std::cerr << "If --blocked is specified, each operation list is computed one cache-sized block of site patterns at a time\n\n";
+    std::cerr << "If --patternmajor is specified, partials are stored with all rate categories of a site pattern adjacent\n\n";
+    std::cerr << "If --ambiguous is specified, some sites are ambiguous between two states (set as state masks on compact tips)\n\n";
+    std::cerr << "If --dirty is specified, BEAGLE skips unchanged operations and each rep after the first only recomputes the path from one edge to the root\n\n";
+    std::cerr << "If --matrixcache is specified, BEAGLE reuses transition matrices for up to that many recently seen edge lengths\n\n";
+    std::cerr << "If --ratematrix is specified, BEAGLE is given the rate matrix instead of its eigen decomposition\n\n";
+    std::cerr << "If --matrixfree is specified, partials are computed from a sparse rate matrix and the edge lengths without transition matrices\n\n";
+    std::cerr << "If --projectedge is specified, the last edge is evaluated again from partials projected onto the eigenbasis\n\n";
+    std::cerr << "If --edgebatch is specified, every edge is evaluated against the root partials in one call\n\n";
+    std::cerr << "If --optimize is specified, the length of every edge is optimized against the root partials\n\n";
+    std::cerr << "If --checkpoint is specified, the instance is saved to a file and restored into a new instance\n\n";
+    std::cerr << "If --clone is specified, the instance is cloned and the clone recomputed without changing the instance\n\n";
+    std::cerr << "If --tipdata is specified, the tips are set through a tip data store, which a clone of the instance is then given again\n\n";
+    std::cerr << "If --zeroweights is specified, the first rate category and runs of site patterns are weighted zero and the lnL checked\n\n";
+    std::cerr << "If --exponentscalers is specified, manual scaling rescales by powers of two and keeps 16-bit exponents, whose overflow is checked\n\n";
+    std::cerr << "If --fusedroot is specified, the root partials are computed and integrated in one pass without being stored and the lnL checked\n\n";
+    std::cerr << "If --fusedmatrices is specified, the transition matrices of each operation are computed with its partials\n\n";
+    std::cerr << "If --sitebuffers is specified, site log likelihoods are written into client buffers and the lnL checked\n\n";
+    std::cerr << "If --partialsbuffers is specified, a clone with compact tips is given the tip partials, some in client memory, and the lnL checked\n\n";
+    std::cerr << "If --kernelcounters is specified, kernel calls, time and throughput are counted and printed per kernel class\n\n";
     std::cerr << "If --full-timing is specified, you will see more detailed timing results (requires BEAGLE_DEBUG_SYNCH defined to report accurate values)\n\n";
 	std::exit(0);
 }
@@ -732,7 +1535,28 @@ void interpretCommandLineParameters(int argc, const char* argv[],
                                     bool* eigencomplex,
                                     bool* ievectrans,
                                     bool* setmatrix,
-                                    bool* opencl)	{
+                                    bool* opencl,
+                                    bool* memoryMapped,
+                                    bool* blockedTraversal,
+                                    bool* patternMajor,
+                                    bool* ambiguous,
+                                    bool* dirtyTracking,
+                                    int* matrixCacheSize,
+                                    bool* rateMatrix,
+                                    bool* matrixFree,
+                                    bool* projectEdge,
+                                    bool* edgeBatch,
+                                    bool* optimize,
+                                    bool* checkpoint,
+                                    bool* cloneTest,
+                                    bool* tipDataTest,
+                                    bool* zeroWeightsTest,
+                                    bool* exponentScalers,
+                                    bool* fusedRoot,
+                                    bool* fusedMatrices,
+                                    bool* siteBuffers,
+                                    bool* partialsBuffers,
+                                    bool* kernelCounters)	{
     bool expecting_stateCount = false;
 	bool expecting_ntaxa = false;
 	bool expecting_nsites = false;
@@ -743,6 +1567,7 @@ void interpretCommandLineParameters(int argc, const char* argv[],
 	bool expecting_seed = false;
     bool expecting_rescaleFrequency = false;
     bool expecting_eigenCount = false;
+    bool expecting_matrixCacheSize = false;
 	
     for (unsigned i = 1; i < argc; ++i) {
 		std::string option = argv[i];
@@ -783,6 +1608,9 @@ void interpretCommandLineParameters(int argc, const char* argv[],
         } else if (expecting_eigenCount) {
             *eigenCount = (unsigned)atoi(option.c_str());
             expecting_eigenCount = false;
+        } else if (expecting_matrixCacheSize) {
+            *matrixCacheSize = (unsigned)atoi(option.c_str());
+            expecting_matrixCacheSize = false;
         } else if (option == "--help") {
 			helpMessage();
         } else if (option == "--resourcelist") {
@@ -835,6 +1663,48 @@ void interpretCommandLineParameters(int argc, const char* argv[],
         	*setmatrix = true;
         } else if (option == "--opencl") {
         	*opencl = true;
+        } else if (option == "--mmap") {
+        	*memoryMapped = true;
+        } else if (option == "--blocked") {
+        	*blockedTraversal = true;
+        } else if (option == "--patternmajor") {
+        	*patternMajor = true;
+        } else if (option == "--ambiguous") {
+        	*ambiguous = true;
+        } else if (option == "--dirty") {
+        	*dirtyTracking = true;
+        } else if (option == "--matrixcache") {
+        	expecting_matrixCacheSize = true;
+        } else if (option == "--ratematrix") {
+        	*rateMatrix = true;
+        } else if (option == "--matrixfree") {
+        	*matrixFree = true;
+        } else if (option == "--projectedge") {
+        	*projectEdge = true;
+        } else if (option == "--edgebatch") {
+        	*edgeBatch = true;
+        } else if (option == "--optimize") {
+        	*optimize = true;
+        } else if (option == "--checkpoint") {
+        	*checkpoint = true;
+        } else if (option == "--clone") {
+        	*cloneTest = true;
+        } else if (option == "--tipdata") {
+        	*tipDataTest = true;
+        } else if (option == "--zeroweights") {
+        	*zeroWeightsTest = true;
+        } else if (option == "--exponentscalers") {
+        	*exponentScalers = true;
+        } else if (option == "--fusedroot") {
+        	*fusedRoot = true;
+        } else if (option == "--fusedmatrices") {
+        	*fusedMatrices = true;
+        } else if (option == "--sitebuffers") {
+        	*siteBuffers = true;
+        } else if (option == "--partialsbuffers") {
+        	*partialsBuffers = true;
+        } else if (option == "--kernelcounters") {
+        	*kernelCounters = true;
         } else {
 			std::string msg("Unknown command line parameter \"");
 			msg.append(option);			
@@ -871,6 +1741,9 @@ void interpretCommandLineParameters(int argc, const char* argv[],
 
     if (expecting_eigenCount)
 		abort("read last command line option without finding value associated with --eigencount");
+
+    if (expecting_matrixCacheSize)
+		abort("read last command line option without finding value associated with --matrixcache");
     
 	if (*stateCount < 2)
 		abort("invalid number of states supplied on the command line");
@@ -904,6 +1777,51 @@ void interpretCommandLineParameters(int argc, const char* argv[],
     
     if (*eigencomplex && (*stateCount != 4 || *eigenCount != 1))
         abort("eigencomplex option only works with stateCount=4 and eigenCount=1");
+
+    if (*autoScaling && *unrooted && *eigenCount != 1)
+        abort("autoscale option with unrooted tree option requires eigenCount=1");
+
+    if (*matrixFree && (*eigenCount != 1 || *setmatrix || *dirtyTracking || *autoScaling || *dynamicScaling))
+        abort("matrixfree option only works with eigenCount=1 and manual or no scaling");
+
+    if (*projectEdge && (!(*unrooted) || *eigenCount != 1 || *setmatrix || *rateMatrix || *matrixFree || *autoScaling))
+        abort("projectedge option requires unrooted tree option and eigenCount=1 without setmatrix, ratematrix, matrixfree or autoscale");
+
+    if (*edgeBatch && (!(*unrooted) || *eigenCount != 1 || *setmatrix || *matrixFree || *autoScaling))
+        abort("edgebatch option requires unrooted tree option and eigenCount=1 without setmatrix, matrixfree or autoscale");
+
+    if (*optimize && (!(*unrooted) || *eigenCount != 1 || *setmatrix || *rateMatrix || *matrixFree || *autoScaling))
+        abort("optimize option requires unrooted tree option and eigenCount=1 without setmatrix, ratematrix, matrixfree or autoscale");
+
+    if (*cloneTest && (*opencl || *memoryMapped))
+        abort("clone option is not available with opencl or mmap");
+
+    if (*tipDataTest && (*opencl || *memoryMapped))
+        abort("tipdata option is not available with opencl or mmap");
+
+    if (*zeroWeightsTest && (*opencl || *memoryMapped))
+        abort("zeroweights option is not available with opencl or mmap");
+
+    if (*exponentScalers && !(*manualScaling))
+        abort("exponentscalers option requires manualscale");
+
+    if (*fusedRoot && (*unrooted || *eigenCount != 1 || *autoScaling || *matrixFree))
+        abort("fusedroot option requires a rooted tree and eigenCount=1 without autoscale or matrixfree");
+
+    if (*fusedMatrices && (*unrooted || *eigenCount != 1 || *setmatrix || *matrixFree || *dirtyTracking || *autoScaling))
+        abort("fusedmatrices option requires a rooted tree and eigenCount=1 without setmatrix, matrixfree, dirty or autoscale");
+
+    if (*siteBuffers && (!(*requireDoublePrecision) || *opencl))
+        abort("sitebuffers option requires doubleprecision and is not available with opencl");
+
+    if (*partialsBuffers && (*opencl || *memoryMapped || *tipDataTest))
+        abort("partialsbuffers option is not available with opencl, mmap or tipdata");
+
+    if (*matrixCacheSize < 0)
+        abort("invalid number for matrixcache supplied on the command line");
+
+    if (*ambiguous && *stateCount > 31)
+        abort("ambiguous option only works with stateCount <= 31");
 }
 
 int main( int argc, const char* argv[] )
@@ -929,6 +1847,27 @@ int main( int argc, const char* argv[] )
     bool ievectrans = false;
     bool setmatrix = false;
     bool opencl = false;
+    bool memoryMapped = false;
+    bool blockedTraversal = false;
+    bool patternMajor = false;
+    bool ambiguous = false;
+    bool dirtyTracking = false;
+    int matrixCacheSize = 0;
+    bool rateMatrix = false;
+    bool matrixFree = false;
+    bool projectEdge = false;
+    bool edgeBatch = false;
+    bool optimize = false;
+    bool checkpoint = false;
+    bool cloneTest = false;
+    bool tipDataTest = false;
+    bool zeroWeightsTest = false;
+    bool exponentScalers = false;
+    bool fusedRoot = false;
+    bool fusedMatrices = false;
+    bool siteBuffers = false;
+    bool partialsBuffers = false;
+    bool kernelCounters = false;
 
     std::vector<int> rsrc;
     rsrc.push_back(-1);
@@ -942,7 +1881,13 @@ int main( int argc, const char* argv[] )
                                    &dynamicScaling, &rateCategoryCount, &rsrc, &nreps, &fullTiming,
                                    &requireDoublePrecision, &requireSSE, &requireAVX, &compactTipCount, &randomSeed,
                                    &rescaleFrequency, &unrooted, &calcderivs, &logscalers,
-                                   &eigenCount, &eigencomplex, &ievectrans, &setmatrix, &opencl);
+                                   &eigenCount, &eigencomplex, &ievectrans, &setmatrix, &opencl,
+                                   &memoryMapped, &blockedTraversal, &patternMajor,
+                                   &ambiguous, &dirtyTracking, &matrixCacheSize,
+                                   &rateMatrix, &matrixFree, &projectEdge, &edgeBatch, &optimize, &checkpoint,
+                                   &cloneTest, &tipDataTest, &zeroWeightsTest,
+                                   &exponentScalers, &fusedRoot, &fusedMatrices, &siteBuffers, &partialsBuffers,
+                                   &kernelCounters);
     
 	std::cout << "\nSimulating genomic ";
     if (stateCount == 4)
@@ -980,7 +1925,28 @@ int main( int argc, const char* argv[] )
                           eigencomplex,
                           ievectrans,
                           setmatrix,
-                          opencl);
+                          opencl,
+                          memoryMapped,
+                          blockedTraversal,
+                          patternMajor,
+                          ambiguous,
+                          dirtyTracking,
+                          matrixCacheSize,
+                          rateMatrix,
+                          matrixFree,
+                          projectEdge,
+                          edgeBatch,
+                          optimize,
+                          checkpoint,
+                          cloneTest,
+                          tipDataTest,
+                          zeroWeightsTest,
+                          exponentScalers,
+                          fusedRoot,
+                          fusedMatrices,
+                          siteBuffers,
+                          partialsBuffers,
+                          kernelCounters);
             }
         }
     } else {
@@ -993,4 +1959,9 @@ int main( int argc, const char* argv[] )
 //    fflush( stderr);
 //    getchar();
 //#endif
+
+    // a check that failed, or no resource that could run the test, fails the run
+    if (instanceCount == 0)
+        fprintf(stderr, "No BEAGLE instance could be created\n");
+    return (errorCount > 0 || instanceCount == 0 ? 1 : 0);
 }
@@ -0,0 +1,386 @@
+/*
+ *  kernelbench.cpp
+ *  BEAGLE
+ *
+ *  Times each class of kernel on its own, for every implementation that can be created
+ *  on each resource, over a grid of state, pattern and rate category counts. Kernels are
+ *  isolated by giving an instance single operations that only reach one of them, and
+ *  timed through the kernel counters of the instance.
+ */
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "libhmsbeagle/beagle.h"
+
+#define BENCH_TIP_COUNT      4  // two compact tips followed by two partials tips
+#define BENCH_RAND_MAX       0x7fffffff
+
+struct BenchKernel {
+    const char* name;
+    int kernelClass;
+};
+
+// the order kernels are run and reported in
+const BenchKernel benchKernels[] = {
+    {"transitionMatrices", BEAGLE_KERNEL_TRANSITION_MATRICES},
+    {"statesStates",       BEAGLE_KERNEL_STATES_STATES},
+    {"statesPartials",     BEAGLE_KERNEL_STATES_PARTIALS},
+    {"partialsPartials",   BEAGLE_KERNEL_PARTIALS_PARTIALS},
+    {"rescalePartials",    BEAGLE_KERNEL_RESCALE},
+    {"root",               BEAGLE_KERNEL_ROOT},
+    {"edge",               BEAGLE_KERNEL_EDGE},
+    {"edgeDerivatives",    BEAGLE_KERNEL_DERIVATIVES}
+};
+const int benchKernelCount = sizeof(benchKernels) / sizeof(BenchKernel);
+
+// the flags implementations are told apart by; each set is required in turn and every
+//  distinct implementation created is benchmarked
+const long benchFlagSets[] = {
+    BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_VECTOR_NONE,
+    BEAGLE_FLAG_PRECISION_DOUBLE | BEAGLE_FLAG_VECTOR_NONE,
+    BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_VECTOR_SSE,
+    BEAGLE_FLAG_PRECISION_DOUBLE | BEAGLE_FLAG_VECTOR_SSE,
+    BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_VECTOR_AVX,
+    BEAGLE_FLAG_PRECISION_DOUBLE | BEAGLE_FLAG_VECTOR_AVX,
+    BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_THREADING_OPENMP,
+    BEAGLE_FLAG_PRECISION_DOUBLE | BEAGLE_FLAG_THREADING_OPENMP
+};
+const int benchFlagSetCount = sizeof(benchFlagSets) / sizeof(long);
+
+void abort(std::string msg) {
+    std::cerr << msg << "\nAborting..." << std::endl;
+    std::exit(1);
+}
+
+double getRandom() {
+    return (double) (rand() & BENCH_RAND_MAX) / BENCH_RAND_MAX;
+}
+
+/*
+ * Sets a model with equal rates between all states: an orthonormal eigenbasis whose first
+ *  vector is constant, found by Gram-Schmidt, with eigenvalue 0 for it and the same
+ *  negative eigenvalue for the others.
+ */
+void setEqualRatesModel(int instance,
+                        int stateCount,
+                        int categoryCount) {
+    std::vector<double> basis(stateCount * stateCount, 0.0); // by column
+    for (int j = 0; j < stateCount; j++) {
+        double* column = &basis[j * stateCount];
+        for (int i = 0; i < stateCount; i++)
+            column[i] = (j == 0 ? 1.0 : (i == j - 1 ? 1.0 : 0.0));
+        for (int m = 0; m < j; m++) {
+            const double* previous = &basis[m * stateCount];
+            double dot = 0.0;
+            for (int i = 0; i < stateCount; i++)
+                dot += column[i] * previous[i];
+            for (int i = 0; i < stateCount; i++)
+                column[i] -= dot * previous[i];
+        }
+        double norm = 0.0;
+        for (int i = 0; i < stateCount; i++)
+            norm += column[i] * column[i];
+        norm = sqrt(norm);
+        for (int i = 0; i < stateCount; i++)
+            column[i] /= norm;
+    }
+
+    std::vector<double> evec(stateCount * stateCount);
+    std::vector<double> ivec(stateCount * stateCount);
+    std::vector<double> eval(stateCount);
+    for (int i = 0; i < stateCount; i++) {
+        for (int j = 0; j < stateCount; j++) {
+            evec[i * stateCount + j] = basis[j * stateCount + i];
+            ivec[i * stateCount + j] = basis[i * stateCount + j];
+        }
+        eval[i] = (i == 0 ? 0.0 : -(double) stateCount / (stateCount - 1));
+    }
+    beagleSetEigenDecomposition(instance, 0, &evec[0], &ivec[0], &eval[0]);
+
+    std::vector<double> freqs(stateCount, 1.0 / stateCount);
+    beagleSetStateFrequencies(instance, 0, &freqs[0]);
+
+    std::vector<double> rates(categoryCount);
+    std::vector<double> weights(categoryCount, 1.0 / categoryCount);
+    for (int l = 0; l < categoryCount; l++)
+        rates[l] = 2.0 * (l + 0.5) / categoryCount;
+    beagleSetCategoryRates(instance, &rates[0]);
+    beagleSetCategoryWeights(instance, 0, &weights[0]);
+}
+
+void setRandomTips(int instance,
+                   int stateCount,
+                   int patternCount) {
+    std::vector<int> states(patternCount);
+    for (int i = 0; i < 2; i++) {
+        for (int k = 0; k < patternCount; k++)
+            states[k] = rand() % stateCount;
+        beagleSetTipStates(instance, i, &states[0]);
+    }
+    std::vector<double> partials(stateCount * patternCount);
+    for (int i = 2; i < BENCH_TIP_COUNT; i++) {
+        for (int k = 0; k < patternCount * stateCount; k++)
+            partials[k] = 0.1 + getRandom();
+        beagleSetTipPartials(instance, i, &partials[0]);
+    }
+    std::vector<double> patternWeights(patternCount, 1.0);
+    beagleSetPatternWeights(instance, &patternWeights[0]);
+}
+
+/*
+ * Runs one kernel class reps times after a warm-up call. Buffers 4 and 5 are internal
+ *  partials, matrices 0 to 2 a transition matrix and its two derivatives.
+ */
+void runKernel(int instance,
+               int kernelClass) {
+    const int probabilityIndex = 0;
+    const int firstDerivativeIndex = 1;
+    const int secondDerivativeIndex = 2;
+    const double edgeLength = 0.1;
+    const int zero = 0;
+    const int parentIndex = 5;
+    const int childIndex = 4;
+    const int noScaling = BEAGLE_OP_NONE;
+    double logL, d1, d2;
+
+    switch (kernelClass) {
+        case BEAGLE_KERNEL_TRANSITION_MATRICES:
+            beagleUpdateTransitionMatrices(instance, 0, &probabilityIndex, NULL, NULL, &edgeLength, 1);
+            break;
+        case BEAGLE_KERNEL_STATES_STATES: {
+            BeagleOperation operation = {4, BEAGLE_OP_NONE, BEAGLE_OP_NONE, 0, 0, 1, 0};
+            beagleUpdatePartials(instance, &operation, 1, BEAGLE_OP_NONE);
+            break;
+        }
+        case BEAGLE_KERNEL_STATES_PARTIALS: {
+            BeagleOperation operation = {4, BEAGLE_OP_NONE, BEAGLE_OP_NONE, 0, 0, 2, 0};
+            beagleUpdatePartials(instance, &operation, 1, BEAGLE_OP_NONE);
+            break;
+        }
+        case BEAGLE_KERNEL_PARTIALS_PARTIALS: {
+            BeagleOperation operation = {5, BEAGLE_OP_NONE, BEAGLE_OP_NONE, 2, 0, 3, 0};
+            beagleUpdatePartials(instance, &operation, 1, BEAGLE_OP_NONE);
+            break;
+        }
+        case BEAGLE_KERNEL_RESCALE: {
+            // the partials of the operation are counted apart from their rescaling
+            BeagleOperation operation = {5, 0, BEAGLE_OP_NONE, 2, 0, 3, 0};
+            beagleUpdatePartials(instance, &operation, 1, BEAGLE_OP_NONE);
+            break;
+        }
+        case BEAGLE_KERNEL_ROOT:
+            beagleCalculateRootLogLikelihoods(instance, &parentIndex, &zero, &zero, &noScaling, 1, &logL);
+            break;
+        case BEAGLE_KERNEL_EDGE:
+            beagleCalculateEdgeLogLikelihoods(instance, &parentIndex, &childIndex, &probabilityIndex,
+                                              NULL, NULL, &zero, &zero, &noScaling, 1, &logL, NULL, NULL);
+            break;
+        case BEAGLE_KERNEL_DERIVATIVES:
+            beagleCalculateEdgeLogLikelihoods(instance, &parentIndex, &childIndex, &probabilityIndex,
+                                              &firstDerivativeIndex, &secondDerivativeIndex, &zero, &zero,
+                                              &noScaling, 1, &logL, &d1, &d2);
+            break;
+    }
+}
+
+void printHeader(bool csv) {
+    if (csv)
+        fprintf(stdout, "resource,impl,states,patterns,rates,kernel,calls,seconds,ns_per_pattern,gb_per_second\n");
+    else
+        fprintf(stdout, "%-28s %6s %8s %5s  %-18s %12s %9s\n",
+                "impl", "states", "patterns", "rates", "kernel", "ns/pattern", "GB/s");
+}
+
+/*
+ * Benchmarks every kernel class on one instance. Transition matrices do not depend on the
+ *  patterns, so their time is given per matrix set of all rate categories.
+ */
+void benchInstance(int instance,
+                   const BeagleInstanceDetails& details,
+                   int stateCount,
+                   int patternCount,
+                   int categoryCount,
+                   int reps,
+                   bool csv) {
+    const int probabilityIndex = 0;
+    const int firstDerivativeIndex = 1;
+    const int secondDerivativeIndex = 2;
+    const double edgeLength = 0.1;
+
+    setEqualRatesModel(instance, stateCount, categoryCount);
+    setRandomTips(instance, stateCount, patternCount);
+    beagleUpdateTransitionMatrices(instance, 0, &probabilityIndex, &firstDerivativeIndex,
+                                   &secondDerivativeIndex, &edgeLength, 1);
+    runKernel(instance, BEAGLE_KERNEL_STATES_PARTIALS);
+    runKernel(instance, BEAGLE_KERNEL_PARTIALS_PARTIALS);
+
+    for (int b = 0; b < benchKernelCount; b++) {
+        const int kernelClass = benchKernels[b].kernelClass;
+        runKernel(instance, kernelClass);
+        beagleResetKernelCounters(instance);
+        for (int r = 0; r < reps; r++)
+            runKernel(instance, kernelClass);
+
+        BeagleKernelCounters counters[BEAGLE_KERNEL_CLASS_COUNT];
+        beagleGetKernelCounters(instance, counters);
+        const BeagleKernelCounters& counter = counters[kernelClass];
+        if (counter.callCount == 0)
+            continue;
+        const double units = (kernelClass == BEAGLE_KERNEL_TRANSITION_MATRICES ? 1.0 : patternCount);
+        const double nsPerUnit = counter.seconds * 1.0e9 / (counter.callCount * units);
+        const double bandwidth = (counter.seconds > 0.0 ? counter.byteCount / counter.seconds / 1.0e9 : 0.0);
+        if (csv)
+            fprintf(stdout, "%s,%s,%d,%d,%d,%s,%ld,%.9f,%.4f,%.4f\n",
+                    details.resourceName, details.implName, stateCount, patternCount, categoryCount,
+                    benchKernels[b].name, counter.callCount, counter.seconds, nsPerUnit, bandwidth);
+        else
+            fprintf(stdout, "%-28s %6d %8d %5d  %-18s %12.3f %9.3f%s\n",
+                    details.implName, stateCount, patternCount, categoryCount, benchKernels[b].name,
+                    nsPerUnit, bandwidth,
+                    (kernelClass == BEAGLE_KERNEL_TRANSITION_MATRICES ? "  (ns per matrix)" : ""));
+    }
+}
+
+void benchResource(int resource,
+                   const std::vector<int>& stateCounts,
+                   const std::vector<int>& patternCounts,
+                   const std::vector<int>& categoryCounts,
+                   int reps,
+                   bool csv) {
+    for (size_t s = 0; s < stateCounts.size(); s++) {
+        for (size_t p = 0; p < patternCounts.size(); p++) {
+            for (size_t c = 0; c < categoryCounts.size(); c++) {
+                std::vector<std::string> benchmarked;
+                for (int f = 0; f < benchFlagSetCount; f++) {
+                    BeagleInstanceDetails details;
+                    int instance = beagleCreateInstance(BENCH_TIP_COUNT,          // tips
+                                                        4,                        // two tips, two internal
+                                                        2,                        // compact tips
+                                                        stateCounts[s],
+                                                        patternCounts[p],
+                                                        1,                        // eigen decompositions
+                                                        3,                        // matrix and derivatives
+                                                        categoryCounts[c],
+                                                        1,                        // scale buffers
+                                                        &resource,
+                                                        1,
+                                                        BEAGLE_FLAG_SCALING_MANUAL,
+                                                        benchFlagSets[f],
+                                                        &details);
+                    if (instance < 0)
+                        continue;
+                    const std::string name = details.implName;
+                    if (std::find(benchmarked.begin(), benchmarked.end(), name) == benchmarked.end()) {
+                        benchmarked.push_back(name);
+                        if (beagleSetKernelCounting(instance, 1) != BEAGLE_SUCCESS) {
+                            if (!csv)
+                                fprintf(stdout, "%-28s kernel counting is not available\n", details.implName);
+                        } else {
+                            benchInstance(instance, details, stateCounts[s], patternCounts[p],
+                                          categoryCounts[c], reps, csv);
+                        }
+                    }
+                    beagleFinalizeInstance(instance);
+                }
+            }
+        }
+    }
+}
+
+std::vector<int> parseList(const std::string& option,
+                           const std::string& value) {
+    std::vector<int> values;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        const int number = atoi(item.c_str());
+        if (number < 1)
+            abort("invalid list for " + option + " supplied on the command line");
+        values.push_back(number);
+    }
+    if (values.empty())
+        abort("invalid list for " + option + " supplied on the command line");
+    return values;
+}
+
+void helpMessage() {
+    std::cerr << "Usage:\n\n";
+    std::cerr << "kernelbench [--help] [--rsrc <integer>] [--states <list>] [--patterns <list>] [--rates <list>] [--reps <integer>] [--csv]\n\n";
+    std::cerr << "Lists are comma-separated, e.g. --states 4,20,61\n\n";
+    std::cerr << "Times are per pattern for each kernel call, and per matrix set for transition matrices\n\n";
+    std::cerr << "If --csv is specified, results are printed as comma-separated values\n\n";
+    std::exit(0);
+}
+
+int main(int argc, const char* argv[]) {
+    std::vector<int> stateCounts;
+    stateCounts.push_back(4);
+    stateCounts.push_back(20);
+    stateCounts.push_back(61);
+    std::vector<int> patternCounts;
+    patternCounts.push_back(1000);
+    patternCounts.push_back(10000);
+    std::vector<int> categoryCounts;
+    categoryCounts.push_back(1);
+    categoryCounts.push_back(4);
+    int resource = -1;
+    int reps = 10;
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if (option == "--help") {
+            helpMessage();
+        } else if (option == "--csv") {
+            csv = true;
+        } else if (!hasValue) {
+            abort("argument " + option + " is missing a value or not recognized");
+        } else if (option == "--rsrc") {
+            resource = atoi(argv[++i]);
+        } else if (option == "--states") {
+            stateCounts = parseList(option, argv[++i]);
+        } else if (option == "--patterns") {
+            patternCounts = parseList(option, argv[++i]);
+        } else if (option == "--rates") {
+            categoryCounts = parseList(option, argv[++i]);
+        } else if (option == "--reps") {
+            reps = atoi(argv[++i]);
+            if (reps < 1)
+                abort("invalid number of reps supplied on the command line");
+        } else {
+            abort("unknown argument: " + option);
+        }
+    }
+
+    for (size_t s = 0; s < stateCounts.size(); s++) {
+        if (stateCounts[s] < 2)
+            abort("state counts must be at least 2");
+    }
+
+    srand(1);
+
+    BeagleResourceList* resourceList = beagleGetResourceList();
+    if (resourceList == NULL)
+        abort("no BEAGLE resources found");
+
+    printHeader(csv);
+    for (int r = 0; r < resourceList->length; r++) {
+        if (resource >= 0 && r != resource)
+            continue;
+        if (!csv)
+            fprintf(stdout, "\nresource %d: %s\n", r, resourceList->list[r].name);
+        benchResource(r, stateCounts, patternCounts, categoryCounts, reps, csv);
+    }
+
+    beagleFinalize();
+
+    return 0;
+}
@@ -113,6 +113,9 @@ void printFlags(long inFlags) {
     if (inFlags & BEAGLE_FLAG_FRAMEWORK_CPU)      fprintf(stdout, " FRAMEWORK_CPU");
     if (inFlags & BEAGLE_FLAG_FRAMEWORK_CUDA)     fprintf(stdout, " FRAMEWORK_CUDA");
     if (inFlags & BEAGLE_FLAG_FRAMEWORK_OPENCL)   fprintf(stdout, " FRAMEWORK_OPENCL");
+    if (inFlags & BEAGLE_FLAG_MEMORY_MAPPED)      fprintf(stdout, " MEMORY_MAPPED");
+    if (inFlags & BEAGLE_FLAG_TRAVERSAL_BLOCKED)  fprintf(stdout, " TRAVERSAL_BLOCKED");
+    if (inFlags & BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR) fprintf(stdout, " PARTIALS_PATTERN_MAJOR");
 }
 
 
@@ -33,6 +33,14 @@ public interface Beagle extends Serializable {
      */
     void finalize() throws Throwable;
 
+    /**
+     * Create a copy of this instance that shares its partials, tip states and pattern
+     * weights until either instance writes to them
+     *
+     * @return the new instance
+     */
+    Beagle cloneInstance();
+
 
     /**
      * Set the weights for each pattern
@@ -55,6 +63,21 @@ public interface Beagle extends Serializable {
             int tipIndex,
             final int[] inStates);
 
+    /**
+     * Set the compressed state representation for tip node from state bitmasks
+     *
+     * This function copies a compact representation of possibly ambiguous states into an instance
+     * buffer. Bit i of each mask is set if state i is compatible with the observation; a mask with
+     * no bits or all bits set is missing data. The inStateMasks array should be patternCount in
+     * length. Masks are limited to instances with at most 32 states.
+     *
+     * @param tipIndex       Index of destination partialsBuffer (input)
+     * @param inStateMasks   Pointer to state bitmasks (input)
+     */
+    void setTipStateMasks(
+            int tipIndex,
+            final int[] inStateMasks);
+
     /**
      * Get the compressed state representation for tip node
      *
@@ -85,6 +108,16 @@ public interface Beagle extends Serializable {
             int tipIndex,
             final double[] inPartials);
 
+    /**
+     * Set the tips of this instance from a tip data store
+     *
+     * The tips set in the store are referenced rather than copied, so that instances over
+     * the same alignment hold the tip data once between them.
+     *
+     * @param tipData   The store, with the state and pattern counts of this instance (input)
+     */
+    void setTipData(TipData tipData);
+
     /**
      * Set an instance partials buffer
      *
@@ -142,6 +175,19 @@ public interface Beagle extends Serializable {
             final double[] inInverseEigenVectors,
             final double[] inEigenValues);
 
+    /**
+     * Set a rate matrix in place of an eigen-decomposition buffer
+     *
+     * Until setEigenDecomposition is next called for the buffer, updateTransitionMatrices
+     * exponentiates this rate matrix directly, so it need not be reversible.
+     *
+     * @param eigenIndex                Index of eigen-decomposition buffer (input)
+     * @param inRateMatrix              Flattened matrix (stateCount x stateCount) of instantaneous rates (input)
+     */
+    void setRateMatrix(
+            int eigenIndex,
+            final double[] inRateMatrix);
+
     /**
      * Set a set of state frequences. These will probably correspond to an
      * eigen-system.
@@ -208,6 +254,24 @@ public interface Beagle extends Serializable {
             final double[] edgeLengths,
             int count);
 
+    /**
+     * Set the size of the transition matrix cache
+     *
+     * updateTransitionMatrices copies matrices for an eigen-decomposition buffer and edge length
+     * it has already computed from a least-recently-used cache of this many entries instead of
+     * recomputing them. A size of zero (the default) turns the cache off.
+     *
+     * @param cacheSize             Number of entries to keep (input)
+     */
+    void setTransitionMatrixCacheSize(final int cacheSize);
+
+    /**
+     * Get the number of transition matrix cache hits and misses
+     *
+     * @param outStatistics         Array of length 2 to receive hits and misses (output)
+     */
+    void getTransitionMatrixCacheStatistics(final long[] outStatistics);
+
     /**
      * This function copies a finite-time transition probability matrix into a matrix buffer. This function
      * is used when the application wishes to explicitly set the transition probability matrix rather than
@@ -264,6 +328,78 @@ public interface Beagle extends Serializable {
             int operationCount,
             int cumulativeScaleIndex);
 
+    /**
+     * Set a sparse rate matrix for updatePartialsByEdgeLengths
+     *
+     * @param eigenIndex            Index of rate matrix buffer (input)
+     * @param nonZeroCount          Number of entries (input)
+     * @param rowIndices            Row (from state) indices of the off-diagonal non-zero rates (input)
+     * @param columnIndices         Column (to state) indices of the rates (input)
+     * @param rates                 Rates (input)
+     */
+    void setSparseRateMatrix(int eigenIndex,
+                             int nonZeroCount,
+                             final int[] rowIndices,
+                             final int[] columnIndices,
+                             final double[] rates);
+
+    /**
+     * Calculate partials by applying the exponential of a sparse rate matrix directly to the
+     * child partials, without forming transition matrices. The transition matrix indices of the
+     * operations are ignored.
+     *
+     * @param eigenIndex            Index of rate matrix buffer (input)
+     * @param operations            An array of operations as for updatePartials (input)
+     * @param operationCount        Number of operations (input)
+     * @param edgeLengths           Child 1 and child 2 edge lengths of each operation (input)
+     * @param cumulativeScaleIndex  Index of the scaleBuffer to store accumulated factors (input)
+     */
+    void updatePartialsByEdgeLengths(int eigenIndex,
+                                     final int[] operations,
+                                     int operationCount,
+                                     final double[] edgeLengths,
+                                     int cumulativeScaleIndex);
+
+    /**
+     * Calculate transition matrices and partials in one pass. The matrices of each operation
+     * are calculated just before they are applied and are not kept, where the implementation
+     * allows; otherwise they are calculated into the child transition matrix buffers of the
+     * operation. Auto scaling is not supported.
+     *
+     * @param operations            An array of operations as for updatePartials (input)
+     * @param operationCount        Number of operations (input)
+     * @param eigenIndices          Index of eigen-decomposition buffer for each operation (input)
+     * @param edgeLengths           Child 1 and child 2 edge lengths of each operation (input)
+     * @param cumulativeScaleIndex  Index of the scaleBuffer to store accumulated factors (input)
+     */
+    void updateMatricesAndPartials(final int[] operations,
+                                   int operationCount,
+                                   final int[] eigenIndices,
+                                   final double[] edgeLengths,
+                                   int cumulativeScaleIndex);
+
+    /**
+     * Turn automatic skipping of unchanged operations on or off
+     *
+     * With dirty tracking on, updatePartials skips each operation whose children, matrices and
+     * scale buffers are unchanged since it last computed the destination, and
+     * updateTransitionMatrices skips matrices whose edge length and model are unchanged.
+     *
+     * @param enable                true to turn dirty tracking on (input)
+     */
+    void setDirtyTracking(final boolean enable);
+
+    /**
+     * Store scale factors as powers of two
+     *
+     * With exponent scalers on, rescaling is exact and scale buffers hold one 16-bit exponent
+     * per pattern, accumulated as integers and converted to logs only at integration. Changing
+     * the setting resets all scale buffers. Only available with manual scaling.
+     *
+     * @param enable                true to store exponents (input)
+     */
+    void setExponentScalers(final boolean enable);
+
     /**
      * Accumulate scale factors
      *
@@ -344,6 +480,26 @@ public interface Beagle extends Serializable {
                                      int count,
                                      double[] outSumLogLikelihood);
 
+    /**
+     * Calculate root partials and integrate them in one pass
+     *
+     * This function computes the partials of a single operation, as updatePartials does, and integrates
+     * them as calculateRootLogLikelihoods does while they are still in cache. If the destination partials
+     * of the operation is Beagle.NONE, the root partials are not stored.
+     *
+     * @param operation                 An operation computing the root partials (input)
+     * @param categoryWeightsIndex      Index of the category weights (input)
+     * @param stateFrequenciesIndex     Index of the state frequencies (input)
+     * @param cumulativeScaleIndex      Index of the scaleBuffer of accumulated factors, which any factors
+     *                                      the operation writes are added to, or Beagle.NONE (input)
+     * @param outSumLogLikelihood       Pointer to destination for resulting sum of log likelihoods (output)
+     */
+    void calculateRootLogLikelihoodsByOperation(int[] operation,
+                                                int categoryWeightsIndex,
+                                                int stateFrequenciesIndex,
+                                                int cumulativeScaleIndex,
+                                                double[] outSumLogLikelihood);
+
     /**
      * Calculate site log likelihoods and derivatives along an edge
      *
@@ -380,6 +536,104 @@ public interface Beagle extends Serializable {
                                      double[] outSumFirstDerivative,
                                      double[] outSumSecondDerivative);
 
+    /**
+     * Calculate log likelihoods and derivatives along several independent edges
+     *
+     * Each entry of the index lists is evaluated as a separate edge and gets its own sum.
+     *
+     * @param parentBufferIndices       List of indices of parent partialsBuffers (input)
+     * @param childBufferIndices        List of indices of child partialsBuffers (input)
+     * @param probabilityIndices        List indices of transition probability matrices (input)
+     * @param firstDerivativeIndices    List indices of first derivative matrices, or null (input)
+     * @param secondDerivativeIndices   List indices of second derivative matrices, or null (input)
+     * @param categoryWeightsIndices    List of indices of category weights for each edge (input)
+     * @param stateFrequenciesIndices   List of indices of state frequencies for each edge (input)
+     * @param cumulativeScaleIndices    List of scalingFactors indices for each edge, or null (input)
+     * @param count                     Number of edges (input)
+     * @param outLogLikelihoods         Destination for the log likelihood of each edge (output)
+     * @param outFirstDerivatives       Destination for the first derivative of each edge, or null (output)
+     * @param outSecondDerivatives      Destination for the second derivative of each edge, or null (output)
+     */
+    void calculateIndependentEdgeLogLikelihoods(int[] parentBufferIndices,
+                                                int[] childBufferIndices,
+                                                int[] probabilityIndices,
+                                                int[] firstDerivativeIndices,
+                                                int[] secondDerivativeIndices,
+                                                int[] categoryWeightsIndices,
+                                                int[] stateFrequenciesIndices,
+                                                int[] cumulativeScaleIndices,
+                                                int count,
+                                                double[] outLogLikelihoods,
+                                                double[] outFirstDerivatives,
+                                                double[] outSecondDerivatives);
+
+    /**
+     * Project the partials at either end of an edge onto the eigenbasis of a rate matrix
+     *
+     * Until the next call, calculateProjectedEdgeLogLikelihoods evaluates the edge for
+     * any length from the eigenvalues alone.
+     *
+     * @param parentBufferIndex         Index of the parent partialsBuffer (input)
+     * @param childBufferIndex          Index of the child partialsBuffer (input)
+     * @param eigenIndex                Index of the Eigen decomposition buffer (input)
+     * @param categoryWeightsIndex      Index of the category weights (input)
+     * @param stateFrequenciesIndex     Index of the state frequencies (input)
+     * @param cumulativeScaleIndex      Index of the scalingFactors to apply, or NONE (input)
+     */
+    void projectEdgePartials(int parentBufferIndex,
+                             int childBufferIndex,
+                             int eigenIndex,
+                             int categoryWeightsIndex,
+                             int stateFrequenciesIndex,
+                             int cumulativeScaleIndex);
+
+    /**
+     * Calculate the log likelihood and derivatives of the projected edge for an edge length
+     *
+     * @param edgeLength                Length of the edge (input)
+     * @param outSumLogLikelihood       Pointer to destination for resulting sum of log likelihoods (output)
+     * @param outSumFirstDerivative     Pointer to destination for resulting sum of first derivatives (output)
+     * @param outSumSecondDerivative    Pointer to destination for resulting sum of second derivatives (output)
+     */
+    void calculateProjectedEdgeLogLikelihoods(double edgeLength,
+                                              double[] outSumLogLikelihood,
+                                              double[] outSumFirstDerivative,
+                                              double[] outSumSecondDerivative);
+
+    /**
+     * Optimize the lengths of edges by Newton-Raphson iteration
+     *
+     * Each edge is optimized in turn between its parent and child partials, keeping every
+     * other length fixed.
+     *
+     * @param parentBufferIndices       List of indices of parent partialsBuffers (input)
+     * @param childBufferIndices        List of indices of child partialsBuffers (input)
+     * @param eigenIndex                Index of the Eigen decomposition buffer (input)
+     * @param categoryWeightsIndex      Index of the category weights (input)
+     * @param stateFrequenciesIndex     Index of the state frequencies (input)
+     * @param cumulativeScaleIndices    List of scalingFactors indices for each edge, or null (input)
+     * @param count                     Number of edges (input)
+     * @param minEdgeLength             Lower bound on the edge lengths (input)
+     * @param maxEdgeLength             Upper bound on the edge lengths (input)
+     * @param tolerance                 Largest change in length still taken as converged (input)
+     * @param maxIterations             Largest number of Newton-Raphson steps per edge (input)
+     * @param inOutEdgeLengths          Starting edge lengths, replaced by the optimal ones (input and output)
+     * @param outLogLikelihoods         Destination for the log likelihood of each edge (output)
+     */
+    void optimizeEdgeLengths(int[] parentBufferIndices,
+                             int[] childBufferIndices,
+                             int eigenIndex,
+                             int categoryWeightsIndex,
+                             int stateFrequenciesIndex,
+                             int[] cumulativeScaleIndices,
+                             int count,
+                             double minEdgeLength,
+                             double maxEdgeLength,
+                             double tolerance,
+                             int maxIterations,
+                             double[] inOutEdgeLengths,
+                             double[] outLogLikelihoods);
+
     /**
      * Return the individual log likelihoods for each site pattern.
      *
@@ -387,6 +641,43 @@ public interface Beagle extends Serializable {
      */
     void getSiteLogLikelihoods(double[] outLogLikelihoods);
 
+    /**
+     * Save the complete state of this instance to a file
+     *
+     * @param fileName the path of the file to write
+     */
+    void saveInstance(String fileName);
+
+    /**
+     * Restore the state saved by saveInstance into this instance, which must have been
+     * created with the same arguments and implementation
+     *
+     * @param fileName the path of the file to read
+     */
+    void restoreInstance(String fileName);
+
+    /**
+     * Turn counting of kernel calls, time and estimated work on or off. Counting is off by
+     * default, and turning it off keeps the counts recorded so far.
+     *
+     * @param enable                true to count kernels (input)
+     */
+    void setKernelCounting(final boolean enable);
+
+    /**
+     * Get the kernel counters recorded since the instance was created or last reset
+     *
+     * @param outCounters           Array of length BeagleKernelClass.COUNTER_COUNT times the number
+     *                              of kernel classes to receive, for each BeagleKernelClass in
+     *                              order, the calls, seconds, elements, flops and bytes (output)
+     */
+    void getKernelCounters(final double[] outCounters);
+
+    /**
+     * Reset the kernel counters to zero
+     */
+    void resetKernelCounters();
+
     /**
      * Get a details class for this instance
      * @return
@@ -36,7 +36,11 @@ public enum BeagleFlag {
 
     FRAMEWORK_CUDA(1 << 22, "use CUDA implementation with GPU resources"),
     FRAMEWORK_OPENCL(1 << 23, "use OpenCL implementation with CPU or GPU resources"),
-    FRAMEWORK_CPU(1 << 27, "use CPU implementation");
+    FRAMEWORK_CPU(1 << 27, "use CPU implementation"),
+
+    MEMORY_MAPPED(1 << 28, "back partials and scale buffers with a memory-mapped scratch file"),
+    TRAVERSAL_BLOCKED(1 << 29, "compute operation lists one cache-sized pattern block at a time"),
+    PARTIALS_PATTERN_MAJOR(1 << 30, "store partials pattern-major, with all categories of a site pattern adjacent");
 
     BeagleFlag(long mask, String meaning) {
         this.mask = mask;
@@ -53,6 +53,20 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    private BeagleJNIImpl(int instance, InstanceDetails details) {
+        this.instance = instance;
+        this.details = details;
+    }
+
+    public Beagle cloneInstance() {
+        InstanceDetails cloneDetails = new InstanceDetails();
+        int clone = BeagleJNIWrapper.INSTANCE.cloneInstance(instance, cloneDetails);
+        if (clone < 0) {
+            throw new BeagleException("cloneInstance", clone);
+        }
+        return new BeagleJNIImpl(clone, cloneDetails);
+    }
+
     public void finalize() throws Throwable {
         super.finalize();
         int errCode = BeagleJNIWrapper.INSTANCE.finalize(instance);
@@ -75,6 +89,13 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void setTipStateMasks(int tipIndex, final int[] stateMasks) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setTipStateMasks(instance, tipIndex, stateMasks);
+        if (errCode != 0) {
+            throw new BeagleException("setTipStateMasks", errCode);
+        }
+    }
+
     public void getTipStates(int tipIndex, final int[] states) {
         int errCode = BeagleJNIWrapper.INSTANCE.getTipStates(instance, tipIndex, states);
         if (errCode != 0) {
@@ -89,6 +110,13 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void setTipData(TipData tipData) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setTipData(instance, tipData.getTipData());
+        if (errCode != 0) {
+            throw new BeagleException("setTipData", errCode);
+        }
+    }
+
     public void setPartials(int bufferIndex, final double[] partials) {
         int errCode = BeagleJNIWrapper.INSTANCE.setPartials(instance, bufferIndex, partials);
         if (errCode != 0) {
@@ -120,6 +148,14 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void setRateMatrix(int eigenIndex,
+                              final double[] rateMatrix) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setRateMatrix(instance, eigenIndex, rateMatrix);
+        if (errCode != 0) {
+            throw new BeagleException("setRateMatrix", errCode);
+        }
+    }
+
     public void setStateFrequencies(int stateFrequenciesIndex,
                                     final double[] stateFrequencies) {
         int errCode = BeagleJNIWrapper.INSTANCE.setStateFrequencies(instance,
@@ -195,6 +231,20 @@ public class BeagleJNIImpl implements Beagle {
     }
 
 
+    public void setTransitionMatrixCacheSize(final int cacheSize) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setTransitionMatrixCacheSize(instance, cacheSize);
+        if (errCode != 0) {
+            throw new BeagleException("setTransitionMatrixCacheSize", errCode);
+        }
+    }
+
+    public void getTransitionMatrixCacheStatistics(final long[] outStatistics) {
+        int errCode = BeagleJNIWrapper.INSTANCE.getTransitionMatrixCacheStatistics(instance, outStatistics);
+        if (errCode != 0) {
+            throw new BeagleException("getTransitionMatrixCacheStatistics", errCode);
+        }
+    }
+
     public void updatePartials(final int[] operations, final int operationCount, final int cumulativeScaleIndex) {
         int errCode = BeagleJNIWrapper.INSTANCE.updatePartials(instance, operations, operationCount, cumulativeScaleIndex);
         if (errCode != 0) {
@@ -202,6 +252,56 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void setSparseRateMatrix(int eigenIndex,
+                                    int nonZeroCount,
+                                    final int[] rowIndices,
+                                    final int[] columnIndices,
+                                    final double[] rates) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setSparseRateMatrix(instance, eigenIndex, nonZeroCount,
+                rowIndices, columnIndices, rates);
+        if (errCode != 0) {
+            throw new BeagleException("setSparseRateMatrix", errCode);
+        }
+    }
+
+    public void updatePartialsByEdgeLengths(int eigenIndex,
+                                            final int[] operations,
+                                            int operationCount,
+                                            final double[] edgeLengths,
+                                            int cumulativeScaleIndex) {
+        int errCode = BeagleJNIWrapper.INSTANCE.updatePartialsByEdgeLengths(instance, eigenIndex, operations,
+                operationCount, edgeLengths, cumulativeScaleIndex);
+        if (errCode != 0) {
+            throw new BeagleException("updatePartialsByEdgeLengths", errCode);
+        }
+    }
+
+    public void updateMatricesAndPartials(final int[] operations,
+                                          int operationCount,
+                                          final int[] eigenIndices,
+                                          final double[] edgeLengths,
+                                          int cumulativeScaleIndex) {
+        int errCode = BeagleJNIWrapper.INSTANCE.updateMatricesAndPartials(instance, operations, operationCount,
+                eigenIndices, edgeLengths, cumulativeScaleIndex);
+        if (errCode != 0) {
+            throw new BeagleException("updateMatricesAndPartials", errCode);
+        }
+    }
+
+    public void setDirtyTracking(final boolean enable) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setDirtyTracking(instance, enable ? 1 : 0);
+        if (errCode != 0) {
+            throw new BeagleException("setDirtyTracking", errCode);
+        }
+    }
+
+    public void setExponentScalers(final boolean enable) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setExponentScalers(instance, enable ? 1 : 0);
+        if (errCode != 0) {
+            throw new BeagleException("setExponentScalers", errCode);
+        }
+    }
+
     public void accumulateScaleFactors(final int[] scaleIndices, final int count, final int cumulativeScaleIndex) {
         int errCode = BeagleJNIWrapper.INSTANCE.accumulateScaleFactors(instance, scaleIndices, count, cumulativeScaleIndex);
         if (errCode != 0) {
@@ -249,6 +349,22 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void calculateRootLogLikelihoodsByOperation(final int[] operation,
+                                                       int categoryWeightsIndex,
+                                                       int stateFrequenciesIndex,
+                                                       int cumulativeScaleIndex,
+                                                       final double[] outSumLogLikelihood) {
+        int errCode = BeagleJNIWrapper.INSTANCE.calculateRootLogLikelihoodsByOperation(instance,
+                operation,
+                categoryWeightsIndex,
+                stateFrequenciesIndex,
+                cumulativeScaleIndex,
+                outSumLogLikelihood);
+        if (errCode != 0 && errCode != BeagleErrorCode.FLOATING_POINT_ERROR.getErrCode()) {
+            throw new BeagleException("calculateRootLogLikelihoodsByOperation", errCode);
+        }
+    }
+
     public void calculateEdgeLogLikelihoods(final int[] parentBufferIndices,
                                             final int[] childBufferIndices,
                                             final int[] probabilityIndices,
@@ -279,6 +395,100 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void calculateIndependentEdgeLogLikelihoods(final int[] parentBufferIndices,
+                                                       final int[] childBufferIndices,
+                                                       final int[] probabilityIndices,
+                                                       final int[] firstDerivativeIndices,
+                                                       final int[] secondDerivativeIndices,
+                                                       final int[] categoryWeightsIndices,
+                                                       final int[] stateFrequenciesIndices,
+                                                       final int[] cumulativeScaleIndices,
+                                                       int count,
+                                                       final double[] outLogLikelihoods,
+                                                       final double[] outFirstDerivatives,
+                                                       final double[] outSecondDerivatives) {
+        int errCode = BeagleJNIWrapper.INSTANCE.calculateIndependentEdgeLogLikelihoods(instance,
+                parentBufferIndices,
+                childBufferIndices,
+                probabilityIndices,
+                firstDerivativeIndices,
+                secondDerivativeIndices,
+                categoryWeightsIndices,
+                stateFrequenciesIndices,
+                cumulativeScaleIndices,
+                count,
+                outLogLikelihoods,
+                outFirstDerivatives,
+                outSecondDerivatives);
+        if (errCode != 0) {
+            throw new BeagleException("calculateIndependentEdgeLogLikelihoods", errCode);
+        }
+    }
+
+    public void projectEdgePartials(int parentBufferIndex,
+                                    int childBufferIndex,
+                                    int eigenIndex,
+                                    int categoryWeightsIndex,
+                                    int stateFrequenciesIndex,
+                                    int cumulativeScaleIndex) {
+        int errCode = BeagleJNIWrapper.INSTANCE.projectEdgePartials(instance,
+                parentBufferIndex,
+                childBufferIndex,
+                eigenIndex,
+                categoryWeightsIndex,
+                stateFrequenciesIndex,
+                cumulativeScaleIndex);
+        if (errCode != 0) {
+            throw new BeagleException("projectEdgePartials", errCode);
+        }
+    }
+
+    public void calculateProjectedEdgeLogLikelihoods(double edgeLength,
+                                                     final double[] outSumLogLikelihood,
+                                                     final double[] outSumFirstDerivative,
+                                                     final double[] outSumSecondDerivative) {
+        int errCode = BeagleJNIWrapper.INSTANCE.calculateProjectedEdgeLogLikelihoods(instance,
+                edgeLength,
+                outSumLogLikelihood,
+                outSumFirstDerivative,
+                outSumSecondDerivative);
+        if (errCode != 0) {
+            throw new BeagleException("calculateProjectedEdgeLogLikelihoods", errCode);
+        }
+    }
+
+    public void optimizeEdgeLengths(final int[] parentBufferIndices,
+                                    final int[] childBufferIndices,
+                                    int eigenIndex,
+                                    int categoryWeightsIndex,
+                                    int stateFrequenciesIndex,
+                                    final int[] cumulativeScaleIndices,
+                                    int count,
+                                    double minEdgeLength,
+                                    double maxEdgeLength,
+                                    double tolerance,
+                                    int maxIterations,
+                                    final double[] inOutEdgeLengths,
+                                    final double[] outLogLikelihoods) {
+        int errCode = BeagleJNIWrapper.INSTANCE.optimizeEdgeLengths(instance,
+                parentBufferIndices,
+                childBufferIndices,
+                eigenIndex,
+                categoryWeightsIndex,
+                stateFrequenciesIndex,
+                cumulativeScaleIndices,
+                count,
+                minEdgeLength,
+                maxEdgeLength,
+                tolerance,
+                maxIterations,
+                inOutEdgeLengths,
+                outLogLikelihoods);
+        if (errCode != 0) {
+            throw new BeagleException("optimizeEdgeLengths", errCode);
+        }
+    }
+
     public void getSiteLogLikelihoods(final double[] outLogLikelihoods) {
         int errCode = BeagleJNIWrapper.INSTANCE.getSiteLogLikelihoods(instance,
                 outLogLikelihoods);
@@ -287,6 +497,41 @@ public class BeagleJNIImpl implements Beagle {
         }
     }
 
+    public void saveInstance(final String fileName) {
+        int errCode = BeagleJNIWrapper.INSTANCE.saveInstance(instance, fileName);
+        if (errCode != 0) {
+            throw new BeagleException("saveInstance", errCode);
+        }
+    }
+
+    public void restoreInstance(final String fileName) {
+        int errCode = BeagleJNIWrapper.INSTANCE.restoreInstance(instance, fileName);
+        if (errCode != 0) {
+            throw new BeagleException("restoreInstance", errCode);
+        }
+    }
+
+    public void setKernelCounting(final boolean enable) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setKernelCounting(instance, enable ? 1 : 0);
+        if (errCode != 0) {
+            throw new BeagleException("setKernelCounting", errCode);
+        }
+    }
+
+    public void getKernelCounters(final double[] outCounters) {
+        int errCode = BeagleJNIWrapper.INSTANCE.getKernelCounters(instance, outCounters);
+        if (errCode != 0) {
+            throw new BeagleException("getKernelCounters", errCode);
+        }
+    }
+
+    public void resetKernelCounters() {
+        int errCode = BeagleJNIWrapper.INSTANCE.resetKernelCounters(instance);
+        if (errCode != 0) {
+            throw new BeagleException("resetKernelCounters", errCode);
+        }
+    }
+
     public InstanceDetails getDetails() {
         return details;
     }
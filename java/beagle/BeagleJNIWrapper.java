@@ -46,6 +46,9 @@ public class BeagleJNIWrapper {
             long requirementFlags,
             InstanceDetails returnInfo);
 
+    public native int cloneInstance(int instance,
+                                    InstanceDetails returnInfo);
+
     public native int finalize(int instance);
 
     public native int setPatternWeights(int instance,
@@ -53,10 +56,22 @@ public class BeagleJNIWrapper {
 
     public native int setTipStates(int instance, int tipIndex, final int[] inStates);
 
+    public native int setTipStateMasks(int instance, int tipIndex, final int[] inStateMasks);
+
     public native int getTipStates(int instance, int tipIndex, final int[] inStates);
 
     public native int setTipPartials(int instance, int tipIndex, final double[] inPartials);
 
+    public native int createTipData(int tipCount, int stateCount, int patternCount);
+
+    public native int setTipDataStates(int tipData, int tipIndex, final int[] inStates);
+
+    public native int setTipDataPartials(int tipData, int tipIndex, final double[] inPartials);
+
+    public native int setTipData(int instance, int tipData);
+
+    public native int finalizeTipData(int tipData);
+
     public native int setPartials(int instance, int bufferIndex, final double[] inPartials);
 
     public native int getPartials(int instance, int bufferIndex, int scaleIndex,
@@ -70,6 +85,10 @@ public class BeagleJNIWrapper {
                                             final double[] inverseEigenValues,
                                             final double[] eigenValues);
 
+    public native int setRateMatrix(int instance,
+                                    int eigenIndex,
+                                    final double[] rateMatrix);
+
     public native int setStateFrequencies(int instance,
                                           int stateFrequenciesIndex,
                                           final double[] stateFrequencies);
@@ -98,11 +117,44 @@ public class BeagleJNIWrapper {
                                                final double[] edgeLengths,
                                                int count);
 
+    public native int setTransitionMatrixCacheSize(final int instance,
+                                                   int cacheSize);
+
+    public native int getTransitionMatrixCacheStatistics(final int instance,
+                                                         final long[] outStatistics);
+
     public native int updatePartials(final int instance,
                                      final int[] operations,
                                      int operationCount,
                                      int cumulativeScalingIndex);
 
+    public native int setSparseRateMatrix(final int instance,
+                                          int eigenIndex,
+                                          int nonZeroCount,
+                                          final int[] rowIndices,
+                                          final int[] columnIndices,
+                                          final double[] rates);
+
+    public native int updatePartialsByEdgeLengths(final int instance,
+                                                  int eigenIndex,
+                                                  final int[] operations,
+                                                  int operationCount,
+                                                  final double[] edgeLengths,
+                                                  int cumulativeScalingIndex);
+
+    public native int updateMatricesAndPartials(final int instance,
+                                                final int[] operations,
+                                                int operationCount,
+                                                final int[] eigenIndices,
+                                                final double[] edgeLengths,
+                                                int cumulativeScalingIndex);
+
+    public native int setDirtyTracking(final int instance,
+                                       int enable);
+
+    public native int setExponentScalers(final int instance,
+                                         int enable);
+
     public native int waitForPartials(final int instance,
                                       final int[] destinationPartials,
                                       int destinationPartialsCount);
@@ -132,6 +184,13 @@ public class BeagleJNIWrapper {
                                                   int count,
                                                   final double[] outSumLogLikelihood);
 
+    public native int calculateRootLogLikelihoodsByOperation(int instance,
+                                                             final int[] operation,
+                                                             int categoryWeightsIndex,
+                                                             int stateFrequenciesIndex,
+                                                             int cumulativeScaleIndex,
+                                                             final double[] outSumLogLikelihood);
+
     public native int calculateEdgeLogLikelihoods(int instance,
                                                   final int[] parentBufferIndices,
                                                   final int[] childBufferIndices,
@@ -146,9 +205,66 @@ public class BeagleJNIWrapper {
                                                   final double[] outSumFirstDerivative,
                                                   final double[] outSumSecondDerivative);
 
+    public native int calculateIndependentEdgeLogLikelihoods(int instance,
+                                                             final int[] parentBufferIndices,
+                                                             final int[] childBufferIndices,
+                                                             final int[] probabilityIndices,
+                                                             final int[] firstDerivativeIndices,
+                                                             final int[] secondDerivativeIndices,
+                                                             final int[] categoryWeightsIndices,
+                                                             final int[] stateFrequenciesIndices,
+                                                             final int[] scalingFactorsIndices,
+                                                             int count,
+                                                             final double[] outLogLikelihoods,
+                                                             final double[] outFirstDerivatives,
+                                                             final double[] outSecondDerivatives);
+
+    public native int projectEdgePartials(int instance,
+                                          int parentBufferIndex,
+                                          int childBufferIndex,
+                                          int eigenIndex,
+                                          int categoryWeightsIndex,
+                                          int stateFrequenciesIndex,
+                                          int cumulativeScaleIndex);
+
+    public native int calculateProjectedEdgeLogLikelihoods(int instance,
+                                                           double edgeLength,
+                                                           final double[] outSumLogLikelihood,
+                                                           final double[] outSumFirstDerivative,
+                                                           final double[] outSumSecondDerivative);
+
+    public native int optimizeEdgeLengths(int instance,
+                                          final int[] parentBufferIndices,
+                                          final int[] childBufferIndices,
+                                          int eigenIndex,
+                                          int categoryWeightsIndex,
+                                          int stateFrequenciesIndex,
+                                          final int[] cumulativeScaleIndices,
+                                          int count,
+                                          double minEdgeLength,
+                                          double maxEdgeLength,
+                                          double tolerance,
+                                          int maxIterations,
+                                          final double[] inOutEdgeLengths,
+                                          final double[] outLogLikelihoods);
+
     public native int getSiteLogLikelihoods(final int instance,
                                             final double[] outLogLikelihoods);
 
+    public native int saveInstance(final int instance,
+                                   final String fileName);
+
+    public native int restoreInstance(final int instance,
+                                      final String fileName);
+
+    public native int setKernelCounting(final int instance,
+                                        int enable);
+
+    public native int getKernelCounters(final int instance,
+                                        final double[] outCounters);
+
+    public native int resetKernelCounters(final int instance);
+
     /* Library loading routines */
 
     private static String getPlatformSpecificLibraryName()
@@ -0,0 +1,33 @@
+package beagle;
+
+/**
+ * The kernel classes that getKernelCounters reports on, in the order of their counters
+ *
+ * @version $Id$
+ */
+public enum BeagleKernelClass {
+    TRANSITION_MATRICES("transition matrices from eigen-decompositions"),
+    STATES_STATES("partials from two compact tips"),
+    STATES_PARTIALS("partials from a compact tip and partials"),
+    PARTIALS_PARTIALS("partials from two sets of partials"),
+    RESCALE("rescaling of partials"),
+    ROOT("root log likelihoods"),
+    EDGE("edge log likelihoods"),
+    DERIVATIVES("edge log likelihoods with derivatives");
+
+    /**
+     * The number of counters per kernel class: calls, seconds, elements, estimated flops
+     * and estimated bytes
+     */
+    public static final int COUNTER_COUNT = 5;
+
+    BeagleKernelClass(String meaning) {
+        this.meaning = meaning;
+    }
+
+    public String getMeaning() {
+        return meaning;
+    }
+
+    private final String meaning;
+}
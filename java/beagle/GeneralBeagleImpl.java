@@ -129,6 +129,10 @@ public class GeneralBeagleImpl implements Beagle {
         super.finalize();
     }
 
+    public Beagle cloneInstance() {
+        throw new UnsupportedOperationException("cloneInstance not implemented in GeneralBeagleImpl");
+    }
+
     public void setPatternWeights(final double[] patternWeights) {
         System.arraycopy(patternWeights, 0, this.patternWeights, 0, this.patternWeights.length);
     }
@@ -153,6 +157,29 @@ public class GeneralBeagleImpl implements Beagle {
 
     }
 
+    /**
+     * Sets partials for a tip from state bitmasks - bit i of each mask is set if state i is possible
+     * @param tipIndex   the tip index
+     * @param stateMasks an array of patternCount state bitmasks
+     */
+    public void setTipStateMasks(int tipIndex, int[] stateMasks) {
+        assert(tipIndex >= 0 && tipIndex < tipCount);
+        final double[] tipPartials = new double[patternCount * stateCount];
+        final int allStates = (stateCount < 32 ? (1 << stateCount) - 1 : ~0);
+        int k = 0;
+        for (int mask : stateMasks) {
+            if ((mask & allStates) == 0) {
+                mask = allStates;
+            }
+            for (int i = 0; i < stateCount; i++) {
+                tipPartials[k * stateCount + i] = ((mask >> i) & 1) != 0 ? 1.0 : 0.0;
+            }
+            k++;
+        }
+        this.tipStates[tipIndex] = null;
+        setTipPartials(tipIndex, tipPartials);
+    }
+
     public void getTipStates(int tipIndex, int[] states) {
         assert(tipIndex >= 0 && tipIndex < tipCount);
         if (this.tipStates[tipIndex] == null) {
@@ -173,6 +200,10 @@ public class GeneralBeagleImpl implements Beagle {
         }
     }
 
+    public void setTipData(TipData tipData) {
+        throw new UnsupportedOperationException("setTipData not implemented in GeneralBeagleImpl");
+    }
+
     public void setPartials(final int bufferIndex, final double[] partials) {
         assert(this.partials[bufferIndex] != null);
         System.arraycopy(partials, 0, this.partials[bufferIndex], 0, partialsSize);
@@ -204,6 +235,10 @@ public class GeneralBeagleImpl implements Beagle {
         System.arraycopy(eigenValues, 0, this.eigenValues[eigenIndex], 0, eigenValues.length);
     }
 
+    public void setRateMatrix(int eigenIndex, double[] rateMatrix) {
+        throw new UnsupportedOperationException("setRateMatrix not implemented in GeneralBeagleImpl");
+    }
+
     public void setStateFrequencies(final int stateFrequenciesIndex, final double[] stateFrequencies) {
         System.arraycopy(stateFrequencies, 0, this.stateFrequencies[stateFrequenciesIndex], 0, stateCount);
     }
@@ -412,6 +447,39 @@ public class GeneralBeagleImpl implements Beagle {
         }
     }
 
+    public void setTransitionMatrixCacheSize(final int cacheSize) {
+        // Matrices are always recomputed, which gives the same results
+    }
+
+    public void getTransitionMatrixCacheStatistics(final long[] outStatistics) {
+        outStatistics[0] = 0;
+        outStatistics[1] = 0;
+    }
+
+    public void setSparseRateMatrix(int eigenIndex, int nonZeroCount, int[] rowIndices, int[] columnIndices, double[] rates) {
+        throw new UnsupportedOperationException("setSparseRateMatrix not implemented in GeneralBeagleImpl");
+    }
+
+    public void updatePartialsByEdgeLengths(int eigenIndex, int[] operations, int operationCount, double[] edgeLengths, int cumulativeScaleIndex) {
+        throw new UnsupportedOperationException("updatePartialsByEdgeLengths not implemented in GeneralBeagleImpl");
+    }
+
+    public void updateMatricesAndPartials(int[] operations, int operationCount, int[] eigenIndices, double[] edgeLengths, int cumulativeScaleIndex) {
+        for (int op = 0; op < operationCount; op++) {
+            updateTransitionMatrices(eigenIndices[op], new int[] { operations[op * 7 + 4], operations[op * 7 + 6] },
+                    null, null, new double[] { edgeLengths[op * 2], edgeLengths[op * 2 + 1] }, 2);
+        }
+        updatePartials(operations, operationCount, cumulativeScaleIndex);
+    }
+
+    public void setDirtyTracking(final boolean enable) {
+        // Every operation is recomputed, which gives the same results
+    }
+
+    public void setExponentScalers(final boolean enable) {
+        throw new UnsupportedOperationException("setExponentScalers not implemented in GeneralBeagleImpl");
+    }
+
     public void accumulateScaleFactors(int[] scaleIndices, int count, int outScaleIndex) {
 //        throw new UnsupportedOperationException("accumulateScaleFactors not implemented in GeneralBeagleImpl");
 
@@ -665,6 +733,15 @@ public class GeneralBeagleImpl implements Beagle {
         return exponent;
     }
 
+    public void calculateRootLogLikelihoodsByOperation(final int[] operation, final int categoryWeightsIndex, final int stateFrequenciesIndex, final int cumulativeScaleIndex, final double[] outSumLogLikelihood) {
+        if (operation[0] == Beagle.NONE) {
+            throw new UnsupportedOperationException("calculateRootLogLikelihoodsByOperation without root partials not implemented in GeneralBeagleImpl");
+        }
+        updatePartials(operation, 1, cumulativeScaleIndex);
+        calculateRootLogLikelihoods(new int[] { operation[0] }, new int[] { categoryWeightsIndex },
+                new int[] { stateFrequenciesIndex }, new int[] { cumulativeScaleIndex }, 1, outSumLogLikelihood);
+    }
+
     public void calculateRootLogLikelihoods(final int[] bufferIndices, final int[] categoryWeightsIndices, final int[] stateFrequenciesIndices, final int[] cumulativeScaleIndices, final int count, final double[] outSumLogLikelihood) {
 
         assert(count == 1); // @todo implement integration across multiple subtrees
@@ -727,10 +804,46 @@ public class GeneralBeagleImpl implements Beagle {
         throw new UnsupportedOperationException("calculateEdgeLogLikelihoods not implemented in GeneralBeagleImpl");
     }
 
+    public void calculateIndependentEdgeLogLikelihoods(final int[] parentBufferIndices, final int[] childBufferIndices, final int[] probabilityIndices, final int[] firstDerivativeIndices, final int[] secondDerivativeIndices, final int[] categoryWeightsIndices, final int[] stateFrequenciesIndices, final int[] cumulativeScaleIndices, final int count, final double[] outLogLikelihoods, final double[] outFirstDerivatives, final double[] outSecondDerivatives) {
+        throw new UnsupportedOperationException("calculateIndependentEdgeLogLikelihoods not implemented in GeneralBeagleImpl");
+    }
+
+    public void projectEdgePartials(final int parentBufferIndex, final int childBufferIndex, final int eigenIndex, final int categoryWeightsIndex, final int stateFrequenciesIndex, final int cumulativeScaleIndex) {
+        throw new UnsupportedOperationException("projectEdgePartials not implemented in GeneralBeagleImpl");
+    }
+
+    public void calculateProjectedEdgeLogLikelihoods(final double edgeLength, final double[] outSumLogLikelihood, final double[] outSumFirstDerivative, final double[] outSumSecondDerivative) {
+        throw new UnsupportedOperationException("calculateProjectedEdgeLogLikelihoods not implemented in GeneralBeagleImpl");
+    }
+
+    public void optimizeEdgeLengths(final int[] parentBufferIndices, final int[] childBufferIndices, final int eigenIndex, final int categoryWeightsIndex, final int stateFrequenciesIndex, final int[] cumulativeScaleIndices, final int count, final double minEdgeLength, final double maxEdgeLength, final double tolerance, final int maxIterations, final double[] inOutEdgeLengths, final double[] outLogLikelihoods) {
+        throw new UnsupportedOperationException("optimizeEdgeLengths not implemented in GeneralBeagleImpl");
+    }
+
     public void getSiteLogLikelihoods(final double[] outLogLikelihoods) {
         throw new UnsupportedOperationException("getSiteLogLikelihoods not implemented in GeneralBeagleImpl");
     }
 
+    public void saveInstance(final String fileName) {
+        throw new UnsupportedOperationException("saveInstance not implemented in GeneralBeagleImpl");
+    }
+
+    public void restoreInstance(final String fileName) {
+        throw new UnsupportedOperationException("restoreInstance not implemented in GeneralBeagleImpl");
+    }
+
+    public void setKernelCounting(final boolean enable) {
+        throw new UnsupportedOperationException("setKernelCounting not implemented in GeneralBeagleImpl");
+    }
+
+    public void getKernelCounters(final double[] outCounters) {
+        throw new UnsupportedOperationException("getKernelCounters not implemented in GeneralBeagleImpl");
+    }
+
+    public void resetKernelCounters() {
+        throw new UnsupportedOperationException("resetKernelCounters not implemented in GeneralBeagleImpl");
+    }
+
 
     public InstanceDetails getDetails() {
         InstanceDetails details = new InstanceDetails();
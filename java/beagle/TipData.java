@@ -0,0 +1,43 @@
+package beagle;
+
+/**
+ * Tip states and partials of one alignment, held once by the library and referenced by
+ * any number of instances through Beagle.setTipData.
+ */
+public class TipData {
+
+    public TipData(int tipCount, int stateCount, int patternCount) {
+        tipData = BeagleJNIWrapper.INSTANCE.createTipData(tipCount, stateCount, patternCount);
+        if (tipData < 0) {
+            throw new BeagleException("createTipData", tipData);
+        }
+    }
+
+    public void setTipStates(int tipIndex, final int[] inStates) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setTipDataStates(tipData, tipIndex, inStates);
+        if (errCode != 0) {
+            throw new BeagleException("setTipDataStates", errCode);
+        }
+    }
+
+    public void setTipPartials(int tipIndex, final double[] inPartials) {
+        int errCode = BeagleJNIWrapper.INSTANCE.setTipDataPartials(tipData, tipIndex, inPartials);
+        if (errCode != 0) {
+            throw new BeagleException("setTipDataPartials", errCode);
+        }
+    }
+
+    public void finalize() throws Throwable {
+        super.finalize();
+        int errCode = BeagleJNIWrapper.INSTANCE.finalizeTipData(tipData);
+        if (errCode != 0) {
+            throw new BeagleException("finalizeTipData", errCode);
+        }
+    }
+
+    int getTipData() {
+        return tipData;
+    }
+
+    private int tipData;
+}
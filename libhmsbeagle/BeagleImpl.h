@@ -38,6 +38,8 @@
 
 namespace beagle {
 
+class TipData;
+
 class BeagleImpl
 {
 public:
@@ -62,12 +64,18 @@ public:
     virtual int setTipStates(int tipIndex,
                              const int* inStates) = 0;
 
+    virtual int setTipStateMasks(int tipIndex,
+                                 const int* inStateMasks) = 0;
+
     virtual int setTipPartials(int tipIndex,
                                const double* inPartials) = 0;
     
     virtual int setPartials(int bufferIndex,
                             const double* inPartials) = 0;
     
+    virtual int setPartialsBuffer(int bufferIndex,
+                                  const double* inPartials) = 0;
+    
     virtual int getPartials(int bufferIndex,
 							int scaleIndex,
                             double* outPartials) = 0;
@@ -77,6 +85,9 @@ public:
                                       const double* inInverseEigenVectors,
                                       const double* inEigenValues) = 0;
     
+    virtual int setRateMatrix(int eigenIndex,
+                              const double* inRateMatrix) = 0;
+    
     virtual int setStateFrequencies(int stateFrequenciesIndex,
                                   const double* inStateFrequencies) = 0;    
     
@@ -114,14 +125,41 @@ public:
                                          const int* secondDerivativeIndices,
                                          const double* edgeLengths,
                                          int count) = 0;
+
+    virtual int setTransitionMatrixCacheSize(int cacheSize) = 0;
+
+    virtual int getTransitionMatrixCacheStatistics(long* outHits,
+                                                   long* outMisses) = 0;
     
     virtual int updatePartials(const int* operations,
                                int operationCount,
                                int cumulativeScalingIndex) = 0;
     
+    virtual int setSparseRateMatrix(int eigenIndex,
+                                    int nonZeroCount,
+                                    const int* rowIndices,
+                                    const int* columnIndices,
+                                    const double* rates) = 0;
+    
+    virtual int updatePartialsByEdgeLengths(int eigenIndex,
+                                            const int* operations,
+                                            int operationCount,
+                                            const double* edgeLengths,
+                                            int cumulativeScalingIndex) = 0;
+
+    virtual int updateMatricesAndPartials(const int* operations,
+                                          int operationCount,
+                                          const int* eigenIndices,
+                                          const double* edgeLengths,
+                                          int cumulativeScalingIndex) = 0;
+    
+    virtual int setDirtyTracking(int enable) = 0;
+
     virtual int waitForPartials(const int* destinationPartials,
                                 int destinationPartialsCount) = 0;
     
+    virtual int setExponentScalers(int enable) = 0;
+
     virtual int accumulateScaleFactors(const int* scalingIndices,
 									   int count,
 									   int cumulativeScalingIndex) = 0;
@@ -144,6 +182,12 @@ public:
                                             const int* scalingFactorsIndices,
                                             int count,
                                             double* outSumLogLikelihood) = 0;
+
+    virtual int calculateRootLogLikelihoodsByOperation(const int* operation,
+                                                       int categoryWeightsIndex,
+                                                       int stateFrequenciesIndex,
+                                                       int cumulativeScaleIndex,
+                                                       double* outSumLogLikelihood) = 0;
     
     virtual int calculateEdgeLogLikelihoods(const int* parentBufferIndices,
                                             const int* childBufferIndices,
@@ -158,10 +202,67 @@ public:
                                             double* outSumFirstDerivative,
                                             double* outSumSecondDerivative) = 0;
     
+    virtual int calculateIndependentEdgeLogLikelihoods(const int* parentBufferIndices,
+                                                       const int* childBufferIndices,
+                                                       const int* probabilityIndices,
+                                                       const int* firstDerivativeIndices,
+                                                       const int* secondDerivativeIndices,
+                                                       const int* categoryWeightsIndices,
+                                                       const int* stateFrequenciesIndices,
+                                                       const int* cumulativeScaleIndices,
+                                                       int count,
+                                                       double* outLogLikelihoods,
+                                                       double* outFirstDerivatives,
+                                                       double* outSecondDerivatives) = 0;
+    
+    virtual int projectEdgePartials(int parentBufferIndex,
+                                    int childBufferIndex,
+                                    int eigenIndex,
+                                    int categoryWeightsIndex,
+                                    int stateFrequenciesIndex,
+                                    int cumulativeScaleIndex) = 0;
+    
+    virtual int calculateProjectedEdgeLogLikelihoods(double edgeLength,
+                                                     double* outSumLogLikelihood,
+                                                     double* outSumFirstDerivative,
+                                                     double* outSumSecondDerivative) = 0;
+    
+    virtual int optimizeEdgeLengths(const int* parentBufferIndices,
+                                    const int* childBufferIndices,
+                                    int eigenIndex,
+                                    int categoryWeightsIndex,
+                                    int stateFrequenciesIndex,
+                                    const int* cumulativeScaleIndices,
+                                    int count,
+                                    double minEdgeLength,
+                                    double maxEdgeLength,
+                                    double tolerance,
+                                    int maxIterations,
+                                    double* inOutEdgeLengths,
+                                    double* outLogLikelihoods) = 0;
+    
     virtual int getSiteLogLikelihoods(double* outLogLikelihoods) = 0;
     
     virtual int getSiteDerivatives(double* outFirstDerivatives,
                                    double* outSecondDerivatives) = 0;
+    
+    virtual int setSiteBuffers(double* outLogLikelihoods,
+                               double* outFirstDerivatives,
+                               double* outSecondDerivatives) = 0;
+    
+    virtual int saveInstance(const char* fileName) = 0;
+    
+    virtual int restoreInstance(const char* fileName) = 0;
+    
+    virtual int cloneInstance(BeagleImpl* sourceInstance) = 0;
+    
+    virtual int setTipData(TipData* tipData) = 0;
+    
+    virtual int setKernelCounting(int enable) = 0;
+    
+    virtual int getKernelCounters(BeagleKernelCounters* outCounters) = 0;
+    
+    virtual int resetKernelCounters() = 0;
 //protected:
     int resourceNumber;
 };
@@ -91,10 +91,10 @@ inline V_Real pick_single(V_Real x) {
 #define AVX_PREFETCH_MATRIX(src_m1, dest_vu_m1) \
 	const double *m1 = (src_m1); \
 	for (int i = 0; i < OFFSET; i++, m1++) { \
-		dest_vu_m1[i][0].x[0] = m1[0*OFFSET]; \
-		dest_vu_m1[i][0].x[1] = m1[1*OFFSET]; \
-		dest_vu_m1[i][1].x[0] = m1[2*OFFSET]; \
-		dest_vu_m1[i][1].x[1] = m1[3*OFFSET]; \
+		dest_vu_m1[i].x[0] = m1[0*OFFSET]; \
+		dest_vu_m1[i].x[1] = m1[1*OFFSET]; \
+		dest_vu_m1[i].x[2] = m1[2*OFFSET]; \
+		dest_vu_m1[i].x[3] = m1[3*OFFSET]; \
 	}
 
 namespace beagle {
@@ -119,13 +119,17 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesStates(float* des
                                      const int* states_q,
                                      const float* matrices_q,
                                      const int* states_r,
-                                     const float* matrices_r) {
+                                     const float* matrices_r,
+                                     int startPattern,
+                                     int endPattern) {
 
 									 BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesStates(destP,
                                      states_q,
                                      matrices_q,
                                      states_r,
-                                     matrices_r);
+                                     matrices_r,
+                                     startPattern,
+                                     endPattern);
 
 									 }
 
@@ -135,31 +139,16 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesStates(double* d
                                      const int* states_q,
                                      const double* matrices_q,
                                      const int* states_r,
-                                     const double* matrices_r) {
-
-	VecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
-
-    int w = 0;
-	V_Real *destPvec = (V_Real *)destP;
-
-    for (int l = 0; l < kCategoryCount; l++) {
-
-    	//AVX_PREFETCH_MATRICES(matrices_q + w, matrices_r + w, vu_mq, vu_mr);
-
-        for (int k = 0; k < kPatternCount; k++) {
-
-            const int state_q = states_q[k];
-            const int state_r = states_r[k];
-
-            *destPvec++ = VEC_MULT(vu_mq[state_q][0].vx, vu_mr[state_r][0].vx);
-            *destPvec++ = VEC_MULT(vu_mq[state_q][1].vx, vu_mr[state_r][1].vx);
-
-        }
-
-        w += OFFSET*4;
-        if (kExtraPatterns)
-        	destPvec += kExtraPatterns * 2;
-    }
+                                     const double* matrices_r,
+                                     int startPattern,
+                                     int endPattern) {
+	BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesStates(destP,
+                                     states_q,
+                                     matrices_q,
+                                     states_r,
+                                     matrices_r,
+                                     startPattern,
+                                     endPattern);
 }
 
 /*
@@ -171,13 +160,17 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesPartials(float* d
                                        const int* states_q,
                                        const float* matrices_q,
                                        const float* partials_r,
-                                       const float* matrices_r) {
+                                       const float* matrices_r,
+                                       int startPattern,
+                                       int endPattern) {
 	BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesPartials(
 									   destP,
 									   states_q,
 									   matrices_q,
 									   partials_r,
-									   matrices_r);
+									   matrices_r,
+									   startPattern,
+									   endPattern);
 }
 
 
@@ -187,48 +180,17 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesPartials(double*
                                        const int* states_q,
                                        const double* matrices_q,
                                        const double* partials_r,
-                                       const double* matrices_r) {
-
-    int v = 0;
-    int w = 0;
-
-    fprintf(stderr, "Not yet implemented!\n");
-    exit(-1);
-
- 	VecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
-	V_Real *destPvec = (V_Real *)destP;
-	V_Real destr_01, destr_23;
-
-    for (int l = 0; l < kCategoryCount; l++) {
-
-    	//AVX_PREFETCH_MATRICES(matrices_q + w, matrices_r + w, vu_mq, vu_mr);
-
-        for (int k = 0; k < kPatternCount; k++) {
-
-            const int state_q = states_q[k];
-            V_Real vp0, vp1, vp2, vp3;
-            AVX_PREFETCH_PARTIALS(vp,partials_r,v);
-
-			destr_01 = VEC_MULT(vp0, vu_mr[0][0].vx);
-			destr_01 = VEC_MADD(vp1, vu_mr[1][0].vx, destr_01);
-			destr_01 = VEC_MADD(vp2, vu_mr[2][0].vx, destr_01);
-			destr_01 = VEC_MADD(vp3, vu_mr[3][0].vx, destr_01);
-			destr_23 = VEC_MULT(vp0, vu_mr[0][1].vx);
-			destr_23 = VEC_MADD(vp1, vu_mr[1][1].vx, destr_23);
-			destr_23 = VEC_MADD(vp2, vu_mr[2][1].vx, destr_23);
-			destr_23 = VEC_MADD(vp3, vu_mr[3][1].vx, destr_23);
-
-            *destPvec++ = VEC_MULT(vu_mq[state_q][0].vx, destr_01);
-            *destPvec++ = VEC_MULT(vu_mq[state_q][1].vx, destr_23);
-
-            v += 4;
-        }
-        w += OFFSET*4;
-        if (kExtraPatterns) {
-        	destPvec += kExtraPatterns * 2;
-        	v += kExtraPatterns * 4;
-        }
-    }
+                                       const double* matrices_r,
+                                       int startPattern,
+                                       int endPattern) {
+	BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesPartials(
+									   destP,
+									   states_q,
+									   matrices_q,
+									   partials_r,
+									   matrices_r,
+									   startPattern,
+									   endPattern);
 }
 
 BEAGLE_CPU_4_AVX_TEMPLATE
@@ -237,14 +199,18 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesPartialsFixedScal
                                 const float* __restrict matrices1,
                                 const float* __restrict partials2,
                                 const float* __restrict matrices2,
-                                const float* __restrict scaleFactors) {
+                                const float* __restrict scaleFactors,
+                                int startPattern,
+                                int endPattern) {
 	BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcStatesPartialsFixedScaling(
 									   destP,
 									   states1,
 									   matrices1,
 									   partials2,
 									   matrices2,
-									   scaleFactors);
+									   scaleFactors,
+									   startPattern,
+									   endPattern);
 }
 
 BEAGLE_CPU_4_AVX_TEMPLATE
@@ -253,48 +219,18 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesPartialsFixedSca
                                 const double* __restrict matrices_q,
                                 const double* __restrict partials_r,
                                 const double* __restrict matrices_r,
-                                const double* __restrict scaleFactors) {
-
-
-    int v = 0;
-    int w = 0;
-
- 	VecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
-	V_Real *destPvec = (V_Real *)destP;
-	V_Real destr_01, destr_23;
-
-    for (int l = 0; l < kCategoryCount; l++) {
-
-    	//AVX_PREFETCH_MATRICES(matrices_q + w, matrices_r + w, vu_mq, vu_mr);
-
-        for (int k = 0; k < kPatternCount; k++) {
-
-        	const V_Real scaleFactor = VEC_SPLAT(scaleFactors[k]);
-
-            const int state_q = states_q[k];
-            V_Real vp0, vp1, vp2, vp3;
-            AVX_PREFETCH_PARTIALS(vp,partials_r,v);
-
-			destr_01 = VEC_MULT(vp0, vu_mr[0][0].vx);
-			destr_01 = VEC_MADD(vp1, vu_mr[1][0].vx, destr_01);
-			destr_01 = VEC_MADD(vp2, vu_mr[2][0].vx, destr_01);
-			destr_01 = VEC_MADD(vp3, vu_mr[3][0].vx, destr_01);
-			destr_23 = VEC_MULT(vp0, vu_mr[0][1].vx);
-			destr_23 = VEC_MADD(vp1, vu_mr[1][1].vx, destr_23);
-			destr_23 = VEC_MADD(vp2, vu_mr[2][1].vx, destr_23);
-			destr_23 = VEC_MADD(vp3, vu_mr[3][1].vx, destr_23);
-
-            *destPvec++ = VEC_DIV(VEC_MULT(vu_mq[state_q][0].vx, destr_01), scaleFactor);
-            *destPvec++ = VEC_DIV(VEC_MULT(vu_mq[state_q][1].vx, destr_23), scaleFactor);
-
-            v += 4;
-        }
-        w += OFFSET*4;
-        if (kExtraPatterns) {
-        	destPvec += kExtraPatterns * 2;
-        	v += kExtraPatterns * 4;
-        }
-    }
+                                const double* __restrict scaleFactors,
+                                int startPattern,
+                                int endPattern) {
+	BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcStatesPartialsFixedScaling(
+									   destP,
+									   states_q,
+									   matrices_q,
+									   partials_r,
+									   matrices_r,
+									   scaleFactors,
+									   startPattern,
+									   endPattern);
 }
 
 BEAGLE_CPU_4_AVX_TEMPLATE
@@ -302,13 +238,17 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcPartialsPartials(float*
                                                   const float*  partials_q,
                                                   const float*  matrices_q,
                                                   const float*  partials_r,
-                                                  const float*  matrices_r) {
+                                                  const float*  matrices_r,
+                                                  int startPattern,
+                                                  int endPattern) {
 
 	BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcPartialsPartials(destP,
                                                   partials_q,
                                                   matrices_q,
                                                   partials_r,
-                                                  matrices_r);
+                                                  matrices_r,
+                                                  startPattern,
+                                                  endPattern);
 }
 
 BEAGLE_CPU_4_AVX_TEMPLATE
@@ -316,7 +256,9 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcPartialsPartials(doubl
                                                   const double*  partials_q,
                                                   const double*  matrices_q,
                                                   const double*  partials_r,
-                                                  const double*  matrices_r) {
+                                                  const double*  matrices_r,
+                                                  int startPattern,
+                                                  int endPattern) {
 
     int v = 0;
     int w = 0;
@@ -331,7 +273,11 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcPartialsPartials(doubl
 //		fprintf(stderr, "%d ->  %d %d\n", i, t1, t2);
 //	}
 
-    for (int l = 0; l < kCategoryCount; l++) {
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        w = l*4*OFFSET;
+        v = (l*kPaddedPatternCount + startPattern)*4;
+        double* destPu = destP + (l*kPaddedPatternCount + startPattern)*4;
 
 		/* Load transition-probability matrices into vectors */
     	AVX_PREFETCH_MATRICES(matrices_q + w, matrices_r + w, vu_mq, vu_mr);
@@ -348,7 +294,7 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcPartialsPartials(doubl
 //
 //    	fprintf(stderr,"APM\n");
 
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
             
 #           if 1 && !defined(_WIN32)
             __builtin_prefetch (&partials_q[v+64]);
@@ -399,8 +345,8 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcPartialsPartials(doubl
 //        	*destPvec = VEC_MULT(destq_0123, destr_0123); // Single store
 //        	destPvec += 1;
 
-        	VEC_STORE(destP, VEC_MULT(destq_0123, destr_0123));
-        	destP += 4;
+        	VEC_STORE(destPu, VEC_MULT(destq_0123, destr_0123));
+        	destPu += 4;
 
 //        	for (int i = 0; i < 4; ++i) {
 //        		fprintf(stderr, " %5.3e", ((double*)destPvec)[i]);
@@ -410,11 +356,6 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcPartialsPartials(doubl
 
             v += 4;
         }
-        w += OFFSET*4;
-        if (kExtraPatterns) {
-        	destPvec += kExtraPatterns * 2;
-        	v += kExtraPatterns * 4;
-        }
     }
 }
 
@@ -424,7 +365,9 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcPartialsPartialsFixedSc
                                         const float*  child0TransMat,
                                         const float*  child1Partials,
                                         const float*  child1TransMat,
-                                        const float*  scaleFactors) {
+                                        const float*  scaleFactors,
+                                        int startPattern,
+                                        int endPattern) {
 
 	BeagleCPU4StateImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcPartialsPartialsFixedScaling(
 			destP,
@@ -432,7 +375,9 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_FLOAT>::calcPartialsPartialsFixedSc
 			child0TransMat,
 			child1Partials,
 			child1TransMat,
-			scaleFactors);
+			scaleFactors,
+			startPattern,
+			endPattern);
 }
 
 BEAGLE_CPU_4_AVX_TEMPLATE
@@ -441,7 +386,9 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcPartialsPartialsFixedS
 		                                                        const double* matrices_q,
 		                                                        const double* partials_r,
 		                                                        const double* matrices_r,
-		                                                        const double* scaleFactors) {
+		                                                        const double* scaleFactors,
+		                                                        int startPattern,
+		                                                        int endPattern) {
 
     int v = 0;
     int w = 0;
@@ -450,12 +397,16 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcPartialsPartialsFixedS
  	VecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
 	V_Real *destPvec = (V_Real *)destP;
 
-	for (int l = 0; l < kCategoryCount; l++) {
+	for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        w = l*4*OFFSET;
+        v = (l*kPaddedPatternCount + startPattern)*4;
+        destPvec = (V_Real *)destP + (l*kPaddedPatternCount + startPattern)*2;
 
 		/* Load transition-probability matrices into vectors */
     	//AVX_PREFETCH_MATRICES(matrices_q + w, matrices_r + w, vu_mq, vu_mr);
 
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
 
 #           if 1 && !defined(_WIN32)
             __builtin_prefetch (&partials_q[v+64]);
@@ -499,11 +450,6 @@ void BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcPartialsPartialsFixedS
             destPvec += 2;
             v += 4;
         }
-        w += OFFSET*4;
-        if (kExtraPatterns) {
-        	destPvec += kExtraPatterns * 2;
-        	v += kExtraPatterns * 4;
-        }
     }
 }
 
@@ -583,72 +529,55 @@ int BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcEdgeLogLikelihoods(cons
 
         const int* statesChild = gTipStates[childIndex];
 
-        int w = 0;
-        V_Real *vcl_r = (V_Real *)cl_r;
-        for(int l = 0; l < kCategoryCount; l++) {
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            const int w = l*4*OFFSET;
+            const double* pr = cl_r + l*kPaddedPatternCount*4;
+            double* pp = cl_p;
 
-            VecUnion vu_m[OFFSET][2];
+            VecUnion vu_m[OFFSET];
             AVX_PREFETCH_MATRIX(transMatrix + w, vu_m)
 
-           V_Real *vcl_p = (V_Real *)cl_p;
-
-           for(int k = 0; k < kPatternCount; k++) {
-
-                const int stateChild = statesChild[k];
-                V_Real vwt = VEC_SPLAT(wt[l]);
+            V_Real vwt = VEC_SPLAT(wt[l]);
 
-                V_Real wtdPartials = VEC_MULT(*vcl_r++, vwt);
-                *vcl_p++ = VEC_MADD(vu_m[stateChild][0].vx, wtdPartials, *vcl_p);
-
-                wtdPartials = VEC_MULT(*vcl_r++, vwt);
-                *vcl_p++ = VEC_MADD(vu_m[stateChild][1].vx, wtdPartials, *vcl_p);
+            for(int k = 0; k < kPatternCount; k++) {
+                V_Real wtdPartials = VEC_MULT(VEC_LOAD(pr), vwt);
+                VEC_STORE(pp, VEC_MADD(vu_m[statesChild[k]].vx, wtdPartials, VEC_LOAD(pp)));
+                pr += 4;
+                pp += 4;
             }
-           w += OFFSET*4;
-           vcl_r += 2 * kExtraPatterns;
         }
     } else { // Integrate against a partial at the child
 
         const double* cl_q = gPartials[childIndex];
-        V_Real * vcl_r = (V_Real *)cl_r;
-        int v = 0;
-        int w = 0;
-
-        for(int l = 0; l < kCategoryCount; l++) {
-
-            V_Real * vcl_p = (V_Real *)cl_p;
-
-            VecUnion vu_m[OFFSET][2];
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            const int w = l*4*OFFSET;
+            const double* pr = cl_r + l*kPaddedPatternCount*4;
+            int v = l*kPaddedPatternCount*4;
+            double* pp = cl_p;
+
+            VecUnion vu_m[OFFSET];
             AVX_PREFETCH_MATRIX(transMatrix + w, vu_m)
 
-            for(int k = 0; k < kPatternCount; k++) {
-                V_Real vclp_01, vclp_23;
-                V_Real vwt = VEC_SPLAT(wt[l]);
+            V_Real vwt = VEC_SPLAT(wt[l]);
 
+            for(int k = 0; k < kPatternCount; k++) {
                 V_Real vcl_q0, vcl_q1, vcl_q2, vcl_q3;
                 AVX_PREFETCH_PARTIALS(vcl_q,cl_q,v);
 
-                vclp_01 = VEC_MULT(vcl_q0, vu_m[0][0].vx);
-                vclp_01 = VEC_MADD(vcl_q1, vu_m[1][0].vx, vclp_01);
-                vclp_01 = VEC_MADD(vcl_q2, vu_m[2][0].vx, vclp_01);
-                vclp_01 = VEC_MADD(vcl_q3, vu_m[3][0].vx, vclp_01);
-                vclp_23 = VEC_MULT(vcl_q0, vu_m[0][1].vx);
-                vclp_23 = VEC_MADD(vcl_q1, vu_m[1][1].vx, vclp_23);
-                vclp_23 = VEC_MADD(vcl_q2, vu_m[2][1].vx, vclp_23);
-                vclp_23 = VEC_MADD(vcl_q3, vu_m[3][1].vx, vclp_23);
-                vclp_01 = VEC_MULT(vclp_01, vwt);
-                vclp_23 = VEC_MULT(vclp_23, vwt);
+                V_Real vclp_0123 = VEC_MULT(vcl_q0, vu_m[0].vx);
+                vclp_0123 = VEC_MADD(vcl_q1, vu_m[1].vx, vclp_0123);
+                vclp_0123 = VEC_MADD(vcl_q2, vu_m[2].vx, vclp_0123);
+                vclp_0123 = VEC_MADD(vcl_q3, vu_m[3].vx, vclp_0123);
+                vclp_0123 = VEC_MULT(vclp_0123, vwt);
 
-                *vcl_p++ = VEC_MADD(vclp_01, *vcl_r++, *vcl_p);
-                *vcl_p++ = VEC_MADD(vclp_23, *vcl_r++, *vcl_p);
+                VEC_STORE(pp, VEC_MADD(vclp_0123, VEC_LOAD(pr), VEC_LOAD(pp)));
+                pr += 4;
+                pp += 4;
 
                 v += 4;
             }
-            w += 4*OFFSET;
-            if (kExtraPatterns) {
-                vcl_r += 2 * kExtraPatterns;
-                v += 4 * kExtraPatterns;
-            }
-
         }
     }
 
@@ -665,15 +594,12 @@ int BeagleCPU4StateAVXImpl<BEAGLE_CPU_4_AVX_DOUBLE>::calcEdgeLogLikelihoods(cons
 
 
     if (scalingFactorsIndex != BEAGLE_OP_NONE) {
-        const double* scalingFactors = gScaleBuffers[scalingFactorsIndex];
+        const double* scalingFactors = getLogScaleFactors(scalingFactorsIndex);
         for(int k=0; k < kPatternCount; k++)
             outLogLikelihoodsTmp[k] += scalingFactors[k];
     }
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -745,6 +671,11 @@ BeagleImpl* BeagleCPU4StateAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImp
                                              long requirementFlags,
                                              int* errorCode) {
 
+    // Vectorized and 4-state kernels only index category-major partials
+    if (requirementFlags & BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR)
+        return NULL;
+    preferenceFlags &= ~BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR;
+
     if (stateCount != 4) {
         return NULL;
     }
@@ -783,7 +714,7 @@ const char* BeagleCPU4StateAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName()
 template <>
 const long BeagleCPU4StateAVXImplFactory<double>::getFlags() {
     return BEAGLE_FLAG_COMPUTATION_SYNCH |
-           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
            BEAGLE_FLAG_THREADING_NONE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_AVX |
@@ -791,13 +722,15 @@ const long BeagleCPU4StateAVXImplFactory<double>::getFlags() {
            BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
            BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL|
            BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_MEMORY_MAPPED |
+           BEAGLE_FLAG_TRAVERSAL_BLOCKED |
            BEAGLE_FLAG_FRAMEWORK_CPU;           
 }
 
 template <>
 const long BeagleCPU4StateAVXImplFactory<float>::getFlags() {
     return BEAGLE_FLAG_COMPUTATION_SYNCH |
-           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
            BEAGLE_FLAG_THREADING_NONE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_AVX |
@@ -805,6 +738,8 @@ const long BeagleCPU4StateAVXImplFactory<float>::getFlags() {
            BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
            BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
            BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_MEMORY_MAPPED |
+           BEAGLE_FLAG_TRAVERSAL_BLOCKED |
            BEAGLE_FLAG_FRAMEWORK_CPU;           
 }
 
@@ -53,10 +53,17 @@ protected:
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gTransitionMatrices;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kPatternCount;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kPaddedPatternCount;
+	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kPartialsCategoryStride;
+	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kPartialsPatternStride;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kExtraPatterns;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kStateCount;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gTipStates;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kCategoryCount;
+	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::kActiveCategoryCount;
+	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gActiveCategories;
+	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::sumActivePatterns;
+	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getLogScaleFactors;
+	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getLogScaleFactor;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gScaleBuffers;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gStateFrequencies;
 	using BeagleCPUImpl<BEAGLE_CPU_GENERIC>::gCategoryWeights;
@@ -74,19 +81,25 @@ public:
                                     const int* states1,
                                     const REALTYPE* matrices1,
                                     const int* states2,
-                                    const REALTYPE* matrices2);
+                                    const REALTYPE* matrices2,
+                                    int startPattern,
+                                    int endPattern);
     
     virtual void calcStatesPartials(REALTYPE* destP,
                                     const int* states1,
                                     const REALTYPE* matrices1,
                                     const REALTYPE* partials2,
-                                    const REALTYPE* matrices2);
+                                    const REALTYPE* matrices2,
+                                    int startPattern,
+                                    int endPattern);
     
     virtual void calcPartialsPartials(REALTYPE* destP,
                                     const REALTYPE* partials1,
                                     const REALTYPE* matrices1,
                                     const REALTYPE* partials2,
-                                    const REALTYPE* matrices2);
+                                    const REALTYPE* matrices2,
+                                    int startPattern,
+                                    int endPattern);
     
     virtual int calcRootLogLikelihoods(const int bufferIndex,
                                         const int categoryWeightsIndex,
@@ -114,21 +127,27 @@ public:
                                         const REALTYPE *child0TransMat,
                                            const int *child1States,
                                         const REALTYPE *child1TransMat,
-                                        const REALTYPE *scaleFactors);
+                                        const REALTYPE *scaleFactors,
+                                        int startPattern,
+                                        int endPattern);
 
     virtual void calcStatesPartialsFixedScaling(REALTYPE *destP,
                                              const int *child0States,
                                           const REALTYPE *child0TransMat,
                                           const REALTYPE *child1Partials,
                                           const REALTYPE *child1TransMat,
-                                          const REALTYPE *scaleFactors);
+                                          const REALTYPE *scaleFactors,
+                                          int startPattern,
+                                          int endPattern);
 
     virtual void calcPartialsPartialsFixedScaling(REALTYPE *destP,
                                             const REALTYPE *child0Partials,
                                             const REALTYPE *child0TransMat,
                                             const REALTYPE *child1Partials,
                                             const REALTYPE *child1TransMat,
-                                            const REALTYPE *scaleFactors);
+                                            const REALTYPE *scaleFactors,
+                                            int startPattern,
+                                            int endPattern);
     
     virtual void calcPartialsPartialsAutoScaling(REALTYPE *destP,
                                                   const REALTYPE *child0Partials,
@@ -146,7 +165,9 @@ public:
     virtual void rescalePartials(REALTYPE *destP,
     		                     REALTYPE *scaleFactors,
                                  REALTYPE *cumulativeScaleFactors,
-                                 const int  fillWithOnes);
+                                 const int  fillWithOnes,
+                                 int startPattern,
+                                 int endPattern);
 
 };
 
@@ -155,14 +155,17 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesStates(REALTYPE* destP,
                                      const int* states1,
                                      const REALTYPE* matrices1,
                                      const int* states2,
-                                     const REALTYPE* matrices2) {
+                                     const REALTYPE* matrices2,
+                                     int startPattern,
+                                     int endPattern) {
 
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*4*kPaddedPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int v = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
         int w = l*4*OFFSET;
 
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
 
             const int state1 = states1[k];
             const int state2 = states2[k];
@@ -175,7 +178,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesStates(REALTYPE* destP,
                            matrices2[w + OFFSET*2 + state2];
             destP[v + 3] = matrices1[w + OFFSET*3 + state1] * 
                            matrices2[w + OFFSET*3 + state2];
-           v += 4;
+           v += kPartialsPatternStride;
         }
     }
 }
@@ -186,14 +189,17 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesStatesFixedScaling(REALT
                                      const REALTYPE* matrices1,
                                      const int* states2,
                                      const REALTYPE* matrices2,
-                                     const REALTYPE* scaleFactors) {
+                                     const REALTYPE* scaleFactors,
+                                     int startPattern,
+                                     int endPattern) {
     
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*4*kPaddedPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int v = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
         int w = l*4*OFFSET;
         
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
             
             const int state1 = states1[k];
             const int state2 = states2[k];
@@ -207,7 +213,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesStatesFixedScaling(REALT
                            matrices2[w + OFFSET*2 + state2] / scaleFactor;
             destP[v + 3] = matrices1[w + OFFSET*3 + state1] * 
                            matrices2[w + OFFSET*3 + state2] / scaleFactor;
-            v += 4;
+            v += kPartialsPatternStride;
         }
     }
 }
@@ -220,16 +226,19 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesPartials(REALTYPE* destP
                                        const int* states1,
                                        const REALTYPE* matrices1,
                                        const REALTYPE* partials2,
-                                       const REALTYPE* matrices2) {
+                                       const REALTYPE* matrices2,
+                                       int startPattern,
+                                       int endPattern) {
 
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int u = l*4*kPaddedPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int u = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
         int w = l*4*OFFSET;
                 
         PREFETCH_MATRIX(2,matrices2,w);
         
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
             
             const int state1 = states1[k];
             
@@ -242,7 +251,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesPartials(REALTYPE* destP
             destP[u + 2] = matrices1[w + OFFSET*2 + state1] * sum22;
             destP[u + 3] = matrices1[w + OFFSET*3 + state1] * sum23;
             
-            u += 4;
+            u += kPartialsPatternStride;
         }
     }
 }
@@ -253,16 +262,19 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesPartialsFixedScaling(REA
                                        const REALTYPE* matrices1,
                                        const REALTYPE* partials2,
                                        const REALTYPE* matrices2,
-                                       const REALTYPE* scaleFactors) {
+                                       const REALTYPE* scaleFactors,
+                                       int startPattern,
+                                       int endPattern) {
     
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int u = l*4*kPaddedPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int u = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
         int w = l*4*OFFSET;
                 
         PREFETCH_MATRIX(2,matrices2,w);
         
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
             
             const int state1 = states1[k];
             const REALTYPE scaleFactor = scaleFactors[k];
@@ -276,7 +288,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcStatesPartialsFixedScaling(REA
             destP[u + 2] = matrices1[w + OFFSET*2 + state1] * sum22 / scaleFactor;
             destP[u + 3] = matrices1[w + OFFSET*3 + state1] * sum23 / scaleFactor;
             
-            u += 4;            
+            u += kPartialsPatternStride;
         }
     }   
 }
@@ -286,17 +298,20 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartials(REALTYPE* des
                                          const REALTYPE* partials1,
                                          const REALTYPE* matrices1,
                                          const REALTYPE* partials2,
-                                         const REALTYPE* matrices2) {
+                                         const REALTYPE* matrices2,
+                                         int startPattern,
+                                         int endPattern) {
     
  
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int u = l*4*kPaddedPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int u = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
         int w = l*4*OFFSET;
                 
         PREFETCH_MATRIX(1,matrices1,w);                
         PREFETCH_MATRIX(2,matrices2,w);
-        for (int k = 0; k < kPatternCount; k++) {                   
+        for (int k = startPattern; k < endPattern; k++) {                   
             PREFETCH_PARTIALS(1,partials1,u);
             PREFETCH_PARTIALS(2,partials2,u);
             
@@ -309,7 +324,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartials(REALTYPE* des
             destP[u + 2] = sum12 * sum22;
             destP[u + 3] = sum13 * sum23;
 
-            u += 4;
+            u += kPartialsPatternStride;
 
         }
     }
@@ -324,9 +339,10 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsAutoScaling(RE
                                                                     int* activateScaling) {
     
     
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int u = l*4*kPaddedPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int u = l*kPartialsCategoryStride;
         int w = l*4*OFFSET;
         
         PREFETCH_MATRIX(1,matrices1,w);                
@@ -363,7 +379,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsAutoScaling(RE
                 }
             }
             
-            u += 4;
+            u += kPartialsPatternStride;
             
         }
     }
@@ -376,17 +392,20 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsFixedScaling(R
                                          const REALTYPE* matrices1,
                                          const REALTYPE* partials2,
                                          const REALTYPE* matrices2,
-                                         const REALTYPE* scaleFactors) {
+                                         const REALTYPE* scaleFactors,
+                                         int startPattern,
+                                         int endPattern) {
     
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int u = l*4*kPaddedPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int u = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
         int w = l*4*OFFSET;
         
         PREFETCH_MATRIX(1,matrices1,w);
         PREFETCH_MATRIX(2,matrices2,w);
         
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
                         
             // Prefetch scale factor
             const REALTYPE scaleFactor = scaleFactors[k];
@@ -403,7 +422,7 @@ void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsFixedScaling(R
             destP[u + 2] = sum12 * sum22 / scaleFactor;
             destP[u + 3] = sum13 * sum23 / scaleFactor;
             
-            u += 4;
+            u += kPartialsPatternStride;
         }
     }    
 }
@@ -436,16 +455,13 @@ int inline BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::integrateOutStatesAndScale(c
     }        
 
     if (scalingFactorsIndex != BEAGLE_OP_NONE) {
-        const REALTYPE* scalingFactors = gScaleBuffers[scalingFactorsIndex];
+        const REALTYPE* scalingFactors = getLogScaleFactors(scalingFactorsIndex);
         for(int k=0; k < kPatternCount; k++) {
             outLogLikelihoodsTmp[k] += scalingFactors[k];
         }
     }
     
-    *outSumLogLikelihood = 0.0;    
-    for(int k=0; k < kPatternCount; k++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[k] * gPatternWeights[k];
-    }    
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
     
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -462,40 +478,60 @@ BEAGLE_CPU_TEMPLATE
 void BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::rescalePartials(REALTYPE* destP,
 		REALTYPE* scaleFactors,
 		REALTYPE* cumulativeScaleFactors,
-        const int  fillWithOnes) {
+        const int  fillWithOnes,
+        int startPattern,
+        int endPattern) {
 
 	bool useLogScalars = kFlags & BEAGLE_FLAG_SCALERS_LOG;
 
-    for (int k = 0; k < kPatternCount; k++) {
+    // pattern-major partials of a pattern are one run over all categories
+    const bool contiguousPattern = (kPartialsCategoryStride == 4 && kActiveCategoryCount == kCategoryCount);
+    const int runLength = 4 * kCategoryCount;
+
+    for (int k = startPattern; k < endPattern; k++) {
     	REALTYPE max = 0;    	
-        const int patternOffset = k * 4;
-        for (int l = 0; l < kCategoryCount; l++) {
-            int offset = l * kPaddedPatternCount * 4 + patternOffset;
+        const int patternOffset = k * kPartialsPatternStride;
+        if (contiguousPattern) {
+            const REALTYPE* run = destP + patternOffset;
+            for (int i = 0; i < runLength; i++)
+                max = FAST_MAX(max, run[i]);
+        } else {
+            for (int a = 0; a < kActiveCategoryCount; a++) {
+                const int l = gActiveCategories[a];
+                int offset = l * kPartialsCategoryStride + patternOffset;
 
 #ifdef BEAGLE_TEST_OPTIMIZATION
-            REALTYPE max01 = FAST_MAX(destP[offset + 0], destP[offset + 1]);
-            REALTYPE max23 = FAST_MAX(destP[offset + 2], destP[offset + 3]);
-            max = FAST_MAX(max, max01);
-            max = FAST_MAX(max, max23);
+                REALTYPE max01 = FAST_MAX(destP[offset + 0], destP[offset + 1]);
+                REALTYPE max23 = FAST_MAX(destP[offset + 2], destP[offset + 3]);
+                max = FAST_MAX(max, max01);
+                max = FAST_MAX(max, max23);
 #else
-			#pragma unroll
-            for (int i = 0; i < 4; i++) {
-                if(destP[offset] > max)
-                    max = destP[offset];
-                offset++;
-            }
+                #pragma unroll
+                for (int i = 0; i < 4; i++) {
+                    if(destP[offset] > max)
+                        max = destP[offset];
+                    offset++;
+                }
 #endif
+            }
         }
 
         if (max == 0)
             max = REALTYPE(1.0);
 
         REALTYPE oneOverMax = REALTYPE(1.0) / max;
-        for (int l = 0; l < kCategoryCount; l++) {
-            int offset = l * kPaddedPatternCount * 4 + patternOffset;
-			#pragma unroll
-            for (int i = 0; i < 4; i++)
-                destP[offset++] *= oneOverMax;
+        if (contiguousPattern) {
+            REALTYPE* run = destP + patternOffset;
+            for (int i = 0; i < runLength; i++)
+                run[i] *= oneOverMax;
+        } else {
+            for (int a = 0; a < kActiveCategoryCount; a++) {
+                const int l = gActiveCategories[a];
+                int offset = l * kPartialsCategoryStride + patternOffset;
+                #pragma unroll
+                for (int i = 0; i < 4; i++)
+                    destP[offset++] *= oneOverMax;
+            }
         }
 
         if (useLogScalars) {
@@ -533,9 +569,10 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int pa
     if (childIndex < kTipCount && gTipStates[childIndex]) { // Integrate against a state at the child
       
         const int* statesChild = gTipStates[childIndex];    
-        int v = 0; // Index for parent partials
-        int w = 0;
-        for(int l = 0; l < kCategoryCount; l++) {
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            int v = l*kPartialsCategoryStride; // Index for parent partials
+            const int w = l*4*OFFSET;
             int u = 0; // Index in resulting product-partials (summed over categories)
             const REALTYPE weight = wt[l];
             for(int k = 0; k < kPatternCount; k++) {
@@ -548,25 +585,18 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int pa
                 integrationTmp[u + 3] += transMatrix[w + OFFSET*3 + stateChild] * partialsParent[v + 3] * weight;
                 
                 u += 4;
-                v += 4;                
+                v += kPartialsPatternStride;
             }
-            w += OFFSET*4;
-            if (kExtraPatterns)
-            	v += 4 * kExtraPatterns;
         }
         
     } else { // Integrate against a partial at the child
         
         const REALTYPE* partialsChild = gPartials[childIndex];
-		#if 0//
-        int v = 0;
-		#endif
-        int w = 0;
-        for(int l = 0; l < kCategoryCount; l++) {            
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
             int u = 0;
-			#if 1//
-			int v = l*kPaddedPatternCount*4;
-			#endif
+			int v = l*kPartialsCategoryStride;
+            const int w = l*4*OFFSET;
             const REALTYPE weight = wt[l];
             
             PREFETCH_MATRIX(1,transMatrix,w);
@@ -585,13 +615,8 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int pa
                 integrationTmp[u + 3] += sum13 * partialsParent[v + 3] * weight;
                 
                 u += 4;
-                v += 4;
+                v += kPartialsPatternStride;
             } 
-            w += OFFSET*4;
-			#if 0//
-            if (kExtraPatterns)
-            	v += 4 * kExtraPatterns;
-			#endif//
         }
     }
 
@@ -609,18 +634,45 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoods(const int bu
     assert(rootPartials);
     const REALTYPE* wt = gCategoryWeights[categoryWeightsIndex];
     
+    if (kPartialsCategoryStride == 4 && kActiveCategoryCount == kCategoryCount) {
+        // pattern-major: the categories of a pattern are read in one run
+        int u = 0;
+        int v = 0;
+        for (int k = 0; k < kPatternCount; k++) {
+            REALTYPE sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+            for (int l = 0; l < kCategoryCount; l++) {
+                const REALTYPE wtl = wt[l];
+                sum0 += rootPartials[v    ] * wtl;
+                sum1 += rootPartials[v + 1] * wtl;
+                sum2 += rootPartials[v + 2] * wtl;
+                sum3 += rootPartials[v + 3] * wtl;
+                v += 4;
+            }
+            integrationTmp[u    ] = sum0;
+            integrationTmp[u + 1] = sum1;
+            integrationTmp[u + 2] = sum2;
+            integrationTmp[u + 3] = sum3;
+            u += 4;
+        }
+        return integrateOutStatesAndScale(integrationTmp, stateFrequenciesIndex, scalingFactorsIndex, outSumLogLikelihood);
+    }
+
+    const int firstCategory = gActiveCategories[0];
     int u = 0;
-    int v = 0;
-    const REALTYPE wt0 = wt[0];
+    int v = firstCategory*kPartialsCategoryStride;
+    const REALTYPE wt0 = wt[firstCategory];
     for (int k = 0; k < kPatternCount; k++) {
-        integrationTmp[v    ] = rootPartials[v    ] * wt0;
-        integrationTmp[v + 1] = rootPartials[v + 1] * wt0;
-        integrationTmp[v + 2] = rootPartials[v + 2] * wt0;
-        integrationTmp[v + 3] = rootPartials[v + 3] * wt0;
-        v += 4;
+        integrationTmp[u    ] = rootPartials[v    ] * wt0;
+        integrationTmp[u + 1] = rootPartials[v + 1] * wt0;
+        integrationTmp[u + 2] = rootPartials[v + 2] * wt0;
+        integrationTmp[u + 3] = rootPartials[v + 3] * wt0;
+        u += 4;
+        v += kPartialsPatternStride;
     }
-    for (int l = 1; l < kCategoryCount; l++) {
+    for (int a = 1; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
         u = 0;
+        v = l*kPartialsCategoryStride;
         const REALTYPE wtl = wt[l];
         for (int k = 0; k < kPatternCount; k++) {
             integrationTmp[u    ] += rootPartials[v    ] * wtl;
@@ -629,9 +681,8 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoods(const int bu
             integrationTmp[u + 3] += rootPartials[v + 3] * wtl;
              
             u += 4;
-            v += 4;
+            v += kPartialsPatternStride;
         }
-		v += 4 * kExtraPatterns;
     }
     
     return integrateOutStatesAndScale(integrationTmp, stateFrequenciesIndex, scalingFactorsIndex, outSumLogLikelihood);
@@ -655,19 +706,23 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const i
         const REALTYPE* rootPartials = gPartials[rootPartialIndex];
         const REALTYPE* frequencies = gStateFrequencies[stateFrequenciesIndices[subsetIndex]];
         const REALTYPE* wt = gCategoryWeights[categoryWeightsIndices[subsetIndex]];
+        const int firstCategory = gActiveCategories[0];
         int u = 0;
-        int v = 0;
+        int v = firstCategory*kPartialsCategoryStride;
         
-        const REALTYPE wt0 = wt[0];
+        const REALTYPE wt0 = wt[firstCategory];
         for (int k = 0; k < kPatternCount; k++) {
-            integrationTmp[v    ] = rootPartials[v    ] * wt0;
-            integrationTmp[v + 1] = rootPartials[v + 1] * wt0;
-            integrationTmp[v + 2] = rootPartials[v + 2] * wt0;
-            integrationTmp[v + 3] = rootPartials[v + 3] * wt0;
-            v += 4;
+            integrationTmp[u    ] = rootPartials[v    ] * wt0;
+            integrationTmp[u + 1] = rootPartials[v + 1] * wt0;
+            integrationTmp[u + 2] = rootPartials[v + 2] * wt0;
+            integrationTmp[u + 3] = rootPartials[v + 3] * wt0;
+            u += 4;
+            v += kPartialsPatternStride;
         }
-        for (int l = 1; l < kCategoryCount; l++) {
+        for (int a = 1; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
             u = 0;
+            v = l*kPartialsCategoryStride;
             const REALTYPE wtl = wt[l];
             for (int k = 0; k < kPatternCount; k++) {
                 integrationTmp[u    ] += rootPartials[v    ] * wtl;
@@ -676,9 +731,8 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const i
                 integrationTmp[u + 3] += rootPartials[v + 3] * wtl;
                 
                 u += 4;
-                v += 4;
+                v += kPartialsPatternStride;
             }
-            v += 4 * kExtraPatterns;
         }
                 
         register REALTYPE freq0, freq1, freq2, freq3; // Is it a good idea to specify 'register'?
@@ -705,17 +759,17 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const i
                 else
                     cumulativeScalingFactorIndex = scaleBufferIndices[subsetIndex];
                 
-                const REALTYPE* cumulativeScaleFactors = gScaleBuffers[cumulativeScalingFactorIndex];
+                const REALTYPE cumulativeScaleFactor = getLogScaleFactor(cumulativeScalingFactorIndex, k);
                 
                 if (subsetIndex == 0) {
                     indexMaxScale[k] = 0;
-                    maxScaleFactor[k] = cumulativeScaleFactors[k];
+                    maxScaleFactor[k] = cumulativeScaleFactor;
                     for (int j = 1; j < count; j++) {
                         REALTYPE tmpScaleFactor;
                         if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS)
                             tmpScaleFactor = gScaleBuffers[bufferIndices[j] - kTipCount][k]; 
                         else
-                            tmpScaleFactor = gScaleBuffers[scaleBufferIndices[j]][k];
+                            tmpScaleFactor = getLogScaleFactor(scaleBufferIndices[j], k);
                         
                         if (tmpScaleFactor > maxScaleFactor[k]) {
                             indexMaxScale[k] = j;
@@ -725,7 +779,7 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const i
                 }
                 
                 if (subsetIndex != indexMaxScale[k])
-                    sum *= exp((REALTYPE)(cumulativeScaleFactors[k] - maxScaleFactor[k]));
+                    sum *= exp((REALTYPE)(cumulativeScaleFactor - maxScaleFactor[k]));
             }
             
             if (subsetIndex == 0) {
@@ -745,10 +799,7 @@ int BeagleCPU4StateImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const i
             outLogLikelihoodsTmp[i] += maxScaleFactor[i];
     }
     
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
     
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -815,13 +866,16 @@ const char* BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 BEAGLE_CPU_FACTORY_TEMPLATE
 const long BeagleCPU4StateImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getFlags() {
     long flags =  BEAGLE_FLAG_COMPUTATION_SYNCH |
-                  BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+                  BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
                   BEAGLE_FLAG_THREADING_NONE |
                   BEAGLE_FLAG_PROCESSOR_CPU |
                   BEAGLE_FLAG_VECTOR_NONE |
                   BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
                   BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
                   BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+                  BEAGLE_FLAG_MEMORY_MAPPED |
+                  BEAGLE_FLAG_TRAVERSAL_BLOCKED |
+                  BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR |
                   BEAGLE_FLAG_FRAMEWORK_CPU;
     
     if (DOUBLE_PRECISION)
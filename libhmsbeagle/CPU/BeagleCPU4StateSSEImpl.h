@@ -64,6 +64,11 @@ protected:
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::kStateCount;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::gTipStates;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::kCategoryCount;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::kActiveCategoryCount;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::gActiveCategories;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::sumActivePatterns;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::getLogScaleFactors;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::getLogScaleFactor;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::gScaleBuffers;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::gCategoryWeights;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_FLOAT>::gStateFrequencies;
@@ -85,33 +90,43 @@ private:
                                   const int* states1,
                                   const float* matrices1,
                                   const int* states2,
-                                  const float* matrices2);
+                                  const float* matrices2,
+                                  int startPattern,
+                                  int endPattern);
     
     virtual void calcStatesPartials(float* destP,
                                     const int* states1,
                                     const float* __restrict matrices1,
                                     const float* __restrict partials2,
-                                    const float* __restrict matrices2);
+                                    const float* __restrict matrices2,
+                                    int startPattern,
+                                    int endPattern);
     
     virtual void calcStatesPartialsFixedScaling(float* destP,
                                                 const int* states1,
                                                 const float* __restrict matrices1,
                                                 const float* __restrict partials2,
                                                 const float* __restrict matrices2,
-                                                const float* __restrict scaleFactors);
+                                                const float* __restrict scaleFactors,
+                                                int startPattern,
+                                                int endPattern);
     
     virtual void calcPartialsPartials(float* __restrict destP,
                                       const float* __restrict partials1,
                                       const float* __restrict matrices1,
                                       const float* __restrict partials2,
-                                      const float* __restrict matrices2);
+                                      const float* __restrict matrices2,
+                                      int startPattern,
+                                      int endPattern);
     
     virtual void calcPartialsPartialsFixedScaling(float* __restrict destP,
                                                   const float* __restrict child0Partials,
                                                   const float* __restrict child0TransMat,
                                                   const float* __restrict child1Partials,
                                                   const float* __restrict child1TransMat,
-                                                  const float* __restrict scaleFactors);
+                                                  const float* __restrict scaleFactors,
+                                                  int startPattern,
+                                                  int endPattern);
     
     virtual void calcPartialsPartialsAutoScaling(float* __restrict destP,
                                                  const float* __restrict partials1,
@@ -145,6 +160,11 @@ protected:
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::kStateCount;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::gTipStates;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::kCategoryCount;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::kActiveCategoryCount;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::gActiveCategories;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::sumActivePatterns;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::getLogScaleFactors;
+    using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::getLogScaleFactor;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::gScaleBuffers;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::gCategoryWeights;
     using BeagleCPUImpl<BEAGLE_CPU_4_SSE_DOUBLE>::gStateFrequencies;
@@ -166,33 +186,43 @@ private:
                                   const int* states1,
                                   const double* matrices1,
                                   const int* states2,
-                                  const double* matrices2);
+                                  const double* matrices2,
+                                  int startPattern,
+                                  int endPattern);
     
     virtual void calcStatesPartials(double* destP,
                                     const int* states1,
                                     const double* __restrict matrices1,
                                     const double* __restrict partials2,
-                                    const double* __restrict matrices2);
+                                    const double* __restrict matrices2,
+                                    int startPattern,
+                                    int endPattern);
     
     virtual void calcStatesPartialsFixedScaling(double* destP,
                                                 const int* states1,
                                                 const double* __restrict matrices1,
                                                 const double* __restrict partials2,
                                                 const double* __restrict matrices2,
-                                                const double* __restrict scaleFactors);
+                                                const double* __restrict scaleFactors,
+                                                int startPattern,
+                                                int endPattern);
     
     virtual void calcPartialsPartials(double* __restrict destP,
                                       const double* __restrict partials1,
                                       const double* __restrict matrices1,
                                       const double* __restrict partials2,
-                                      const double* __restrict matrices2);
+                                      const double* __restrict matrices2,
+                                      int startPattern,
+                                      int endPattern);
     
     virtual void calcPartialsPartialsFixedScaling(double* __restrict destP,
                                                   const double* __restrict child0Partials,
                                                   const double* __restrict child0TransMat,
                                                   const double* __restrict child1Partials,
                                                   const double* __restrict child1TransMat,
-                                                  const double* __restrict scaleFactors);
+                                                  const double* __restrict scaleFactors,
+                                                  int startPattern,
+                                                  int endPattern);
     
     virtual void calcPartialsPartialsAutoScaling(double* __restrict destP,
                                                  const double* __restrict partials1,
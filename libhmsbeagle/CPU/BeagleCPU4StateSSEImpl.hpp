@@ -107,13 +107,17 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcStatesStates(float* des
                                      const int* states_q,
                                      const float* matrices_q,
                                      const int* states_r,
-                                     const float* matrices_r) {
+                                     const float* matrices_r,
+                                     int startPattern,
+                                     int endPattern) {
 
 									 BeagleCPU4StateImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcStatesStates(destP,
                                      states_q,
                                      matrices_q,
                                      states_r,
-                                     matrices_r);
+                                     matrices_r,
+                                     startPattern,
+                                     endPattern);
 
 									 }
 
@@ -123,18 +127,23 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesStates(double* d
                                      const int* states_q,
                                      const double* matrices_q,
                                      const int* states_r,
-                                     const double* matrices_r) {
+                                     const double* matrices_r,
+                                     int startPattern,
+                                     int endPattern) {
 
 	VecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
 
     int w = 0;
 	V_Real *destPvec = (V_Real *)destP;
 
-    for (int l = 0; l < kCategoryCount; l++) {
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        w = l*4*OFFSET;
+        destPvec = (V_Real *)destP + (l*kPaddedPatternCount + startPattern)*2;
 
     	SSE_PREFETCH_MATRICES(matrices_q + w, matrices_r + w, vu_mq, vu_mr);
 
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
 
             const int state_q = states_q[k];
             const int state_r = states_r[k];
@@ -144,9 +153,6 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesStates(double* d
 
         }
 
-        w += OFFSET*4;
-        if (kExtraPatterns)
-        	destPvec += kExtraPatterns * 2;
     }
 }
 
@@ -159,13 +165,17 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcStatesPartials(float* d
                                        const int* states_q,
                                        const float* matrices_q,
                                        const float* partials_r,
-                                       const float* matrices_r) {
+                                       const float* matrices_r,
+                                       int startPattern,
+                                       int endPattern) {
 	BeagleCPU4StateImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcStatesPartials(
 									   destP,
 									   states_q,
 									   matrices_q,
 									   partials_r,
-									   matrices_r);
+									   matrices_r,
+									   startPattern,
+									   endPattern);
 }
 
 
@@ -175,7 +185,9 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesPartials(double*
                                        const int* states_q,
                                        const double* matrices_q,
                                        const double* partials_r,
-                                       const double* matrices_r) {
+                                       const double* matrices_r,
+                                       int startPattern,
+                                       int endPattern) {
 
     int v = 0;
     int w = 0;
@@ -184,11 +196,15 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesPartials(double*
 	V_Real *destPvec = (V_Real *)destP;
 	V_Real destr_01, destr_23;
 
-    for (int l = 0; l < kCategoryCount; l++) {
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        w = l*4*OFFSET;
+        v = (l*kPaddedPatternCount + startPattern)*4;
+        destPvec = (V_Real *)destP + (l*kPaddedPatternCount + startPattern)*2;
 
     	SSE_PREFETCH_MATRICES(matrices_q + w, matrices_r + w, vu_mq, vu_mr);
 
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
 
             const int state_q = states_q[k];
             V_Real vp0, vp1, vp2, vp3;
@@ -208,11 +224,6 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesPartials(double*
 
             v += 4;
         }
-        w += OFFSET*4;
-        if (kExtraPatterns) {
-        	destPvec += kExtraPatterns * 2;
-        	v += kExtraPatterns * 4;
-        }
     }
 }
 
@@ -222,14 +233,18 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcStatesPartialsFixedScal
                                 const float* __restrict matrices1,
                                 const float* __restrict partials2,
                                 const float* __restrict matrices2,
-                                const float* __restrict scaleFactors) {
+                                const float* __restrict scaleFactors,
+                                int startPattern,
+                                int endPattern) {
 	BeagleCPU4StateImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcStatesPartialsFixedScaling(
 									   destP,
 									   states1,
 									   matrices1,
 									   partials2,
 									   matrices2,
-									   scaleFactors);
+									   scaleFactors,
+									   startPattern,
+									   endPattern);
 }
 
 BEAGLE_CPU_4_SSE_TEMPLATE
@@ -238,7 +253,9 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesPartialsFixedSca
                                 const double* __restrict matrices_q,
                                 const double* __restrict partials_r,
                                 const double* __restrict matrices_r,
-                                const double* __restrict scaleFactors) {
+                                const double* __restrict scaleFactors,
+                                int startPattern,
+                                int endPattern) {
 
 
     int v = 0;
@@ -248,11 +265,15 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesPartialsFixedSca
 	V_Real *destPvec = (V_Real *)destP;
 	V_Real destr_01, destr_23;
 
-    for (int l = 0; l < kCategoryCount; l++) {
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        w = l*4*OFFSET;
+        v = (l*kPaddedPatternCount + startPattern)*4;
+        destPvec = (V_Real *)destP + (l*kPaddedPatternCount + startPattern)*2;
 
     	SSE_PREFETCH_MATRICES(matrices_q + w, matrices_r + w, vu_mq, vu_mr);
 
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
 
         	const V_Real scaleFactor = VEC_SPLAT(1.0/scaleFactors[k]);
 
@@ -274,11 +295,6 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcStatesPartialsFixedSca
 
             v += 4;
         }
-        w += OFFSET*4;
-        if (kExtraPatterns) {
-        	destPvec += kExtraPatterns * 2;
-        	v += kExtraPatterns * 4;
-        }
     }
 }
 
@@ -287,13 +303,17 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcPartialsPartials(float*
                                                   const float*  partials_q,
                                                   const float*  matrices_q,
                                                   const float*  partials_r,
-                                                  const float*  matrices_r) {
+                                                  const float*  matrices_r,
+                                                  int startPattern,
+                                                  int endPattern) {
 
 	BeagleCPU4StateImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcPartialsPartials(destP,
                                                   partials_q,
                                                   matrices_q,
                                                   partials_r,
-                                                  matrices_r);
+                                                  matrices_r,
+                                                  startPattern,
+                                                  endPattern);
 }
 
 BEAGLE_CPU_4_SSE_TEMPLATE
@@ -301,7 +321,9 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcPartialsPartials(doubl
                                                   const double*  partials_q,
                                                   const double*  matrices_q,
                                                   const double*  partials_r,
-                                                  const double*  matrices_r) {
+                                                  const double*  matrices_r,
+                                                  int startPattern,
+                                                  int endPattern) {
 
     int v = 0;
     int w = 0;
@@ -310,12 +332,16 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcPartialsPartials(doubl
  	VecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
 	V_Real *destPvec = (V_Real *)destP;
 
-    for (int l = 0; l < kCategoryCount; l++) {
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        w = l*4*OFFSET;
+        v = (l*kPaddedPatternCount + startPattern)*4;
+        destPvec = (V_Real *)destP + (l*kPaddedPatternCount + startPattern)*2;
 
 		/* Load transition-probability matrices into vectors */
     	SSE_PREFETCH_MATRICES(matrices_q + w, matrices_r + w, vu_mq, vu_mr);
 
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
             
 #           if 1 && !defined(_WIN32)
             __builtin_prefetch (&partials_q[v+64]);
@@ -395,11 +421,6 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcPartialsPartials(doubl
 
             v += 4;
         }
-        w += OFFSET*4;
-        if (kExtraPatterns) {
-        	destPvec += kExtraPatterns * 2;
-        	v += kExtraPatterns * 4;
-        }
     }
 }
 
@@ -409,7 +430,9 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcPartialsPartialsFixedSc
                                         const float*  child0TransMat,
                                         const float*  child1Partials,
                                         const float*  child1TransMat,
-                                        const float*  scaleFactors) {
+                                        const float*  scaleFactors,
+                                        int startPattern,
+                                        int endPattern) {
 
 	BeagleCPU4StateImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcPartialsPartialsFixedScaling(
 			destP,
@@ -417,7 +440,9 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_FLOAT>::calcPartialsPartialsFixedSc
 			child0TransMat,
 			child1Partials,
 			child1TransMat,
-			scaleFactors);
+			scaleFactors,
+			startPattern,
+			endPattern);
 }
 
 BEAGLE_CPU_4_SSE_TEMPLATE
@@ -426,7 +451,9 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcPartialsPartialsFixedS
 		                                                        const double* matrices_q,
 		                                                        const double* partials_r,
 		                                                        const double* matrices_r,
-		                                                        const double* scaleFactors) {
+		                                                        const double* scaleFactors,
+		                                                        int startPattern,
+		                                                        int endPattern) {
 
     int v = 0;
     int w = 0;
@@ -435,12 +462,16 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcPartialsPartialsFixedS
  	VecUnion vu_mq[OFFSET][2], vu_mr[OFFSET][2];
 	V_Real *destPvec = (V_Real *)destP;
 
-	for (int l = 0; l < kCategoryCount; l++) {
+	for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        w = l*4*OFFSET;
+        v = (l*kPaddedPatternCount + startPattern)*4;
+        destPvec = (V_Real *)destP + (l*kPaddedPatternCount + startPattern)*2;
 
 		/* Load transition-probability matrices into vectors */
     	SSE_PREFETCH_MATRICES(matrices_q + w, matrices_r + w, vu_mq, vu_mr);
 
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
 
 #           if 1 && !defined(_WIN32)
             __builtin_prefetch (&partials_q[v+64]);
@@ -485,11 +516,6 @@ void BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcPartialsPartialsFixedS
             destPvec += 2;
             v += 4;
         }
-        w += OFFSET*4;
-        if (kExtraPatterns) {
-        	destPvec += kExtraPatterns * 2;
-        	v += kExtraPatterns * 4;
-        }
     }
 }
 
@@ -569,9 +595,10 @@ int BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcEdgeLogLikelihoods(cons
 
         const int* statesChild = gTipStates[childIndex];
 
-        int w = 0;
-        V_Real *vcl_r = (V_Real *)cl_r;
-        for(int l = 0; l < kCategoryCount; l++) {
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            const int w = l*4*OFFSET;
+            V_Real *vcl_r = (V_Real *)cl_r + l*kPaddedPatternCount*2;
 
             VecUnion vu_m[OFFSET][2];
             SSE_PREFETCH_MATRIX(transMatrix + w, vu_m)
@@ -589,17 +616,15 @@ int BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcEdgeLogLikelihoods(cons
                 wtdPartials = VEC_MULT(*vcl_r++, vwt);
                 *vcl_p++ = VEC_MADD(vu_m[stateChild][1].vx, wtdPartials, *vcl_p);
             }
-           w += OFFSET*4;
-           vcl_r += 2 * kExtraPatterns;
         }
     } else { // Integrate against a partial at the child
 
         const double* cl_q = gPartials[childIndex];
-        V_Real * vcl_r = (V_Real *)cl_r;
-        int v = 0;
-        int w = 0;
-
-        for(int l = 0; l < kCategoryCount; l++) {
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            const int w = l*4*OFFSET;
+            V_Real * vcl_r = (V_Real *)cl_r + l*kPaddedPatternCount*2;
+            int v = l*kPaddedPatternCount*4;
 
             V_Real * vcl_p = (V_Real *)cl_p;
 
@@ -629,12 +654,6 @@ int BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcEdgeLogLikelihoods(cons
 
                 v += 4;
             }
-            w += 4*OFFSET;
-            if (kExtraPatterns) {
-                vcl_r += 2 * kExtraPatterns;
-                v += 4 * kExtraPatterns;
-            }
-
         }
     }
 
@@ -651,15 +670,12 @@ int BeagleCPU4StateSSEImpl<BEAGLE_CPU_4_SSE_DOUBLE>::calcEdgeLogLikelihoods(cons
 
 
     if (scalingFactorsIndex != BEAGLE_OP_NONE) {
-        const double* scalingFactors = gScaleBuffers[scalingFactorsIndex];
+        const double* scalingFactors = getLogScaleFactors(scalingFactorsIndex);
         for(int k=0; k < kPatternCount; k++)
             outLogLikelihoodsTmp[k] += scalingFactors[k];
     }
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -733,6 +749,11 @@ BeagleImpl* BeagleCPU4StateSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImp
                                              long requirementFlags,
                                              int* errorCode) {
 
+    // Vectorized and 4-state kernels only index category-major partials
+    if (requirementFlags & BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR)
+        return NULL;
+    preferenceFlags &= ~BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR;
+
     if (stateCount != 4) {
         return NULL;
     }
@@ -773,7 +794,7 @@ const char* BeagleCPU4StateSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName()
 template <>
 const long BeagleCPU4StateSSEImplFactory<double>::getFlags() {
     return BEAGLE_FLAG_COMPUTATION_SYNCH |
-           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
            BEAGLE_FLAG_THREADING_NONE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_SSE |
@@ -781,13 +802,15 @@ const long BeagleCPU4StateSSEImplFactory<double>::getFlags() {
            BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
            BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL|
            BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_MEMORY_MAPPED |
+           BEAGLE_FLAG_TRAVERSAL_BLOCKED |
            BEAGLE_FLAG_FRAMEWORK_CPU;
 }
 
 template <>
 const long BeagleCPU4StateSSEImplFactory<float>::getFlags() {
     return BEAGLE_FLAG_COMPUTATION_SYNCH |
-           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
            BEAGLE_FLAG_THREADING_NONE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_SSE |
@@ -795,6 +818,8 @@ const long BeagleCPU4StateSSEImplFactory<float>::getFlags() {
            BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
            BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
            BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_MEMORY_MAPPED |
+           BEAGLE_FLAG_TRAVERSAL_BLOCKED |
            BEAGLE_FLAG_FRAMEWORK_CPU;
 }
 
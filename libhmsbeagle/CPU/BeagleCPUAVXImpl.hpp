@@ -64,13 +64,17 @@ void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcStatesStates(double* destP,
                                      const int* states_q,
                                      const double* matrices_q,
                                      const int* states_r,
-                                     const double* matrices_r) {
+                                     const double* matrices_r,
+                                     int startPattern,
+                                     int endPattern) {
 
 	BeagleCPUImpl<BEAGLE_CPU_AVX_DOUBLE>::calcStatesStates(destP,
                                      states_q,
                                      matrices_q,
                                      states_r,
-                                     matrices_r);
+                                     matrices_r,
+                                     startPattern,
+                                     endPattern);
 }
 
 
@@ -115,13 +119,17 @@ void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcStatesPartials(double* destP,
                                        const int* states_q,
                                        const double* matrices_q,
                                        const double* partials_r,
-                                       const double* matrices_r) {
+                                       const double* matrices_r,
+                                       int startPattern,
+                                       int endPattern) {
 	BeagleCPUImpl<BEAGLE_CPU_AVX_DOUBLE>::calcStatesPartials(
 									   destP,
 									   states_q,
 									   matrices_q,
 									   partials_r,
-									   matrices_r);
+									   matrices_r,
+									   startPattern,
+									   endPattern);
 }
 
 //
@@ -212,8 +220,12 @@ void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcPartialsPartials(double* __res
                                               const double* __restrict partials1,
                                               const double* __restrict matrices1,
                                               const double* __restrict partials2,
-                                              const double* __restrict matrices2) {
-    int stateCountMinusOne = kPartialsPaddedStateCount - 1;
+                                              const double* __restrict matrices2,
+                                              int startPattern,
+                                              int endPattern) {
+    // whole vectors of states, then the remainder; padded rows are not a multiple of the
+    //  vector length or alignment for every state count
+    const int vectorStateCount = kStateCount & ~3;
 
     struct IO {
     	void operator()(V_Real v) {
@@ -233,30 +245,37 @@ void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcPartialsPartials(double* __res
     };
 
 
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-    	double* destPu = destP + l*kPartialsPaddedStateCount*kPatternCount;
-    	int v = l*kPartialsPaddedStateCount*kPatternCount;
-        for (int k = 0; k < kPatternCount; k++) {
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+    	double* destPu = destP + (l*kPaddedPatternCount + startPattern)*kPartialsPaddedStateCount;
+    	int v = (l*kPaddedPatternCount + startPattern)*kPartialsPaddedStateCount;
+        for (int k = startPattern; k < endPattern; k++) {
             int w = l * kMatrixSize;
             for (int i = 0; i < kStateCount; ++i) {
             	register V_Real sum1_vecA = VEC_SETZERO();
             	register V_Real sum2_vecA = VEC_SETZERO();
-            	for (int j = 0; j < stateCountMinusOne; j += 4) {
+            	for (int j = 0; j < vectorStateCount; j += 4) {
 //            		IO()(VEC_LOAD(matrices1 + w + j));
 //            		IO()(VEC_LOAD(partials1 + v + j));
 
             		sum1_vecA = VEC_MADD(
-								 VEC_LOAD(matrices1 + w + j),  // TODO This only works if w is even
-								 VEC_LOAD(partials1 + v + j),  // TODO This only works if v is even
+								 _mm256_loadu_pd(matrices1 + w + j),
+								 _mm256_loadu_pd(partials1 + v + j),
 								 sum1_vecA);
 //            		IO()(sum1_vecA);
             		sum2_vecA = VEC_MADD(
-								 VEC_LOAD(matrices2 + w + j),
-								 VEC_LOAD(partials2 + v + j),
+								 _mm256_loadu_pd(matrices2 + w + j),
+								 _mm256_loadu_pd(partials2 + v + j),
 								 sum2_vecA);
 //            		fprintf(stderr,"\n");
             	}
+            	double sum1 = math::horizontal_add(sum1_vecA);
+            	double sum2 = math::horizontal_add(sum2_vecA);
+            	for (int j = vectorStateCount; j < kStateCount; j++) {
+            		sum1 += matrices1[w + j] * partials1[v + j];
+            		sum2 += matrices2[w + j] * partials2[v + j];
+            	}
 
 
 //            	sum1_vecA = VEC_MULT(
@@ -274,7 +293,7 @@ void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcPartialsPartials(double* __res
 //                double x[4];
 //                _mm256_storeu_pd(x, VEC_MULT(sum1_vecA,sum2_vecA));
 //                *destPu = x[0];
-                *destPu = math::horizontal_add(sum1_vecA) * math::horizontal_add(sum2_vecA);
+                *destPu = sum1 * sum2;
 
 //                *destPu = 1.0; //sum1_vecA[0];
                 destPu++;
@@ -293,13 +312,15 @@ void BeagleCPUAVXImpl<BEAGLE_CPU_AVX_DOUBLE>::calcPartialsPartialsFixedScaling(
                                               const double* __restrict matrices1,
                                               const double* __restrict partials2,
                                               const double* __restrict matrices2,
-                                              const double* __restrict scaleFactors) {
+                                              const double* __restrict scaleFactors,
+                                              int startPattern,
+                                              int endPattern) {
 
 	fprintf(stderr, "Not yet implemented: BeagleCPUAVXImpl::calcPartialsPartialsFixedScaling\n");
 	exit(-1);
 
 //    int stateCountMinusOne = kPartialsPaddedStateCount - 1;
-//#pragma omp parallel for num_threads(kCategoryCount)
+//#pragma omp parallel for num_threads(kActiveCategoryCount)
 //    for (int l = 0; l < kCategoryCount; l++) {
 //    	double* destPu = destP + l*kPartialsPaddedStateCount*kPatternCount;
 //    	int v = l*kPartialsPaddedStateCount*kPatternCount;
@@ -571,6 +592,11 @@ BeagleImpl* BeagleCPUAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int
                                              long requirementFlags,
                                              int* errorCode) {
 
+    // Vectorized and 4-state kernels only index category-major partials
+    if (requirementFlags & BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR)
+        return NULL;
+    preferenceFlags &= ~BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR;
+
     if (!CPUSupportsAVX())
         return NULL;
     
@@ -625,7 +651,7 @@ const char* BeagleCPUAVXImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 template <>
 const long BeagleCPUAVXImplFactory<double>::getFlags() {
     return BEAGLE_FLAG_COMPUTATION_SYNCH |
-           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
            BEAGLE_FLAG_THREADING_NONE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_AVX |
@@ -633,13 +659,15 @@ const long BeagleCPUAVXImplFactory<double>::getFlags() {
            BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
            BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
            BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_MEMORY_MAPPED |
+           BEAGLE_FLAG_TRAVERSAL_BLOCKED |
            BEAGLE_FLAG_FRAMEWORK_CPU;           
 }
 
 template <>
 const long BeagleCPUAVXImplFactory<float>::getFlags() {
     return BEAGLE_FLAG_COMPUTATION_SYNCH |
-           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
            BEAGLE_FLAG_THREADING_NONE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_AVX |
@@ -647,6 +675,8 @@ const long BeagleCPUAVXImplFactory<float>::getFlags() {
            BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
            BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
            BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_MEMORY_MAPPED |
+           BEAGLE_FLAG_TRAVERSAL_BLOCKED |
            BEAGLE_FLAG_FRAMEWORK_CPU;           
 }
 
@@ -27,7 +27,7 @@ Plugin("CPU-AVX", "CPU-AVX")
         resource.name = (char*) "CPU";
         resource.description = (char*) "";
         resource.supportFlags = BEAGLE_FLAG_COMPUTATION_SYNCH |
-                                         BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+                                         BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
                                          BEAGLE_FLAG_THREADING_NONE |
                                          BEAGLE_FLAG_PROCESSOR_CPU |
                                          BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_PRECISION_DOUBLE |
@@ -35,6 +35,8 @@ Plugin("CPU-AVX", "CPU-AVX")
                                          BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
                                          BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
                                          BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+                                         BEAGLE_FLAG_MEMORY_MAPPED |
+                                         BEAGLE_FLAG_TRAVERSAL_BLOCKED |
                                          BEAGLE_FLAG_FRAMEWORK_CPU;
         resource.supportFlags |= BEAGLE_FLAG_VECTOR_AVX;
         resource.requiredFlags = BEAGLE_FLAG_FRAMEWORK_CPU;
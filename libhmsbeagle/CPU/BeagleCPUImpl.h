@@ -35,6 +35,12 @@
 #include "libhmsbeagle/BeagleImpl.h"
 #include "libhmsbeagle/CPU/Precision.h"
 #include "libhmsbeagle/CPU/EigenDecomposition.h"
+#include "libhmsbeagle/CPU/SparseRateMatrix.h"
+#include "libhmsbeagle/CPU/EdgeProjection.h"
+#include "libhmsbeagle/CPU/CheckpointFile.h"
+#include "libhmsbeagle/SharedBuffer.h"
+#include "libhmsbeagle/TipData.h"
+#include "libhmsbeagle/KernelCounters.h"
 
 #include <vector>
 
@@ -48,6 +54,20 @@
 #define T_PAD_DEFAULT   1   // Pad transition matrix rows with an extra 1.0 for ambiguous characters
 #define P_PAD_DEFAULT   0   // No partials padding necessary for non-SSE implementations
 
+#define BEAGLE_CPU_PATTERN_BLOCK_BYTES  262144 // Bytes per category of a partials buffer visited in one pattern block
+#define BEAGLE_CPU_CACHE_BLOCK_BYTES    32768  // Bytes of a partials buffer (all categories) visited in one cache block
+#ifdef _OPENMP
+#define BEAGLE_CPU_MIN_PATTERN_GAP      64     // Shortest run of zero-weight patterns skipped in traversals
+#else
+#define BEAGLE_CPU_MIN_PATTERN_GAP      2
+#endif
+#define BEAGLE_CPU_DYNAMIC_SCALING_RANGE 4     // Dynamic scaling rescales patterns below 1/RANGE of the exponent range
+#define BEAGLE_CPU_SUM_BLOCK_SIZE       64     // Active patterns summed in order before block sums are paired
+#define BEAGLE_CPU_PARALLEL_SUM_BLOCKS  64     // Fewest blocks worth summing in parallel
+
+#define BEAGLE_CPU_CHECKPOINT_VERSION       2   // Bumped whenever the checkpoint layout changes
+#define BEAGLE_CPU_CHECKPOINT_HEADER_SIZE   16  // Number of longs identifying the instance layout
+
 
 namespace beagle {
 namespace cpu {
@@ -72,6 +92,8 @@ protected:
     int kScaleBufferCount;
 
     int kPartialsSize;  /// stored for convenience. kPartialsSize = kStateCount*kPatternCount
+    int kPartialsCategoryStride; /// distance between categories in a partials buffer
+    int kPartialsPatternStride; /// distance between patterns in a partials buffer
     int kMatrixSize; /// stored for convenience. kMatrixSize = kStateCount*(kStateCount + 1)
     
     int kInternalPartialsBufferCount; 
@@ -82,6 +104,11 @@ protected:
     int scalingExponentThreshhold;
 
     EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>* gEigenDecomposition;
+    SparseRateMatrix** gSparseRateMatrices; // per eigen buffer, NULL unless set
+    EdgeProjection* gEdgeProjection; // NULL until projectEdgePartials is first called
+    std::vector<double> gEdgeProjectionScales; /// the cumulative log scale factors of the projected edge, if any
+    EdgeProjection* gEdgeOptimizerProjection; // NULL until optimizeEdgeLengths is first called
+    std::vector<double> gEdgeOptimizerSites; /// site likelihoods and derivatives for optimizeEdgeLengths
 
     double* gCategoryRates; // Kept in double-precision until multiplication by edgelength
     double* gPatternWeights;
@@ -96,6 +123,13 @@ protected:
     int** gTipStates;
     REALTYPE** gScaleBuffers;
     
+    // Buffers shared with clones of this instance, or with the instance it was cloned from,
+    //  have a reference count here and are NULL while private. A shared buffer is never
+    //  written to; the instance writing to it first takes a private copy
+    std::vector<SharedBuffer*> gSharedPartials;
+    std::vector<SharedBuffer*> gSharedTipStates;
+    SharedBuffer* gSharedPatternWeights;
+
     signed short** gAutoScaleBuffers;
     
     int* gActiveScalingFactors;
@@ -112,10 +146,63 @@ protected:
     REALTYPE* outLogLikelihoodsTmp;
     REALTYPE* outFirstDerivativesTmp;
     REALTYPE* outSecondDerivativesTmp;
+    REALTYPE* gSiteBuffers[3]; // as allocated, while client buffers stand in for the above
 
     REALTYPE* ones;
     REALTYPE* zeros;
 
+    REALTYPE* gRootScratchPartials; // NULL until root partials are first integrated without being stored
+    REALTYPE* gOperationMatrices[2]; // NULL until updateMatricesAndPartials is first called
+
+    // Scratch-file mapping that backs the internal partials and scale buffers
+    //  when BEAGLE_FLAG_MEMORY_MAPPED is set
+    void* gMappedBuffer;
+    size_t kMappedSize;
+    int kPatternBlockSize; /// the number of patterns visited per block in memory-mapped traversals
+    int kCacheBlockSize; /// the number of patterns visited per block in cache-blocked traversals
+    REALTYPE kDynamicScalingThreshold; /// the pattern maximum below which dynamic scaling rescales
+
+    // Exponent scalers set through setExponentScalers. Operations then rescale by powers
+    //  of two and every scale buffer holds kPaddedPatternCount signed short exponents in
+    //  place of REALTYPE factors; integration converts them to log factors. A cumulative
+    //  exponent that overflowed holds kExponentOverflow and integrates to NaN
+    bool kExponentScalers;
+    static const signed short kExponentOverflow = -32768; /// the smallest signed short
+    REALTYPE* gExponentScaleFactors; /// scratch for scale factors expanded from exponents
+
+    // Partially ambiguous tip states set through setTipStateMasks. gTipStates holds the
+    //  missing state for these patterns so that the kernels stay unchanged; the
+    //  patterns are then recomputed from a lookup table of summed matrix columns
+    std::vector< std::vector<int> > gAmbiguousPatterns; /// per tip, ascending ambiguous pattern indices
+    std::vector< std::vector<int> > gAmbiguousCodes; /// per tip, index into gAmbiguityMasks for each ambiguous pattern
+    std::vector< std::vector<int> > gAmbiguityMasks; /// per tip, the distinct state bitmasks in use
+    REALTYPE* gAmbiguityLookup;
+    int kAmbiguityLookupSize;
+
+    // Dirty tracking set through setDirtyTracking. Every write to a partials buffer,
+    //  transition matrix or scale buffer takes a new stamp from kDirtyClock, and each
+    //  computed buffer remembers the stamps of its inputs so that unchanged work is skipped
+    bool kDirtyTracking;
+    long kDirtyClock;
+    std::vector<long> gPartialsStamps;
+    std::vector<long> gMatrixStamps;
+    std::vector<long> gScaleBufferStamps;
+    std::vector<long> gEigenStamps;
+    long kCategoryRatesStamp;
+    std::vector< std::vector<long> > gPartialsInputs; /// per buffer, the operation and stamps it was computed from
+    std::vector< std::vector<long> > gMatrixInputs; /// per matrix, the eigen system, rates and derivative order used
+    std::vector<double> gMatrixEdgeLengths; /// per matrix, the edge length it was computed for
+
+    // Categories and patterns with weight zero are neither computed nor integrated. A
+    //  category is active while any set category weights give it nonzero weight
+    std::vector<int> gActiveCategories; /// ascending indices of the active categories
+    int kActiveCategoryCount;
+    std::vector<int> gActivePatterns; /// ascending indices of the patterns with nonzero weight
+    int kActivePatternCount;
+    std::vector<int> gActivePatternRuns; /// start and end of the pattern ranges traversals visit
+
+    KernelCounters gKernelCounters; /// per kernel class, while counting is set through setKernelCounting
+
 public:
     virtual ~BeagleCPUImpl();
 
@@ -144,6 +231,13 @@ public:
     int setTipStates(int tipIndex,
                      const int* inStates);
 
+    // set the states for a given tip from state bitmasks
+    //
+    // tipIndex the index of the tip
+    // inStateMasks the array of masks: bit i set if state i is possible
+    int setTipStateMasks(int tipIndex,
+                         const int* inStateMasks);
+
     // set the partials for a given tip
     //
     // tipIndex the index of the tip
@@ -155,6 +249,11 @@ public:
     int setPartials(int bufferIndex,
                     const double* inPartials);
 
+    // point a partials buffer at client memory where precision and layout allow, else
+    // copy it as setPartials does
+    int setPartialsBuffer(int bufferIndex,
+                          const double* inPartials);
+
     int getPartials(int bufferIndex,
 					int scaleBuffer,
                     double* outPartials);
@@ -170,6 +269,13 @@ public:
                               const double* inInverseEigenVectors,
                               const double* inEigenValues);
 
+    // sets a rate matrix to exponentiate in place of an Eigen decomposition
+    //
+    // eigenIndex the index of the Eigen decomposition buffer to replace
+    // inRateMatrix a stateCount x stateCount row-major rate matrix
+    int setRateMatrix(int eigenIndex,
+                      const double* inRateMatrix);
+
     int setStateFrequencies(int stateFrequenciesIndex,
                             const double* inStateFrequencies);    
     
@@ -217,6 +323,14 @@ public:
                                  const double* edgeLengths,
                                  int count);
 
+    // resize the cache of transition matrices reused by updateTransitionMatrices
+    //
+    // cacheSize the number of edge lengths to remember, zero turns the cache off
+    int setTransitionMatrixCacheSize(int cacheSize);
+
+    int getTransitionMatrixCacheStatistics(long* outHits,
+                                           long* outMisses);
+
     // calculate or queue for calculation partials using an array of operations
     //
     // operations an array of triplets of indices: the two source partials and the destination
@@ -227,6 +341,49 @@ public:
                        int operationCount,
                        int cumulativeScalingIndex);
 
+    // set a sparse rate matrix for updatePartialsByEdgeLengths
+    //
+    // eigenIndex the index of the buffer to hold the rate matrix
+    // nonZeroCount the number of entries in the following arrays
+    // rowIndices, columnIndices, rates the off-diagonal non-zero rates
+    int setSparseRateMatrix(int eigenIndex,
+                            int nonZeroCount,
+                            const int* rowIndices,
+                            const int* columnIndices,
+                            const double* rates);
+
+    // calculate partials by applying the exponential of a sparse rate matrix directly
+    // to the child partials, without forming transition matrices
+    //
+    // eigenIndex the index of the sparse rate matrix
+    // operations as for updatePartials, with the transition matrix indices ignored
+    // edgeLengths the child 1 and child 2 edge lengths of each operation
+    int updatePartialsByEdgeLengths(int eigenIndex,
+                                    const int* operations,
+                                    int operationCount,
+                                    const double* edgeLengths,
+                                    int cumulativeScalingIndex);
+
+    // calculate partials with the transition matrices of each operation computed on the fly
+    //
+    // eigenIndices the eigen decomposition of each operation
+    // edgeLengths the child 1 and child 2 edge lengths of each operation
+    int updateMatricesAndPartials(const int* operations,
+                                  int operationCount,
+                                  const int* eigenIndices,
+                                  const double* edgeLengths,
+                                  int cumulativeScalingIndex);
+
+    // turn dirty tracking on or off
+    //
+    // enable non-zero to skip operations and transition matrices whose inputs are unchanged
+    int setDirtyTracking(int enable);
+
+    // turn exponent scalers on or off, resetting all scale buffers
+    //
+    // enable non-zero to keep power-of-two exponents in the scale buffers
+    int setExponentScalers(int enable);
+
     // Block until all calculations that write to the specified partials have completed.
     //
     // This function is optional and only has to be called by clients that "recycle" partials.
@@ -271,6 +428,12 @@ public:
                                     int count,
                                     double* outSumLogLikelihood);
 
+    int calculateRootLogLikelihoodsByOperation(const int* operation,
+                                               int categoryWeightsIndex,
+                                               int stateFrequenciesIndex,
+                                               int cumulativeScaleIndex,
+                                               double* outSumLogLikelihood);
+
     // possible nulls: firstDerivativeIndices, secondDerivativeIndices,
     //                 outFirstDerivatives, outSecondDerivatives
     int calculateEdgeLogLikelihoods(const int* parentBufferIndices,
@@ -285,12 +448,98 @@ public:
                                     double* outSumLogLikelihood,
                                     double* outSumFirstDerivative,
                                     double* outSumSecondDerivative);
+
+    // calculate the log likelihoods and derivatives of several independent edges at once,
+    // one per entry of the index lists, spreading the edges over threads when built with
+    // OpenMP; possible nulls as for calculateEdgeLogLikelihoods, and cumulativeScaleIndices
+    int calculateIndependentEdgeLogLikelihoods(const int* parentBufferIndices,
+                                               const int* childBufferIndices,
+                                               const int* probabilityIndices,
+                                               const int* firstDerivativeIndices,
+                                               const int* secondDerivativeIndices,
+                                               const int* categoryWeightsIndices,
+                                               const int* stateFrequenciesIndices,
+                                               const int* cumulativeScaleIndices,
+                                               int count,
+                                               double* outLogLikelihoods,
+                                               double* outFirstDerivatives,
+                                               double* outSecondDerivatives);
+
+    // project the partials at either end of an edge onto the eigenbasis of a rate matrix,
+    // for calculateProjectedEdgeLogLikelihoods
+    //
+    // parentBufferIndex, childBufferIndex the partials or tips at either end of the edge
+    // eigenIndex the Eigen decomposition of the rate matrix
+    // cumulativeScaleIndex the scale buffer to add to the site log likelihoods, or BEAGLE_OP_NONE
+    int projectEdgePartials(int parentBufferIndex,
+                            int childBufferIndex,
+                            int eigenIndex,
+                            int categoryWeightsIndex,
+                            int stateFrequenciesIndex,
+                            int cumulativeScaleIndex);
+
+    // calculate the log likelihood of the projected edge for an edge length, in time
+    // proportional to patterns x states; possible nulls: outSumFirstDerivative,
+    // outSumSecondDerivative
+    int calculateProjectedEdgeLogLikelihoods(double edgeLength,
+                                             double* outSumLogLikelihood,
+                                             double* outSumFirstDerivative,
+                                             double* outSumSecondDerivative);
+
+    // optimize the lengths of edges one after another by Newton-Raphson iteration on partials
+    // projected onto the eigenbasis, within [minEdgeLength, maxEdgeLength]; iteration stops
+    // once a step is no longer than tolerance or after maxIterations steps
+    //
+    // cumulativeScaleIndices one per edge, or NULL
+    // inOutEdgeLengths the starting lengths, replaced by the optimal ones
+    // outLogLikelihoods the log likelihood of each edge at its optimal length
+    int optimizeEdgeLengths(const int* parentBufferIndices,
+                            const int* childBufferIndices,
+                            int eigenIndex,
+                            int categoryWeightsIndex,
+                            int stateFrequenciesIndex,
+                            const int* cumulativeScaleIndices,
+                            int count,
+                            double minEdgeLength,
+                            double maxEdgeLength,
+                            double tolerance,
+                            int maxIterations,
+                            double* inOutEdgeLengths,
+                            double* outLogLikelihoods);
     
     int getSiteLogLikelihoods(double* outLogLikelihoods);
     
     int getSiteDerivatives(double* outFirstDerivatives,
                            double* outSecondDerivatives);
 
+    // have the integration kernels write site values straight into client buffers, in
+    // place of the outLogLikelihoodsTmp family; double precision only
+    int setSiteBuffers(double* outLogLikelihoods,
+                       double* outFirstDerivatives,
+                       double* outSecondDerivatives);
+
+    // write every buffer of the instance to a binary file, in the memory layout of this
+    // implementation
+    int saveInstance(const char* fileName);
+
+    // read back a file written by saveInstance from an instance created with the same
+    // dimensions, flags and implementation
+    int restoreInstance(const char* fileName);
+
+    // make this instance, created with the same arguments as sourceInstance, a copy of it
+    // that shares its partials, tip states and pattern weights until either writes to them
+    int cloneInstance(BeagleImpl* sourceInstance);
+
+    // point the tips of this instance at those of a store with the same state and pattern
+    // counts, converting partials tips the first time an instance with this layout does so
+    int setTipData(TipData* tipData);
+
+    int setKernelCounting(int enable);
+
+    int getKernelCounters(BeagleKernelCounters* outCounters);
+
+    int resetKernelCounters();
+
     int block(void);
 
 	virtual const char* getName();
@@ -302,20 +551,34 @@ protected:
                                     const int* states1,
                                     const REALTYPE* matrices1,
                                     const int* states2,
-                                    const REALTYPE* matrices2);
+                                    const REALTYPE* matrices2,
+                                    int startPattern,
+                                    int endPattern);
 
 
     virtual void calcStatesPartials(REALTYPE* destP,
                                     const int* states1,
                                     const REALTYPE* matrices1,
                                     const REALTYPE* partials2,
-                                    const REALTYPE* matrices2);
+                                    const REALTYPE* matrices2,
+                                    int startPattern,
+                                    int endPattern);
 
     virtual void calcPartialsPartials(REALTYPE* destP,
                                       const REALTYPE* partials1,
                                       const REALTYPE* matrices1,
                                       const REALTYPE* partials2,
-                                      const REALTYPE* matrices2);
+                                      const REALTYPE* matrices2,
+                                      int startPattern,
+                                      int endPattern);
+
+    // integrates the root partials of patterns [startPattern, endPattern) into
+    // outLogLikelihoodsTmp, without scale factors
+    void calcRootSiteLogLikelihoods(const REALTYPE* rootPartials,
+                                    const REALTYPE* wt,
+                                    const REALTYPE* freqs,
+                                    int startPattern,
+                                    int endPattern);
 
     virtual int calcRootLogLikelihoods(const int bufferIndex,
                                         const int categoryWeightsIndex,
@@ -347,6 +610,30 @@ protected:
                                             int count,
                                             double* outSumLogLikelihood);
     
+    int calcEdgeLogLikelihoodsMultiDeriv(const int* parentBufferIndices,
+                                         const int* childBufferIndices,
+                                         const int* probabilityIndices,
+                                         const int* firstDerivativeIndices,
+                                         const int* secondDerivativeIndices,
+                                         const int* categoryWeightsIndices,
+                                         const int* stateFrequenciesIndices,
+                                         const int* scalingFactorsIndices,
+                                         int count,
+                                         double* outSumLogLikelihood,
+                                         double* outSumFirstDerivative,
+                                         double* outSumSecondDerivative);
+
+    void calcEdgeSiteLikelihoods(int parentBufferIndex,
+                                 int childBufferIndex,
+                                 int probabilityIndex,
+                                 int firstDerivativeIndex,
+                                 int secondDerivativeIndex,
+                                 int categoryWeightsIndex,
+                                 int stateFrequenciesIndex,
+                                 double* outLikelihoods,
+                                 double* outFirstDerivatives,
+                                 double* outSecondDerivatives);
+
     virtual int calcEdgeLogLikelihoodsFirstDeriv(const int parentBufferIndex,
                                                   const int childBufferIndex,
                                                   const int probabilityIndex,
@@ -374,21 +661,27 @@ protected:
                                               const REALTYPE *child0TransMat,
                                               const int *child1States,
                                               const REALTYPE *child1TransMat,
-                                              const REALTYPE *scaleFactors);
+                                              const REALTYPE *scaleFactors,
+                                              int startPattern,
+                                              int endPattern);
 
     virtual void calcStatesPartialsFixedScaling(REALTYPE *destP,
                                                 const int *child0States,
                                                 const REALTYPE *child0TransMat,
                                                 const REALTYPE *child1Partials,
                                                 const REALTYPE *child1TransMat,
-                                                const REALTYPE *scaleFactors);
+                                                const REALTYPE *scaleFactors,
+                                                int startPattern,
+                                                int endPattern);
 
     virtual void calcPartialsPartialsFixedScaling(REALTYPE *destP,
                                             const REALTYPE *child0States,
                                             const REALTYPE *child0TransMat,
                                             const REALTYPE *child1Partials,
                                             const REALTYPE *child1TransMat,
-                                            const REALTYPE *scaleFactors);
+                                            const REALTYPE *scaleFactors,
+                                            int startPattern,
+                                            int endPattern);
     
     virtual void calcPartialsPartialsAutoScaling(REALTYPE* destP,
                                                   const REALTYPE* partials1,
@@ -397,18 +690,249 @@ protected:
                                                   const REALTYPE* matrices2,
                                                   int* activateScaling);
 
+    int removeCleanOperations(const int* operations,
+                              int operationCount,
+                              int cumulativeScalingIndex,
+                              std::vector<int>& dirtyOperations);
+
+    bool isMatrixClean(int matrixIndex,
+                       int eigenIndex,
+                       int order,
+                       double edgeLength);
+
+    void markMatrixComputed(int matrixIndex,
+                            int eigenIndex,
+                            int order,
+                            double edgeLength);
+
+    void markPartialsWritten(int bufferIndex);
+
+    void markMatrixWritten(int matrixIndex);
+
+    void markScaleBufferWritten(int scaleIndex);
+
+    int updatePartialsBlocked(const int* operations,
+                              int operationCount,
+                              int cumulativeScalingIndex);
+
+    // returns false if a cumulative exponent overflowed
+    bool accumulateScaleFactorsForPatterns(const int* scalingIndices,
+                                           int count,
+                                           int cumulativeScalingIndex,
+                                           int startPattern,
+                                           int endPattern);
+
+    void calcOperationPartials(REALTYPE* destPartials,
+                               int child1Index,
+                               const REALTYPE* matrices1,
+                               int child2Index,
+                               const REALTYPE* matrices2,
+                               int rescale,
+                               REALTYPE* scalingFactors,
+                               REALTYPE* cumulativeScaleBuffer,
+                               int startPattern,
+                               int endPattern);
+
+    void calcOperationPartialsForPatterns(REALTYPE* destPartials,
+                                          int child1Index,
+                                          const REALTYPE* matrices1,
+                                          int child2Index,
+                                          const REALTYPE* matrices2,
+                                          int rescale,
+                                          REALTYPE* scalingFactors,
+                                          REALTYPE* cumulativeScaleBuffer,
+                                          int startPattern,
+                                          int endPattern);
+
+    // rebuilds the active category index from the set category weights
+    void updateActiveCategories();
+
+    // rebuilds the active pattern index and runs from the pattern weights
+    void updateActivePatterns();
+
+    // the sum of values over the patterns with nonzero weight, weighted by pattern; fixed
+    // blocks of patterns are summed in order and the block sums pairwise, so that the
+    // result does not depend on how many threads share the blocks
+    template <typename T>
+    double sumActivePatterns(const T* values);
+
+    // records a kernel call started at startTime over units of one pattern of every active
+    // category, or of one transition matrix of every category
+    void recordKernel(int kernelClass,
+                      double startTime,
+                      double units);
+
     virtual void rescalePartials(REALTYPE *destP,
     		                     REALTYPE *scaleFactors,
                                  REALTYPE *cumulativeScaleFactors,
-                                 const int  fillWithOnes);
+                                 const int  fillWithOnes,
+                                 int startPattern,
+                                 int endPattern);
     
     virtual void autoRescalePartials(REALTYPE *destP,
     		                     signed short *scaleFactors);
 
+    // under dynamic scaling, points scalingFactors at the buffer an operation is rescaled
+    // into, holding the factors the partials were last scaled by; returns the rescale mode
+    int prepareDynamicScaling(int writeScalingIndex,
+                              int readScalingIndex,
+                              REALTYPE** scalingFactors,
+                              int startPattern,
+                              int endPattern);
+
+    // rescales only the patterns near underflow, adding the change of each factor to the
+    // cumulative factors
+    void rescalePartialsDynamic(REALTYPE* destP,
+                                REALTYPE* scaleFactors,
+                                REALTYPE* cumulativeScaleFactors,
+                                int startPattern,
+                                int endPattern);
+
+    // rescales by the power of two nearest below the pattern maximum, storing its exponent
+    // and adding it to the cumulative exponents unless these are NULL
+    void rescalePartialsExponent(REALTYPE* destP,
+                                 signed short* scaleExponents,
+                                 signed short* cumulativeScaleExponents,
+                                 int startPattern,
+                                 int endPattern);
+
+    // adds to a cumulative exponent, which is set to the overflow marker once the sum leaves
+    // the range of a signed short and then stays there; returns false on overflow
+    static bool addScaleExponent(signed short* cumulativeExponent,
+                                 int exponent);
+
+    // the factors a scale buffer of exponents stands for, over [startPattern, endPattern)
+    REALTYPE* expandScaleExponents(const signed short* scaleExponents,
+                                   int startPattern,
+                                   int endPattern);
+
+    // the log scale factors of a scale buffer; exponents are converted into scratch space,
+    // which the next call overwrites, with NaN for overflowed ones
+    const REALTYPE* getLogScaleFactors(int scaleIndex);
+
+    REALTYPE getLogScaleFactor(int scaleIndex,
+                               int pattern);
+
+    // allocates a scale buffer for the current kind of scalers, zeroed
+    void allocateScaleBuffer(int scaleIndex);
+
     virtual int getPaddedPatternsModulus();
 
     void* mallocAligned(size_t size);
 
+    void* mapScratchFile(size_t size);
+
+    const REALTYPE* buildAmbiguityLookup(int tipIndex,
+                                         const REALTYPE* matrices,
+                                         REALTYPE* lookup);
+
+    // fills the values that a checkpoint must match to be restored into this instance
+    void getCheckpointHeader(long* outHeader);
+
+    // reads a buffer written by CheckpointWriter::writeOptional, allocating or freeing
+    // the destination to match
+    template <typename T>
+    bool restoreOptionalBuffer(CheckpointReader* file,
+                               T** buffer,
+                               size_t count);
+
+    // drops the compact states and ambiguity data of a tip about to hold partials
+    void releaseTipStates(int bufferIndex);
+
+    // frees a buffer, or drops the reference of this instance to it if it is shared
+    template <typename T>
+    void releaseBuffer(T** buffer,
+                       SharedBuffer** sharedBuffer);
+
+    // gives this instance a private copy of a shared buffer that it is about to write to,
+    // leaving the contents uninitialized unless keepContents is set
+    template <typename T>
+    void detachBuffer(T** buffer,
+                      SharedBuffer** sharedBuffer,
+                      size_t count,
+                      bool keepContents);
+
+    // points buffer at source, shared from here on, dropping the buffer held before
+    template <typename T>
+    void shareBuffer(T** buffer,
+                     SharedBuffer** sharedBuffer,
+                     T* source,
+                     SharedBuffer** sourceSharedBuffer);
+
+    // makes the destination partials of a list of operations private, keeping the
+    // contents of those that an operation in the list also reads
+    void detachDestinationPartials(const int* operations,
+                                   int operationCount);
+
+    // grows the ambiguity lookup to hold the tables of maskCount masks
+    int reserveAmbiguityLookup(int maskCount);
+
+    // the values that decide how setTipPartials stores a tip, to key converted tips by
+    std::vector<long> getTipLayout();
+
+    // allocates a buffer and copies source into it, or frees it if source is NULL
+    template <typename T>
+    void copyOptionalBuffer(T** buffer,
+                            const T* source,
+                            size_t count);
+
+    // sets an Eigen decomposition saved in standard layout through setEigenDecomposition
+    void restoreEigenSystem(int eigenIndex,
+                            const double* eigenSystem);
+
+    // sets the model of projection and projects the partials of an edge onto it
+    void projectPartials(EdgeProjection* projection,
+                         const double* eigenSystem,
+                         int parentBufferIndex,
+                         int childBufferIndex,
+                         int categoryWeightsIndex,
+                         int stateFrequenciesIndex);
+
+    // sums the log likelihood and its two derivatives over patterns for optimizeEdgeLengths,
+    // without scale factors
+    void sumProjectedEdge(const EdgeProjection* projection,
+                          double edgeLength,
+                          double* outSums);
+
+    void getPatternPartials(int bufferIndex,
+                            int category,
+                            int pattern,
+                            double* outPartials);
+
+    int getAmbiguousCode(int tipIndex,
+                         int pattern);
+
+    void calcAmbiguousPatterns(REALTYPE* destPartials,
+                               int child1Index,
+                               const REALTYPE* matrices1,
+                               int child2Index,
+                               const REALTYPE* matrices2,
+                               const REALTYPE* scalingFactors,
+                               int startPattern,
+                               int endPattern);
+
+    void integrateAmbiguousTip(int childIndex,
+                               const REALTYPE* partialsParent,
+                               const REALTYPE* lookup,
+                               const REALTYPE* wt,
+                               REALTYPE* integration);
+
+    int calcAmbiguousEdgeSites(const int parIndex,
+                               const int childIndex,
+                               const int probIndex,
+                               const int firstDerivativeIndex,
+                               const int secondDerivativeIndex,
+                               const int categoryWeightsIndex,
+                               const int stateFrequenciesIndex,
+                               const int scalingFactorsIndex,
+                               double* outSumLogLikelihood,
+                               double* outSumFirstDerivative,
+                               double* outSumSecondDerivative);
+
+    void prefetchPatternBlock(const REALTYPE* partials,
+                              int startPattern,
+                              int endPattern);
+
 };
 
 BEAGLE_CPU_FACTORY_TEMPLATE
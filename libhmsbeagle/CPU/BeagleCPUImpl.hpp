@@ -79,7 +79,17 @@
 #include <cmath>
 #include <cassert>
 #include <vector>
+#include <algorithm>
 #include <cfloat>
+#include <limits>
+#include <cerrno>
+#include <string>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "libhmsbeagle/beagle.h"
 #include "libhmsbeagle/CPU/Precision.h"
@@ -132,6 +142,19 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
     // If you delete partials, make sure not to delete the last element
     // which is TEMP_SCRATCH_PARTIAL twice.
 
+#ifndef WIN32
+    if (gMappedBuffer != NULL) {
+        // Internal partials and scale buffers live in the scratch mapping
+        for (int i = kTipCount; i < kBufferCount; i++)
+            gPartials[i] = NULL;
+        if (!(kFlags & BEAGLE_FLAG_SCALING_AUTO)) {
+            for (int i = 0; i < kScaleBufferCount; i++)
+                gScaleBuffers[i] = NULL;
+        }
+        munmap(gMappedBuffer, kMappedSize);
+    }
+#endif
+
     for(unsigned int i=0; i<kEigenDecompCount; i++) {
 	    if (gCategoryWeights[i] != NULL)
 		    free(gCategoryWeights[i]);
@@ -146,10 +169,8 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
     free(gTransitionMatrices);
 
 	for(unsigned int i=0; i<kBufferCount; i++) {
-	    if (gPartials[i] != NULL)
-		    free(gPartials[i]);
-	    if (gTipStates[i] != NULL)
-		    free(gTipStates[i]);
+        releaseBuffer(&gPartials[i], &gSharedPartials[i]);
+        releaseBuffer(&gTipStates[i], &gSharedTipStates[i]);
 	}
     free(gPartials);
     free(gTipStates);
@@ -174,21 +195,44 @@ BeagleCPUImpl<BEAGLE_CPU_GENERIC>::~BeagleCPUImpl() {
     if (gScaleBuffers)
         free(gScaleBuffers);
 
-	free(gCategoryRates);
-    free(gPatternWeights);
+    free(gCategoryRates);
+    releaseBuffer(&gPatternWeights, &gSharedPatternWeights);
 
-	free(integrationTmp);
+    free(integrationTmp);
     free(firstDerivTmp);
     free(secondDerivTmp);
 
-    free(outLogLikelihoodsTmp);
-    free(outFirstDerivativesTmp);
-    free(outSecondDerivativesTmp);
+    for (int i = 0; i < 3; i++) {
+        free(gSiteBuffers[i]);
+    }
+
+    free(ones);
+    free(zeros);
+
+    if (gAmbiguityLookup != NULL)
+        free(gAmbiguityLookup);
 
-	free(ones);
-	free(zeros);
+    if (gExponentScaleFactors != NULL)
+        free(gExponentScaleFactors);
 
-	delete gEigenDecomposition;
+    if (gRootScratchPartials != NULL)
+        free(gRootScratchPartials);
+
+    for (int i = 0; i < 2; i++) {
+        if (gOperationMatrices[i] != NULL)
+            free(gOperationMatrices[i]);
+    }
+
+    delete gEigenDecomposition;
+
+    if (gSparseRateMatrices != NULL) {
+        for (int i = 0; i < kEigenDecompCount; i++)
+            delete gSparseRateMatrices[i];
+        free(gSparseRateMatrices);
+    }
+
+    delete gEdgeProjection;
+    delete gEdgeOptimizerProjection;
 }
 
 BEAGLE_CPU_TEMPLATE
@@ -208,6 +252,23 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     if (DEBUGGING_OUTPUT)
         std::cerr << "in BeagleCPUImpl::initialize\n" ;
 
+    gMappedBuffer = NULL;
+    kMappedSize = 0;
+    gAmbiguityLookup = NULL;
+    kAmbiguityLookupSize = 0;
+    gSparseRateMatrices = NULL;
+    gEdgeProjection = NULL;
+    gEdgeOptimizerProjection = NULL;
+    gSharedPatternWeights = NULL;
+    kDirtyTracking = false;
+    kDirtyClock = 0;
+    kCategoryRatesStamp = 0;
+    kExponentScalers = false;
+    gExponentScaleFactors = NULL;
+    gRootScratchPartials = NULL;
+    gOperationMatrices[0] = NULL;
+    gOperationMatrices[1] = NULL;
+
     if (DOUBLE_PRECISION) {
         realtypeMin = DBL_MIN;
         scalingExponentThreshhold = 200;
@@ -236,6 +297,20 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     }
     kExtraPatterns = kPaddedPatternCount - kPatternCount;
 
+    // Pattern blocks must start on a padded-pattern boundary for the vectorized kernels
+    kPatternBlockSize = BEAGLE_CPU_PATTERN_BLOCK_BYTES / (sizeof(REALTYPE) * kPartialsPaddedStateCount);
+    kPatternBlockSize -= kPatternBlockSize % modulus;
+    if (kPatternBlockSize < modulus)
+        kPatternBlockSize = modulus;
+
+    kCacheBlockSize = BEAGLE_CPU_CACHE_BLOCK_BYTES / (sizeof(REALTYPE) * kPartialsPaddedStateCount * categoryCount);
+    kCacheBlockSize -= kCacheBlockSize % modulus;
+    if (kCacheBlockSize < modulus)
+        kCacheBlockSize = modulus;
+
+    kDynamicScalingThreshold = ldexp(REALTYPE(1.0),
+                                     std::numeric_limits<REALTYPE>::min_exponent / BEAGLE_CPU_DYNAMIC_SCALING_RANGE);
+
     kMatrixCount = matrixCount;
     kEigenDecompCount = eigenDecompositionCount;
 	kCategoryCount = categoryCount;
@@ -275,6 +350,17 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     	kFlags |= BEAGLE_FLAG_INVEVEC_TRANSPOSED;
     else
         kFlags |= BEAGLE_FLAG_INVEVEC_STANDARD;
+
+#ifndef WIN32
+    if (requirementFlags & BEAGLE_FLAG_MEMORY_MAPPED || preferenceFlags & BEAGLE_FLAG_MEMORY_MAPPED)
+        kFlags |= BEAGLE_FLAG_MEMORY_MAPPED;
+#endif
+
+    if (requirementFlags & BEAGLE_FLAG_TRAVERSAL_BLOCKED || preferenceFlags & BEAGLE_FLAG_TRAVERSAL_BLOCKED)
+        kFlags |= BEAGLE_FLAG_TRAVERSAL_BLOCKED;
+
+    if (requirementFlags & BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR || preferenceFlags & BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR)
+        kFlags |= BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR;
     
     if (kFlags & BEAGLE_FLAG_EIGEN_COMPLEX)
     	gEigenDecomposition = new EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>(kEigenDecompCount,
@@ -283,6 +369,11 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     	gEigenDecomposition = new EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>(kEigenDecompCount,
     			kStateCount, kCategoryCount,kFlags);
 
+    gSparseRateMatrices = (SparseRateMatrix**) calloc(kEigenDecompCount, sizeof(SparseRateMatrix*));
+    if (gSparseRateMatrices == NULL) {
+        throw std::bad_alloc();
+    }
+
 	gCategoryRates = (double*) malloc(sizeof(double) * kCategoryCount);
 	if (gCategoryRates == NULL)
 		throw std::bad_alloc();
@@ -294,6 +385,14 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     // TODO: if pattern padding is implemented this will create problems with setTipPartials
     kPartialsSize = kPaddedPatternCount * kPartialsPaddedStateCount * kCategoryCount;
 
+    if (kFlags & BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR) {
+        kPartialsCategoryStride = kPartialsPaddedStateCount;
+        kPartialsPatternStride = kPartialsPaddedStateCount * kCategoryCount;
+    } else {
+        kPartialsCategoryStride = kPartialsPaddedStateCount * kPaddedPatternCount;
+        kPartialsPatternStride = kPartialsPaddedStateCount;
+    }
+
     gPartials = (REALTYPE**) malloc(sizeof(REALTYPE*) * kBufferCount);
     if (gPartials == NULL)
      throw std::bad_alloc();
@@ -306,6 +405,18 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     if (gCategoryWeights == NULL)
         throw std::bad_alloc();
 
+    // everything is active until weights are set
+    gActiveCategories.clear();
+    for (int l = 0; l < kCategoryCount; l++)
+        gActiveCategories.push_back(l);
+    kActiveCategoryCount = kCategoryCount;
+    gActivePatterns.clear();
+    for (int k = 0; k < kPatternCount; k++)
+        gActivePatterns.push_back(k);
+    kActivePatternCount = kPatternCount;
+    gActivePatternRuns.assign(1, 0);
+    gActivePatternRuns.push_back(kPatternCount);
+
     // assigning kBufferCount to this array so that we can just check if a tipStateBuffer is
     // allocated
     gTipStates = (int**) malloc(sizeof(int*) * kBufferCount);
@@ -316,9 +427,38 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
         gPartials[i] = NULL;
         gTipStates[i] = NULL;
     }
+    gSharedPartials.assign(kBufferCount, NULL);
+    gSharedTipStates.assign(kBufferCount, NULL);
+
+    gAmbiguousPatterns.resize(kTipCount);
+    gAmbiguousCodes.resize(kTipCount);
+    gAmbiguityMasks.resize(kTipCount);
+
+    size_t mappedPartialsSize = 0;
+    size_t mappedScaleBufferSize = 0;
+#ifndef WIN32
+    if (kFlags & BEAGLE_FLAG_MEMORY_MAPPED) {
+        // Page-align each partials buffer so that prefetch hints never straddle buffers
+        const size_t pageSize = sysconf(_SC_PAGESIZE);
+        mappedPartialsSize = sizeof(REALTYPE) * kPartialsSize;
+        mappedPartialsSize += (pageSize - mappedPartialsSize % pageSize) % pageSize;
+        if (!(kFlags & BEAGLE_FLAG_SCALING_AUTO)) {
+            mappedScaleBufferSize = sizeof(REALTYPE) * scaleBufferSize;
+            mappedScaleBufferSize += (32 - mappedScaleBufferSize % 32) % 32;
+        }
+        kMappedSize = mappedPartialsSize * kInternalPartialsBufferCount +
+                      mappedScaleBufferSize * kScaleBufferCount;
+        gMappedBuffer = mapScratchFile(kMappedSize);
+        if (gMappedBuffer == NULL)
+            throw std::bad_alloc();
+    }
+#endif
 
     for (int i = kTipCount; i < kBufferCount; i++) {
-        gPartials[i] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+        if (gMappedBuffer != NULL)
+            gPartials[i] = (REALTYPE*) ((char*) gMappedBuffer + mappedPartialsSize * (i - kTipCount));
+        else
+            gPartials[i] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
         if (gPartials[i] == NULL)
             throw std::bad_alloc();
     }
@@ -345,7 +485,12 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
             throw std::bad_alloc();
         
         for (int i = 0; i < kScaleBufferCount; i++) {
-            gScaleBuffers[i] = (REALTYPE*) malloc(sizeof(REALTYPE) * scaleBufferSize);
+            if (gMappedBuffer != NULL)
+                gScaleBuffers[i] = (REALTYPE*) ((char*) gMappedBuffer +
+                                                mappedPartialsSize * kInternalPartialsBufferCount +
+                                                mappedScaleBufferSize * i);
+            else
+                gScaleBuffers[i] = (REALTYPE*) malloc(sizeof(REALTYPE) * scaleBufferSize);
             
             if (gScaleBuffers[i] == 0L)
                 throw std::bad_alloc();
@@ -376,6 +521,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::createInstance(int tipCount,
     outLogLikelihoodsTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kPatternCount * kStateCount);
     outFirstDerivativesTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kPatternCount * kStateCount);
     outSecondDerivativesTmp = (REALTYPE*) malloc(sizeof(REALTYPE) * kPatternCount * kStateCount);
+    gSiteBuffers[0] = outLogLikelihoodsTmp;
+    gSiteBuffers[1] = outFirstDerivativesTmp;
+    gSiteBuffers[2] = outSecondDerivativesTmp;
 
     zeros = (REALTYPE*) malloc(sizeof(REALTYPE) * kPaddedPatternCount);
     ones = (REALTYPE*) malloc(sizeof(REALTYPE) * kPaddedPatternCount);
@@ -415,8 +563,12 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipStates(int tipIndex,
                                 const int* inStates) {
     if (tipIndex < 0 || tipIndex >= kTipCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
-    gTipStates[tipIndex] = (int*) mallocAligned(sizeof(int) * kPaddedPatternCount);
-    // TODO: What if this throws a memory full error?
+    detachBuffer(&gTipStates[tipIndex], &gSharedTipStates[tipIndex], kPaddedPatternCount, false);
+    if (gTipStates[tipIndex] == NULL) {
+        gTipStates[tipIndex] = (int*) mallocAligned(sizeof(int) * kPaddedPatternCount);
+        if (gTipStates[tipIndex] == NULL)
+            return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
 	for (int j = 0; j < kPatternCount; j++) {
 		gTipStates[tipIndex][j] = (inStates[j] < kStateCount ? inStates[j] : kStateCount);
 	}
@@ -424,6 +576,63 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipStates(int tipIndex,
 		gTipStates[tipIndex][j] = kStateCount;
 	}
 
+    gAmbiguousPatterns[tipIndex].clear();
+    gAmbiguousCodes[tipIndex].clear();
+    gAmbiguityMasks[tipIndex].clear();
+    markPartialsWritten(tipIndex);
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipStateMasks(int tipIndex,
+                                    const int* inStateMasks) {
+    if (tipIndex < 0 || tipIndex >= kTipCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (kStateCount > 32)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    const unsigned int allStates = (kStateCount == 32 ? 0xFFFFFFFFu : (1u << kStateCount) - 1);
+
+    std::vector<int> states(kPatternCount);
+    std::vector<int> patterns;
+    std::vector<int> codes;
+    std::vector<int> masks;
+    for (int k = 0; k < kPatternCount; k++) {
+        const unsigned int mask = ((unsigned int) inStateMasks[k]) & allStates;
+        if (mask == 0 || mask == allStates) {
+            states[k] = kStateCount;
+        } else if ((mask & (mask - 1)) == 0) {
+            int state = 0;
+            while (!((mask >> state) & 1u))
+                state++;
+            states[k] = state;
+        } else {
+            // Ambiguous patterns are computed as missing by the kernels and then patched up
+            states[k] = kStateCount;
+            int code = 0;
+            while (code < (int) masks.size() && masks[code] != (int) mask)
+                code++;
+            if (code == (int) masks.size())
+                masks.push_back((int) mask);
+            patterns.push_back(k);
+            codes.push_back(code);
+        }
+    }
+
+    int returnCode = setTipStates(tipIndex, &states[0]);
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    returnCode = reserveAmbiguityLookup(masks.size());
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    gAmbiguousPatterns[tipIndex].swap(patterns);
+    gAmbiguousCodes[tipIndex].swap(codes);
+    gAmbiguityMasks[tipIndex].swap(masks);
+    markPartialsWritten(tipIndex);
+
     return BEAGLE_SUCCESS;
 }
 
@@ -432,6 +641,52 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipPartials(int tipIndex,
                                   const double* inPartials) {
     if (tipIndex < 0 || tipIndex >= kTipCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    // Tips whose partials are all 0s and 1s are stored as compact states, which selects
+    // the states kernels. Sites with several 1s go through the ambiguity masks, but only
+    // while they are rare enough for the per-site fix-up to stay cheaper than partials.
+    std::vector<int> states(kPatternCount);
+    std::vector<int> masks(kPatternCount);
+    bool isZeroOne = true;
+    int ambiguousCount = 0;
+    for (int k = 0; k < kPatternCount && isZeroOne; k++) {
+        const double* sitePartials = inPartials + k * kStateCount;
+        unsigned int mask = 0;
+        int ones = 0;
+        for (int i = 0; i < kStateCount; i++) {
+            if (sitePartials[i] == 1.0) {
+                states[k] = i;
+                if (i < 32)
+                    mask |= 1u << i;
+                ones++;
+            } else if (sitePartials[i] != 0.0) {
+                isZeroOne = false;
+            }
+        }
+        if (ones == kStateCount) {
+            states[k] = kStateCount;
+        } else if (ones != 1) {
+            // An all-zero site is kept as partials, it would otherwise become missing data
+            if (ones == 0 || kStateCount > 32)
+                isZeroOne = false;
+            ambiguousCount++;
+        }
+        masks[k] = (int) mask;
+    }
+    if (isZeroOne && ambiguousCount * 4 <= kPatternCount) {
+        int returnCode;
+        if (ambiguousCount == 0)
+            returnCode = setTipStates(tipIndex, &states[0]);
+        else
+            returnCode = setTipStateMasks(tipIndex, &masks[0]);
+        if (returnCode == BEAGLE_SUCCESS)
+            releaseBuffer(&gPartials[tipIndex], &gSharedPartials[tipIndex]);
+        return returnCode;
+    }
+
+    releaseTipStates(tipIndex);
+
+    detachBuffer(&gPartials[tipIndex], &gSharedPartials[tipIndex], kPartialsSize, false);
     if(gPartials[tipIndex] == NULL) {
         gPartials[tipIndex] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
         // TODO: What if this throws a memory full error?
@@ -439,20 +694,31 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipPartials(int tipIndex,
             return BEAGLE_ERROR_OUT_OF_MEMORY;
     }
 
+    if (kPatternCount == kPaddedPatternCount && kPartialsPatternStride == kStateCount) {
+        for (int l = 0; l < kCategoryCount; l++)
+            beagleMemCpy(gPartials[tipIndex] + l * kPartialsCategoryStride, inPartials,
+                         kPatternCount * kStateCount);
+        markPartialsWritten(tipIndex);
+        return BEAGLE_SUCCESS;
+    }
+
     const double* inPartialsOffset;
-    REALTYPE* tmpRealPartialsOffset = gPartials[tipIndex];
     for (int l = 0; l < kCategoryCount; l++) {
+        REALTYPE* tmpRealPartialsOffset = gPartials[tipIndex] + l * kPartialsCategoryStride;
         inPartialsOffset = inPartials;
         for (int i = 0; i < kPatternCount; i++) {
         	beagleMemCpy(tmpRealPartialsOffset, inPartialsOffset, kStateCount);
-            tmpRealPartialsOffset += kPartialsPaddedStateCount;
+            tmpRealPartialsOffset += kPartialsPatternStride;
             inPartialsOffset += kStateCount;
         }
     	// Pad extra buffer with zeros
-    	for(int k = 0; k < kPartialsPaddedStateCount * (kPaddedPatternCount - kPatternCount); k++) {
-    		*tmpRealPartialsOffset++ = 0;
+    	for(int i = kPatternCount; i < kPaddedPatternCount; i++) {
+            for (int k = 0; k < kPartialsPaddedStateCount; k++)
+                tmpRealPartialsOffset[k] = 0;
+            tmpRealPartialsOffset += kPartialsPatternStride;
     	}
     }
+    markPartialsWritten(tipIndex);
 
     return BEAGLE_SUCCESS;
 }
@@ -462,25 +728,66 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPartials(int bufferIndex,
                                const double* inPartials) {
     if (bufferIndex < 0 || bufferIndex >= kBufferCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    // A compact tip would otherwise keep selecting the states kernels over these partials
+    releaseTipStates(bufferIndex);
+
+    detachBuffer(&gPartials[bufferIndex], &gSharedPartials[bufferIndex], kPartialsSize, false);
     if (gPartials[bufferIndex] == NULL) {
         gPartials[bufferIndex] = (REALTYPE*) malloc(sizeof(REALTYPE) * kPartialsSize);
         if (gPartials[bufferIndex] == 0L)
             return BEAGLE_ERROR_OUT_OF_MEMORY;
     }
     
+    if (kPatternCount == kPaddedPatternCount && kPartialsPatternStride == kStateCount) {
+        beagleMemCpy(gPartials[bufferIndex], inPartials, kPartialsSize);
+        markPartialsWritten(bufferIndex);
+        return BEAGLE_SUCCESS;
+    }
+
     const double* inPartialsOffset = inPartials;
-    REALTYPE* tmpRealPartialsOffset = gPartials[bufferIndex];
     for (int l = 0; l < kCategoryCount; l++) {
+        REALTYPE* tmpRealPartialsOffset = gPartials[bufferIndex] + l * kPartialsCategoryStride;
         for (int i = 0; i < kPatternCount; i++) {
         	beagleMemCpy(tmpRealPartialsOffset, inPartialsOffset, kStateCount);
-            tmpRealPartialsOffset += kPartialsPaddedStateCount;
+            tmpRealPartialsOffset += kPartialsPatternStride;
             inPartialsOffset += kStateCount;
         }
     	// Pad extra buffer with zeros
-    	for(int k = 0; k < kPartialsPaddedStateCount * (kPaddedPatternCount - kPatternCount); k++) {
-    		*tmpRealPartialsOffset++ = 0;
+    	for(int i = kPatternCount; i < kPaddedPatternCount; i++) {
+            for (int k = 0; k < kPartialsPaddedStateCount; k++)
+                tmpRealPartialsOffset[k] = 0;
+            tmpRealPartialsOffset += kPartialsPatternStride;
     	}
     }
+    markPartialsWritten(bufferIndex);
+
+    return BEAGLE_SUCCESS;
+}
+
+/*
+ * Client memory in the layout of the partials buffers is held like a buffer shared with
+ *  another instance, so that any write to the buffer index first takes a private copy.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPartialsBuffer(int bufferIndex,
+                                                         const double* inPartials) {
+    if (bufferIndex < 0 || bufferIndex >= kBufferCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    releaseTipStates(bufferIndex);
+
+    // Otherwise the memory is converted or rearranged as by setPartials
+    const bool inPlace = (DOUBLE_PRECISION && gMappedBuffer == NULL &&
+                          kPatternCount == kPaddedPatternCount && kPartialsPatternStride == kStateCount &&
+                          ((size_t) inPartials) % 32 == 0);
+    if (!inPlace)
+        return setPartials(bufferIndex, inPartials);
+
+    releaseBuffer(&gPartials[bufferIndex], &gSharedPartials[bufferIndex]);
+    gPartials[bufferIndex] = (REALTYPE*) inPartials;
+    gSharedPartials[bufferIndex] = new SharedBuffer(true);
+    markPartialsWritten(bufferIndex);
 
     return BEAGLE_SUCCESS;
 }
@@ -495,21 +802,43 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getPartials(int bufferIndex,
     if (bufferIndex < 0 || bufferIndex >= kBufferCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
 
-    if (kPatternCount == kPaddedPatternCount) {
+    if (gPartials[bufferIndex] == NULL) {
+        if (gTipStates[bufferIndex] == NULL)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        // Expand a compact tip back into partials, ambiguous sites from their masks
+        const int* tipStates = gTipStates[bufferIndex];
+        double* offsetOutPartials = outPartials;
+        for (int k = 0; k < kPatternCount; k++) {
+            const int state = tipStates[k];
+            for (int i = 0; i < kStateCount; i++)
+                offsetOutPartials[i] = (state == kStateCount || state == i ? 1.0 : 0.0);
+            offsetOutPartials += kStateCount;
+        }
+        const std::vector<int>& patterns = gAmbiguousPatterns[bufferIndex];
+        for (size_t p = 0; p < patterns.size(); p++) {
+            const unsigned int mask = gAmbiguityMasks[bufferIndex][gAmbiguousCodes[bufferIndex][p]];
+            for (int i = 0; i < kStateCount; i++)
+                outPartials[patterns[p] * kStateCount + i] = ((mask >> i) & 1u ? 1.0 : 0.0);
+        }
+        for (int l = 1; l < kCategoryCount; l++)
+            memcpy(outPartials + l * kPatternCount * kStateCount, outPartials,
+                   sizeof(double) * kPatternCount * kStateCount);
+    } else if (kPatternCount == kPaddedPatternCount && kPartialsPatternStride == kStateCount) {
     	beagleMemCpy(outPartials, gPartials[bufferIndex], kPartialsSize);
-    } else { // Need to remove padding
-    	double *offsetOutPartials;
-    	REALTYPE* offsetBeaglePartials = gPartials[bufferIndex];
+    } else { // Need to remove padding or reorder patterns
+    	double *offsetOutPartials = outPartials;
     	for(int i = 0; i < kCategoryCount; i++) {
-    		beagleMemCpy(offsetOutPartials,offsetBeaglePartials,
-    				kPatternCount * kStateCount);
-    		offsetOutPartials += kPatternCount * kStateCount;
-    		offsetBeaglePartials += kPaddedPatternCount * kStateCount;
+    		const REALTYPE* offsetBeaglePartials = gPartials[bufferIndex] + i * kPartialsCategoryStride;
+    		for(int k = 0; k < kPatternCount; k++) {
+    			beagleMemCpy(offsetOutPartials, offsetBeaglePartials, kStateCount);
+    			offsetOutPartials += kStateCount;
+    			offsetBeaglePartials += kPartialsPatternStride;
+    		}
     	}
     }
 
     if (cumulativeScaleIndex != BEAGLE_OP_NONE) {
-    	REALTYPE* cumulativeScaleBuffer = gScaleBuffers[cumulativeScaleIndex];
+    	const REALTYPE* cumulativeScaleBuffer = getLogScaleFactors(cumulativeScaleIndex);
     	int index = 0;
     	for(int k=0; k<kPatternCount; k++) {
     		REALTYPE scaleFactor = exp(cumulativeScaleBuffer[k]);
@@ -531,19 +860,37 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setEigenDecomposition(int eigenIndex,
                                          const double* inEigenValues) {
 
 	gEigenDecomposition->setEigenDecomposition(eigenIndex, inEigenVectors, inInverseEigenVectors, inEigenValues);
-	return BEAGLE_SUCCESS;
+    if (kDirtyTracking)
+        gEigenStamps[eigenIndex] = ++kDirtyClock;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setRateMatrix(int eigenIndex,
+                                                     const double* inRateMatrix) {
+    if (eigenIndex < 0 || eigenIndex >= kEigenDecompCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    gEigenDecomposition->setRateMatrix(eigenIndex, inRateMatrix);
+    if (kDirtyTracking)
+        gEigenStamps[eigenIndex] = ++kDirtyClock;
+    return BEAGLE_SUCCESS;
 }
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCategoryRates(const double* inCategoryRates) {
 	memcpy(gCategoryRates, inCategoryRates, sizeof(double) * kCategoryCount);
+    if (kDirtyTracking)
+        kCategoryRatesStamp = ++kDirtyClock;
     return BEAGLE_SUCCESS;
 }
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setPatternWeights(const double* inPatternWeights) {
     assert(inPatternWeights != 0L);
+    detachBuffer(&gPatternWeights, &gSharedPatternWeights, kPatternCount, false);
     memcpy(gPatternWeights, inPatternWeights, sizeof(double) * kPatternCount);
+    updateActivePatterns();
     return BEAGLE_SUCCESS;
 }
 
@@ -573,6 +920,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setCategoryWeights(int categoryWeightsInd
             return BEAGLE_ERROR_OUT_OF_MEMORY;
     }
     beagleMemCpy(gCategoryWeights[categoryWeightsIndex], inCategoryWeights, kCategoryCount);
+    updateActiveCategories();
 
     return BEAGLE_SUCCESS;
 }
@@ -615,6 +963,379 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getSiteDerivatives(double* outFirstDeriva
     return BEAGLE_SUCCESS;
 }
 
+/*
+ * The kernels only ever index the site arrays by pattern, so a client buffer of
+ *  kPatternCount doubles can take the place of each.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setSiteBuffers(double* outLogLikelihoods,
+                                                      double* outFirstDerivatives,
+                                                      double* outSecondDerivatives) {
+    if (!DOUBLE_PRECISION)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    double* buffers[3] = {outLogLikelihoods, outFirstDerivatives, outSecondDerivatives};
+    REALTYPE** sites[3] = {&outLogLikelihoodsTmp, &outFirstDerivativesTmp, &outSecondDerivativesTmp};
+    for (int i = 0; i < 3; i++) {
+        REALTYPE* site = (buffers[i] != NULL ? (REALTYPE*) buffers[i] : gSiteBuffers[i]);
+        // keep the values of the last integration
+        if (site != *sites[i])
+            beagleMemCpy(site, *sites[i], kPatternCount);
+        *sites[i] = site;
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::saveInstance(const char* fileName) {
+    CheckpointWriter file(fileName);
+    long header[BEAGLE_CPU_CHECKPOINT_HEADER_SIZE];
+    getCheckpointHeader(header);
+    file.write("BEAGLECP", 8);
+    file.write(header, BEAGLE_CPU_CHECKPOINT_HEADER_SIZE);
+    file.write((int) kExponentScalers);
+
+    file.write(gCategoryRates, kCategoryCount);
+    file.write(gPatternWeights, kPatternCount);
+
+    std::vector<int> rowIndices, columnIndices;
+    std::vector<double> rates;
+    for (int i = 0; i < kEigenDecompCount; i++) {
+        file.writeOptional(gCategoryWeights[i], kCategoryCount);
+        file.writeOptional(gStateFrequencies[i], kStateCount);
+        // rate matrices and Eigen systems are kept in double precision, so are saved as set
+        file.writeOptional(gEigenDecomposition->getEigenSystem(i), 2 * kStateCount * (kStateCount + 1));
+        file.writeOptional(gEigenDecomposition->getRateMatrix(i), kStateCount * kStateCount);
+        file.write((int) (gSparseRateMatrices[i] != NULL));
+        if (gSparseRateMatrices[i] != NULL) {
+            gSparseRateMatrices[i]->getRates(&rowIndices, &columnIndices, &rates);
+            file.writeVector(rowIndices);
+            file.writeVector(columnIndices);
+            file.writeVector(rates);
+        }
+    }
+
+    for (int i = 0; i < kTipCount; i++) {
+        file.writeOptional(gTipStates[i], kPaddedPatternCount);
+        file.writeVector(gAmbiguousPatterns[i]);
+        file.writeVector(gAmbiguousCodes[i]);
+        file.writeVector(gAmbiguityMasks[i]);
+    }
+    for (int i = 0; i < kBufferCount; i++)
+        file.writeOptional(gPartials[i], kPartialsSize);
+
+    if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
+        file.write(gScaleBuffers[0], kPaddedPatternCount);
+        for (int i = 0; i < kScaleBufferCount; i++)
+            file.write(gAutoScaleBuffers[i], kPaddedPatternCount);
+        file.write(gActiveScalingFactors, kInternalPartialsBufferCount);
+    } else if (kExponentScalers) {
+        for (int i = 0; i < kScaleBufferCount; i++)
+            file.write((const signed short*) gScaleBuffers[i], kPaddedPatternCount);
+    } else {
+        for (int i = 0; i < kScaleBufferCount; i++)
+            file.write(gScaleBuffers[i], kPaddedPatternCount);
+    }
+
+    for (int i = 0; i < kMatrixCount; i++)
+        file.write(gTransitionMatrices[i], kMatrixSize * kCategoryCount);
+
+    if (!file.close())
+        return BEAGLE_ERROR_GENERAL;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::restoreInstance(const char* fileName) {
+    CheckpointReader file(fileName);
+    if (!file.isOpen())
+        return BEAGLE_ERROR_GENERAL;
+
+    char magic[8];
+    long header[BEAGLE_CPU_CHECKPOINT_HEADER_SIZE];
+    long expectedHeader[BEAGLE_CPU_CHECKPOINT_HEADER_SIZE];
+    getCheckpointHeader(expectedHeader);
+    if (!file.read(magic, 8) || memcmp(magic, "BEAGLECP", 8) != 0 ||
+        !file.read(header, BEAGLE_CPU_CHECKPOINT_HEADER_SIZE) ||
+        memcmp(header, expectedHeader, sizeof(header)) != 0)
+        return BEAGLE_ERROR_GENERAL;
+
+    int exponentScalers = 0;
+    if (!file.read(&exponentScalers) ||
+        ((exponentScalers != 0) != kExponentScalers &&
+         setExponentScalers(exponentScalers) != BEAGLE_SUCCESS))
+        return BEAGLE_ERROR_GENERAL;
+
+    // every buffer is overwritten, so shared ones are given up without copying them
+    detachBuffer(&gPatternWeights, &gSharedPatternWeights, kPatternCount, false);
+    for (int i = 0; i < kBufferCount; i++) {
+        detachBuffer(&gPartials[i], &gSharedPartials[i], kPartialsSize, false);
+        detachBuffer(&gTipStates[i], &gSharedTipStates[i], kPaddedPatternCount, false);
+    }
+
+    // from here on a short file leaves the instance partly restored
+    bool ok = (file.read(gCategoryRates, kCategoryCount) &&
+               file.read(gPatternWeights, kPatternCount));
+
+    std::vector<double> system;
+    std::vector<int> rowIndices, columnIndices;
+    std::vector<double> rates;
+    for (int i = 0; i < kEigenDecompCount && ok; i++) {
+        ok = (restoreOptionalBuffer(&file, &gCategoryWeights[i], kCategoryCount) &&
+              restoreOptionalBuffer(&file, &gStateFrequencies[i], kStateCount));
+        int present = 0;
+        if (ok && (ok = file.read(&present)) && present) {
+            system.resize(2 * kStateCount * (kStateCount + 1));
+            if ((ok = file.read(&system[0], system.size())))
+                restoreEigenSystem(i, &system[0]);
+        }
+        if (ok && (ok = file.read(&present)) && present) {
+            system.resize(kStateCount * kStateCount);
+            if ((ok = file.read(&system[0], system.size())))
+                setRateMatrix(i, &system[0]);
+        }
+        if (ok && (ok = file.read(&present)) && present) {
+            ok = (file.readVector(&rowIndices) && file.readVector(&columnIndices) &&
+                  file.readVector(&rates) && rowIndices.size() == columnIndices.size() &&
+                  rowIndices.size() == rates.size());
+            if (ok)
+                ok = (setSparseRateMatrix(i, (int) rates.size(), (rates.empty() ? NULL : &rowIndices[0]),
+                                          (rates.empty() ? NULL : &columnIndices[0]),
+                                          (rates.empty() ? NULL : &rates[0])) == BEAGLE_SUCCESS);
+        }
+    }
+
+    for (int i = 0; i < kTipCount && ok; i++) {
+        ok = (restoreOptionalBuffer(&file, &gTipStates[i], kPaddedPatternCount) &&
+              file.readVector(&gAmbiguousPatterns[i]) &&
+              file.readVector(&gAmbiguousCodes[i]) &&
+              file.readVector(&gAmbiguityMasks[i]));
+    }
+    for (int i = 0; i < kBufferCount && ok; i++) {
+        if (i >= kTipCount) {
+            // internal buffers may live in the scratch mapping, so are only ever copied into
+            int present = 0;
+            ok = (file.read(&present) && present && file.read(gPartials[i], kPartialsSize));
+        } else {
+            ok = restoreOptionalBuffer(&file, &gPartials[i], kPartialsSize);
+        }
+        markPartialsWritten(i);
+    }
+
+    if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
+        ok = ok && file.read(gScaleBuffers[0], kPaddedPatternCount);
+        for (int i = 0; i < kScaleBufferCount && ok; i++)
+            ok = file.read(gAutoScaleBuffers[i], kPaddedPatternCount);
+        ok = ok && file.read(gActiveScalingFactors, kInternalPartialsBufferCount);
+    } else {
+        for (int i = 0; i < kScaleBufferCount && ok; i++) {
+            if (kExponentScalers)
+                ok = file.read((signed short*) gScaleBuffers[i], kPaddedPatternCount);
+            else
+                ok = file.read(gScaleBuffers[i], kPaddedPatternCount);
+            markScaleBufferWritten(i);
+        }
+    }
+
+    for (int i = 0; i < kMatrixCount && ok; i++) {
+        ok = file.read(gTransitionMatrices[i], kMatrixSize * kCategoryCount);
+        markMatrixWritten(i);
+    }
+
+    if (kDirtyTracking)
+        kCategoryRatesStamp = ++kDirtyClock;
+    updateActiveCategories();
+    updateActivePatterns();
+
+    if (!ok || !file.atEnd())
+        return BEAGLE_ERROR_GENERAL;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::cloneInstance(BeagleImpl* sourceInstance) {
+    BeagleCPUImpl<BEAGLE_CPU_GENERIC>* source =
+        dynamic_cast<BeagleCPUImpl<BEAGLE_CPU_GENERIC>*>(sourceInstance);
+    if (source == NULL)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    // partials in the scratch mapping are unmapped with their instance, so cannot be shared
+    if (gMappedBuffer != NULL || source->gMappedBuffer != NULL)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    long header[BEAGLE_CPU_CHECKPOINT_HEADER_SIZE];
+    long sourceHeader[BEAGLE_CPU_CHECKPOINT_HEADER_SIZE];
+    getCheckpointHeader(header);
+    source->getCheckpointHeader(sourceHeader);
+    if (memcmp(header, sourceHeader, sizeof(header)) != 0 || kFlags != source->kFlags)
+        return BEAGLE_ERROR_GENERAL;
+
+    // the large buffers are shared
+    shareBuffer(&gPatternWeights, &gSharedPatternWeights,
+                source->gPatternWeights, &source->gSharedPatternWeights);
+    for (int i = 0; i < kBufferCount; i++) {
+        shareBuffer(&gPartials[i], &gSharedPartials[i], source->gPartials[i], &source->gSharedPartials[i]);
+        shareBuffer(&gTipStates[i], &gSharedTipStates[i], source->gTipStates[i], &source->gSharedTipStates[i]);
+    }
+    gAmbiguousPatterns = source->gAmbiguousPatterns;
+    gAmbiguousCodes = source->gAmbiguousCodes;
+    gAmbiguityMasks = source->gAmbiguityMasks;
+    if (source->kAmbiguityLookupSize > 0) {
+        gAmbiguityLookup = (REALTYPE*) malloc(sizeof(REALTYPE) * source->kAmbiguityLookupSize);
+        if (gAmbiguityLookup == NULL)
+            throw std::bad_alloc();
+        kAmbiguityLookupSize = source->kAmbiguityLookupSize;
+    }
+
+    // the model and everything sized by patterns alone are copied
+    memcpy(gCategoryRates, source->gCategoryRates, sizeof(double) * kCategoryCount);
+
+    std::vector<int> rowIndices, columnIndices;
+    std::vector<double> rates;
+    for (int i = 0; i < kEigenDecompCount; i++) {
+        copyOptionalBuffer(&gCategoryWeights[i], source->gCategoryWeights[i], kCategoryCount);
+        copyOptionalBuffer(&gStateFrequencies[i], source->gStateFrequencies[i], kStateCount);
+        if (source->gEigenDecomposition->getEigenSystem(i) != NULL)
+            restoreEigenSystem(i, source->gEigenDecomposition->getEigenSystem(i));
+        if (source->gEigenDecomposition->getRateMatrix(i) != NULL)
+            setRateMatrix(i, source->gEigenDecomposition->getRateMatrix(i));
+        if (source->gSparseRateMatrices[i] != NULL) {
+            source->gSparseRateMatrices[i]->getRates(&rowIndices, &columnIndices, &rates);
+            setSparseRateMatrix(i, (int) rates.size(), (rates.empty() ? NULL : &rowIndices[0]),
+                                (rates.empty() ? NULL : &columnIndices[0]),
+                                (rates.empty() ? NULL : &rates[0]));
+        }
+    }
+    if (!gEigenDecomposition->setMatrixCacheSize(source->gEigenDecomposition->getMatrixCacheSize()))
+        throw std::bad_alloc();
+
+    if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
+        memcpy(gScaleBuffers[0], source->gScaleBuffers[0], sizeof(REALTYPE) * kPaddedPatternCount);
+        for (int i = 0; i < kScaleBufferCount; i++)
+            memcpy(gAutoScaleBuffers[i], source->gAutoScaleBuffers[i],
+                   sizeof(signed short) * kPaddedPatternCount);
+        memcpy(gActiveScalingFactors, source->gActiveScalingFactors,
+               sizeof(int) * kInternalPartialsBufferCount);
+    } else {
+        if (source->kExponentScalers)
+            setExponentScalers(1);
+        const size_t scaleBufferBytes = (kExponentScalers ? sizeof(signed short) : sizeof(REALTYPE)) *
+                                        kPaddedPatternCount;
+        for (int i = 0; i < kScaleBufferCount; i++)
+            memcpy(gScaleBuffers[i], source->gScaleBuffers[i], scaleBufferBytes);
+    }
+
+    for (int i = 0; i < kMatrixCount; i++)
+        memcpy(gTransitionMatrices[i], source->gTransitionMatrices[i],
+               sizeof(REALTYPE) * kMatrixSize * kCategoryCount);
+
+    beagleMemCpy(outLogLikelihoodsTmp, source->outLogLikelihoodsTmp, kPatternCount);
+    beagleMemCpy(outFirstDerivativesTmp, source->outFirstDerivativesTmp, kPatternCount);
+    beagleMemCpy(outSecondDerivativesTmp, source->outSecondDerivativesTmp, kPatternCount);
+
+    if (source->gEdgeProjection != NULL) {
+        gEdgeProjection = new EdgeProjection(*source->gEdgeProjection);
+        gEdgeProjectionScales = source->gEdgeProjectionScales;
+    }
+
+    // the stamps are taken over last, so that the buffers above count as unchanged
+    kDirtyTracking = source->kDirtyTracking;
+    kDirtyClock = source->kDirtyClock;
+    gPartialsStamps = source->gPartialsStamps;
+    gMatrixStamps = source->gMatrixStamps;
+    gScaleBufferStamps = source->gScaleBufferStamps;
+    gEigenStamps = source->gEigenStamps;
+    kCategoryRatesStamp = source->kCategoryRatesStamp;
+    gPartialsInputs = source->gPartialsInputs;
+    gMatrixInputs = source->gMatrixInputs;
+    gMatrixEdgeLengths = source->gMatrixEdgeLengths;
+
+    gActiveCategories = source->gActiveCategories;
+    kActiveCategoryCount = source->kActiveCategoryCount;
+    gActivePatterns = source->gActivePatterns;
+    kActivePatternCount = source->kActivePatternCount;
+    gActivePatternRuns = source->gActivePatternRuns;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTipData(TipData* tipData) {
+    if (tipData->getStateCount() != kStateCount || tipData->getPatternCount() != kPatternCount ||
+        tipData->getTipCount() > kTipCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    const std::vector<long> layout = getTipLayout();
+    for (int i = 0; i < tipData->getTipCount(); i++) {
+        SharedBuffer* sharedStates;
+        int* states = tipData->getTipStates(i, &sharedStates);
+        const double* partials = tipData->getTipPartials(i);
+        if (states != NULL) {
+            if (tipData->getPaddedPatternCount() >= kPaddedPatternCount) {
+                shareBuffer(&gTipStates[i], &gSharedTipStates[i], states, &sharedStates);
+                releaseBuffer(&gPartials[i], &gSharedPartials[i]);
+                gAmbiguousPatterns[i].clear();
+                gAmbiguousCodes[i].clear();
+                gAmbiguityMasks[i].clear();
+                markPartialsWritten(i);
+            } else {
+                int returnCode = setTipStates(i, states);
+                if (returnCode != BEAGLE_SUCCESS)
+                    return returnCode;
+            }
+        } else if (partials != NULL) {
+            const TipData::ConvertedTip* converted = tipData->getConvertedTip(layout, i);
+            if (converted == NULL) {
+                int returnCode = setTipPartials(i, partials);
+                if (returnCode != BEAGLE_SUCCESS)
+                    return returnCode;
+                // the buffers are handed to the store for the next instance to convert this tip
+                if (gPartials[i] != NULL && gSharedPartials[i] == NULL)
+                    gSharedPartials[i] = new SharedBuffer();
+                if (gTipStates[i] != NULL && gSharedTipStates[i] == NULL)
+                    gSharedTipStates[i] = new SharedBuffer();
+                TipData::ConvertedTip tip = {gPartials[i], gSharedPartials[i], gTipStates[i], gSharedTipStates[i],
+                                             gAmbiguousPatterns[i], gAmbiguousCodes[i], gAmbiguityMasks[i]};
+                tipData->setConvertedTip(layout, i, tip);
+            } else {
+                SharedBuffer* sharedPartials = converted->sharedPartials;
+                sharedStates = converted->sharedStates;
+                shareBuffer(&gPartials[i], &gSharedPartials[i], (REALTYPE*) converted->partials, &sharedPartials);
+                shareBuffer(&gTipStates[i], &gSharedTipStates[i], converted->states, &sharedStates);
+                int returnCode = reserveAmbiguityLookup(converted->ambiguityMasks.size());
+                if (returnCode != BEAGLE_SUCCESS)
+                    return returnCode;
+                gAmbiguousPatterns[i] = converted->ambiguousPatterns;
+                gAmbiguousCodes[i] = converted->ambiguousCodes;
+                gAmbiguityMasks[i] = converted->ambiguityMasks;
+                markPartialsWritten(i);
+            }
+        }
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setKernelCounting(int enable) {
+    gKernelCounters.setEnabled(enable != 0);
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getKernelCounters(BeagleKernelCounters* outCounters) {
+    gKernelCounters.get(outCounters);
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetKernelCounters() {
+    gKernelCounters.reset();
+    return BEAGLE_SUCCESS;
+}
+
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTransitionMatrix(int matrixIndex,
@@ -636,6 +1357,7 @@ if (T_PAD != 0) {
     beagleMemCpy(gTransitionMatrices[matrixIndex], inMatrix,
                  kMatrixSize * kCategoryCount);
 }
+    markMatrixWritten(matrixIndex);
     return BEAGLE_SUCCESS;
 }
     
@@ -663,6 +1385,7 @@ if (T_PAD != 0) {
         beagleMemCpy(gTransitionMatrices[matrixIndex], inMatrix,
                      kMatrixSize * kCategoryCount);
 }
+        markMatrixWritten(matrixIndex);
     }
     
     return BEAGLE_SUCCESS;
@@ -768,6 +1491,8 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::convolveTransitionMatrices(const int* fir
 
 		}//END: rates loop
 
+		markMatrixWritten(resultIndices[u]);
+
 	}//END: u loop
 
 #ifdef BEAGLE_DEBUG_FLOW
@@ -785,16 +1510,89 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateTransitionMatrices(int eigenIndex,
                                             const int* secondDerivativeIndices,
                                             const double* edgeLengths,
                                             int count) {
+    if (kDirtyTracking) {
+        // Only recompute the entries whose edge length or model changed
+        std::vector<int> dirtyProbabilityIndices;
+        std::vector<int> dirtyFirstDerivativeIndices;
+        std::vector<int> dirtySecondDerivativeIndices;
+        std::vector<double> dirtyEdgeLengths;
+        for (int u = 0; u < count; u++) {
+            if (isMatrixClean(probabilityIndices[u], eigenIndex, 0, edgeLengths[u]) &&
+                (firstDerivativeIndices == NULL ||
+                 isMatrixClean(firstDerivativeIndices[u], eigenIndex, 1, edgeLengths[u])) &&
+                (secondDerivativeIndices == NULL ||
+                 isMatrixClean(secondDerivativeIndices[u], eigenIndex, 2, edgeLengths[u])))
+                continue;
+            dirtyProbabilityIndices.push_back(probabilityIndices[u]);
+            if (firstDerivativeIndices != NULL)
+                dirtyFirstDerivativeIndices.push_back(firstDerivativeIndices[u]);
+            if (secondDerivativeIndices != NULL)
+                dirtySecondDerivativeIndices.push_back(secondDerivativeIndices[u]);
+            dirtyEdgeLengths.push_back(edgeLengths[u]);
+        }
+        const int dirtyCount = dirtyProbabilityIndices.size();
+        if (dirtyCount == 0)
+            return BEAGLE_SUCCESS;
+        const double startTime = gKernelCounters.start();
+        gEigenDecomposition->updateTransitionMatrices(eigenIndex, &dirtyProbabilityIndices[0],
+                                                      (firstDerivativeIndices == NULL ? NULL : &dirtyFirstDerivativeIndices[0]),
+                                                      (secondDerivativeIndices == NULL ? NULL : &dirtySecondDerivativeIndices[0]),
+                                                      &dirtyEdgeLengths[0], gCategoryRates, gTransitionMatrices,
+                                                      dirtyCount);
+        recordKernel(BEAGLE_KERNEL_TRANSITION_MATRICES, startTime,
+                     dirtyCount * (1 + (firstDerivativeIndices != NULL) + (secondDerivativeIndices != NULL)));
+        for (int u = 0; u < dirtyCount; u++) {
+            markMatrixComputed(dirtyProbabilityIndices[u], eigenIndex, 0, dirtyEdgeLengths[u]);
+            if (firstDerivativeIndices != NULL)
+                markMatrixComputed(dirtyFirstDerivativeIndices[u], eigenIndex, 1, dirtyEdgeLengths[u]);
+            if (secondDerivativeIndices != NULL)
+                markMatrixComputed(dirtySecondDerivativeIndices[u], eigenIndex, 2, dirtyEdgeLengths[u]);
+        }
+        return BEAGLE_SUCCESS;
+    }
+
+    const double startTime = gKernelCounters.start();
 	gEigenDecomposition->updateTransitionMatrices(eigenIndex,probabilityIndices,firstDerivativeIndices,secondDerivativeIndices,
 												  edgeLengths,gCategoryRates,gTransitionMatrices,count);
+    recordKernel(BEAGLE_KERNEL_TRANSITION_MATRICES, startTime,
+                 count * (1 + (firstDerivativeIndices != NULL) + (secondDerivativeIndices != NULL)));
 	return BEAGLE_SUCCESS;
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setTransitionMatrixCacheSize(int cacheSize) {
+    if (cacheSize < 0)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (!gEigenDecomposition->setMatrixCacheSize(cacheSize))
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getTransitionMatrixCacheStatistics(long* outHits,
+                                                                          long* outMisses) {
+    gEigenDecomposition->getMatrixCacheStatistics(outHits, outMisses);
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartials(const int* operations,
                                   int count,
                                   int cumulativeScaleIndex) {
 
+    std::vector<int> dirtyOperations;
+    if (kDirtyTracking) {
+        count = removeCleanOperations(operations, count, cumulativeScaleIndex, dirtyOperations);
+        if (count == 0)
+            return BEAGLE_SUCCESS;
+        operations = &dirtyOperations[0];
+    }
+    detachDestinationPartials(operations, count);
+
+    // Auto scaling makes full passes over scale buffers between operations
+    if ((kFlags & BEAGLE_FLAG_TRAVERSAL_BLOCKED) && !(kFlags & BEAGLE_FLAG_SCALING_AUTO))
+        return updatePartialsBlocked(operations, count, cumulativeScaleIndex);
+
     REALTYPE* cumulativeScaleBuffer = NULL;
     if (cumulativeScaleIndex != BEAGLE_OP_NONE)
         cumulativeScaleBuffer = gScaleBuffers[cumulativeScaleIndex];
@@ -839,12 +1637,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartials(const int* operations,
         } else if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
             rescale = 1;
             scalingFactors = gScaleBuffers[parIndex - kTipCount];
-        } else if (kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) { // TODO: this is a quick and dirty implementation just so it returns correct results
-            if (tipStates1 == 0 && tipStates2 == 0) {
-                rescale = 1;
-                removeScaleFactors(&readScalingIndex, 1, cumulativeScaleIndex);
-                scalingFactors = gScaleBuffers[writeScalingIndex];
-            }
+        } else if (kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) {
+            rescale = prepareDynamicScaling(writeScalingIndex, readScalingIndex, &scalingFactors,
+                                            0, kPatternCount);
         } else if (writeScalingIndex >= 0) {
             rescale = 1;
             scalingFactors = gScaleBuffers[writeScalingIndex];
@@ -858,54 +1653,43 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartials(const int* operations,
                      << " readIndex = " << readScalingIndex << "\n";
         }
 
-        if (tipStates1 != NULL) {
-            if (tipStates2 != NULL ) {
-                if (rescale == 0) { // Use fixed scaleFactors
-                    calcStatesStatesFixedScaling(destPartials, tipStates1, matrices1, tipStates2, matrices2,
-                                                 scalingFactors);
-                } else {
-                    // First compute without any scaling
-                    calcStatesStates(destPartials, tipStates1, matrices1, tipStates2, matrices2);
-                    if (rescale == 1) // Recompute scaleFactors
-                        rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                }
-            } else {
-                if (rescale == 0) {
-                    calcStatesPartialsFixedScaling(destPartials, tipStates1, matrices1, partials2, matrices2,
-                                                   scalingFactors);
-                } else {
-                    calcStatesPartials(destPartials, tipStates1, matrices1, partials2, matrices2);
-                    if (rescale == 1)
-                        rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                }
+        if (rescale == 2) {
+            int sIndex = parIndex - kTipCount;
+            double startTime = gKernelCounters.start();
+            calcPartialsPartialsAutoScaling(destPartials,partials1,matrices1,partials2,matrices2,
+                                             &gActiveScalingFactors[sIndex]);
+            recordKernel(BEAGLE_KERNEL_PARTIALS_PARTIALS, startTime, kPatternCount);
+            if (gActiveScalingFactors[sIndex]) {
+                startTime = gKernelCounters.start();
+                autoRescalePartials(destPartials, gAutoScaleBuffers[sIndex]);
+                recordKernel(BEAGLE_KERNEL_RESCALE, startTime, kPatternCount);
             }
-        } else {
-            if (tipStates2 != NULL) {
-                if (rescale == 0) {
-                    calcStatesPartialsFixedScaling(destPartials,tipStates2,matrices2,partials1,matrices1,
-                                                   scalingFactors);
-                } else {
-                    calcStatesPartials(destPartials, tipStates2, matrices2, partials1, matrices1);
-                    if (rescale == 1)
-                        rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
-                }
-            } else {
-                if (rescale == 2) {
-                    int sIndex = parIndex - kTipCount;
-                    calcPartialsPartialsAutoScaling(destPartials,partials1,matrices1,partials2,matrices2,
-                                                     &gActiveScalingFactors[sIndex]);
-                    if (gActiveScalingFactors[sIndex])
-                        autoRescalePartials(destPartials, gAutoScaleBuffers[sIndex]);
-
-                } else if (rescale == 0) {
-                    calcPartialsPartialsFixedScaling(destPartials,partials1,matrices1,partials2,matrices2,
-                                                     scalingFactors);
-                } else {
-                    calcPartialsPartials(destPartials, partials1, matrices1, partials2, matrices2);
-                    if (rescale == 1)
-                        rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0);
+        } else if (gMappedBuffer != NULL) {
+            // Walk the mapped buffers one pattern block at a time, asking the kernel
+            // to page in the next block of each child while this one is computed
+            for (int startPattern = 0; startPattern < kPatternCount; startPattern += kPatternBlockSize) {
+                int endPattern = startPattern + kPatternBlockSize;
+                if (endPattern > kPatternCount)
+                    endPattern = kPatternCount;
+                if (endPattern < kPatternCount) {
+                    int nextEndPattern = endPattern + kPatternBlockSize;
+                    if (nextEndPattern > kPatternCount)
+                        nextEndPattern = kPatternCount;
+                    if (tipStates1 == NULL)
+                        prefetchPatternBlock(partials1, endPattern, nextEndPattern);
+                    if (tipStates2 == NULL)
+                        prefetchPatternBlock(partials2, endPattern, nextEndPattern);
                 }
+                calcOperationPartials(destPartials, child1Index, matrices1,
+                                      child2Index, matrices2,
+                                      rescale, scalingFactors, cumulativeScaleBuffer,
+                                      startPattern, endPattern);
             }
+        } else {
+            calcOperationPartials(destPartials, child1Index, matrices1,
+                                  child2Index, matrices2,
+                                  rescale, scalingFactors, cumulativeScaleBuffer,
+                                  0, kPatternCount);
         }
         
         if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
@@ -938,41 +1722,449 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartials(const int* operations,
     return BEAGLE_SUCCESS;
 }
 
-
 BEAGLE_CPU_TEMPLATE
-int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::waitForPartials(const int* destinationPartials,
-                                   int destinationPartialsCount) {
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setSparseRateMatrix(int eigenIndex,
+                                                           int nonZeroCount,
+                                                           const int* rowIndices,
+                                                           const int* columnIndices,
+                                                           const double* rates) {
+    if (eigenIndex < 0 || eigenIndex >= kEigenDecompCount || nonZeroCount < 0)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (gSparseRateMatrices[eigenIndex] == NULL)
+        gSparseRateMatrices[eigenIndex] = new SparseRateMatrix(kStateCount);
+    if (!gSparseRateMatrices[eigenIndex]->setRateMatrix(nonZeroCount, rowIndices, columnIndices, rates)) {
+        delete gSparseRateMatrices[eigenIndex];
+        gSparseRateMatrices[eigenIndex] = NULL;
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
     return BEAGLE_SUCCESS;
 }
 
-
 BEAGLE_CPU_TEMPLATE
-    int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateRootLogLikelihoods(const int* bufferIndices,
-                                                             const int* categoryWeightsIndices,
-                                                             const int* stateFrequenciesIndices,
-                                                             const int* cumulativeScaleIndices,
-                                                             int count,
-                                                             double* outSumLogLikelihood) {
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartialsByEdgeLengths(int eigenIndex,
+                                                                   const int* operations,
+                                                                   int count,
+                                                                   const double* edgeLengths,
+                                                                   int cumulativeScaleIndex) {
+    if (eigenIndex < 0 || eigenIndex >= kEigenDecompCount || gSparseRateMatrices[eigenIndex] == NULL)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_DYNAMIC))
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
 
-    if (count == 1) {
-        // We treat this as a special case so that we don't have convoluted logic
-        //      at the end of the loop over patterns
-        int cumulativeScalingFactorIndex;
-        if (kFlags & BEAGLE_FLAG_SCALING_AUTO)
-            cumulativeScalingFactorIndex = 0;
-        else if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS)
-            cumulativeScalingFactorIndex = bufferIndices[0] - kTipCount; 
-        else
-            cumulativeScalingFactorIndex = cumulativeScaleIndices[0];
-        return calcRootLogLikelihoods(bufferIndices[0], categoryWeightsIndices[0], stateFrequenciesIndices[0],
-                               cumulativeScalingFactorIndex, outSumLogLikelihood);
-    }
-    else
-    {
-        return calcRootLogLikelihoodsMulti(bufferIndices, categoryWeightsIndices, stateFrequenciesIndices,
-                                    cumulativeScaleIndices, count, outSumLogLikelihood);
-    }
-}
+    const SparseRateMatrix* rateMatrix = gSparseRateMatrices[eigenIndex];
+    REALTYPE* cumulativeScaleBuffer = NULL;
+    if (cumulativeScaleIndex != BEAGLE_OP_NONE)
+        cumulativeScaleBuffer = gScaleBuffers[cumulativeScaleIndex];
+
+    std::vector< std::vector<double> > weights(2 * kCategoryCount);
+    std::vector<int> steps(2 * kCategoryCount);
+    detachDestinationPartials(operations, count);
+
+    for (int op = 0; op < count; op++) {
+        const int parIndex = operations[op * 7];
+        const int writeScalingIndex = operations[op * 7 + 1];
+        const int readScalingIndex = operations[op * 7 + 2];
+        const int childIndices[2] = {operations[op * 7 + 3], operations[op * 7 + 5]};
+
+        // Poisson weights for each child edge and rate category
+        for (int c = 0; c < 2; c++) {
+            for (int l = 0; l < kCategoryCount; l++)
+                rateMatrix->getWeights(edgeLengths[op * 2 + c] * gCategoryRates[l],
+                                       &weights[c * kCategoryCount + l], &steps[c * kCategoryCount + l]);
+        }
+
+        // Ambiguity masks of compact tips, by pattern
+        std::vector<unsigned int> tipMasks[2];
+        for (int c = 0; c < 2; c++) {
+            const int childIndex = childIndices[c];
+            if (gPartials[childIndex] == NULL && !gAmbiguousPatterns[childIndex].empty()) {
+                tipMasks[c].assign(kPatternCount, 0);
+                const std::vector<int>& patterns = gAmbiguousPatterns[childIndex];
+                for (size_t p = 0; p < patterns.size(); p++)
+                    tipMasks[c][patterns[p]] = gAmbiguityMasks[childIndex][gAmbiguousCodes[childIndex][p]];
+            }
+        }
+
+        const REALTYPE* readScaleFactors = NULL;
+        if (writeScalingIndex < 0 && readScalingIndex >= 0) {
+            if (kExponentScalers)
+                readScaleFactors = expandScaleExponents((const signed short*) gScaleBuffers[readScalingIndex],
+                                                        0, kPatternCount);
+            else
+                readScaleFactors = gScaleBuffers[readScalingIndex];
+        }
+
+        REALTYPE* destP = gPartials[parIndex];
+
+#pragma omp parallel
+        {
+            std::vector<double> work(5 * kStateCount);
+            double* tipPartials = &work[0];
+            double* childResults[2] = {&work[kStateCount], &work[2 * kStateCount]};
+            double* scratch = &work[3 * kStateCount];
+
+#pragma omp for
+            for (int n = 0; n < kActivePatternCount; n++) {
+                const int k = gActivePatterns[n];
+                for (int a = 0; a < kActiveCategoryCount; a++) {
+                    const int l = gActiveCategories[a];
+                    const int offset = l * kPartialsCategoryStride + k * kPartialsPatternStride;
+                    for (int c = 0; c < 2; c++) {
+                        const int childIndex = childIndices[c];
+                        const int w = c * kCategoryCount + l;
+                        if (gPartials[childIndex] != NULL) {
+                            rateMatrix->applyExponential(weights[w], steps[w], gPartials[childIndex] + offset,
+                                                         childResults[c], scratch);
+                        } else {
+                            const int state = gTipStates[childIndex][k];
+                            const unsigned int mask = (tipMasks[c].empty() ? 0 : tipMasks[c][k]);
+                            for (int i = 0; i < kStateCount; i++) {
+                                if (mask != 0)
+                                    tipPartials[i] = ((mask >> i) & 1u ? 1.0 : 0.0);
+                                else
+                                    tipPartials[i] = (state == kStateCount || state == i ? 1.0 : 0.0);
+                            }
+                            rateMatrix->applyExponential(weights[w], steps[w], (const double*) tipPartials,
+                                                         childResults[c], scratch);
+                        }
+                    }
+                    const double oneOverScaleFactor = (readScaleFactors != NULL ? 1.0 / readScaleFactors[k] : 1.0);
+                    for (int i = 0; i < kStateCount; i++)
+                        destP[offset + i] = (REALTYPE) (childResults[0][i] * childResults[1][i] * oneOverScaleFactor);
+                }
+            }
+        }
+
+        if (writeScalingIndex >= 0) {
+            if (kExponentScalers)
+                rescalePartialsExponent(destP, (signed short*) gScaleBuffers[writeScalingIndex],
+                                        (signed short*) cumulativeScaleBuffer, 0, kPatternCount);
+            else
+                rescalePartials(destP, gScaleBuffers[writeScalingIndex], cumulativeScaleBuffer, 0,
+                                0, kPatternCount);
+            markScaleBufferWritten(writeScalingIndex);
+            if (cumulativeScaleBuffer != NULL)
+                markScaleBufferWritten(cumulativeScaleIndex);
+        }
+        markPartialsWritten(parIndex);
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+/*
+ * Computes the two child matrices of each operation into scratch space just before its
+ *  partials, so that they are still in cache when read and are never stored in, or
+ *  read back from, the transition matrix buffers.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateMatricesAndPartials(const int* operations,
+                                                                 int count,
+                                                                 const int* eigenIndices,
+                                                                 const double* edgeLengths,
+                                                                 int cumulativeScaleIndex) {
+    // Auto scaling makes full passes over scale buffers between operations
+    if (kFlags & BEAGLE_FLAG_SCALING_AUTO)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    for (int op = 0; op < count; op++) {
+        const int parIndex = operations[op * 7];
+        const int child1Index = operations[op * 7 + 3];
+        const int child2Index = operations[op * 7 + 5];
+        if (eigenIndices[op] < 0 || eigenIndices[op] >= kEigenDecompCount ||
+            parIndex < kTipCount || parIndex >= kBufferCount ||
+            child1Index < 0 || child1Index >= kBufferCount || child2Index < 0 || child2Index >= kBufferCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (gOperationMatrices[i] == NULL) {
+            gOperationMatrices[i] = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kMatrixSize * kCategoryCount);
+            if (gOperationMatrices[i] == NULL)
+                return BEAGLE_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    detachDestinationPartials(operations, count);
+
+    REALTYPE* cumulativeScaleBuffer = NULL;
+    if (cumulativeScaleIndex != BEAGLE_OP_NONE)
+        cumulativeScaleBuffer = gScaleBuffers[cumulativeScaleIndex];
+
+    const int matrixIndices[2] = {0, 1};
+    for (int op = 0; op < count; op++) {
+        const int parIndex = operations[op * 7];
+        const int writeScalingIndex = operations[op * 7 + 1];
+        const int readScalingIndex = operations[op * 7 + 2];
+        const int child1Index = operations[op * 7 + 3];
+        const int child2Index = operations[op * 7 + 5];
+
+        const double startTime = gKernelCounters.start();
+        gEigenDecomposition->updateTransitionMatrices(eigenIndices[op], matrixIndices, NULL, NULL,
+                                                      edgeLengths + op * 2, gCategoryRates,
+                                                      gOperationMatrices, 2);
+        recordKernel(BEAGLE_KERNEL_TRANSITION_MATRICES, startTime, 2);
+
+        int rescale = BEAGLE_OP_NONE;
+        REALTYPE* scalingFactors = NULL;
+        if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
+            rescale = 1;
+            scalingFactors = gScaleBuffers[parIndex - kTipCount];
+        } else if (kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) {
+            rescale = prepareDynamicScaling(writeScalingIndex, readScalingIndex, &scalingFactors,
+                                            0, kPatternCount);
+        } else if (writeScalingIndex >= 0) {
+            rescale = 1;
+            scalingFactors = gScaleBuffers[writeScalingIndex];
+        } else if (readScalingIndex >= 0) {
+            rescale = 0;
+            scalingFactors = gScaleBuffers[readScalingIndex];
+        }
+
+        calcOperationPartials(gPartials[parIndex],
+                              child1Index, gOperationMatrices[0],
+                              child2Index, gOperationMatrices[1],
+                              rescale, scalingFactors, cumulativeScaleBuffer,
+                              0, kPatternCount);
+
+        if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
+            int scalingIndices[2];
+            int scalingCount = 0;
+            if (child1Index >= kTipCount)
+                scalingIndices[scalingCount++] = child1Index - kTipCount;
+            if (child2Index >= kTipCount)
+                scalingIndices[scalingCount++] = child2Index - kTipCount;
+            if (scalingCount > 0)
+                accumulateScaleFactorsForPatterns(scalingIndices, scalingCount,
+                                                  parIndex - kTipCount, 0, kPatternCount);
+        }
+
+        markPartialsWritten(parIndex);
+        if (rescale == 1) {
+            markScaleBufferWritten(writeScalingIndex);
+            if (cumulativeScaleBuffer != NULL)
+                markScaleBufferWritten(cumulativeScaleIndex);
+        }
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setDirtyTracking(int enable) {
+    kDirtyTracking = (enable != 0);
+    // Forget what was computed before, stamps were not kept up to date meanwhile
+    kDirtyClock = 0;
+    kCategoryRatesStamp = 0;
+    gPartialsStamps.assign(kBufferCount, 0);
+    gMatrixStamps.assign(kMatrixCount, 0);
+    gScaleBufferStamps.assign(kScaleBufferCount, 0);
+    gEigenStamps.assign(kEigenDecompCount, 0);
+    gPartialsInputs.assign(kBufferCount, std::vector<long>());
+    gMatrixInputs.assign(kMatrixCount, std::vector<long>());
+    gMatrixEdgeLengths.assign(kMatrixCount, 0.0);
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::setExponentScalers(int enable) {
+    // Only manual scaling leaves the scale buffers to the client
+    if ((kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_DYNAMIC)) &&
+        enable != 0)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (enable != 0 && gExponentScaleFactors == NULL) {
+        gExponentScaleFactors = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPaddedPatternCount);
+        if (gExponentScaleFactors == NULL)
+            return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+
+    kExponentScalers = (enable != 0);
+    for (int i = 0; i < kScaleBufferCount; i++) {
+        allocateScaleBuffer(i);
+        markScaleBufferWritten(i);
+    }
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::waitForPartials(const int* destinationPartials,
+                                   int destinationPartialsCount) {
+    return BEAGLE_SUCCESS;
+}
+
+
+BEAGLE_CPU_TEMPLATE
+    int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateRootLogLikelihoods(const int* bufferIndices,
+                                                             const int* categoryWeightsIndices,
+                                                             const int* stateFrequenciesIndices,
+                                                             const int* cumulativeScaleIndices,
+                                                             int count,
+                                                             double* outSumLogLikelihood) {
+
+    const double startTime = gKernelCounters.start();
+    int returnCode;
+    if (count == 1) {
+        // We treat this as a special case so that we don't have convoluted logic
+        //      at the end of the loop over patterns
+        int cumulativeScalingFactorIndex;
+        if (kFlags & BEAGLE_FLAG_SCALING_AUTO)
+            cumulativeScalingFactorIndex = 0;
+        else if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS)
+            cumulativeScalingFactorIndex = bufferIndices[0] - kTipCount; 
+        else
+            cumulativeScalingFactorIndex = cumulativeScaleIndices[0];
+        returnCode = calcRootLogLikelihoods(bufferIndices[0], categoryWeightsIndices[0], stateFrequenciesIndices[0],
+                                            cumulativeScalingFactorIndex, outSumLogLikelihood);
+    }
+    else
+    {
+        returnCode = calcRootLogLikelihoodsMulti(bufferIndices, categoryWeightsIndices, stateFrequenciesIndices,
+                                                 cumulativeScaleIndices, count, outSumLogLikelihood);
+    }
+    recordKernel(BEAGLE_KERNEL_ROOT, startTime, (double) count * kActivePatternCount);
+    return returnCode;
+}
+
+/*
+ * Computes the root partials one cache block of patterns at a time and integrates each
+ *  block straight after, so that the partials are read back from cache rather than
+ *  memory. Without a destination buffer they go to scratch space.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateRootLogLikelihoodsByOperation(const int* operation,
+                                                                            int categoryWeightsIndex,
+                                                                            int stateFrequenciesIndex,
+                                                                            int cumulativeScaleIndex,
+                                                                            double* outSumLogLikelihood) {
+    if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS))
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    const int parIndex = operation[0];
+    const int writeScalingIndex = operation[1];
+    const int readScalingIndex = operation[2];
+    const int child1Index = operation[3];
+    const int child1TransMatIndex = operation[4];
+    const int child2Index = operation[5];
+    const int child2TransMatIndex = operation[6];
+    if ((parIndex != BEAGLE_OP_NONE && (parIndex < kTipCount || parIndex >= kBufferCount)) ||
+        child1Index < 0 || child1Index >= kBufferCount || child2Index < 0 || child2Index >= kBufferCount ||
+        child1TransMatIndex < 0 || child1TransMatIndex >= kMatrixCount ||
+        child2TransMatIndex < 0 || child2TransMatIndex >= kMatrixCount ||
+        writeScalingIndex >= kScaleBufferCount || readScalingIndex >= kScaleBufferCount ||
+        cumulativeScaleIndex >= kScaleBufferCount ||
+        categoryWeightsIndex < 0 || categoryWeightsIndex >= kEigenDecompCount ||
+        stateFrequenciesIndex < 0 || stateFrequenciesIndex >= kEigenDecompCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    REALTYPE* rootPartials;
+    if (parIndex != BEAGLE_OP_NONE) {
+        detachDestinationPartials(operation, 1);
+        rootPartials = gPartials[parIndex];
+    } else {
+        if (gRootScratchPartials == NULL) {
+            gRootScratchPartials = (REALTYPE*) mallocAligned(sizeof(REALTYPE) * kPartialsSize);
+            if (gRootScratchPartials == NULL)
+                return BEAGLE_ERROR_OUT_OF_MEMORY;
+        }
+        rootPartials = gRootScratchPartials;
+    }
+
+    REALTYPE* cumulativeScaleBuffer = NULL;
+    if (cumulativeScaleIndex != BEAGLE_OP_NONE)
+        cumulativeScaleBuffer = gScaleBuffers[cumulativeScaleIndex];
+
+    const REALTYPE* wt = gCategoryWeights[categoryWeightsIndex];
+    const REALTYPE* freqs = gStateFrequencies[stateFrequenciesIndex];
+
+    // patterns with weight zero are left out of the sum, and of the site log likelihoods
+    for (int k = 0; k < kPatternCount; k++)
+        outLogLikelihoodsTmp[k] = 0.0;
+
+    for (int startPattern = 0; startPattern < kPatternCount; startPattern += kCacheBlockSize) {
+        int endPattern = startPattern + kCacheBlockSize;
+        if (endPattern > kPatternCount)
+            endPattern = kPatternCount;
+
+        int rescale = BEAGLE_OP_NONE;
+        REALTYPE* scalingFactors = NULL;
+        if (kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) {
+            rescale = prepareDynamicScaling(writeScalingIndex, readScalingIndex, &scalingFactors,
+                                            startPattern, endPattern);
+        } else if (writeScalingIndex >= 0) {
+            rescale = 1;
+            scalingFactors = gScaleBuffers[writeScalingIndex];
+        } else if (readScalingIndex >= 0) {
+            rescale = 0;
+            scalingFactors = gScaleBuffers[readScalingIndex];
+        }
+
+        calcOperationPartials(rootPartials,
+                              child1Index, gTransitionMatrices[child1TransMatIndex],
+                              child2Index, gTransitionMatrices[child2TransMatIndex],
+                              rescale, scalingFactors, cumulativeScaleBuffer,
+                              startPattern, endPattern);
+
+        for (size_t r = 0; r < gActivePatternRuns.size(); r += 2) {
+            const int runStart = std::max(startPattern, gActivePatternRuns[r]);
+            const int runEnd = std::min(endPattern, gActivePatternRuns[r + 1]);
+            if (runStart < runEnd) {
+                const double startTime = gKernelCounters.start();
+                calcRootSiteLogLikelihoods(rootPartials, wt, freqs, runStart, runEnd);
+                recordKernel(BEAGLE_KERNEL_ROOT, startTime, runEnd - runStart);
+            }
+        }
+    }
+
+    if (parIndex != BEAGLE_OP_NONE)
+        markPartialsWritten(parIndex);
+    if (writeScalingIndex >= 0) {
+        markScaleBufferWritten(writeScalingIndex);
+        markScaleBufferWritten(cumulativeScaleIndex);
+    }
+
+    if (cumulativeScaleIndex != BEAGLE_OP_NONE) {
+        const REALTYPE* cumulativeScaleFactors = getLogScaleFactors(cumulativeScaleIndex);
+        for (int n = 0; n < kActivePatternCount; n++) {
+            const int k = gActivePatterns[n];
+            outLogLikelihoodsTmp[k] += cumulativeScaleFactors[k];
+        }
+    }
+
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
+
+    if (*outSumLogLikelihood != *outSumLogLikelihood)
+        return BEAGLE_ERROR_FLOATING_POINT;
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootSiteLogLikelihoods(const REALTYPE* rootPartials,
+                                                                  const REALTYPE* wt,
+                                                                  const REALTYPE* freqs,
+                                                                  int startPattern,
+                                                                  int endPattern) {
+    // sums in the order of calcRootLogLikelihoods
+    const int firstCategory = gActiveCategories[0];
+    for (int k = startPattern; k < endPattern; k++) {
+        REALTYPE* stateSums = integrationTmp + k * kStateCount;
+        const int patternOffset = k * kPartialsPatternStride;
+        const REALTYPE* partials = rootPartials + firstCategory * kPartialsCategoryStride + patternOffset;
+        for (int i = 0; i < kStateCount; i++)
+            stateSums[i] = partials[i] * (REALTYPE) wt[firstCategory];
+        for (int c = 1; c < kActiveCategoryCount; c++) {
+            const int l = gActiveCategories[c];
+            partials = rootPartials + l * kPartialsCategoryStride + patternOffset;
+            for (int i = 0; i < kStateCount; i++)
+                stateSums[i] += partials[i] * (REALTYPE) wt[l];
+        }
+        REALTYPE sum = 0.0;
+        for (int i = 0; i < kStateCount; i++)
+            sum += freqs[i] * stateSums[i];
+        outLogLikelihoodsTmp[k] = log(sum);
+    }
+}
 
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const int* bufferIndices,
@@ -1000,25 +2192,28 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const int* bu
         const REALTYPE* rootPartials = gPartials[rootPartialIndex];
         const REALTYPE* frequencies = gStateFrequencies[stateFrequenciesIndices[subsetIndex]];
         const REALTYPE* wt = gCategoryWeights[categoryWeightsIndices[subsetIndex]];
+        const int firstCategory = gActiveCategories[0];
         int u = 0;
-        int v = 0;
+        int v = firstCategory * kPartialsCategoryStride;
         for (int k = 0; k < kPatternCount; k++) {
             for (int i = 0; i < kStateCount; i++) {
-                integrationTmp[u] = rootPartials[v] * (REALTYPE) wt[0];
+                integrationTmp[u] = rootPartials[v] * (REALTYPE) wt[firstCategory];
                 u++;
                 v++;
             }
-            v += P_PAD;
+            v += kPartialsPatternStride - kStateCount;
         }
-        for (int l = 1; l < kCategoryCount; l++) {
+        for (int c = 1; c < kActiveCategoryCount; c++) {
+            const int l = gActiveCategories[c];
             u = 0;
+            v = l * kPartialsCategoryStride;
             for (int k = 0; k < kPatternCount; k++) {
                 for (int i = 0; i < kStateCount; i++) {
                     integrationTmp[u] += rootPartials[v] * (REALTYPE) wt[l];
                     u++;
                     v++;
                 }
-                v += P_PAD;
+                v += kPartialsPatternStride - kStateCount;
             }
         }
         u = 0;
@@ -1037,17 +2232,17 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const int* bu
                 else
                     cumulativeScalingFactorIndex = scaleBufferIndices[subsetIndex];
                 
-                const REALTYPE* cumulativeScaleFactors = gScaleBuffers[cumulativeScalingFactorIndex];
+                const REALTYPE cumulativeScaleFactor = getLogScaleFactor(cumulativeScalingFactorIndex, k);
 
                 if (subsetIndex == 0) {
                     indexMaxScale[k] = 0;
-                    maxScaleFactor[k] = cumulativeScaleFactors[k];
+                    maxScaleFactor[k] = cumulativeScaleFactor;
                     for (int j = 1; j < count; j++) {
                         REALTYPE tmpScaleFactor;
                         if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS)
                             tmpScaleFactor = gScaleBuffers[bufferIndices[j] - kTipCount][k]; 
                         else
-                            tmpScaleFactor = gScaleBuffers[scaleBufferIndices[j]][k];
+                            tmpScaleFactor = getLogScaleFactor(scaleBufferIndices[j], k);
 
                         if (tmpScaleFactor > maxScaleFactor[k]) {
                             indexMaxScale[k] = j;
@@ -1057,7 +2252,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const int* bu
                 }
 
                 if (subsetIndex != indexMaxScale[k])
-                    sum *= exp((REALTYPE)(cumulativeScaleFactors[k] - maxScaleFactor[k]));
+                    sum *= exp((REALTYPE)(cumulativeScaleFactor - maxScaleFactor[k]));
             }
 
             if (subsetIndex == 0) {
@@ -1077,10 +2272,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoodsMulti(const int* bu
             outLogLikelihoodsTmp[i] += maxScaleFactor[i];
     }
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -1101,25 +2293,28 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoods(const int bufferIn
     const REALTYPE* rootPartials = gPartials[bufferIndex];
     const REALTYPE* wt = gCategoryWeights[categoryWeightsIndex];
     const REALTYPE* freqs = gStateFrequencies[stateFrequenciesIndex];
+    const int firstCategory = gActiveCategories[0];
     int u = 0;
-    int v = 0;
+    int v = firstCategory * kPartialsCategoryStride;
     for (int k = 0; k < kPatternCount; k++) {
         for (int i = 0; i < kStateCount; i++) {
-            integrationTmp[u] = rootPartials[v] * (REALTYPE) wt[0];
+            integrationTmp[u] = rootPartials[v] * (REALTYPE) wt[firstCategory];
             u++;
             v++;
         }
-        v += P_PAD;
+        v += kPartialsPatternStride - kStateCount;
     }
-    for (int l = 1; l < kCategoryCount; l++) {
+    for (int c = 1; c < kActiveCategoryCount; c++) {
+        const int l = gActiveCategories[c];
         u = 0;
+        v = l * kPartialsCategoryStride;
         for (int k = 0; k < kPatternCount; k++) {
             for (int i = 0; i < kStateCount; i++) {
                 integrationTmp[u] += rootPartials[v] * (REALTYPE) wt[l];
                 u++;
                 v++;
             }
-            v += P_PAD;
+            v += kPartialsPatternStride - kStateCount;
         }
     }
     u = 0;
@@ -1134,16 +2329,13 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcRootLogLikelihoods(const int bufferIn
     }
 
     if (scalingFactorsIndex >= 0) {
-    	const REALTYPE* cumulativeScaleFactors = gScaleBuffers[scalingFactorsIndex];
+    	const REALTYPE* cumulativeScaleFactors = getLogScaleFactors(scalingFactorsIndex);
     	for(int i=0; i<kPatternCount; i++) {
     		outLogLikelihoodsTmp[i] += cumulativeScaleFactors[i];
         }
     }
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -1172,23 +2364,11 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::accumulateScaleFactors(const int* scaling
         }
                 
     } else {
-        REALTYPE* cumulativeScaleBuffer = gScaleBuffers[cumulativeScalingIndex];
-        for(int i=0; i<count; i++) {
-            const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
-            for(int j=0; j<kPatternCount; j++) {
-                if (kFlags & BEAGLE_FLAG_SCALERS_LOG)
-                    cumulativeScaleBuffer[j] += scaleBuffer[j];
-                else
-                    cumulativeScaleBuffer[j] += log(scaleBuffer[j]);
-            }
-        }
-
-        if (DEBUGGING_OUTPUT) {
-            fprintf(stderr,"Accumulating %d scale buffers into #%d\n",count,cumulativeScalingIndex);
-            for(int j=0; j<kPatternCount; j++) {
-                fprintf(stderr,"cumulativeScaleBuffer[%d] = %2.5e\n",j,cumulativeScaleBuffer[j]);
-            }
-        }
+        const bool inRange = accumulateScaleFactorsForPatterns(scalingIndices, count, cumulativeScalingIndex,
+                                                               0, kPatternCount);
+        markScaleBufferWritten(cumulativeScalingIndex);
+        if (!inRange)
+            return BEAGLE_ERROR_FLOATING_POINT;
     }
     
     return BEAGLE_SUCCESS;
@@ -1198,6 +2378,20 @@ BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::removeScaleFactors(const int* scalingIndices,
                                             int  count,
                                             int  cumulativeScalingIndex) {
+    if (kExponentScalers) {
+        signed short* cumulativeScaleExponents = (signed short*) gScaleBuffers[cumulativeScalingIndex];
+        bool inRange = true;
+        for (int i = 0; i < count; i++) {
+            const signed short* scaleExponents = (const signed short*) gScaleBuffers[scalingIndices[i]];
+            for (int j = 0; j < kPatternCount; j++) {
+                if (!addScaleExponent(&cumulativeScaleExponents[j], -scaleExponents[j]))
+                    inRange = false;
+            }
+        }
+        markScaleBufferWritten(cumulativeScalingIndex);
+        return (inRange ? BEAGLE_SUCCESS : BEAGLE_ERROR_FLOATING_POINT);
+    }
+
 	REALTYPE* cumulativeScaleBuffer = gScaleBuffers[cumulativeScalingIndex];
     for(int i=0; i<count; i++) {
         const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
@@ -1208,6 +2402,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::removeScaleFactors(const int* scalingIndi
                 cumulativeScaleBuffer[j] -= log(scaleBuffer[j]);
         }
     }
+    markScaleBufferWritten(cumulativeScalingIndex);
 
     return BEAGLE_SUCCESS;
 }
@@ -1216,18 +2411,21 @@ BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::resetScaleFactors(int cumulativeScalingIndex) {
     //memcpy(gScaleBuffers[cumulativeScalingIndex],zeros,sizeof(double) * kPatternCount);
 	
-	 if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
+	 if ((kFlags & BEAGLE_FLAG_SCALING_AUTO) || kExponentScalers) {
 		 memset(gScaleBuffers[cumulativeScalingIndex], 0, sizeof(signed short) * kPaddedPatternCount);
 	 } else {	        
 		 memset(gScaleBuffers[cumulativeScalingIndex], 0, sizeof(REALTYPE) * kPaddedPatternCount);
 	 }
+    markScaleBufferWritten(cumulativeScalingIndex);
     return BEAGLE_SUCCESS;
 }
     
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::copyScaleFactors(int destScalingIndex,
                                                         int srcScalingIndex) {
-    memcpy(gScaleBuffers[destScalingIndex],gScaleBuffers[srcScalingIndex],sizeof(REALTYPE) * kPatternCount);
+    memcpy(gScaleBuffers[destScalingIndex],gScaleBuffers[srcScalingIndex],
+           (kExponentScalers ? sizeof(signed short) : sizeof(REALTYPE)) * kPatternCount);
+    markScaleBufferWritten(destScalingIndex);
 
     return BEAGLE_SUCCESS;
 }
@@ -1252,8 +2450,8 @@ BEAGLE_CPU_TEMPLATE
                                                              double* outSumLogLikelihood,
                                                              double* outSumFirstDerivative,
                                                              double* outSumSecondDerivative) {
-    // TODO: implement for count > 1
-
+    const double startTime = gKernelCounters.start();
+    int returnCode;
     if (count == 1) {
         int cumulativeScalingFactorIndex;
         if (kFlags & BEAGLE_FLAG_SCALING_AUTO) {
@@ -1277,34 +2475,312 @@ BEAGLE_CPU_TEMPLATE
             cumulativeScalingFactorIndex = cumulativeScaleIndices[0];
         }
 		if (firstDerivativeIndices == NULL && secondDerivativeIndices == NULL)
-			return calcEdgeLogLikelihoods(parentBufferIndices[0], childBufferIndices[0], probabilityIndices[0],
+			returnCode = calcEdgeLogLikelihoods(parentBufferIndices[0], childBufferIndices[0], probabilityIndices[0],
                                    categoryWeightsIndices[0], stateFrequenciesIndices[0], cumulativeScalingFactorIndex,
                                    outSumLogLikelihood);
 		else if (secondDerivativeIndices == NULL)
-			return calcEdgeLogLikelihoodsFirstDeriv(parentBufferIndices[0], childBufferIndices[0], probabilityIndices[0],
+			returnCode = calcEdgeLogLikelihoodsFirstDeriv(parentBufferIndices[0], childBufferIndices[0], probabilityIndices[0],
                                              firstDerivativeIndices[0], categoryWeightsIndices[0], stateFrequenciesIndices[0],
                                              cumulativeScalingFactorIndex, outSumLogLikelihood, outSumFirstDerivative);
 		else
-			return calcEdgeLogLikelihoodsSecondDeriv(parentBufferIndices[0], childBufferIndices[0], probabilityIndices[0],
+			returnCode = calcEdgeLogLikelihoodsSecondDeriv(parentBufferIndices[0], childBufferIndices[0], probabilityIndices[0],
                                               firstDerivativeIndices[0], secondDerivativeIndices[0], categoryWeightsIndices[0],
                                               stateFrequenciesIndices[0], cumulativeScalingFactorIndex, outSumLogLikelihood,
                                               outSumFirstDerivative, outSumSecondDerivative);
+
+        const int childIndex = childBufferIndices[0];
+        if (childIndex < kTipCount && gTipStates[childIndex] != NULL && !gAmbiguousPatterns[childIndex].empty())
+            returnCode = calcAmbiguousEdgeSites(parentBufferIndices[0], childIndex, probabilityIndices[0],
+                                                (firstDerivativeIndices == NULL ? BEAGLE_OP_NONE : firstDerivativeIndices[0]),
+                                                (secondDerivativeIndices == NULL ? BEAGLE_OP_NONE : secondDerivativeIndices[0]),
+                                                categoryWeightsIndices[0], stateFrequenciesIndices[0],
+                                                cumulativeScalingFactorIndex, outSumLogLikelihood,
+                                                outSumFirstDerivative, outSumSecondDerivative);
     } else {
-        if ((kFlags & BEAGLE_FLAG_SCALING_AUTO) || (kFlags & BEAGLE_FLAG_SCALING_ALWAYS)) {
-            fprintf(stderr,"BeagleCPUImpl::calculateEdgeLogLikelihoods not yet implemented for count > 1 and auto/always scaling\n");
-        }
-        
+        // auto and always scaling fill a single cumulative scale buffer, not one per edge
+        if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS))
+            return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
 		if (firstDerivativeIndices == NULL && secondDerivativeIndices == NULL) {
-			return calcEdgeLogLikelihoodsMulti(parentBufferIndices, childBufferIndices, probabilityIndices,
-                                          categoryWeightsIndices, stateFrequenciesIndices, cumulativeScaleIndices, count,
-                                          outSumLogLikelihood);
+			returnCode = calcEdgeLogLikelihoodsMulti(parentBufferIndices, childBufferIndices, probabilityIndices,
+                                                     categoryWeightsIndices, stateFrequenciesIndices,
+                                                     cumulativeScaleIndices, count, outSumLogLikelihood);
 		} else {
-            fprintf(stderr,"BeagleCPUImpl::calculateEdgeLogLikelihoods not yet implemented for count > 1 and derivatives\n");
-        }            
+            returnCode = calcEdgeLogLikelihoodsMultiDeriv(parentBufferIndices, childBufferIndices, probabilityIndices,
+                                                          firstDerivativeIndices, secondDerivativeIndices,
+                                                          categoryWeightsIndices, stateFrequenciesIndices,
+                                                          cumulativeScaleIndices, count, outSumLogLikelihood,
+                                                          outSumFirstDerivative, outSumSecondDerivative);
+        }
     }
+    recordKernel((firstDerivativeIndices == NULL && secondDerivativeIndices == NULL ?
+                  BEAGLE_KERNEL_EDGE : BEAGLE_KERNEL_DERIVATIVES),
+                 startTime, (double) count * kActivePatternCount);
+    return returnCode;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateIndependentEdgeLogLikelihoods(const int* parentBufferIndices,
+                                                                              const int* childBufferIndices,
+                                                                              const int* probabilityIndices,
+                                                                              const int* firstDerivativeIndices,
+                                                                              const int* secondDerivativeIndices,
+                                                                              const int* categoryWeightsIndices,
+                                                                              const int* stateFrequenciesIndices,
+                                                                              const int* cumulativeScaleIndices,
+                                                                              int count,
+                                                                              double* outLogLikelihoods,
+                                                                              double* outFirstDerivatives,
+                                                                              double* outSecondDerivatives) {
+    // the shared cumulative scale buffers of auto and always scaling cannot be filled in parallel
+    if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS))
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    for (int e = 0; e < count; e++) {
+        if (parentBufferIndices[e] < kTipCount || parentBufferIndices[e] >= kBufferCount ||
+            childBufferIndices[e] < 0 || childBufferIndices[e] >= kBufferCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+
+    const bool firstDerivative = (firstDerivativeIndices != NULL);
+    const bool secondDerivative = (firstDerivative && secondDerivativeIndices != NULL);
+    int returnCode = BEAGLE_SUCCESS;
+    const double startTime = gKernelCounters.start();
+
+#pragma omp parallel
+    {
+        std::vector<double> siteValues(3 * kPatternCount);
+        double* likelihoods = &siteValues[0];
+        double* firstDerivatives = &siteValues[kPatternCount];
+        double* secondDerivatives = &siteValues[2 * kPatternCount];
+
+#pragma omp for schedule(dynamic)
+        for (int e = 0; e < count; e++) {
+            calcEdgeSiteLikelihoods(parentBufferIndices[e], childBufferIndices[e], probabilityIndices[e],
+                                    (firstDerivative ? firstDerivativeIndices[e] : BEAGLE_OP_NONE),
+                                    (secondDerivative ? secondDerivativeIndices[e] : BEAGLE_OP_NONE),
+                                    categoryWeightsIndices[e], stateFrequenciesIndices[e],
+                                    likelihoods, firstDerivatives, secondDerivatives);
+
+            int scalingFactorsIndex = BEAGLE_OP_NONE;
+            if (cumulativeScaleIndices != NULL)
+                scalingFactorsIndex = cumulativeScaleIndices[e];
+
+            // site values replace the site likelihoods they are computed from
+            for (int n = 0; n < kActivePatternCount; n++) {
+                const int k = gActivePatterns[n];
+                if (firstDerivative) {
+                    const double siteFirstDerivative = firstDerivatives[k] / likelihoods[k];
+                    firstDerivatives[k] = siteFirstDerivative;
+                    if (secondDerivative)
+                        secondDerivatives[k] = secondDerivatives[k] / likelihoods[k] -
+                                               siteFirstDerivative * siteFirstDerivative;
+                }
+                likelihoods[k] = log(likelihoods[k]);
+                if (scalingFactorsIndex != BEAGLE_OP_NONE)
+                    likelihoods[k] += getLogScaleFactor(scalingFactorsIndex, k);
+            }
+            const double sumLogLikelihood = sumActivePatterns(likelihoods);
+            const double sumFirstDerivative = (firstDerivative ? sumActivePatterns(firstDerivatives) : 0.0);
+            const double sumSecondDerivative = (secondDerivative ? sumActivePatterns(secondDerivatives) : 0.0);
+
+            outLogLikelihoods[e] = sumLogLikelihood;
+            if (firstDerivative && outFirstDerivatives != NULL)
+                outFirstDerivatives[e] = sumFirstDerivative;
+            if (secondDerivative && outSecondDerivatives != NULL)
+                outSecondDerivatives[e] = sumSecondDerivative;
+            if (sumLogLikelihood != sumLogLikelihood) {
+#pragma omp critical
+                returnCode = BEAGLE_ERROR_FLOATING_POINT;
+            }
+        }
+    }
+
+    recordKernel((firstDerivative ? BEAGLE_KERNEL_DERIVATIVES : BEAGLE_KERNEL_EDGE), startTime,
+                 (double) count * kActivePatternCount);
+    return returnCode;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::projectEdgePartials(int parentBufferIndex,
+                                                           int childBufferIndex,
+                                                           int eigenIndex,
+                                                           int categoryWeightsIndex,
+                                                           int stateFrequenciesIndex,
+                                                           int cumulativeScaleIndex) {
+    if (eigenIndex < 0 || eigenIndex >= kEigenDecompCount ||
+        parentBufferIndex < 0 || parentBufferIndex >= kBufferCount ||
+        childBufferIndex < 0 || childBufferIndex >= kBufferCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS))
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    // only Eigen decompositions have a basis to project onto
+    const double* eigenSystem = gEigenDecomposition->getEigenSystem(eigenIndex);
+    if (eigenSystem == NULL)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    if (gEdgeProjection == NULL)
+        gEdgeProjection = new EdgeProjection(kStateCount);
+    projectPartials(gEdgeProjection, eigenSystem, parentBufferIndex, childBufferIndex,
+                    categoryWeightsIndex, stateFrequenciesIndex);
+
+    gEdgeProjectionScales.clear();
+    if (cumulativeScaleIndex != BEAGLE_OP_NONE) {
+        const REALTYPE* scalingFactors = getLogScaleFactors(cumulativeScaleIndex);
+        gEdgeProjectionScales.assign(scalingFactors, scalingFactors + kPatternCount);
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calculateProjectedEdgeLogLikelihoods(double edgeLength,
+                                                                            double* outSumLogLikelihood,
+                                                                            double* outSumFirstDerivative,
+                                                                            double* outSumSecondDerivative) {
+    if (gEdgeProjection == NULL)
+        return BEAGLE_ERROR_GENERAL;
+
+    const double startTime = gKernelCounters.start();
+    const bool firstDerivative = (outSumFirstDerivative != NULL || outSumSecondDerivative != NULL);
+    const bool secondDerivative = (outSumSecondDerivative != NULL);
+    std::vector<double> siteValues(3 * kPatternCount);
+    double* likelihoods = &siteValues[0];
+    double* firstDerivatives = &siteValues[kPatternCount];
+    double* secondDerivatives = &siteValues[2 * kPatternCount];
+    gEdgeProjection->getSiteLikelihoods(edgeLength, likelihoods,
+                                        (firstDerivative ? firstDerivatives : NULL),
+                                        (secondDerivative ? secondDerivatives : NULL));
+
+    // sums are kept in double precision so that they vary smoothly with edgeLength
+    for (int n = 0; n < kActivePatternCount; n++) {
+        const int k = gActivePatterns[n];
+        double siteLogLikelihood = log(likelihoods[k]);
+        if (!gEdgeProjectionScales.empty())
+            siteLogLikelihood += gEdgeProjectionScales[k];
+        const double siteFirstDerivative = firstDerivatives[k] / likelihoods[k];
+        if (firstDerivative) {
+            outFirstDerivativesTmp[k] = siteFirstDerivative;
+            firstDerivatives[k] = siteFirstDerivative;
+        }
+        if (secondDerivative) {
+            const double siteSecondDerivative = secondDerivatives[k] / likelihoods[k] -
+                                                siteFirstDerivative * siteFirstDerivative;
+            outSecondDerivativesTmp[k] = siteSecondDerivative;
+            secondDerivatives[k] = siteSecondDerivative;
+        }
+        outLogLikelihoodsTmp[k] = siteLogLikelihood;
+        likelihoods[k] = siteLogLikelihood;
+    }
+    const double sumLogLikelihood = sumActivePatterns(likelihoods);
+    const double sumFirstDerivative = (firstDerivative ? sumActivePatterns(firstDerivatives) : 0.0);
+    const double sumSecondDerivative = (secondDerivative ? sumActivePatterns(secondDerivatives) : 0.0);
+
+    *outSumLogLikelihood = sumLogLikelihood;
+    if (outSumFirstDerivative != NULL)
+        *outSumFirstDerivative = sumFirstDerivative;
+    if (outSumSecondDerivative != NULL)
+        *outSumSecondDerivative = sumSecondDerivative;
+    recordKernel((firstDerivative ? BEAGLE_KERNEL_DERIVATIVES : BEAGLE_KERNEL_EDGE), startTime,
+                 kActivePatternCount);
+
+    if (sumLogLikelihood != sumLogLikelihood)
+        return BEAGLE_ERROR_FLOATING_POINT;
+
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::optimizeEdgeLengths(const int* parentBufferIndices,
+                                                           const int* childBufferIndices,
+                                                           int eigenIndex,
+                                                           int categoryWeightsIndex,
+                                                           int stateFrequenciesIndex,
+                                                           const int* cumulativeScaleIndices,
+                                                           int count,
+                                                           double minEdgeLength,
+                                                           double maxEdgeLength,
+                                                           double tolerance,
+                                                           int maxIterations,
+                                                           double* inOutEdgeLengths,
+                                                           double* outLogLikelihoods) {
+    if (eigenIndex < 0 || eigenIndex >= kEigenDecompCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    for (int e = 0; e < count; e++) {
+        if (parentBufferIndices[e] < 0 || parentBufferIndices[e] >= kBufferCount ||
+            childBufferIndices[e] < 0 || childBufferIndices[e] >= kBufferCount)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    if (!(minEdgeLength >= 0.0 && maxEdgeLength >= minEdgeLength) || maxIterations < 0)
+        return BEAGLE_ERROR_GENERAL;
+    if (kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS))
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    const double* eigenSystem = gEigenDecomposition->getEigenSystem(eigenIndex);
+    if (eigenSystem == NULL)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    // the projection and site values are kept between calls, as an optimization pass over a
+    //  tree visits every edge in turn
+    if (gEdgeOptimizerProjection == NULL)
+        gEdgeOptimizerProjection = new EdgeProjection(kStateCount);
+    gEdgeOptimizerSites.resize(3 * kPatternCount);
+    int returnCode = BEAGLE_SUCCESS;
+
+    for (int e = 0; e < count; e++) {
+        projectPartials(gEdgeOptimizerProjection, eigenSystem, parentBufferIndices[e],
+                        childBufferIndices[e], categoryWeightsIndex, stateFrequenciesIndex);
+
+        // the scale factors do not depend on the edge length, so only shift the log likelihood
+        double sumScales = 0.0;
+        if (cumulativeScaleIndices != NULL && cumulativeScaleIndices[e] != BEAGLE_OP_NONE) {
+            sumScales = sumActivePatterns(getLogScaleFactors(cumulativeScaleIndices[e]));
+        }
+
+        // Newton-Raphson, falling back on bisection of the interval known to hold the
+        //  maximum whenever a step leaves it or the likelihood is not concave
+        double lower = minEdgeLength;
+        double upper = maxEdgeLength;
+        double edgeLength = std::min(std::max(inOutEdgeLengths[e], minEdgeLength), maxEdgeLength);
+        double sums[3];
+        bool converged = false;
+        for (int iteration = 0; ; iteration++) {
+            sumProjectedEdge(gEdgeOptimizerProjection, edgeLength, sums);
+            if (converged || iteration >= maxIterations)
+                break;
+
+            const double firstDerivative = sums[1];
+            const double secondDerivative = sums[2];
+            if ((firstDerivative >= 0.0 && edgeLength >= maxEdgeLength) ||
+                (firstDerivative <= 0.0 && edgeLength <= minEdgeLength))
+                break;
+            if (firstDerivative > 0.0)
+                lower = edgeLength;
+            else
+                upper = edgeLength;
+
+            double next = (secondDerivative < 0.0 ? edgeLength - firstDerivative / secondDerivative :
+                           (firstDerivative > 0.0 ? upper : lower));
+            if (!(next > lower && next < upper)) {
+                if (next <= minEdgeLength && lower == minEdgeLength)
+                    next = minEdgeLength;
+                else if (next >= maxEdgeLength && upper == maxEdgeLength)
+                    next = maxEdgeLength;
+                else
+                    next = 0.5 * (lower + upper);
+            }
+            converged = (fabs(next - edgeLength) <= tolerance);
+            edgeLength = next;
+        }
+
+        inOutEdgeLengths[e] = edgeLength;
+        outLogLikelihoods[e] = sums[0] + sumScales;
+        if (outLogLikelihoods[e] != outLogLikelihoods[e])
+            returnCode = BEAGLE_ERROR_FLOATING_POINT;
+    }
+
+    return returnCode;
+}
+
 BEAGLE_CPU_TEMPLATE
 int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int parIndex,
 													 const int childIndex,
@@ -1331,7 +2807,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int parIndex
 		const int* statesChild = gTipStates[childIndex];
 		int v = 0; // Index for parent partials
 
-		for(int l = 0; l < kCategoryCount; l++) {
+		for (int a = 0; a < kActiveCategoryCount; a++) {
+			const int l = gActiveCategories[a];
+			v = l * kPartialsCategoryStride;
 			int u = 0; // Index in resulting product-partials (summed over categories)
 			const REALTYPE weight = wt[l];
 			for(int k = 0; k < kPatternCount; k++) {
@@ -1345,7 +2823,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int parIndex
 
 					w += kTransPaddedStateCount;
 				}
-				v += kPartialsPaddedStateCount;
+				v += kPartialsPatternStride;
 			}
 		}
 
@@ -1355,7 +2833,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int parIndex
         int v = 0;
         int stateCountModFour = (kStateCount / 4) * 4;
         
-        for(int l = 0; l < kCategoryCount; l++) {
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            v = l * kPartialsCategoryStride;
             int u = 0;
             const REALTYPE weight = wt[l];
             for(int k = 0; k < kPatternCount; k++) {
@@ -1387,7 +2867,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int parIndex
                     // increment for the extra column at the end
                     w += T_PAD;
                 }
-                v += kPartialsPaddedStateCount;
+                v += kPartialsPatternStride;
             }
         }
     }
@@ -1405,15 +2885,12 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoods(const int parIndex
 
 
 	if (scalingFactorsIndex != BEAGLE_OP_NONE) {
-		const REALTYPE* scalingFactors = gScaleBuffers[scalingFactorsIndex];
+		const REALTYPE* scalingFactors = getLogScaleFactors(scalingFactorsIndex);
 		for(int k=0; k < kPatternCount; k++)
 			outLogLikelihoodsTmp[k] += scalingFactors[k];
 	}
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -1450,7 +2927,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsMulti(const int* pa
             const int* statesChild = gTipStates[childIndex];
             int v = 0; // Index for parent partials
             
-            for(int l = 0; l < kCategoryCount; l++) {
+            for (int a = 0; a < kActiveCategoryCount; a++) {
+                const int l = gActiveCategories[a];
+                v = l * kPartialsCategoryStride;
                 int u = 0; // Index in resulting product-partials (summed over categories)
                 const REALTYPE weight = wt[l];
                 for(int k = 0; k < kPatternCount; k++) {
@@ -1464,15 +2943,22 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsMulti(const int* pa
                         
                         w += kTransPaddedStateCount;
                     }
-                    v += kPartialsPaddedStateCount;
+                    v += kPartialsPatternStride;
                 }
-            }                
+            }
+
+            if (!gAmbiguousPatterns[childIndex].empty())
+                integrateAmbiguousTip(childIndex, partialsParent,
+                                      buildAmbiguityLookup(childIndex, transMatrix, gAmbiguityLookup),
+                                      wt, integrationTmp);
         } else {
             const REALTYPE* partialsChild = gPartials[childIndex];
             int v = 0;
             int stateCountModFour = (kStateCount / 4) * 4;
             
-            for(int l = 0; l < kCategoryCount; l++) {
+            for (int a = 0; a < kActiveCategoryCount; a++) {
+                const int l = gActiveCategories[a];
+                v = l * kPartialsCategoryStride;
                 int u = 0;
                 const REALTYPE weight = wt[l];
                 for(int k = 0; k < kPatternCount; k++) {
@@ -1504,7 +2990,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsMulti(const int* pa
                         // increment for the extra column at the end
                         w += T_PAD;
                     }
-                    v += kPartialsPaddedStateCount;
+                    v += kPartialsPatternStride;
                 }
             }
                             
@@ -1521,14 +3007,14 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsMulti(const int* pa
                 int cumulativeScalingFactorIndex;
                 cumulativeScalingFactorIndex = scalingFactorsIndices[subsetIndex];
                 
-                const REALTYPE* cumulativeScaleFactors = gScaleBuffers[cumulativeScalingFactorIndex];
+                const REALTYPE cumulativeScaleFactor = getLogScaleFactor(cumulativeScalingFactorIndex, k);
                 
                 if (subsetIndex == 0) {
                     indexMaxScale[k] = 0;
-                    maxScaleFactor[k] = cumulativeScaleFactors[k];
+                    maxScaleFactor[k] = cumulativeScaleFactor;
                     for (int j = 1; j < count; j++) {
                         REALTYPE tmpScaleFactor;
-                        tmpScaleFactor = gScaleBuffers[scalingFactorsIndices[j]][k];
+                        tmpScaleFactor = getLogScaleFactor(scalingFactorsIndices[j], k);
                         
                         if (tmpScaleFactor > maxScaleFactor[k]) {
                             indexMaxScale[k] = j;
@@ -1538,7 +3024,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsMulti(const int* pa
                 }
                 
                 if (subsetIndex != indexMaxScale[k])
-                    sumOverI *= exp((REALTYPE)(cumulativeScaleFactors[k] - maxScaleFactor[k]));
+                    sumOverI *= exp((REALTYPE)(cumulativeScaleFactor - maxScaleFactor[k]));
             }
 
 
@@ -1563,10 +3049,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsMulti(const int* pa
     }
     
 
-    *outSumLogLikelihood = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
     
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -1575,14 +3058,166 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsMulti(const int* pa
 }
 
     
+/*
+ * Mixture of subsets as in calcEdgeLogLikelihoodsMulti, with derivatives. The
+ *  subsets are computed in parallel and combined site by site.
+ */
 BEAGLE_CPU_TEMPLATE
-int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsFirstDeriv(const int parIndex,
-                                                               const int childIndex,
-                                                               const int probIndex,
-                                                               const int firstDerivativeIndex,
-                                                               const int categoryWeightsIndex,
-                                                               const int stateFrequenciesIndex,
-                                                               const int scalingFactorsIndex,
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsMultiDeriv(const int* parentBufferIndices,
+                                                                        const int* childBufferIndices,
+                                                                        const int* probabilityIndices,
+                                                                        const int* firstDerivativeIndices,
+                                                                        const int* secondDerivativeIndices,
+                                                                        const int* categoryWeightsIndices,
+                                                                        const int* stateFrequenciesIndices,
+                                                                        const int* scalingFactorsIndices,
+                                                                        int count,
+                                                                        double* outSumLogLikelihood,
+                                                                        double* outSumFirstDerivative,
+                                                                        double* outSumSecondDerivative) {
+    if (firstDerivativeIndices == NULL)
+        return BEAGLE_ERROR_GENERAL;
+
+    const bool secondDerivative = (secondDerivativeIndices != NULL);
+    const bool scaled = (scalingFactorsIndices[0] != BEAGLE_OP_NONE);
+    const int siteCount = 3 * kPatternCount;
+    std::vector<double> siteValues(siteCount * count);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int subsetIndex = 0; subsetIndex < count; subsetIndex++) {
+        double* values = &siteValues[subsetIndex * siteCount];
+        calcEdgeSiteLikelihoods(parentBufferIndices[subsetIndex], childBufferIndices[subsetIndex],
+                                probabilityIndices[subsetIndex], firstDerivativeIndices[subsetIndex],
+                                (secondDerivative ? secondDerivativeIndices[subsetIndex] : BEAGLE_OP_NONE),
+                                categoryWeightsIndices[subsetIndex], stateFrequenciesIndices[subsetIndex],
+                                values, values + kPatternCount, values + 2 * kPatternCount);
+    }
+
+    for (int n = 0; n < kActivePatternCount; n++) {
+        const int k = gActivePatterns[n];
+        // rescale each subset to the largest scale factor before summing
+        double maxScaleFactor = 0.0;
+        if (scaled) {
+            maxScaleFactor = getLogScaleFactor(scalingFactorsIndices[0], k);
+            for (int j = 1; j < count; j++) {
+                if (getLogScaleFactor(scalingFactorsIndices[j], k) > maxScaleFactor)
+                    maxScaleFactor = getLogScaleFactor(scalingFactorsIndices[j], k);
+            }
+        }
+
+        double sumOverSubsets[3] = {0.0, 0.0, 0.0};
+        for (int subsetIndex = 0; subsetIndex < count; subsetIndex++) {
+            const double* values = &siteValues[subsetIndex * siteCount];
+            double factor = 1.0;
+            if (scaled)
+                factor = exp(getLogScaleFactor(scalingFactorsIndices[subsetIndex], k) - maxScaleFactor);
+            sumOverSubsets[0] += factor * values[k];
+            sumOverSubsets[1] += factor * values[kPatternCount + k];
+            if (secondDerivative)
+                sumOverSubsets[2] += factor * values[2 * kPatternCount + k];
+        }
+
+        outLogLikelihoodsTmp[k] = log(sumOverSubsets[0]) + maxScaleFactor;
+        outFirstDerivativesTmp[k] = sumOverSubsets[1] / sumOverSubsets[0];
+        if (secondDerivative)
+            outSecondDerivativesTmp[k] = sumOverSubsets[2] / sumOverSubsets[0] -
+                                         outFirstDerivativesTmp[k] * outFirstDerivativesTmp[k];
+    }
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
+    *outSumFirstDerivative = sumActivePatterns(outFirstDerivativesTmp);
+    if (secondDerivative)
+        *outSumSecondDerivative = sumActivePatterns(outSecondDerivativesTmp);
+
+    if (*outSumLogLikelihood != *outSumLogLikelihood)
+        return BEAGLE_ERROR_FLOATING_POINT;
+
+    return BEAGLE_SUCCESS;
+}
+
+/*
+ * Calculates the site likelihoods of one edge, summed over categories and without
+ *  scale factors, and their derivatives unless the derivative indices are
+ *  BEAGLE_OP_NONE. Only reads instance buffers, so edges may be computed on several
+ *  threads at once.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeSiteLikelihoods(int parIndex,
+                                                                int childIndex,
+                                                                int probIndex,
+                                                                int firstDerivIndex,
+                                                                int secondDerivIndex,
+                                                                int categoryWeightsIndex,
+                                                                int stateFrequenciesIndex,
+                                                                double* outLikelihoods,
+                                                                double* outFirstDerivatives,
+                                                                double* outSecondDerivatives) {
+    const REALTYPE* partialsParent = gPartials[parIndex];
+    const REALTYPE* wt = gCategoryWeights[categoryWeightsIndex];
+    const REALTYPE* freqs = gStateFrequencies[stateFrequenciesIndex];
+    const REALTYPE* matrices[3] = {gTransitionMatrices[probIndex],
+                                   (firstDerivIndex != BEAGLE_OP_NONE ? gTransitionMatrices[firstDerivIndex] : NULL),
+                                   (secondDerivIndex != BEAGLE_OP_NONE ? gTransitionMatrices[secondDerivIndex] : NULL)};
+    const int derivativeCount = (matrices[1] == NULL ? 0 : (matrices[2] != NULL ? 2 : 1));
+    double* outputs[3] = {outLikelihoods, outFirstDerivatives, outSecondDerivatives};
+
+    const int* statesChild = (childIndex < kTipCount ? gTipStates[childIndex] : NULL);
+    const REALTYPE* partialsChild = (statesChild == NULL ? gPartials[childIndex] : NULL);
+    std::vector<int> masks;
+    if (statesChild != NULL && !gAmbiguousPatterns[childIndex].empty()) {
+        masks.assign(kPatternCount, 0);
+        const std::vector<int>& patterns = gAmbiguousPatterns[childIndex];
+        for (size_t p = 0; p < patterns.size(); p++)
+            masks[patterns[p]] = gAmbiguityMasks[childIndex][gAmbiguousCodes[childIndex][p]];
+    }
+
+    for (int n = 0; n < kActivePatternCount; n++) {
+        const int k = gActivePatterns[n];
+        const int stateChild = (statesChild != NULL ? statesChild[k] : 0);
+        const int mask = (masks.empty() ? 0 : masks[k]);
+        double sums[3] = {0.0, 0.0, 0.0};
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            const int v = l * kPartialsCategoryStride + k * kPartialsPatternStride;
+            for (int d = 0; d <= derivativeCount; d++) {
+                const REALTYPE* transMatrix = matrices[d] + l * kMatrixSize;
+                double sumOverI = 0.0;
+                for (int i = 0; i < kStateCount; i++) {
+                    const REALTYPE* row = transMatrix + i * kTransPaddedStateCount;
+                    double sumOverJ = 0.0;
+                    if (partialsChild != NULL) {
+                        for (int j = 0; j < kStateCount; j++)
+                            sumOverJ += row[j] * partialsChild[v + j];
+                    } else if (mask != 0) {
+                        for (int j = 0; j < kStateCount; j++) {
+                            if ((mask >> j) & 1)
+                                sumOverJ += row[j];
+                        }
+                    } else if (stateChild < kStateCount) {
+                        sumOverJ = row[stateChild];
+                    } else if (T_PAD != 0) {
+                        sumOverJ = row[kStateCount];
+                    } else {
+                        for (int j = 0; j < kStateCount; j++)
+                            sumOverJ += row[j];
+                    }
+                    sumOverI += freqs[i] * partialsParent[v + i] * sumOverJ;
+                }
+                sums[d] += wt[l] * sumOverI;
+            }
+        }
+        for (int d = 0; d <= derivativeCount; d++)
+            outputs[d][k] = sums[d];
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsFirstDeriv(const int parIndex,
+                                                               const int childIndex,
+                                                               const int probIndex,
+                                                               const int firstDerivativeIndex,
+                                                               const int categoryWeightsIndex,
+                                                               const int stateFrequenciesIndex,
+                                                               const int scalingFactorsIndex,
                                                                double* outSumLogLikelihood,
                                                                double* outSumFirstDerivative) {
 
@@ -1605,7 +3240,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsFirstDeriv(const in
 		const int* statesChild = gTipStates[childIndex];
 		int v = 0; // Index for parent partials
 
-		for(int l = 0; l < kCategoryCount; l++) {
+		for (int a = 0; a < kActiveCategoryCount; a++) {
+			const int l = gActiveCategories[a];
+			v = l * kPartialsCategoryStride;
 			int u = 0; // Index in resulting product-partials (summed over categories)
 			const REALTYPE weight = wt[l];
 			for(int k = 0; k < kPatternCount; k++) {
@@ -1620,7 +3257,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsFirstDeriv(const in
 
 					w += kTransPaddedStateCount;
 				}
-				v += kPartialsPaddedStateCount;
+				v += kPartialsPatternStride;
 			}
 		}
 
@@ -1629,7 +3266,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsFirstDeriv(const in
 		const REALTYPE* partialsChild = gPartials[childIndex];
 		int v = 0;
 
-		for(int l = 0; l < kCategoryCount; l++) {
+		for (int a = 0; a < kActiveCategoryCount; a++) {
+			const int l = gActiveCategories[a];
+			v = l * kPartialsCategoryStride;
 			int u = 0;
 			const REALTYPE weight = wt[l];
 			for(int k = 0; k < kPatternCount; k++) {
@@ -1650,7 +3289,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsFirstDeriv(const in
 					firstDerivTmp[u] += sumOverJD1 * partialsParent[v + i] * weight;
 					u++;
 				}
-				v += kPartialsPaddedStateCount;
+				v += kPartialsPatternStride;
 			}
 		}
 	}
@@ -1671,18 +3310,13 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsFirstDeriv(const in
 
 
 	if (scalingFactorsIndex != BEAGLE_OP_NONE) {
-		const REALTYPE* scalingFactors = gScaleBuffers[scalingFactorsIndex];
+		const REALTYPE* scalingFactors = getLogScaleFactors(scalingFactorsIndex);
 		for(int k=0; k < kPatternCount; k++)
 			outLogLikelihoodsTmp[k] += scalingFactors[k];
 	}
 
-    *outSumLogLikelihood = 0.0;
-    *outSumFirstDerivative = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-
-        *outSumFirstDerivative += outFirstDerivativesTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
+    *outSumFirstDerivative = sumActivePatterns(outFirstDerivativesTmp);
     
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -1724,7 +3358,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsSecondDeriv(const i
 		const int* statesChild = gTipStates[childIndex];
 		int v = 0; // Index for parent partials
 
-		for(int l = 0; l < kCategoryCount; l++) {
+		for (int a = 0; a < kActiveCategoryCount; a++) {
+			const int l = gActiveCategories[a];
+			v = l * kPartialsCategoryStride;
 			int u = 0; // Index in resulting product-partials (summed over categories)
 			const REALTYPE weight = wt[l];
 			for(int k = 0; k < kPatternCount; k++) {
@@ -1740,7 +3376,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsSecondDeriv(const i
 
 					w += kTransPaddedStateCount;
 				}
-				v += kPartialsPaddedStateCount;
+				v += kPartialsPatternStride;
 			}
 		}
 
@@ -1749,7 +3385,9 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsSecondDeriv(const i
 		const REALTYPE* partialsChild = gPartials[childIndex];
 		int v = 0;
 
-		for(int l = 0; l < kCategoryCount; l++) {
+		for (int a = 0; a < kActiveCategoryCount; a++) {
+			const int l = gActiveCategories[a];
+			v = l * kPartialsCategoryStride;
 			int u = 0;
 			const REALTYPE weight = wt[l];
 			for(int k = 0; k < kPatternCount; k++) {
@@ -1773,7 +3411,7 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsSecondDeriv(const i
 					secondDerivTmp[u] += sumOverJD2 * partialsParent[v + i] * weight;
 					u++;
 				}
-				v += kPartialsPaddedStateCount;
+				v += kPartialsPatternStride;
 			}
 		}
 	}
@@ -1797,21 +3435,14 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcEdgeLogLikelihoodsSecondDeriv(const i
 
 
 	if (scalingFactorsIndex != BEAGLE_OP_NONE) {
-		const REALTYPE* scalingFactors = gScaleBuffers[scalingFactorsIndex];
+		const REALTYPE* scalingFactors = getLogScaleFactors(scalingFactorsIndex);
 		for(int k=0; k < kPatternCount; k++)
 			outLogLikelihoodsTmp[k] += scalingFactors[k];
 	}
 
-    *outSumLogLikelihood = 0.0;
-    *outSumFirstDerivative = 0.0;
-    *outSumSecondDerivative = 0.0;
-    for (int i = 0; i < kPatternCount; i++) {
-        *outSumLogLikelihood += outLogLikelihoodsTmp[i] * gPatternWeights[i];
-
-        *outSumFirstDerivative += outFirstDerivativesTmp[i] * gPatternWeights[i];
-
-        *outSumSecondDerivative += outSecondDerivativesTmp[i] * gPatternWeights[i];
-    }
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
+    *outSumFirstDerivative = sumActivePatterns(outFirstDerivativesTmp);
+    *outSumSecondDerivative = sumActivePatterns(outSecondDerivativesTmp);
 
     if (*outSumLogLikelihood != *outSumLogLikelihood)
         returnCode = BEAGLE_ERROR_FLOATING_POINT;
@@ -1830,6 +3461,927 @@ int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::block(void) {
 ///////////////////////////////////////////////////////////////////////////////
 // private methods
 
+/*
+ * Drops the operations whose destination is still up to date, i.e. it was last computed by
+ *  the same operation from children, matrices and scale factors that have not been written
+ *  since. The remaining operations are copied into dirtyOperations and their outputs are
+ *  stamped right away, so later operations in the list see them as changed.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::removeCleanOperations(const int* operations,
+                                                             int operationCount,
+                                                             int cumulativeScalingIndex,
+                                                             std::vector<int>& dirtyOperations) {
+    // Internally managed scale factors are rewritten by every operation
+    const bool canSkip = !(kFlags & (BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_ALWAYS |
+                                     BEAGLE_FLAG_SCALING_DYNAMIC));
+    std::vector<int> skippedScalingIndices;
+    dirtyOperations.clear();
+    for (int op = 0; op < operationCount; op++) {
+        const int* operation = operations + op * 7;
+        const int parIndex = operation[0];
+        const int writeScalingIndex = operation[1];
+        const int readScalingIndex = operation[2];
+
+        std::vector<long> inputs(operation, operation + 7);
+        inputs.push_back(gPartialsStamps[operation[3]]);
+        inputs.push_back(gMatrixStamps[operation[4]]);
+        inputs.push_back(gPartialsStamps[operation[5]]);
+        inputs.push_back(gMatrixStamps[operation[6]]);
+        inputs.push_back(readScalingIndex >= 0 ? gScaleBufferStamps[readScalingIndex] : 0);
+        inputs.push_back(gPartialsStamps[parIndex]);
+        inputs.push_back(writeScalingIndex >= 0 ? gScaleBufferStamps[writeScalingIndex] : 0);
+
+        if (canSkip && gPartialsInputs[parIndex] == inputs) {
+            if (writeScalingIndex >= 0)
+                skippedScalingIndices.push_back(writeScalingIndex);
+            continue;
+        }
+
+        dirtyOperations.insert(dirtyOperations.end(), operation, operation + 7);
+        gPartialsStamps[parIndex] = ++kDirtyClock;
+        inputs[12] = gPartialsStamps[parIndex];
+        if (writeScalingIndex >= 0) {
+            gScaleBufferStamps[writeScalingIndex] = ++kDirtyClock;
+            inputs[13] = gScaleBufferStamps[writeScalingIndex];
+        }
+        gPartialsInputs[parIndex].swap(inputs);
+    }
+
+    if (cumulativeScalingIndex != BEAGLE_OP_NONE) {
+        // The scale factors of skipped operations still belong in the cumulative buffer
+        if (!skippedScalingIndices.empty())
+            accumulateScaleFactors(&skippedScalingIndices[0], skippedScalingIndices.size(),
+                                   cumulativeScalingIndex);
+        markScaleBufferWritten(cumulativeScalingIndex);
+    }
+
+    return dirtyOperations.size() / 7;
+}
+
+BEAGLE_CPU_TEMPLATE
+bool BeagleCPUImpl<BEAGLE_CPU_GENERIC>::isMatrixClean(int matrixIndex,
+                                                      int eigenIndex,
+                                                      int order,
+                                                      double edgeLength) {
+    const std::vector<long>& inputs = gMatrixInputs[matrixIndex];
+    return (inputs.size() == 5 &&
+            inputs[0] == eigenIndex &&
+            inputs[1] == gEigenStamps[eigenIndex] &&
+            inputs[2] == kCategoryRatesStamp &&
+            inputs[3] == order &&
+            inputs[4] == gMatrixStamps[matrixIndex] &&
+            gMatrixEdgeLengths[matrixIndex] == edgeLength);
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::markMatrixComputed(int matrixIndex,
+                                                           int eigenIndex,
+                                                           int order,
+                                                           double edgeLength) {
+    gMatrixStamps[matrixIndex] = ++kDirtyClock;
+    std::vector<long>& inputs = gMatrixInputs[matrixIndex];
+    inputs.resize(5);
+    inputs[0] = eigenIndex;
+    inputs[1] = gEigenStamps[eigenIndex];
+    inputs[2] = kCategoryRatesStamp;
+    inputs[3] = order;
+    inputs[4] = gMatrixStamps[matrixIndex];
+    gMatrixEdgeLengths[matrixIndex] = edgeLength;
+}
+
+/*
+ * A category is active while any set category weights give it nonzero weight, or if
+ *  none do. Partials of an inactive category are left as they were, so with dirty
+ *  tracking every internal buffer is recomputed once a category becomes active again.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateActiveCategories() {
+    std::vector<int> activeCategories;
+    for (int l = 0; l < kCategoryCount; l++) {
+        for (int i = 0; i < kEigenDecompCount; i++) {
+            if (gCategoryWeights[i] != NULL && gCategoryWeights[i][l] != 0.0) {
+                activeCategories.push_back(l);
+                break;
+            }
+        }
+    }
+    if (activeCategories.empty()) {
+        for (int l = 0; l < kCategoryCount; l++)
+            activeCategories.push_back(l);
+    }
+
+    if (kDirtyTracking && !std::includes(gActiveCategories.begin(), gActiveCategories.end(),
+                                         activeCategories.begin(), activeCategories.end())) {
+        for (int i = kTipCount; i < kBufferCount; i++)
+            markPartialsWritten(i);
+    }
+    gActiveCategories.swap(activeCategories);
+    kActiveCategoryCount = gActiveCategories.size();
+}
+
+/*
+ * Traversals visit the active patterns in runs, computing gaps of fewer than
+ *  BEAGLE_CPU_MIN_PATTERN_GAP zero-weight patterns along with their neighbours.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updateActivePatterns() {
+    std::vector<int> activePatterns;
+    for (int k = 0; k < kPatternCount; k++) {
+        if (gPatternWeights[k] != 0.0)
+            activePatterns.push_back(k);
+    }
+
+    if (kDirtyTracking && !std::includes(gActivePatterns.begin(), gActivePatterns.end(),
+                                         activePatterns.begin(), activePatterns.end())) {
+        for (int i = kTipCount; i < kBufferCount; i++)
+            markPartialsWritten(i);
+    }
+    gActivePatterns.swap(activePatterns);
+    kActivePatternCount = gActivePatterns.size();
+
+    gActivePatternRuns.clear();
+    for (int n = 0; n < kActivePatternCount; n++) {
+        const int k = gActivePatterns[n];
+        if (!gActivePatternRuns.empty() && k - gActivePatternRuns.back() < BEAGLE_CPU_MIN_PATTERN_GAP) {
+            gActivePatternRuns.back() = k + 1;
+        } else {
+            gActivePatternRuns.push_back(k);
+            gActivePatternRuns.push_back(k + 1);
+        }
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+template <typename T>
+double BeagleCPUImpl<BEAGLE_CPU_GENERIC>::sumActivePatterns(const T* values) {
+    const int blockCount = (kActivePatternCount + BEAGLE_CPU_SUM_BLOCK_SIZE - 1) / BEAGLE_CPU_SUM_BLOCK_SIZE;
+    if (blockCount <= 1) {
+        double sum = 0.0;
+        for (int n = 0; n < kActivePatternCount; n++) {
+            const int k = gActivePatterns[n];
+            sum += values[k] * gPatternWeights[k];
+        }
+        return sum;
+    }
+
+    std::vector<double> blockSums(blockCount);
+#pragma omp parallel for if(blockCount >= BEAGLE_CPU_PARALLEL_SUM_BLOCKS)
+    for (int b = 0; b < blockCount; b++) {
+        const int start = b * BEAGLE_CPU_SUM_BLOCK_SIZE;
+        const int end = std::min(start + BEAGLE_CPU_SUM_BLOCK_SIZE, kActivePatternCount);
+        double sum = 0.0;
+        for (int n = start; n < end; n++) {
+            const int k = gActivePatterns[n];
+            sum += values[k] * gPatternWeights[k];
+        }
+        blockSums[b] = sum;
+    }
+    for (int stride = 1; stride < blockCount; stride *= 2) {
+        for (int b = 0; b + stride < blockCount; b += 2 * stride)
+            blockSums[b] += blockSums[b + stride];
+    }
+    return blockSums[0];
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::recordKernel(int kernelClass,
+                                                     double startTime,
+                                                     double units) {
+    const int categoryCount = (kernelClass == BEAGLE_KERNEL_TRANSITION_MATRICES ?
+                               kCategoryCount : kActiveCategoryCount);
+    gKernelCounters.record(kernelClass, startTime, units * categoryCount, kStateCount, sizeof(REALTYPE));
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::markPartialsWritten(int bufferIndex) {
+    if (kDirtyTracking) {
+        gPartialsStamps[bufferIndex] = ++kDirtyClock;
+        gPartialsInputs[bufferIndex].clear();
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::markMatrixWritten(int matrixIndex) {
+    if (kDirtyTracking) {
+        gMatrixStamps[matrixIndex] = ++kDirtyClock;
+        gMatrixInputs[matrixIndex].clear();
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::markScaleBufferWritten(int scaleIndex) {
+    if (kDirtyTracking && scaleIndex >= 0 && scaleIndex < (int) gScaleBufferStamps.size())
+        gScaleBufferStamps[scaleIndex] = ++kDirtyClock;
+}
+
+/*
+ * Executes a whole operation list one pattern block at a time, so that the partials
+ *  of each block flow up the tree while they are still in cache. Per-pattern results
+ *  are identical to updatePartials since no operation mixes patterns.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::updatePartialsBlocked(const int* operations,
+                                                   int count,
+                                                   int cumulativeScaleIndex) {
+
+    REALTYPE* cumulativeScaleBuffer = NULL;
+    if (cumulativeScaleIndex != BEAGLE_OP_NONE)
+        cumulativeScaleBuffer = gScaleBuffers[cumulativeScaleIndex];
+
+    for (int startPattern = 0; startPattern < kPatternCount; startPattern += kCacheBlockSize) {
+        int endPattern = startPattern + kCacheBlockSize;
+        if (endPattern > kPatternCount)
+            endPattern = kPatternCount;
+
+        for (int op = 0; op < count; op++) {
+            const int parIndex = operations[op * 7];
+            const int writeScalingIndex = operations[op * 7 + 1];
+            const int readScalingIndex = operations[op * 7 + 2];
+            const int child1Index = operations[op * 7 + 3];
+            const int child1TransMatIndex = operations[op * 7 + 4];
+            const int child2Index = operations[op * 7 + 5];
+            const int child2TransMatIndex = operations[op * 7 + 6];
+
+            int rescale = BEAGLE_OP_NONE;
+            REALTYPE* scalingFactors = NULL;
+
+            if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
+                rescale = 1;
+                scalingFactors = gScaleBuffers[parIndex - kTipCount];
+            } else if (kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) {
+                rescale = prepareDynamicScaling(writeScalingIndex, readScalingIndex, &scalingFactors,
+                                                startPattern, endPattern);
+            } else if (writeScalingIndex >= 0) {
+                rescale = 1;
+                scalingFactors = gScaleBuffers[writeScalingIndex];
+            } else if (readScalingIndex >= 0) {
+                rescale = 0;
+                scalingFactors = gScaleBuffers[readScalingIndex];
+            }
+
+            calcOperationPartials(gPartials[parIndex],
+                                  child1Index, gTransitionMatrices[child1TransMatIndex],
+                                  child2Index, gTransitionMatrices[child2TransMatIndex],
+                                  rescale, scalingFactors, cumulativeScaleBuffer,
+                                  startPattern, endPattern);
+
+            if (kFlags & BEAGLE_FLAG_SCALING_ALWAYS) {
+                int scalingIndices[2];
+                int scalingCount = 0;
+                if (child1Index >= kTipCount)
+                    scalingIndices[scalingCount++] = child1Index - kTipCount;
+                if (child2Index >= kTipCount)
+                    scalingIndices[scalingCount++] = child2Index - kTipCount;
+                if (scalingCount > 0)
+                    accumulateScaleFactorsForPatterns(scalingIndices, scalingCount,
+                                                      parIndex - kTipCount,
+                                                      startPattern, endPattern);
+            }
+        }
+    }
+
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+bool BeagleCPUImpl<BEAGLE_CPU_GENERIC>::accumulateScaleFactorsForPatterns(const int* scalingIndices,
+                                                                int count,
+                                                                int cumulativeScalingIndex,
+                                                                int startPattern,
+                                                                int endPattern) {
+    if (kExponentScalers) {
+        signed short* cumulativeScaleExponents = (signed short*) gScaleBuffers[cumulativeScalingIndex];
+        bool inRange = true;
+        for (int i = 0; i < count; i++) {
+            const signed short* scaleExponents = (const signed short*) gScaleBuffers[scalingIndices[i]];
+            for (int j = startPattern; j < endPattern; j++) {
+                if (!addScaleExponent(&cumulativeScaleExponents[j], scaleExponents[j]))
+                    inRange = false;
+            }
+        }
+        return inRange;
+    }
+
+    REALTYPE* cumulativeScaleBuffer = gScaleBuffers[cumulativeScalingIndex];
+    for(int i=0; i<count; i++) {
+        const REALTYPE* scaleBuffer = gScaleBuffers[scalingIndices[i]];
+        for(int j=startPattern; j<endPattern; j++) {
+            if (kFlags & BEAGLE_FLAG_SCALERS_LOG)
+                cumulativeScaleBuffer[j] += scaleBuffer[j];
+            else
+                cumulativeScaleBuffer[j] += log(scaleBuffer[j]);
+        }
+    }
+
+    if (DEBUGGING_OUTPUT) {
+        fprintf(stderr,"Accumulating %d scale buffers into #%d\n",count,cumulativeScalingIndex);
+        for(int j=startPattern; j<endPattern; j++) {
+            fprintf(stderr,"cumulativeScaleBuffer[%d] = %2.5e\n",j,cumulativeScaleBuffer[j]);
+        }
+    }
+    return true;
+}
+
+/*
+ * Computes the partials of a single operation over the active patterns in
+ *  [startPattern, endPattern), one run of active patterns at a time. rescale is 0 to
+ *  apply fixed scaling factors, 1 to recompute them and anything else to compute
+ *  without scaling.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcOperationPartials(REALTYPE* destPartials,
+                                                    int child1Index,
+                                                    const REALTYPE* matrices1,
+                                                    int child2Index,
+                                                    const REALTYPE* matrices2,
+                                                    int rescale,
+                                                    REALTYPE* scalingFactors,
+                                                    REALTYPE* cumulativeScaleBuffer,
+                                                    int startPattern,
+                                                    int endPattern) {
+    for (size_t r = 0; r < gActivePatternRuns.size(); r += 2) {
+        const int runStart = std::max(startPattern, gActivePatternRuns[r]);
+        const int runEnd = std::min(endPattern, gActivePatternRuns[r + 1]);
+        if (runStart < runEnd)
+            calcOperationPartialsForPatterns(destPartials, child1Index, matrices1, child2Index, matrices2,
+                                             rescale, scalingFactors, cumulativeScaleBuffer,
+                                             runStart, runEnd);
+    }
+}
+
+/*
+ * Computes the partials of a single operation over patterns [startPattern, endPattern).
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcOperationPartialsForPatterns(REALTYPE* destPartials,
+                                                               int child1Index,
+                                                               const REALTYPE* matrices1,
+                                                               int child2Index,
+                                                               const REALTYPE* matrices2,
+                                                               int rescale,
+                                                               REALTYPE* scalingFactors,
+                                                               REALTYPE* cumulativeScaleBuffer,
+                                                               int startPattern,
+                                                               int endPattern) {
+    const REALTYPE* partials1 = gPartials[child1Index];
+    const REALTYPE* partials2 = gPartials[child2Index];
+    const int* tipStates1 = gTipStates[child1Index];
+    const int* tipStates2 = gTipStates[child2Index];
+
+    // Exponent scalers hand the kernels the factors they stand for
+    REALTYPE* scaleExponents = scalingFactors;
+    if (kExponentScalers && rescale == 0)
+        scalingFactors = expandScaleExponents((const signed short*) scaleExponents, startPattern, endPattern);
+
+    const double startTime = gKernelCounters.start();
+    const int kernelClass = (tipStates1 != NULL && tipStates2 != NULL ? BEAGLE_KERNEL_STATES_STATES :
+                             (tipStates1 != NULL || tipStates2 != NULL ? BEAGLE_KERNEL_STATES_PARTIALS :
+                              BEAGLE_KERNEL_PARTIALS_PARTIALS));
+
+    // With rescale == 1 compute first without any scaling
+    if (tipStates1 != NULL) {
+        if (tipStates2 != NULL ) {
+            if (rescale == 0) // Use fixed scaleFactors
+                calcStatesStatesFixedScaling(destPartials, tipStates1, matrices1, tipStates2, matrices2,
+                                             scalingFactors, startPattern, endPattern);
+            else
+                calcStatesStates(destPartials, tipStates1, matrices1, tipStates2, matrices2,
+                                 startPattern, endPattern);
+        } else {
+            if (rescale == 0)
+                calcStatesPartialsFixedScaling(destPartials, tipStates1, matrices1, partials2, matrices2,
+                                               scalingFactors, startPattern, endPattern);
+            else
+                calcStatesPartials(destPartials, tipStates1, matrices1, partials2, matrices2,
+                                   startPattern, endPattern);
+        }
+    } else {
+        if (tipStates2 != NULL) {
+            if (rescale == 0)
+                calcStatesPartialsFixedScaling(destPartials,tipStates2,matrices2,partials1,matrices1,
+                                               scalingFactors, startPattern, endPattern);
+            else
+                calcStatesPartials(destPartials, tipStates2, matrices2, partials1, matrices1,
+                                   startPattern, endPattern);
+        } else {
+            if (rescale == 0)
+                calcPartialsPartialsFixedScaling(destPartials,partials1,matrices1,partials2,matrices2,
+                                                 scalingFactors, startPattern, endPattern);
+            else
+                calcPartialsPartials(destPartials, partials1, matrices1, partials2, matrices2,
+                                     startPattern, endPattern);
+        }
+    }
+
+    calcAmbiguousPatterns(destPartials, child1Index, matrices1, child2Index, matrices2,
+                          (rescale == 0 ? scalingFactors : NULL), startPattern, endPattern);
+    recordKernel(kernelClass, startTime, endPattern - startPattern);
+
+    const double rescaleStartTime = gKernelCounters.start();
+    if (rescale == 1 && kExponentScalers)
+        rescalePartialsExponent(destPartials, (signed short*) scaleExponents,
+                                (signed short*) cumulativeScaleBuffer, startPattern, endPattern);
+    else if (rescale == 1) // Recompute scaleFactors
+        rescalePartials(destPartials,scalingFactors,cumulativeScaleBuffer,0,
+                        startPattern, endPattern);
+    else if (rescale == 3) // Update the scaleFactors of patterns near underflow
+        rescalePartialsDynamic(destPartials, scalingFactors, cumulativeScaleBuffer,
+                               startPattern, endPattern);
+    if (rescale == 1 || rescale == 3)
+        recordKernel(BEAGLE_KERNEL_RESCALE, rescaleStartTime, endPattern - startPattern);
+}
+
+/*
+ * Sums, for each category, row and ambiguity mask of a tip, the transition matrix
+ *  columns of the states allowed by the mask. The table is laid out as
+ *  [category][mask][state].
+ */
+BEAGLE_CPU_TEMPLATE
+const REALTYPE* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::buildAmbiguityLookup(int tipIndex,
+                                                              const REALTYPE* matrices,
+                                                              REALTYPE* lookup) {
+    const std::vector<int>& masks = gAmbiguityMasks[tipIndex];
+    REALTYPE* lookupPtr = lookup;
+    for (int l = 0; l < kCategoryCount; l++) {
+        for (int m = 0; m < (int) masks.size(); m++) {
+            const unsigned int mask = (unsigned int) masks[m];
+            const REALTYPE* matrixPtr = matrices + l * kMatrixSize;
+            for (int i = 0; i < kStateCount; i++) {
+                REALTYPE sum = 0.0;
+                for (int j = 0; j < kStateCount; j++) {
+                    if ((mask >> j) & 1u)
+                        sum += matrixPtr[j];
+                }
+                *(lookupPtr++) = sum;
+                matrixPtr += kTransPaddedStateCount;
+            }
+        }
+    }
+    return lookup;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getCheckpointHeader(long* outHeader) {
+    // flags that change the layout or meaning of the saved buffers
+    const long layoutFlags = kFlags & (BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR |
+                                       BEAGLE_FLAG_SCALING_AUTO |
+                                       BEAGLE_FLAG_SCALERS_LOG |
+                                       BEAGLE_FLAG_EIGEN_COMPLEX);
+    const long header[BEAGLE_CPU_CHECKPOINT_HEADER_SIZE] = {
+        BEAGLE_CPU_CHECKPOINT_VERSION, (long) sizeof(REALTYPE), T_PAD, P_PAD,
+        kTipCount, kBufferCount, kStateCount, kPatternCount, kPaddedPatternCount,
+        kEigenDecompCount, kMatrixCount, kCategoryCount, kScaleBufferCount,
+        kPartialsSize, kMatrixSize, layoutFlags};
+    memcpy(outHeader, header, sizeof(header));
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::reserveAmbiguityLookup(int maskCount) {
+    // Room for one table per child of an operation, or the three matrices of an edge
+    const int lookupSize = 3 * kCategoryCount * maskCount * kStateCount;
+    if (lookupSize > kAmbiguityLookupSize) {
+        if (gAmbiguityLookup != NULL)
+            free(gAmbiguityLookup);
+        gAmbiguityLookup = (REALTYPE*) malloc(sizeof(REALTYPE) * lookupSize);
+        if (gAmbiguityLookup == NULL) {
+            kAmbiguityLookupSize = 0;
+            return BEAGLE_ERROR_OUT_OF_MEMORY;
+        }
+        kAmbiguityLookupSize = lookupSize;
+    }
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_CPU_TEMPLATE
+std::vector<long> BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getTipLayout() {
+    const long layout[] = {
+        (long) sizeof(REALTYPE), P_PAD, kStateCount, kPatternCount, kPaddedPatternCount,
+        kCategoryCount, kPartialsSize, kPartialsCategoryStride, kPartialsPatternStride};
+    return std::vector<long>(layout, layout + sizeof(layout) / sizeof(long));
+}
+
+BEAGLE_CPU_TEMPLATE
+template <typename T>
+bool BeagleCPUImpl<BEAGLE_CPU_GENERIC>::restoreOptionalBuffer(CheckpointReader* file,
+                                                              T** buffer,
+                                                              size_t count) {
+    int present;
+    if (!file->read(&present))
+        return false;
+    if (!present) {
+        if (*buffer != NULL) {
+            free(*buffer);
+            *buffer = NULL;
+        }
+        return true;
+    }
+    if (*buffer == NULL) {
+        *buffer = (T*) mallocAligned(sizeof(T) * count);
+        if (*buffer == NULL)
+            throw std::bad_alloc();
+    }
+    return file->read(*buffer, count);
+}
+
+BEAGLE_CPU_TEMPLATE
+template <typename T>
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::copyOptionalBuffer(T** buffer,
+                                                           const T* source,
+                                                           size_t count) {
+    if (source == NULL) {
+        if (*buffer != NULL) {
+            free(*buffer);
+            *buffer = NULL;
+        }
+        return;
+    }
+    if (*buffer == NULL) {
+        *buffer = (T*) malloc(sizeof(T) * count);
+        if (*buffer == NULL)
+            throw std::bad_alloc();
+    }
+    memcpy(*buffer, source, sizeof(T) * count);
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::releaseTipStates(int bufferIndex) {
+    if (gTipStates[bufferIndex] == NULL)
+        return;
+    releaseBuffer(&gTipStates[bufferIndex], &gSharedTipStates[bufferIndex]);
+    gAmbiguousPatterns[bufferIndex].clear();
+    gAmbiguousCodes[bufferIndex].clear();
+    gAmbiguityMasks[bufferIndex].clear();
+}
+
+BEAGLE_CPU_TEMPLATE
+template <typename T>
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::releaseBuffer(T** buffer,
+                                                      SharedBuffer** sharedBuffer) {
+    if (*sharedBuffer == NULL) {
+        if (*buffer != NULL)
+            free(*buffer);
+    } else if ((*sharedBuffer)->release()) {
+        if (!(*sharedBuffer)->isClientMemory())
+            free(*buffer);
+        delete *sharedBuffer;
+    }
+    *buffer = NULL;
+    *sharedBuffer = NULL;
+}
+
+BEAGLE_CPU_TEMPLATE
+template <typename T>
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::detachBuffer(T** buffer,
+                                                     SharedBuffer** sharedBuffer,
+                                                     size_t count,
+                                                     bool keepContents) {
+    if (*sharedBuffer == NULL)
+        return;
+    if ((*sharedBuffer)->isUnique() && !(*sharedBuffer)->isClientMemory()) {
+        // the other instances have let go already, so the buffer is private again
+        delete *sharedBuffer;
+        *sharedBuffer = NULL;
+        return;
+    }
+    T* copy = (T*) mallocAligned(sizeof(T) * count);
+    if (copy == NULL)
+        throw std::bad_alloc();
+    if (keepContents)
+        memcpy(copy, *buffer, sizeof(T) * count);
+    releaseBuffer(buffer, sharedBuffer);
+    *buffer = copy;
+}
+
+BEAGLE_CPU_TEMPLATE
+template <typename T>
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::shareBuffer(T** buffer,
+                                                    SharedBuffer** sharedBuffer,
+                                                    T* source,
+                                                    SharedBuffer** sourceSharedBuffer) {
+    if (source == *buffer)
+        return;
+    releaseBuffer(buffer, sharedBuffer);
+    if (source == NULL)
+        return;
+    if (*sourceSharedBuffer == NULL)
+        *sourceSharedBuffer = new SharedBuffer();
+    (*sourceSharedBuffer)->retain();
+    *buffer = source;
+    *sharedBuffer = *sourceSharedBuffer;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::detachDestinationPartials(const int* operations,
+                                                                  int operationCount) {
+    std::vector<bool> isRead;
+    for (int op = 0; op < operationCount; op++) {
+        const int parIndex = operations[op * 7];
+        if (gSharedPartials[parIndex] == NULL)
+            continue;
+        if (isRead.empty()) {
+            isRead.assign(kBufferCount, false);
+            for (int i = 0; i < operationCount; i++) {
+                isRead[operations[i * 7 + 3]] = true;
+                isRead[operations[i * 7 + 5]] = true;
+            }
+        }
+        detachBuffer(&gPartials[parIndex], &gSharedPartials[parIndex], kPartialsSize, isRead[parIndex]);
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::restoreEigenSystem(int eigenIndex,
+                                                           const double* eigenSystem) {
+    const int matrixSize = kStateCount * kStateCount;
+    std::vector<double> inverseEigenVectors(eigenSystem + matrixSize, eigenSystem + 2 * matrixSize);
+    if (kFlags & BEAGLE_FLAG_INVEVEC_TRANSPOSED) {
+        for (int i = 0; i < kStateCount; i++) {
+            for (int j = 0; j < kStateCount; j++)
+                inverseEigenVectors[j * kStateCount + i] = eigenSystem[matrixSize + i * kStateCount + j];
+        }
+    }
+    // the imaginary parts follow the real ones, as setEigenDecomposition takes them
+    setEigenDecomposition(eigenIndex, eigenSystem, &inverseEigenVectors[0], eigenSystem + 2 * matrixSize);
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::projectPartials(EdgeProjection* projection,
+                                                        const double* eigenSystem,
+                                                        int parentBufferIndex,
+                                                        int childBufferIndex,
+                                                        int categoryWeightsIndex,
+                                                        int stateFrequenciesIndex) {
+    const double startTime = gKernelCounters.start();
+    std::vector<double> categoryWeights(gCategoryWeights[categoryWeightsIndex],
+                                        gCategoryWeights[categoryWeightsIndex] + kCategoryCount);
+    projection->setModel(eigenSystem, kCategoryCount, gCategoryRates, &categoryWeights[0],
+                         kPatternCount);
+
+    const REALTYPE* freqs = gStateFrequencies[stateFrequenciesIndex];
+
+#pragma omp parallel
+    {
+        std::vector<double> work(4 * kStateCount);
+        double* parent = &work[0];
+        double* child = &work[kStateCount];
+        double* scratch = &work[2 * kStateCount];
+
+#pragma omp for
+        for (int n = 0; n < kActivePatternCount; n++) {
+            const int k = gActivePatterns[n];
+            for (int c = 0; c < kActiveCategoryCount; c++) {
+                const int l = gActiveCategories[c];
+                getPatternPartials(parentBufferIndex, l, k, parent);
+                getPatternPartials(childBufferIndex, l, k, child);
+                for (int i = 0; i < kStateCount; i++)
+                    parent[i] *= freqs[i];
+                projection->setPattern(l, k, parent, child, scratch);
+            }
+        }
+    }
+    recordKernel(BEAGLE_KERNEL_EDGE, startTime, kActivePatternCount);
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::sumProjectedEdge(const EdgeProjection* projection,
+                                                         double edgeLength,
+                                                         double* outSums) {
+    const double startTime = gKernelCounters.start();
+    double* likelihoods = &gEdgeOptimizerSites[0];
+    double* firstDerivatives = &gEdgeOptimizerSites[kPatternCount];
+    double* secondDerivatives = &gEdgeOptimizerSites[2 * kPatternCount];
+    projection->getSiteLikelihoods(edgeLength, likelihoods, firstDerivatives, secondDerivatives);
+
+    for (int n = 0; n < kActivePatternCount; n++) {
+        const int k = gActivePatterns[n];
+        const double siteFirstDerivative = firstDerivatives[k] / likelihoods[k];
+        secondDerivatives[k] = secondDerivatives[k] / likelihoods[k] - siteFirstDerivative * siteFirstDerivative;
+        firstDerivatives[k] = siteFirstDerivative;
+        likelihoods[k] = log(likelihoods[k]);
+    }
+    outSums[0] = sumActivePatterns(likelihoods);
+    outSums[1] = sumActivePatterns(firstDerivatives);
+    outSums[2] = sumActivePatterns(secondDerivatives);
+    recordKernel(BEAGLE_KERNEL_DERIVATIVES, startTime, kActivePatternCount);
+}
+
+/*
+ * Copies the partials of one category and pattern of a buffer in double precision,
+ *  expanding compact tip states and their ambiguity masks.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getPatternPartials(int bufferIndex,
+                                                           int category,
+                                                           int pattern,
+                                                           double* outPartials) {
+    if (gPartials[bufferIndex] != NULL) {
+        const REALTYPE* partials = gPartials[bufferIndex] + category * kPartialsCategoryStride +
+                                   pattern * kPartialsPatternStride;
+        for (int i = 0; i < kStateCount; i++)
+            outPartials[i] = partials[i];
+        return;
+    }
+
+    const int code = getAmbiguousCode(bufferIndex, pattern);
+    if (code >= 0) {
+        const int mask = gAmbiguityMasks[bufferIndex][code];
+        for (int i = 0; i < kStateCount; i++)
+            outPartials[i] = ((mask >> i) & 1 ? 1.0 : 0.0);
+    } else {
+        const int state = gTipStates[bufferIndex][pattern];
+        for (int i = 0; i < kStateCount; i++)
+            outPartials[i] = (state == kStateCount || state == i ? 1.0 : 0.0);
+    }
+}
+
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getAmbiguousCode(int tipIndex,
+                                              int pattern) {
+    if (tipIndex >= kTipCount || gAmbiguousPatterns[tipIndex].empty())
+        return -1;
+    const std::vector<int>& patterns = gAmbiguousPatterns[tipIndex];
+    std::vector<int>::const_iterator it = std::lower_bound(patterns.begin(), patterns.end(), pattern);
+    if (it == patterns.end() || *it != pattern)
+        return -1;
+    return gAmbiguousCodes[tipIndex][it - patterns.begin()];
+}
+
+/*
+ * Recomputes the patterns in [startPattern, endPattern) at which a child tip is
+ *  partially ambiguous. The kernels treated these patterns as missing data.
+ *  scalingFactors, if not NULL, are fixed factors to divide out.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcAmbiguousPatterns(REALTYPE* destPartials,
+                                                    int child1Index,
+                                                    const REALTYPE* matrices1,
+                                                    int child2Index,
+                                                    const REALTYPE* matrices2,
+                                                    const REALTYPE* scalingFactors,
+                                                    int startPattern,
+                                                    int endPattern) {
+    const int childIndices[2] = {child1Index, child2Index};
+    const REALTYPE* matrices[2] = {matrices1, matrices2};
+    const REALTYPE* lookups[2] = {NULL, NULL};
+    int maskCounts[2] = {0, 0};
+
+    REALTYPE* lookupPtr = gAmbiguityLookup;
+    for (int c = 0; c < 2; c++) {
+        if (childIndices[c] < kTipCount && !gAmbiguousPatterns[childIndices[c]].empty()) {
+            maskCounts[c] = gAmbiguityMasks[childIndices[c]].size();
+            lookups[c] = buildAmbiguityLookup(childIndices[c], matrices[c], lookupPtr);
+            lookupPtr += kCategoryCount * maskCounts[c] * kStateCount;
+        }
+    }
+    if (lookups[0] == NULL && lookups[1] == NULL)
+        return;
+
+    for (int c = 0; c < 2; c++) {
+        if (lookups[c] == NULL)
+            continue;
+        const std::vector<int>& patterns = gAmbiguousPatterns[childIndices[c]];
+        const std::vector<int>& codes = gAmbiguousCodes[childIndices[c]];
+        int n = std::lower_bound(patterns.begin(), patterns.end(), startPattern) - patterns.begin();
+        for (; n < (int) patterns.size() && patterns[n] < endPattern; n++) {
+            const int k = patterns[n];
+            int code[2];
+            code[c] = codes[n];
+            code[1 - c] = (lookups[1 - c] != NULL ? getAmbiguousCode(childIndices[1 - c], k) : -1);
+            if (c == 1 && code[0] >= 0) // already recomputed for the first child
+                continue;
+
+            const REALTYPE scale = (scalingFactors != NULL ? REALTYPE(1.0) / scalingFactors[k] : REALTYPE(1.0));
+            for (int a = 0; a < kActiveCategoryCount; a++) {
+                const int l = gActiveCategories[a];
+                REALTYPE* destPtr = destPartials + l * kPartialsCategoryStride + k * kPartialsPatternStride;
+                for (int i = 0; i < kStateCount; i++)
+                    destPtr[i] = scale;
+                for (int d = 0; d < 2; d++) {
+                    const REALTYPE* matrixPtr = matrices[d] + l * kMatrixSize;
+                    if (code[d] >= 0) {
+                        const REALTYPE* columnSums = lookups[d] + (l * maskCounts[d] + code[d]) * kStateCount;
+                        for (int i = 0; i < kStateCount; i++)
+                            destPtr[i] *= columnSums[i];
+                    } else if (gTipStates[childIndices[d]] != NULL) {
+                        const int state = gTipStates[childIndices[d]][k];
+                        for (int i = 0; i < kStateCount; i++)
+                            destPtr[i] *= matrixPtr[i * kTransPaddedStateCount + state];
+                    } else {
+                        const REALTYPE* partialsPtr = gPartials[childIndices[d]] + l * kPartialsCategoryStride +
+                                                      k * kPartialsPatternStride;
+                        for (int i = 0; i < kStateCount; i++) {
+                            REALTYPE sum = 0.0;
+                            for (int j = 0; j < kStateCount; j++)
+                                sum += matrixPtr[i * kTransPaddedStateCount + j] * partialsPtr[j];
+                            destPtr[i] *= sum;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Replaces the rows of integration at which a child tip is partially ambiguous by
+ *  the category-weighted product of the parent partials and the lookup table.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::integrateAmbiguousTip(int childIndex,
+                                                    const REALTYPE* partialsParent,
+                                                    const REALTYPE* lookup,
+                                                    const REALTYPE* wt,
+                                                    REALTYPE* integration) {
+    const std::vector<int>& patterns = gAmbiguousPatterns[childIndex];
+    const std::vector<int>& codes = gAmbiguousCodes[childIndex];
+    const int maskCount = gAmbiguityMasks[childIndex].size();
+    for (int n = 0; n < (int) patterns.size(); n++) {
+        const int k = patterns[n];
+        REALTYPE* integrationPtr = integration + k * kStateCount;
+        for (int i = 0; i < kStateCount; i++)
+            integrationPtr[i] = 0.0;
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            const REALTYPE* columnSums = lookup + (l * maskCount + codes[n]) * kStateCount;
+            const REALTYPE* parentPtr = partialsParent + l * kPartialsCategoryStride + k * kPartialsPatternStride;
+            for (int i = 0; i < kStateCount; i++)
+                integrationPtr[i] += columnSums[i] * parentPtr[i] * wt[l];
+        }
+    }
+}
+
+/*
+ * Recomputes the site log likelihoods (and derivatives) of an edge whose child tip
+ *  is partially ambiguous, then the weighted sums over sites.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcAmbiguousEdgeSites(const int parIndex,
+                                                    const int childIndex,
+                                                    const int probIndex,
+                                                    const int firstDerivativeIndex,
+                                                    const int secondDerivativeIndex,
+                                                    const int categoryWeightsIndex,
+                                                    const int stateFrequenciesIndex,
+                                                    const int scalingFactorsIndex,
+                                                    double* outSumLogLikelihood,
+                                                    double* outSumFirstDerivative,
+                                                    double* outSumSecondDerivative) {
+    const REALTYPE* partialsParent = gPartials[parIndex];
+    const REALTYPE* wt = gCategoryWeights[categoryWeightsIndex];
+    const REALTYPE* freqs = gStateFrequencies[stateFrequenciesIndex];
+    const int lookupSize = kCategoryCount * gAmbiguityMasks[childIndex].size() * kStateCount;
+
+    integrateAmbiguousTip(childIndex, partialsParent,
+                          buildAmbiguityLookup(childIndex, gTransitionMatrices[probIndex], gAmbiguityLookup),
+                          wt, integrationTmp);
+    if (firstDerivativeIndex != BEAGLE_OP_NONE)
+        integrateAmbiguousTip(childIndex, partialsParent,
+                              buildAmbiguityLookup(childIndex, gTransitionMatrices[firstDerivativeIndex],
+                                                   gAmbiguityLookup + lookupSize),
+                              wt, firstDerivTmp);
+    if (secondDerivativeIndex != BEAGLE_OP_NONE)
+        integrateAmbiguousTip(childIndex, partialsParent,
+                              buildAmbiguityLookup(childIndex, gTransitionMatrices[secondDerivativeIndex],
+                                                   gAmbiguityLookup + 2 * lookupSize),
+                              wt, secondDerivTmp);
+
+    const std::vector<int>& patterns = gAmbiguousPatterns[childIndex];
+    for (int n = 0; n < (int) patterns.size(); n++) {
+        const int k = patterns[n];
+        const int u = k * kStateCount;
+        REALTYPE sumOverI = 0.0;
+        REALTYPE sumOverID1 = 0.0;
+        REALTYPE sumOverID2 = 0.0;
+        for (int i = 0; i < kStateCount; i++) {
+            sumOverI += freqs[i] * integrationTmp[u + i];
+            if (firstDerivativeIndex != BEAGLE_OP_NONE)
+                sumOverID1 += freqs[i] * firstDerivTmp[u + i];
+            if (secondDerivativeIndex != BEAGLE_OP_NONE)
+                sumOverID2 += freqs[i] * secondDerivTmp[u + i];
+        }
+
+        outLogLikelihoodsTmp[k] = log(sumOverI);
+        if (scalingFactorsIndex != BEAGLE_OP_NONE)
+            outLogLikelihoodsTmp[k] += getLogScaleFactor(scalingFactorsIndex, k);
+        if (firstDerivativeIndex != BEAGLE_OP_NONE)
+            outFirstDerivativesTmp[k] = sumOverID1 / sumOverI;
+        if (secondDerivativeIndex != BEAGLE_OP_NONE)
+            outSecondDerivativesTmp[k] = sumOverID2 / sumOverI - outFirstDerivativesTmp[k] * outFirstDerivativesTmp[k];
+    }
+
+    *outSumLogLikelihood = sumActivePatterns(outLogLikelihoodsTmp);
+    if (firstDerivativeIndex != BEAGLE_OP_NONE)
+        *outSumFirstDerivative = sumActivePatterns(outFirstDerivativesTmp);
+    if (secondDerivativeIndex != BEAGLE_OP_NONE)
+        *outSumSecondDerivative = sumActivePatterns(outSecondDerivativesTmp);
+
+    if (*outSumLogLikelihood != *outSumLogLikelihood)
+        return BEAGLE_ERROR_FLOATING_POINT;
+
+    return BEAGLE_SUCCESS;
+}
+
 /*
  * Re-scales the partial likelihoods such that the largest is one.
  */
@@ -1837,7 +4389,9 @@ BEAGLE_CPU_TEMPLATE
 void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartials(REALTYPE* destP,
 		REALTYPE* scaleFactors,
 		REALTYPE* cumulativeScaleFactors,
-        const int  fillWithOnes) {
+        const int  fillWithOnes,
+        int startPattern,
+        int endPattern) {
     if (DEBUGGING_OUTPUT) {
         std::cerr << "destP (before rescale): \n";// << destP << "\n";
         for(int i=0; i<kPartialsSize; i++)
@@ -1845,11 +4399,12 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartials(REALTYPE* destP,
     }
 
     // TODO None of the code below has been optimized.
-    for (int k = 0; k < kPatternCount; k++) {
+    for (int k = startPattern; k < endPattern; k++) {
     	REALTYPE max = 0;
-        const int patternOffset = k * kPartialsPaddedStateCount;
-        for (int l = 0; l < kCategoryCount; l++) {
-            int offset = l * kPaddedPatternCount * kPartialsPaddedStateCount + patternOffset;
+        const int patternOffset = k * kPartialsPatternStride;
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            int offset = l * kPartialsCategoryStride + patternOffset;
             for (int i = 0; i < kStateCount; i++) {
                 if(destP[offset] > max)
                     max = destP[offset];
@@ -1861,8 +4416,9 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartials(REALTYPE* destP,
             max = 1.0;
 			
         REALTYPE oneOverMax = REALTYPE(1.0) / max;
-        for (int l = 0; l < kCategoryCount; l++) {
-            int offset = l * kPaddedPatternCount * kPartialsPaddedStateCount + patternOffset;
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            int offset = l * kPartialsCategoryStride + patternOffset;
             for (int i = 0; i < kStateCount; i++)
                 destP[offset++] *= oneOverMax;
         }
@@ -1879,11 +4435,202 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartials(REALTYPE* destP,
         }
     }
     if (DEBUGGING_OUTPUT) {
-        for(int i=0; i<kPatternCount; i++)
+        for(int i=startPattern; i<endPattern; i++)
             fprintf(stderr,"new scaleFactor[%d] = %.5f\n",i,scaleFactors[i]);
     }
 }
     
+/*
+ * Dynamic scaling keeps, per node, the factors its partials were last scaled by in the
+ *  buffer of the operation, with their logs summed into the cumulative buffer. The
+ *  partials are computed unscaled and only patterns whose maximum has fallen below
+ *  kDynamicScalingThreshold are rescaled, so that on most nodes and patterns the factors
+ *  stay one and the cumulative buffer is left alone.
+ */
+BEAGLE_CPU_TEMPLATE
+int BeagleCPUImpl<BEAGLE_CPU_GENERIC>::prepareDynamicScaling(int writeScalingIndex,
+                                                             int readScalingIndex,
+                                                             REALTYPE** scalingFactors,
+                                                             int startPattern,
+                                                             int endPattern) {
+    if (writeScalingIndex < 0) {
+        if (readScalingIndex < 0)
+            return BEAGLE_OP_NONE;
+        *scalingFactors = gScaleBuffers[readScalingIndex];
+        return 0;
+    }
+
+    REALTYPE* writeFactors = gScaleBuffers[writeScalingIndex];
+    if (readScalingIndex != writeScalingIndex) {
+        // factors not read from a buffer are not in the cumulative buffer either
+        if (readScalingIndex >= 0) {
+            memcpy(writeFactors + startPattern, gScaleBuffers[readScalingIndex] + startPattern,
+                   sizeof(REALTYPE) * (endPattern - startPattern));
+        } else {
+            const REALTYPE unit = (kFlags & BEAGLE_FLAG_SCALERS_LOG ? 0.0 : 1.0);
+            for (int k = startPattern; k < endPattern; k++)
+                writeFactors[k] = unit;
+        }
+    }
+    *scalingFactors = writeFactors;
+    return 3;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartialsDynamic(REALTYPE* destP,
+                                                              REALTYPE* scaleFactors,
+                                                              REALTYPE* cumulativeScaleFactors,
+                                                              int startPattern,
+                                                              int endPattern) {
+    const bool useLogScalers = kFlags & BEAGLE_FLAG_SCALERS_LOG;
+    const REALTYPE unit = (useLogScalers ? 0.0 : 1.0);
+
+    for (int k = startPattern; k < endPattern; k++) {
+        REALTYPE max = 0;
+        const int patternOffset = k * kPartialsPatternStride;
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            int offset = l * kPartialsCategoryStride + patternOffset;
+            for (int i = 0; i < kStateCount; i++) {
+                if (destP[offset] > max)
+                    max = destP[offset];
+                offset++;
+            }
+        }
+
+        REALTYPE factor = unit;
+        if (max < kDynamicScalingThreshold && max > 0) {
+            const REALTYPE oneOverMax = REALTYPE(1.0) / max;
+            for (int a = 0; a < kActiveCategoryCount; a++) {
+                const int l = gActiveCategories[a];
+                int offset = l * kPartialsCategoryStride + patternOffset;
+                for (int i = 0; i < kStateCount; i++)
+                    destP[offset++] *= oneOverMax;
+            }
+            factor = (useLogScalers ? log(max) : max);
+        }
+
+        if (factor != scaleFactors[k]) {
+            if (cumulativeScaleFactors != NULL) {
+                if (useLogScalers)
+                    cumulativeScaleFactors[k] += factor - scaleFactors[k];
+                else
+                    cumulativeScaleFactors[k] += log(factor) - log(scaleFactors[k]);
+            }
+            scaleFactors[k] = factor;
+        }
+    }
+}
+
+/*
+ * Re-scales the partial likelihoods by a power of two such that the largest lies in
+ *  [0.5, 1). Scaling by powers of two is exact and the exponents sum as integers.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::rescalePartialsExponent(REALTYPE* destP,
+                                                               signed short* scaleExponents,
+                                                               signed short* cumulativeScaleExponents,
+                                                               int startPattern,
+                                                               int endPattern) {
+    for (int k = startPattern; k < endPattern; k++) {
+        REALTYPE max = 0;
+        const int patternOffset = k * kPartialsPatternStride;
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            int offset = l * kPartialsCategoryStride + patternOffset;
+            for (int i = 0; i < kStateCount; i++) {
+                if (destP[offset] > max)
+                    max = destP[offset];
+                offset++;
+            }
+        }
+
+        int expMax = 0;
+        if (max > 0)
+            frexp(max, &expMax);
+        if (expMax != 0) {
+            const REALTYPE scale = ldexp(REALTYPE(1.0), -expMax);
+            for (int a = 0; a < kActiveCategoryCount; a++) {
+                const int l = gActiveCategories[a];
+                int offset = l * kPartialsCategoryStride + patternOffset;
+                for (int i = 0; i < kStateCount; i++)
+                    destP[offset++] *= scale;
+            }
+        }
+
+        scaleExponents[k] = (signed short) expMax;
+        if (cumulativeScaleExponents != NULL)
+            addScaleExponent(&cumulativeScaleExponents[k], expMax);
+    }
+}
+
+/*
+ * Cumulative exponents are kept in 16 bits; a sum outside that range cannot be stored, so
+ *  the pattern is marked and integrates to NaN instead of wrapping to a wrong likelihood.
+ */
+BEAGLE_CPU_TEMPLATE
+inline bool BeagleCPUImpl<BEAGLE_CPU_GENERIC>::addScaleExponent(signed short* cumulativeExponent,
+                                                               int exponent) {
+    if (*cumulativeExponent == kExponentOverflow)
+        return false;
+    const int sum = *cumulativeExponent + exponent;
+    if (sum <= kExponentOverflow || sum > 32767) {
+        *cumulativeExponent = kExponentOverflow;
+        return false;
+    }
+    *cumulativeExponent = (signed short) sum;
+    return true;
+}
+
+BEAGLE_CPU_TEMPLATE
+REALTYPE* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::expandScaleExponents(const signed short* scaleExponents,
+                                                                 int startPattern,
+                                                                 int endPattern) {
+    for (int k = startPattern; k < endPattern; k++)
+        gExponentScaleFactors[k] = ldexp(REALTYPE(1.0), scaleExponents[k]);
+    return gExponentScaleFactors;
+}
+
+BEAGLE_CPU_TEMPLATE
+const REALTYPE* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getLogScaleFactors(int scaleIndex) {
+    if (!kExponentScalers)
+        return gScaleBuffers[scaleIndex];
+
+    const signed short* scaleExponents = (const signed short*) gScaleBuffers[scaleIndex];
+    for (int k = 0; k < kPatternCount; k++) {
+        if (scaleExponents[k] == kExponentOverflow)
+            gExponentScaleFactors[k] = std::numeric_limits<REALTYPE>::quiet_NaN();
+        else
+            gExponentScaleFactors[k] = M_LN2 * scaleExponents[k];
+    }
+    return gExponentScaleFactors;
+}
+
+BEAGLE_CPU_TEMPLATE
+REALTYPE BeagleCPUImpl<BEAGLE_CPU_GENERIC>::getLogScaleFactor(int scaleIndex,
+                                                             int pattern) {
+    if (!kExponentScalers)
+        return gScaleBuffers[scaleIndex][pattern];
+    const signed short exponent = ((const signed short*) gScaleBuffers[scaleIndex])[pattern];
+    if (exponent == kExponentOverflow)
+        return std::numeric_limits<REALTYPE>::quiet_NaN();
+    return M_LN2 * exponent;
+}
+
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::allocateScaleBuffer(int scaleIndex) {
+    const size_t size = (kExponentScalers ? sizeof(signed short) : sizeof(REALTYPE)) * kPaddedPatternCount;
+    // Buffers in the scratch mapping keep their REALTYPE-sized slot
+    if (gMappedBuffer == NULL) {
+        if (gScaleBuffers[scaleIndex] != NULL)
+            free(gScaleBuffers[scaleIndex]);
+        gScaleBuffers[scaleIndex] = (REALTYPE*) malloc(size);
+        if (gScaleBuffers[scaleIndex] == NULL)
+            throw std::bad_alloc();
+    }
+    memset(gScaleBuffers[scaleIndex], 0, size);
+}
+
 BEAGLE_CPU_TEMPLATE
 void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::autoRescalePartials(REALTYPE* destP,
                                               signed short* scaleFactors) {
@@ -1891,9 +4638,10 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::autoRescalePartials(REALTYPE* destP,
     
     for (int k = 0; k < kPatternCount; k++) {
         REALTYPE max = 0;
-        const int patternOffset = k * kPartialsPaddedStateCount;
-        for (int l = 0; l < kCategoryCount; l++) {
-            int offset = l * kPaddedPatternCount * kPartialsPaddedStateCount + patternOffset;
+        const int patternOffset = k * kPartialsPatternStride;
+        for (int a = 0; a < kActiveCategoryCount; a++) {
+            const int l = gActiveCategories[a];
+            int offset = l * kPartialsCategoryStride + patternOffset;
             for (int i = 0; i < kStateCount; i++) {
                 if(destP[offset] > max)
                     max = destP[offset];
@@ -1906,8 +4654,9 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::autoRescalePartials(REALTYPE* destP,
         scaleFactors[k] = expMax;
         
         if (expMax != 0) {
-            for (int l = 0; l < kCategoryCount; l++) {
-                int offset = l * kPaddedPatternCount * kPartialsPaddedStateCount + patternOffset;
+            for (int a = 0; a < kActiveCategoryCount; a++) {
+                const int l = gActiveCategories[a];
+                int offset = l * kPartialsCategoryStride + patternOffset;
                 for (int i = 0; i < kStateCount; i++)
                     destP[offset++] *= pow(2.0, -expMax);
             }
@@ -1923,12 +4672,15 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesStates(REALTYPE* destP,
                                      const int* states1,
                                      const REALTYPE* matrices1,
                                      const int* states2,
-                                     const REALTYPE* matrices2) {
-
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*kPartialsPaddedStateCount*kPatternCount;
-        for (int k = 0; k < kPatternCount; k++) {
+                                     const REALTYPE* matrices2,
+                                     int startPattern,
+                                     int endPattern) {
+
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int v = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
+        for (int k = startPattern; k < endPattern; k++) {
             const int state1 = states1[k];
             const int state2 = states2[k];
             if (DEBUGGING_OUTPUT) {
@@ -1942,7 +4694,7 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesStates(REALTYPE* destP,
 
                 w += kTransPaddedStateCount;
             }
-            v += P_PAD;
+            v += kPartialsPatternStride - kStateCount;
         }
     }
 }
@@ -1953,11 +4705,14 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesStatesFixedScaling(REALTYPE* d
                                            const REALTYPE* child1TransMat,
                                               const int* child2States,
                                            const REALTYPE* child2TransMat,
-                                           const REALTYPE* scaleFactors) {
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-	int v = l*kPartialsPaddedStateCount*kPatternCount;
-        for (int k = 0; k < kPatternCount; k++) {
+                                           const REALTYPE* scaleFactors,
+                                           int startPattern,
+                                           int endPattern) {
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+	int v = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
+        for (int k = startPattern; k < endPattern; k++) {
             const int state1 = child1States[k];
             const int state2 = child2States[k];
             int w = l * kMatrixSize;
@@ -1969,7 +4724,7 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesStatesFixedScaling(REALTYPE* d
 
                 w += kTransPaddedStateCount;
             }
-            v += P_PAD;
+            v += kPartialsPatternStride - kStateCount;
         }
     }
 }
@@ -1982,7 +4737,9 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesPartials(REALTYPE* destP,
                                        const int* states1,
                                        const REALTYPE* matrices1,
                                        const REALTYPE* partials2,
-                                       const REALTYPE* matrices2) {
+                                       const REALTYPE* matrices2,
+                                       int startPattern,
+                                       int endPattern) {
     int matrixIncr = kStateCount;
 
     // increment for the extra column at the end
@@ -1991,13 +4748,14 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesPartials(REALTYPE* destP,
 
 	int stateCountModFour = (kStateCount / 4) * 4;
 
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*kPartialsPaddedStateCount*kPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int v = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
         int matrixOffset = l*kMatrixSize;
         const REALTYPE* partials2Ptr = &partials2[v];
         REALTYPE* destPtr = &destP[v];
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
             int w = l * kMatrixSize;
             int state1 = states1[k];
             for (int i = 0; i < kStateCount; i++) {
@@ -2020,8 +4778,8 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesPartials(REALTYPE* destP,
                 
                 *(destPtr++) = tmp * (sumA + sumB);
             }
-            destPtr += P_PAD;
-            partials2Ptr += kPartialsPaddedStateCount;
+            destPtr += kPartialsPatternStride - kStateCount;
+            partials2Ptr += kPartialsPatternStride;
         }
     }
 }
@@ -2032,7 +4790,9 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesPartialsFixedScaling(REALTYPE*
                                              const REALTYPE* matrices1,
                                              const REALTYPE* partials2,
                                              const REALTYPE* matrices2,
-                                             const REALTYPE* scaleFactors) {
+                                             const REALTYPE* scaleFactors,
+                                             int startPattern,
+                                             int endPattern) {
     int matrixIncr = kStateCount;
 
     // increment for the extra column at the end
@@ -2040,13 +4800,14 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesPartialsFixedScaling(REALTYPE*
 
 	int stateCountModFour = (kStateCount / 4) * 4;
 
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*kPartialsPaddedStateCount*kPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int v = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
         int matrixOffset = l*kMatrixSize;
         const REALTYPE* partials2Ptr = &partials2[v];
         REALTYPE* destPtr = &destP[v];
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
             int w = l * kMatrixSize;
             int state1 = states1[k];
 			REALTYPE oneOverScaleFactor = REALTYPE(1.0) / scaleFactors[k];
@@ -2070,8 +4831,8 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcStatesPartialsFixedScaling(REALTYPE*
                 
                 *(destPtr++) = tmp * (sumA + sumB) * oneOverScaleFactor;
             }
-			destPtr += P_PAD;
-            partials2Ptr += kPartialsPaddedStateCount;
+			destPtr += kPartialsPatternStride - kStateCount;
+            partials2Ptr += kPartialsPatternStride;
         }
     }											 
 }
@@ -2084,7 +4845,9 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartials(REALTYPE* destP,
                                          const REALTYPE* partials1,
                                          const REALTYPE* matrices1,
                                          const REALTYPE* partials2,
-                                         const REALTYPE* matrices2) {
+                                         const REALTYPE* matrices2,
+                                         int startPattern,
+                                         int endPattern) {
     int matrixIncr = kStateCount;
 
     // increment for the extra column at the end
@@ -2092,14 +4855,15 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartials(REALTYPE* destP,
 
 	int stateCountModFour = (kStateCount / 4) * 4;
 
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*kPartialsPaddedStateCount*kPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int v = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
         int matrixOffset = l*kMatrixSize;
         const REALTYPE* partials1Ptr = &partials1[v];
         const REALTYPE* partials2Ptr = &partials2[v];
         REALTYPE* destPtr = &destP[v];
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
 
             for (int i = 0; i < kStateCount; i++) {
                 const REALTYPE* matrices1Ptr = matrices1 + matrixOffset + i * matrixIncr;
@@ -2128,9 +4892,9 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartials(REALTYPE* destP,
 
                 *(destPtr++) = (sum1A + sum1B) * (sum2A + sum2B);
             }
-            destPtr += P_PAD;
-            partials1Ptr += kPartialsPaddedStateCount;
-            partials2Ptr += kPartialsPaddedStateCount;
+            destPtr += kPartialsPatternStride - kStateCount;
+            partials1Ptr += kPartialsPatternStride;
+            partials2Ptr += kPartialsPatternStride;
         }
     }
 }
@@ -2141,7 +4905,9 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsFixedScaling(REALTYP
                                                const REALTYPE* matrices1,
                                                const REALTYPE* partials2,
                                                const REALTYPE* matrices2,
-                                               const REALTYPE* scaleFactors) {
+                                               const REALTYPE* scaleFactors,
+                                               int startPattern,
+                                               int endPattern) {
     int matrixIncr = kStateCount;
 
     // increment for the extra column at the end
@@ -2149,14 +4915,15 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsFixedScaling(REALTYP
 
 	int stateCountModFour = (kStateCount / 4) * 4;
     
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int v = l*kPartialsPaddedStateCount*kPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int v = l*kPartialsCategoryStride + startPattern*kPartialsPatternStride;
         int matrixOffset = l*kMatrixSize;
         const REALTYPE* partials1Ptr = &partials1[v];
         const REALTYPE* partials2Ptr = &partials2[v];
         REALTYPE* destPtr = &destP[v];
-        for (int k = 0; k < kPatternCount; k++) {
+        for (int k = startPattern; k < endPattern; k++) {
             REALTYPE oneOverScaleFactor = REALTYPE(1.0) / scaleFactors[k];
             for (int i = 0; i < kStateCount; i++) {
                 const REALTYPE* matrices1Ptr = matrices1 + matrixOffset + i * matrixIncr;
@@ -2185,9 +4952,9 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsFixedScaling(REALTYP
 
                 *(destPtr++) = (sum1A + sum1B) * (sum2A + sum2B) * oneOverScaleFactor;
             }
-			destPtr += P_PAD;
-			partials1Ptr += kPartialsPaddedStateCount;
-            partials2Ptr += kPartialsPaddedStateCount;
+			destPtr += kPartialsPatternStride - kStateCount;
+			partials1Ptr += kPartialsPatternStride;
+            partials2Ptr += kPartialsPatternStride;
         }
     }
 }
@@ -2200,10 +4967,11 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsAutoScaling(REALTYPE
                                                                const REALTYPE* matrices2,
                                                                int* activateScaling) {
     
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-        int u = l*kPartialsPaddedStateCount*kPatternCount;
-        int v = l*kPartialsPaddedStateCount*kPatternCount;
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+        int u = l*kPartialsCategoryStride;
+        int v = l*kPartialsCategoryStride;
         for (int k = 0; k < kPatternCount; k++) {
             int w = l * kMatrixSize;
             for (int i = 0; i < kStateCount; i++) {
@@ -2228,8 +4996,8 @@ void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::calcPartialsPartialsAutoScaling(REALTYPE
                 
                 u++;
             }
-            u += P_PAD;
-            v += kPartialsPaddedStateCount;
+            u += kPartialsPatternStride - kStateCount;
+            v += kPartialsPatternStride;
         }
     }
 }
@@ -2271,6 +5039,78 @@ void* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::mallocAligned(size_t size) {
 	return ptr;
 }
 
+BEAGLE_CPU_TEMPLATE
+void* BeagleCPUImpl<BEAGLE_CPU_GENERIC>::mapScratchFile(size_t size) {
+#ifdef WIN32
+    return NULL;
+#else
+    // Scratch files go to BEAGLE_SCRATCH_DIR, falling back to TMPDIR and then /tmp
+    const char* dir = getenv("BEAGLE_SCRATCH_DIR");
+    if (dir == NULL)
+        dir = getenv("TMPDIR");
+    if (dir == NULL)
+        dir = "/tmp";
+
+    std::string path(dir);
+    path.append("/beagle-XXXXXX");
+    std::vector<char> fileName(path.begin(), path.end());
+    fileName.push_back('\0');
+
+    int fd = mkstemp(&fileName[0]);
+    if (fd < 0)
+        return NULL;
+    // The file disappears with its last reference, which the mapping holds
+    unlink(&fileName[0]);
+
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return NULL;
+    }
+#ifdef __linux__
+    // Reserve the disk blocks now so that a full disk fails here rather than with a SIGBUS later
+    int err = posix_fallocate(fd, 0, size);
+    if (err != 0 && err != EINVAL && err != EOPNOTSUPP) {
+        close(fd);
+        return NULL;
+    }
+#endif
+
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return NULL;
+
+    madvise(ptr, size, MADV_SEQUENTIAL);
+
+    return ptr;
+#endif
+}
+
+/*
+ * Hints the kernel to page in patterns [startPattern, endPattern) of each category of
+ *  a partials buffer. Buffers outside the scratch mapping are left alone.
+ */
+BEAGLE_CPU_TEMPLATE
+void BeagleCPUImpl<BEAGLE_CPU_GENERIC>::prefetchPatternBlock(const REALTYPE* partials,
+                                                   int startPattern,
+                                                   int endPattern) {
+#ifndef WIN32
+    const size_t mappedBegin = (size_t) gMappedBuffer;
+    if ((size_t) partials < mappedBegin || (size_t) partials >= mappedBegin + kMappedSize)
+        return;
+
+    // Pattern-major blocks are a single run across all categories
+    const int regionCount = (kFlags & BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR) ? 1 : kCategoryCount;
+    const size_t pageMask = ~((size_t) sysconf(_SC_PAGESIZE) - 1);
+    for (int l = 0; l < regionCount; l++) {
+        size_t blockBegin = (size_t) (partials + l*kPartialsCategoryStride + startPattern*kPartialsPatternStride);
+        size_t blockEnd = (size_t) (partials + l*kPartialsCategoryStride + endPattern*kPartialsPatternStride);
+        blockBegin &= pageMask;
+        madvise((void*) blockBegin, blockEnd - blockBegin, MADV_WILLNEED);
+    }
+#endif
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // BeagleCPUImplFactory public methods
 BEAGLE_CPU_FACTORY_TEMPLATE
@@ -2332,6 +5172,9 @@ const long BeagleCPUImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getFlags() {
                  BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
                  BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
                  BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+                 BEAGLE_FLAG_MEMORY_MAPPED |
+                 BEAGLE_FLAG_TRAVERSAL_BLOCKED |
+                 BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR |
                  BEAGLE_FLAG_FRAMEWORK_CPU;
 	if (DOUBLE_PRECISION)
 		flags |= BEAGLE_FLAG_PRECISION_DOUBLE;
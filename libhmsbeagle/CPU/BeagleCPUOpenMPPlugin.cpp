@@ -23,7 +23,7 @@ Plugin("CPU-SSE-OpenMP", "CPU-SSE-OpenMP")
         resource.name = (char*) "CPU";
         resource.description = (char*) "";
         resource.supportFlags = BEAGLE_FLAG_COMPUTATION_SYNCH |
-                                         BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+                                         BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
                                          BEAGLE_FLAG_THREADING_NONE |
                                          BEAGLE_FLAG_PROCESSOR_CPU |
                                          BEAGLE_FLAG_PRECISION_SINGLE | BEAGLE_FLAG_PRECISION_DOUBLE |
@@ -31,6 +31,9 @@ Plugin("CPU-SSE-OpenMP", "CPU-SSE-OpenMP")
                                          BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
                                          BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
                                          BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+                                         BEAGLE_FLAG_MEMORY_MAPPED |
+                                         BEAGLE_FLAG_TRAVERSAL_BLOCKED |
+                                         BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR |
                                          BEAGLE_FLAG_FRAMEWORK_CPU;
         resource.supportFlags |= BEAGLE_FLAG_VECTOR_SSE;
         resource.supportFlags |= BEAGLE_FLAG_THREADING_OPENMP;
@@ -28,6 +28,9 @@ Plugin("CPU", "CPU")
                                          BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
                                          BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
                                          BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+                                         BEAGLE_FLAG_MEMORY_MAPPED |
+                                         BEAGLE_FLAG_TRAVERSAL_BLOCKED |
+                                         BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR |
                                          BEAGLE_FLAG_FRAMEWORK_CPU;
         resource.requiredFlags = BEAGLE_FLAG_FRAMEWORK_CPU;
 	beagleResources.push_back(resource);
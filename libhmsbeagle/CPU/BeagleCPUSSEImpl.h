@@ -82,6 +82,8 @@ protected:
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_FLOAT>::kStateCount;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_FLOAT>::gTipStates;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_FLOAT>::kCategoryCount;
+	using BeagleCPUImpl<BEAGLE_CPU_SSE_FLOAT>::kActiveCategoryCount;
+	using BeagleCPUImpl<BEAGLE_CPU_SSE_FLOAT>::gActiveCategories;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_FLOAT>::gScaleBuffers;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_FLOAT>::gCategoryWeights;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_FLOAT>::gStateFrequencies;
@@ -102,26 +104,34 @@ private:
                                      const int* states1,
                                      const float* matrices1,
                                      const int* states2,
-                                     const float* matrices2);
+                                     const float* matrices2,
+                                     int startPattern,
+                                     int endPattern);
 
     virtual void calcStatesPartials(float* destP,
                                     const int* states1,
                                     const float* matrices1,
                                     const float* partials2,
-                                    const float* matrices2);
+                                    const float* matrices2,
+                                    int startPattern,
+                                    int endPattern);
 
     virtual void calcPartialsPartials(float* __restrict destP,
                                       const float* __restrict partials1,
                                       const float* __restrict matrices1,
                                       const float* __restrict partials2,
-                                      const float* __restrict matrices2);
+                                      const float* __restrict matrices2,
+                                      int startPattern,
+                                      int endPattern);
     
     virtual void calcPartialsPartialsFixedScaling(float* __restrict destP,
                                       const float* __restrict partials1,
                                       const float* __restrict matrices1,
                                       const float* __restrict partials2,
                                       const float* __restrict matrices2,
-                                      const float* __restrict scaleFactors);
+                                      const float* __restrict scaleFactors,
+                                      int startPattern,
+                                      int endPattern);
 
     virtual void calcPartialsPartialsAutoScaling(float* __restrict destP,
                                                  const float* __restrict partials1,
@@ -156,6 +166,8 @@ protected:
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::kStateCount;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::gTipStates;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::kCategoryCount;
+	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::kActiveCategoryCount;
+	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::gActiveCategories;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::gScaleBuffers;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::gCategoryWeights;
 	using BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::gStateFrequencies;
@@ -176,26 +188,34 @@ private:
                                      const int* states1,
                                      const double* matrices1,
                                      const int* states2,
-                                     const double* matrices2);
+                                     const double* matrices2,
+                                     int startPattern,
+                                     int endPattern);
 
     virtual void calcStatesPartials(double* destP,
                                     const int* states1,
                                     const double* matrices1,
                                     const double* partials2,
-                                    const double* matrices2);
+                                    const double* matrices2,
+                                    int startPattern,
+                                    int endPattern);
 
     virtual void calcPartialsPartials(double* __restrict destP,
                                       const double* __restrict partials1,
                                       const double* __restrict matrices1,
                                       const double* __restrict partials2,
-                                      const double* __restrict matrices2);
+                                      const double* __restrict matrices2,
+                                      int startPattern,
+                                      int endPattern);
     
     virtual void calcPartialsPartialsFixedScaling(double* __restrict destP,
                                       const double* __restrict partials1,
                                       const double* __restrict matrices1,
                                       const double* __restrict partials2,
                                       const double* __restrict matrices2,
-                                      const double* __restrict scaleFactors);
+                                      const double* __restrict scaleFactors,
+                                      int startPattern,
+                                      int endPattern);
 
     virtual void calcPartialsPartialsAutoScaling(double* __restrict destP,
                                                  const double* __restrict partials1,
@@ -65,13 +65,17 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcStatesStates(double* destP,
                                      const int* states_q,
                                      const double* matrices_q,
                                      const int* states_r,
-                                     const double* matrices_r) {
+                                     const double* matrices_r,
+                                     int startPattern,
+                                     int endPattern) {
 
 	BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::calcStatesStates(destP,
                                      states_q,
                                      matrices_q,
                                      states_r,
-                                     matrices_r);
+                                     matrices_r,
+                                     startPattern,
+                                     endPattern);
 }
 
 
@@ -116,13 +120,17 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcStatesPartials(double* destP,
                                        const int* states_q,
                                        const double* matrices_q,
                                        const double* partials_r,
-                                       const double* matrices_r) {
+                                       const double* matrices_r,
+                                       int startPattern,
+                                       int endPattern) {
 	BeagleCPUImpl<BEAGLE_CPU_SSE_DOUBLE>::calcStatesPartials(
 									   destP,
 									   states_q,
 									   matrices_q,
 									   partials_r,
-									   matrices_r);
+									   matrices_r,
+									   startPattern,
+									   endPattern);
 }
 
 //
@@ -211,13 +219,16 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcPartialsPartials(double* __res
                                               const double* __restrict partials1,
                                               const double* __restrict matrices1,
                                               const double* __restrict partials2,
-                                              const double* __restrict matrices2) {
+                                              const double* __restrict matrices2,
+                                              int startPattern,
+                                              int endPattern) {
     int stateCountMinusOne = kPartialsPaddedStateCount - 1;
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-    	double* destPu = destP + l*kPartialsPaddedStateCount*kPatternCount;
-    	int v = l*kPartialsPaddedStateCount*kPatternCount;
-        for (int k = 0; k < kPatternCount; k++) {
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+    	double* destPu = destP + (l*kPaddedPatternCount + startPattern)*kPartialsPaddedStateCount;
+    	int v = (l*kPaddedPatternCount + startPattern)*kPartialsPaddedStateCount;
+        for (int k = startPattern; k < endPattern; k++) {
             int w = l * kMatrixSize;
             for (int i = 0; i < kStateCount;
 #ifdef DOUBLE_UNROLL
@@ -294,13 +305,16 @@ void BeagleCPUSSEImpl<BEAGLE_CPU_SSE_DOUBLE>::calcPartialsPartialsFixedScaling(
                                               const double* __restrict matrices1,
                                               const double* __restrict partials2,
                                               const double* __restrict matrices2,
-                                              const double* __restrict scaleFactors) {
+                                              const double* __restrict scaleFactors,
+                                              int startPattern,
+                                              int endPattern) {
     int stateCountMinusOne = kPartialsPaddedStateCount - 1;
-#pragma omp parallel for num_threads(kCategoryCount)
-    for (int l = 0; l < kCategoryCount; l++) {
-    	double* destPu = destP + l*kPartialsPaddedStateCount*kPatternCount;
-    	int v = l*kPartialsPaddedStateCount*kPatternCount;
-        for (int k = 0; k < kPatternCount; k++) {
+#pragma omp parallel for num_threads(kActiveCategoryCount)
+    for (int a = 0; a < kActiveCategoryCount; a++) {
+        const int l = gActiveCategories[a];
+    	double* destPu = destP + (l*kPaddedPatternCount + startPattern)*kPartialsPaddedStateCount;
+    	int v = (l*kPaddedPatternCount + startPattern)*kPartialsPaddedStateCount;
+        for (int k = startPattern; k < endPattern; k++) {
             int w = l * kMatrixSize;
             const V_Real scalar = VEC_SPLAT(scaleFactors[k]);
             for (int i = 0; i < kStateCount; i++) {
@@ -568,6 +582,11 @@ BeagleImpl* BeagleCPUSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::createImpl(int
                                              long requirementFlags,
                                              int* errorCode) {
 
+    // Vectorized and 4-state kernels only index category-major partials
+    if (requirementFlags & BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR)
+        return NULL;
+    preferenceFlags &= ~BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR;
+
     if (!CPUSupportsSSE())
         return NULL;
     
@@ -626,7 +645,7 @@ const char* BeagleCPUSSEImplFactory<BEAGLE_CPU_FACTORY_GENERIC>::getName() {
 template <>
 const long BeagleCPUSSEImplFactory<double>::getFlags() {
     return BEAGLE_FLAG_COMPUTATION_SYNCH |
-           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
            BEAGLE_FLAG_THREADING_NONE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_SSE |
@@ -634,13 +653,15 @@ const long BeagleCPUSSEImplFactory<double>::getFlags() {
            BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
            BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
            BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_MEMORY_MAPPED |
+           BEAGLE_FLAG_TRAVERSAL_BLOCKED |
            BEAGLE_FLAG_FRAMEWORK_CPU;
 }
 
 template <>
 const long BeagleCPUSSEImplFactory<float>::getFlags() {
     return BEAGLE_FLAG_COMPUTATION_SYNCH |
-           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO |
+           BEAGLE_FLAG_SCALING_MANUAL | BEAGLE_FLAG_SCALING_ALWAYS | BEAGLE_FLAG_SCALING_AUTO | BEAGLE_FLAG_SCALING_DYNAMIC |
            BEAGLE_FLAG_THREADING_NONE |
            BEAGLE_FLAG_PROCESSOR_CPU |
            BEAGLE_FLAG_VECTOR_SSE |
@@ -648,6 +669,8 @@ const long BeagleCPUSSEImplFactory<float>::getFlags() {
            BEAGLE_FLAG_SCALERS_LOG | BEAGLE_FLAG_SCALERS_RAW |
            BEAGLE_FLAG_EIGEN_COMPLEX | BEAGLE_FLAG_EIGEN_REAL |
            BEAGLE_FLAG_INVEVEC_STANDARD | BEAGLE_FLAG_INVEVEC_TRANSPOSED |
+           BEAGLE_FLAG_MEMORY_MAPPED |
+           BEAGLE_FLAG_TRAVERSAL_BLOCKED |
            BEAGLE_FLAG_FRAMEWORK_CPU;
 }
 
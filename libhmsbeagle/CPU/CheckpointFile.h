@@ -0,0 +1,172 @@
+/*
+ * CheckpointFile.h
+ *
+ * Sequential binary writer and reader for instance checkpoints. The reader maps the
+ * whole file into memory so that a restore is a series of copies out of the page cache.
+ */
+
+#ifndef CHECKPOINTFILE_H_
+#define CHECKPOINTFILE_H_
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace beagle {
+namespace cpu {
+
+class CheckpointWriter {
+
+public:
+	CheckpointWriter(const char* fileName)
+        : gFile(fopen(fileName, "wb")), kFailed(false) {
+        if (gFile == NULL)
+            kFailed = true;
+    }
+
+    ~CheckpointWriter() {
+        if (gFile != NULL)
+            fclose(gFile);
+    }
+
+    template <typename T>
+    void write(const T* values,
+               size_t count) {
+        if (!kFailed && count > 0 && fwrite(values, sizeof(T), count, gFile) != count)
+            kFailed = true;
+    }
+
+    template <typename T>
+    void write(T value) {
+        write(&value, 1);
+    }
+
+    // writes the length of a vector followed by its elements
+    template <typename T>
+    void writeVector(const std::vector<T>& values) {
+        write((int) values.size());
+        if (!values.empty())
+            write(&values[0], values.size());
+    }
+
+    // writes whether a buffer is allocated, followed by its elements if so
+    template <typename T>
+    void writeOptional(const T* values,
+                       size_t count) {
+        write((int) (values != NULL));
+        if (values != NULL)
+            write(values, count);
+    }
+
+    // flushes the file; returns false if any write failed
+    bool close() {
+        if (gFile != NULL) {
+            if (fclose(gFile) != 0)
+                kFailed = true;
+            gFile = NULL;
+        }
+        return !kFailed;
+    }
+
+private:
+    FILE* gFile;
+    bool kFailed;
+};
+
+class CheckpointReader {
+
+public:
+	CheckpointReader(const char* fileName)
+        : gData(NULL), kSize(0), kOffset(0), kMapped(false) {
+#ifndef WIN32
+        int fd = open(fileName, O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat status;
+        if (fstat(fd, &status) == 0 && status.st_size > 0) {
+            void* ptr = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                madvise(ptr, status.st_size, MADV_SEQUENTIAL);
+                gData = (const char*) ptr;
+                kSize = status.st_size;
+                kMapped = true;
+            }
+        }
+        close(fd);
+#else
+        FILE* file = fopen(fileName, "rb");
+        if (file == NULL)
+            return;
+        char block[65536];
+        size_t length;
+        while ((length = fread(block, 1, sizeof(block), file)) > 0)
+            gBuffer.insert(gBuffer.end(), block, block + length);
+        fclose(file);
+        if (!gBuffer.empty()) {
+            gData = &gBuffer[0];
+            kSize = gBuffer.size();
+        }
+#endif
+    }
+
+    ~CheckpointReader() {
+#ifndef WIN32
+        if (kMapped)
+            munmap((void*) gData, kSize);
+#endif
+    }
+
+    bool isOpen() const {
+        return gData != NULL;
+    }
+
+    // copies the next count values; returns false if the file ends first
+    template <typename T>
+    bool read(T* values,
+              size_t count) {
+        const size_t length = sizeof(T) * count;
+        if (length > kSize - kOffset)
+            return false;
+        if (length > 0)
+            memcpy(values, gData + kOffset, length);
+        kOffset += length;
+        return true;
+    }
+
+    template <typename T>
+    bool read(T* value) {
+        return read(value, 1);
+    }
+
+    template <typename T>
+    bool readVector(std::vector<T>* values) {
+        int count;
+        if (!read(&count) || count < 0 || sizeof(T) * (size_t) count > kSize - kOffset)
+            return false;
+        values->resize(count);
+        return (count == 0 || read(&(*values)[0], count));
+    }
+
+    bool atEnd() const {
+        return kOffset == kSize;
+    }
+
+private:
+    const char* gData;
+    size_t kSize;
+    size_t kOffset;
+    bool kMapped;
+    std::vector<char> gBuffer;
+};
+
+}
+}
+
+#endif /* CHECKPOINTFILE_H_ */
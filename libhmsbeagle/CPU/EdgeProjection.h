@@ -0,0 +1,189 @@
+/*
+ * EdgeProjection.h
+ *
+ * Holds the parent and child partials of one edge projected onto the eigenbasis of
+ * the rate matrix, so that the likelihood and its derivatives can be evaluated for
+ * any edge length from the eigenvalues alone.
+ */
+
+#ifndef EDGEPROJECTION_H_
+#define EDGEPROJECTION_H_
+
+#include <cmath>
+#include <vector>
+
+namespace beagle {
+namespace cpu {
+
+class EdgeProjection {
+
+public:
+	EdgeProjection(int stateCount)
+        : kStateCount(stateCount), kCategoryCount(0), kPatternCount(0), kComplex(false) {}
+
+    // sets the model the next projections are made under
+    //
+    // eigenSystem the eigenvectors and inverse eigenvectors, both row-major, followed by the
+    //   real and the imaginary parts of the eigenvalues
+    // categoryRates, categoryWeights one entry per rate category
+    void setModel(const double* eigenSystem,
+                  int categoryCount,
+                  const double* categoryRates,
+                  const double* categoryWeights,
+                  int patternCount) {
+        const int matrixSize = kStateCount * kStateCount;
+        gEigenSystem.assign(eigenSystem, eigenSystem + 2 * matrixSize + 2 * kStateCount);
+        kCategoryCount = categoryCount;
+        kPatternCount = patternCount;
+        gCategoryRates.assign(categoryRates, categoryRates + categoryCount);
+        gCategoryWeights.assign(categoryWeights, categoryWeights + categoryCount);
+
+        kComplex = false;
+        for (int k = 0; k < kStateCount; k++) {
+            if (eigenSystem[2 * matrixSize + kStateCount + k] != 0.0)
+                kComplex = true;
+        }
+        const size_t size = (size_t) kCategoryCount * kPatternCount * kStateCount;
+        gCosineCoefficients.assign(size, 0.0);
+        gSineCoefficients.assign(kComplex ? size : 0, 0.0);
+    }
+
+    // projects the partials of one category and pattern; work holds 2 * stateCount doubles
+    //
+    // parent the parent partials already multiplied by the state frequencies
+    // child the child partials
+    void setPattern(int category,
+                    int pattern,
+                    const double* parent,
+                    const double* child,
+                    double* work) {
+        const int matrixSize = kStateCount * kStateCount;
+        const double* evec = &gEigenSystem[0];
+        const double* ivec = evec + matrixSize;
+        const double* evalImag = evec + 2 * matrixSize + kStateCount;
+        double* parentProjection = work;
+        double* childProjection = work + kStateCount;
+
+        for (int k = 0; k < kStateCount; k++) {
+            parentProjection[k] = 0.0;
+            childProjection[k] = 0.0;
+        }
+        for (int i = 0; i < kStateCount; i++) {
+            const double* evecRow = evec + i * kStateCount;
+            const double* ivecRow = ivec + i * kStateCount;
+            double sum = 0.0;
+            for (int k = 0; k < kStateCount; k++) {
+                parentProjection[k] += parent[i] * evecRow[k];
+                sum += ivecRow[k] * child[k];
+            }
+            childProjection[i] = sum;
+        }
+
+        const double weight = gCategoryWeights[category];
+        const size_t offset = ((size_t) category * kPatternCount + pattern) * kStateCount;
+        double* cosine = &gCosineCoefficients[offset];
+        for (int k = 0; k < kStateCount; k++) {
+            if (!kComplex || evalImag[k] == 0.0) {
+                cosine[k] = weight * parentProjection[k] * childProjection[k];
+                if (kComplex)
+                    gSineCoefficients[offset + k] = 0.0;
+            } else {
+                // 2 x 2 conjugate block, rotating as in EigenDecompositionSquare
+                const int k2 = k + 1;
+                cosine[k] = weight * (parentProjection[k] * childProjection[k] +
+                                      parentProjection[k2] * childProjection[k2]);
+                gSineCoefficients[offset + k] = weight * (parentProjection[k] * childProjection[k2] -
+                                                          parentProjection[k2] * childProjection[k]);
+                cosine[k2] = 0.0;
+                gSineCoefficients[offset + k2] = 0.0;
+                k++;
+            }
+        }
+    }
+
+    // calculates the site likelihoods summed over categories, and their first and second
+    // derivatives with respect to edgeLength unless outFirstDerivatives or
+    // outSecondDerivatives are NULL
+    void getSiteLikelihoods(double edgeLength,
+                            double* outLikelihoods,
+                            double* outFirstDerivatives,
+                            double* outSecondDerivatives) const {
+        const int matrixSize = kStateCount * kStateCount;
+        const double* evalReal = &gEigenSystem[2 * matrixSize];
+        const double* evalImag = evalReal + kStateCount;
+
+        // factors multiplying the cosine and sine coefficients, by category and eigenvalue
+        const int factorCount = kCategoryCount * kStateCount;
+        std::vector<double> factors(6 * factorCount, 0.0);
+        double* cosine[3] = {&factors[0], &factors[factorCount], &factors[2 * factorCount]};
+        double* sine[3] = {&factors[3 * factorCount], &factors[4 * factorCount], &factors[5 * factorCount]};
+        for (int l = 0; l < kCategoryCount; l++) {
+            const double rate = gCategoryRates[l];
+            const double distance = rate * edgeLength;
+            for (int k = 0; k < kStateCount; k++) {
+                const int f = l * kStateCount + k;
+                const double a = evalReal[k];
+                const double b = (kComplex ? evalImag[k] : 0.0);
+                const double expat = exp(a * distance);
+                const double expatcosbt = (b == 0.0 ? expat : expat * cos(b * distance));
+                const double expatsinbt = (b == 0.0 ? 0.0 : expat * sin(b * distance));
+                cosine[0][f] = expatcosbt;
+                sine[0][f] = expatsinbt;
+                cosine[1][f] = rate * (a * expatcosbt - b * expatsinbt);
+                sine[1][f] = rate * (b * expatcosbt + a * expatsinbt);
+                cosine[2][f] = rate * rate * ((a * a - b * b) * expatcosbt - 2.0 * a * b * expatsinbt);
+                sine[2][f] = rate * rate * (2.0 * a * b * expatcosbt + (a * a - b * b) * expatsinbt);
+                if (b != 0.0)
+                    k++; // the second row of the block has zero coefficients
+            }
+        }
+
+        const int derivativeCount = (outSecondDerivatives != NULL ? 2 : (outFirstDerivatives != NULL ? 1 : 0));
+        double* outputs[3] = {outLikelihoods, outFirstDerivatives, outSecondDerivatives};
+
+#pragma omp parallel for
+        for (int p = 0; p < kPatternCount; p++) {
+            double sums[3] = {0.0, 0.0, 0.0};
+            for (int l = 0; l < kCategoryCount; l++) {
+                const size_t offset = ((size_t) l * kPatternCount + p) * kStateCount;
+                const double* coefficients = &gCosineCoefficients[offset];
+                const int f = l * kStateCount;
+                for (int d = 0; d <= derivativeCount; d++) {
+                    const double* factor = cosine[d] + f;
+                    double sum = 0.0;
+                    for (int k = 0; k < kStateCount; k++)
+                        sum += coefficients[k] * factor[k];
+                    sums[d] += sum;
+                }
+                if (kComplex) {
+                    const double* sineCoefficients = &gSineCoefficients[offset];
+                    for (int d = 0; d <= derivativeCount; d++) {
+                        const double* factor = sine[d] + f;
+                        double sum = 0.0;
+                        for (int k = 0; k < kStateCount; k++)
+                            sum += sineCoefficients[k] * factor[k];
+                        sums[d] += sum;
+                    }
+                }
+            }
+            for (int d = 0; d <= derivativeCount; d++)
+                outputs[d][p] = sums[d];
+        }
+    }
+
+private:
+    int kStateCount;
+    int kCategoryCount;
+    int kPatternCount;
+    bool kComplex;                           /// any eigenvalue has a non-zero imaginary part
+    std::vector<double> gEigenSystem;
+    std::vector<double> gCategoryRates;
+    std::vector<double> gCategoryWeights;
+    std::vector<double> gCosineCoefficients; /// by category, pattern and eigenvalue
+    std::vector<double> gSineCoefficients;   /// as above, for conjugate pairs only
+};
+
+}
+}
+
+#endif /* EDGEPROJECTION_H_ */
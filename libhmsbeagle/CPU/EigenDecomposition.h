@@ -16,6 +16,10 @@
 #include <cassert>
 #include <vector>
 
+#include "libhmsbeagle/beagle.h"
+#include "libhmsbeagle/MatrixExponential.h"
+#include "libhmsbeagle/TransitionMatrixCache.h"
+
 #define BEAGLE_CPU_EIGEN_GENERIC	REALTYPE, T_PAD
 #define BEAGLE_CPU_EIGEN_TEMPLATE	template <typename REALTYPE, int T_PAD>
 
@@ -34,6 +38,16 @@ protected:
     REALTYPE* matrixTmp;
     REALTYPE* firstDerivTmp;
     REALTYPE* secondDerivTmp;
+
+    TransitionMatrixCache gMatrixCache;
+    REALTYPE* gCachedMatrices; // three sets of kCategoryCount matrices per cache slot
+
+    MatrixExponential** gRateMatrices; // NULL unless the buffer was set with setRateMatrix
+
+    // per buffer, the eigenvectors and inverse eigenvectors in double precision and standard
+    //  layout followed by the real and imaginary eigenvalues; empty unless an Eigen
+    //  decomposition is set
+    std::vector< std::vector<double> > gEigenSystems;
     
 public:
 	EigenDecomposition(int decompositionCount,
@@ -46,9 +60,19 @@ public:
 					   		kStateCount = stateCount;
 					   		kCategoryCount = categoryCount;
                             kFlags = flags;
+                            gCachedMatrices = NULL;
+                            gRateMatrices = (MatrixExponential**) calloc(decompositionCount,
+                                                                          sizeof(MatrixExponential*));
+                            gEigenSystems.resize(decompositionCount);
 					   	};
 	
-	virtual ~EigenDecomposition() {};
+	virtual ~EigenDecomposition() {
+        if (gCachedMatrices != NULL)
+            free(gCachedMatrices);
+        for (int i = 0; i < kEigenDecompCount; i++)
+            delete gRateMatrices[i];
+        free(gRateMatrices);
+    };
 	
     // sets the Eigen decomposition for a given matrix
     //
@@ -60,21 +84,236 @@ public:
                               const double* inEigenVectors,
                               const double* inInverseEigenVectors,
                               const double* inEigenValues) = 0;
+
+    // sets a rate matrix to exponentiate in place of an Eigen decomposition, until
+    // setEigenDecomposition is next called for the same index
+    //
+    // eigenIndex the index of the Eigen decomposition buffer to replace
+    // inRateMatrix a kStateCount x kStateCount row-major rate matrix
+    void setRateMatrix(int eigenIndex,
+                       const double* inRateMatrix) {
+        if (gRateMatrices[eigenIndex] == NULL)
+            gRateMatrices[eigenIndex] = new MatrixExponential(kStateCount);
+        gRateMatrices[eigenIndex]->setRateMatrix(inRateMatrix);
+        gMatrixCache.invalidateEigen(eigenIndex);
+        gEigenSystems[eigenIndex].clear();
+    }
+
+    // returns the rate matrix of a buffer as set by setRateMatrix, or NULL if it holds none
+    const double* getRateMatrix(int eigenIndex) const {
+        if (gRateMatrices[eigenIndex] == NULL)
+            return NULL;
+        return gRateMatrices[eigenIndex]->getRateMatrix();
+    }
+
+    // returns the eigenvectors, inverse eigenvectors, real and imaginary eigenvalues of a
+    // buffer as saved by setEigenDecomposition, or NULL if it holds none
+    const double* getEigenSystem(int eigenIndex) const {
+        if (gEigenSystems[eigenIndex].empty())
+            return NULL;
+        return &gEigenSystems[eigenIndex][0];
+    }
 		
     // calculate a transition probability matrices for a given list of node. This will
     // calculate for all categories (and all matrices if more than one is being used).
+    // Matrices found in the cache are copied instead of being calculated again.
     //
     // nodeIndices an array of node indices that require transition probability matrices
     // edgeLengths an array of expected lengths in substitutions per site
     // count the number of elements in the above arrays
-    virtual void updateTransitionMatrices(int eigenIndex,
-                                 const int* probabilityIndices,
-                                 const int* firstDerivativeIndices,
-                                 const int* secondDerivativeIndices,
-                                 const double* edgeLengths,
-                                 const double* categoryRates,
-                                 REALTYPE** transitionMatrices,
-                                 int count) = 0;
+    void updateTransitionMatrices(int eigenIndex,
+                                  const int* probabilityIndices,
+                                  const int* firstDerivativeIndices,
+                                  const int* secondDerivativeIndices,
+                                  const double* edgeLengths,
+                                  const double* categoryRates,
+                                  REALTYPE** transitionMatrices,
+                                  int count) {
+        if (gMatrixCache.getCapacity() == 0) {
+            computeTransitionMatrices(eigenIndex, probabilityIndices, firstDerivativeIndices,
+                                   secondDerivativeIndices, edgeLengths, categoryRates,
+                                   transitionMatrices, count);
+            return;
+        }
+
+        gMatrixCache.checkCategoryRates(categoryRates, kCategoryCount);
+        const int derivativeCount = (secondDerivativeIndices != NULL ? 2 :
+                                     (firstDerivativeIndices != NULL ? 1 : 0));
+        const int* indices[3] = {probabilityIndices, firstDerivativeIndices, secondDerivativeIndices};
+        const size_t matricesSize = sizeof(REALTYPE) * kCategoryCount * kStateCount * (kStateCount + T_PAD);
+
+        std::vector<int> missIndices[3];
+        std::vector<double> missEdgeLengths;
+        for (int u = 0; u < count; u++) {
+            const int slot = gMatrixCache.find(eigenIndex, edgeLengths[u], derivativeCount);
+            if (slot >= 0) {
+                for (int d = 0; d <= derivativeCount; d++)
+                    memcpy(transitionMatrices[indices[d][u]], getCachedMatrices(slot, d), matricesSize);
+            } else {
+                for (int d = 0; d <= derivativeCount; d++)
+                    missIndices[d].push_back(indices[d][u]);
+                missEdgeLengths.push_back(edgeLengths[u]);
+            }
+        }
+
+        const int missCount = missEdgeLengths.size();
+        if (missCount == 0)
+            return;
+        computeTransitionMatrices(eigenIndex, &missIndices[0][0],
+                               (derivativeCount > 0 ? &missIndices[1][0] : NULL),
+                               (derivativeCount > 1 ? &missIndices[2][0] : NULL),
+                               &missEdgeLengths[0], categoryRates, transitionMatrices, missCount);
+        for (int u = 0; u < missCount; u++) {
+            const int slot = gMatrixCache.insert(eigenIndex, missEdgeLengths[u], derivativeCount);
+            for (int d = 0; d <= derivativeCount; d++)
+                memcpy(getCachedMatrices(slot, d), transitionMatrices[missIndices[d][u]], matricesSize);
+        }
+    }
+
+    // resizes the transition matrix cache, zero turns it off
+    //
+    // returns false if the cache could not be allocated
+    bool setMatrixCacheSize(int cacheSize) {
+        if (gCachedMatrices != NULL)
+            free(gCachedMatrices);
+        gCachedMatrices = NULL;
+        if (cacheSize > 0) {
+            gCachedMatrices = (REALTYPE*) malloc(sizeof(REALTYPE) * 3 * cacheSize * kCategoryCount *
+                                                 kStateCount * (kStateCount + T_PAD));
+            if (gCachedMatrices == NULL) {
+                gMatrixCache.setCapacity(0);
+                return false;
+            }
+        }
+        gMatrixCache.setCapacity(cacheSize);
+        return true;
+    }
+
+    int getMatrixCacheSize() {
+        return gMatrixCache.getCapacity();
+    }
+
+    void getMatrixCacheStatistics(long* outHits,
+                                  long* outMisses) {
+        *outHits = gMatrixCache.getHits();
+        *outMisses = gMatrixCache.getMisses();
+    }
+
+protected:
+    // drops the rate matrix of a buffer that has been given an Eigen decomposition
+    void clearRateMatrix(int eigenIndex) {
+        delete gRateMatrices[eigenIndex];
+        gRateMatrices[eigenIndex] = NULL;
+    }
+
+    // keeps a copy of an Eigen decomposition for getEigenSystem
+    void saveEigenSystem(int eigenIndex,
+                         const double* inEigenVectors,
+                         const double* inInverseEigenVectors,
+                         const double* inEigenValues) {
+        const int matrixSize = kStateCount * kStateCount;
+        std::vector<double>& system = gEigenSystems[eigenIndex];
+        system.assign(2 * matrixSize + 2 * kStateCount, 0.0);
+        memcpy(&system[0], inEigenVectors, sizeof(double) * matrixSize);
+        double* ivec = &system[matrixSize];
+        for (int i = 0; i < kStateCount; i++) {
+            for (int j = 0; j < kStateCount; j++) {
+                if (kFlags & BEAGLE_FLAG_INVEVEC_TRANSPOSED)
+                    ivec[i * kStateCount + j] = inInverseEigenVectors[j * kStateCount + i];
+                else
+                    ivec[i * kStateCount + j] = inInverseEigenVectors[i * kStateCount + j];
+            }
+        }
+        const int valueCount = (kFlags & BEAGLE_FLAG_EIGEN_COMPLEX ? 2 * kStateCount : kStateCount);
+        memcpy(&system[2 * matrixSize], inEigenValues, sizeof(double) * valueCount);
+    }
+
+    // calculates the transition matrices without consulting the cache, from the rate
+    // matrix if one is set and from the Eigen decomposition otherwise
+    void computeTransitionMatrices(int eigenIndex,
+                                   const int* probabilityIndices,
+                                   const int* firstDerivativeIndices,
+                                   const int* secondDerivativeIndices,
+                                   const double* edgeLengths,
+                                   const double* categoryRates,
+                                   REALTYPE** transitionMatrices,
+                                   int count) {
+        if (gRateMatrices[eigenIndex] != NULL)
+            calcRateMatrixTransitionMatrices(eigenIndex, probabilityIndices, firstDerivativeIndices,
+                                             secondDerivativeIndices, edgeLengths, categoryRates,
+                                             transitionMatrices, count);
+        else
+            calcTransitionMatrices(eigenIndex, probabilityIndices, firstDerivativeIndices,
+                                   secondDerivativeIndices, edgeLengths, categoryRates,
+                                   transitionMatrices, count);
+    }
+
+    // exponentiates the rate matrix for every edge length and category, spreading
+    // them over threads when built with OpenMP
+    void calcRateMatrixTransitionMatrices(int eigenIndex,
+                                          const int* probabilityIndices,
+                                          const int* firstDerivativeIndices,
+                                          const int* secondDerivativeIndices,
+                                          const double* edgeLengths,
+                                          const double* categoryRates,
+                                          REALTYPE** transitionMatrices,
+                                          int count) {
+        const MatrixExponential* exponential = gRateMatrices[eigenIndex];
+        const int matrixSize = kStateCount * kStateCount;
+        const int paddedMatrixSize = kStateCount * (kStateCount + T_PAD);
+        const int total = count * kCategoryCount;
+
+#pragma omp parallel
+        {
+            std::vector<double> workspace(exponential->getWorkspaceSize() + 3 * matrixSize);
+            double* matrices[3] = {&workspace[exponential->getWorkspaceSize()],
+                                   &workspace[exponential->getWorkspaceSize() + matrixSize],
+                                   &workspace[exponential->getWorkspaceSize() + 2 * matrixSize]};
+            const int* indices[3] = {probabilityIndices, firstDerivativeIndices, secondDerivativeIndices};
+
+#pragma omp for
+            for (int b = 0; b < total; b++) {
+                const int u = b / kCategoryCount;
+                const int l = b % kCategoryCount;
+                exponential->getTransitionMatrix(edgeLengths[u], categoryRates[l], matrices[0],
+                                                 (firstDerivativeIndices != NULL ? matrices[1] : NULL),
+                                                 (secondDerivativeIndices != NULL ? matrices[2] : NULL),
+                                                 &workspace[0]);
+                for (int d = 0; d < 3; d++) {
+                    if (indices[d] == NULL)
+                        continue;
+                    REALTYPE* transitionMat = transitionMatrices[indices[d][u]] + l * paddedMatrixSize;
+                    int n = 0;
+                    for (int i = 0; i < kStateCount; i++) {
+                        for (int j = 0; j < kStateCount; j++) {
+                            const double value = matrices[d][i * kStateCount + j];
+                            transitionMat[n] = (d == 0 && value < 0 ? 0 : (REALTYPE) value);
+                            n++;
+                        }
+if (T_PAD != 0) {
+                        transitionMat[n] = (d == 0 ? 1.0 : 0.0);
+                        n += T_PAD;
+}
+                    }
+                }
+            }
+        }
+    }
+
+    // calculates the transition matrices from the Eigen decomposition
+    virtual void calcTransitionMatrices(int eigenIndex,
+                                        const int* probabilityIndices,
+                                        const int* firstDerivativeIndices,
+                                        const int* secondDerivativeIndices,
+                                        const double* edgeLengths,
+                                        const double* categoryRates,
+                                        REALTYPE** transitionMatrices,
+                                        int count) = 0;
+
+    REALTYPE* getCachedMatrices(int slot,
+                                int derivative) {
+        return gCachedMatrices + (slot * 3 + derivative) * kCategoryCount * kStateCount * (kStateCount + T_PAD);
+    }
 
 };
 
@@ -24,6 +24,9 @@ class EigenDecompositionCube : public EigenDecomposition<BEAGLE_CPU_EIGEN_GENERI
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::firstDerivTmp;
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::secondDerivTmp;
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kFlags;
+	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::gMatrixCache;
+	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::clearRateMatrix;
+	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::saveEigenSystem;
 
 protected:
     REALTYPE** gCMatrices;
@@ -40,8 +43,9 @@ public:
                               const double* inEigenVectors,
                               const double* inInverseEigenVectors,
                               const double* inEigenValues);
-		
-    virtual void updateTransitionMatrices(int eigenIndex,
+
+protected:
+    virtual void calcTransitionMatrices(int eigenIndex,
                                  const int* probabilityIndices,
                                  const int* firstDerivativeIndices,
                                  const int* secondDerivativeIndices,
@@ -49,7 +53,6 @@ public:
                                  const double* categoryRates,
                                  REALTYPE** transitionMatrices,
                                  int count);
-	
 };
 
 }
@@ -97,12 +97,15 @@ void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::setEigenDecomposition(int
         }
     }
 
+    gMatrixCache.invalidateEigen(eigenIndex);
+    clearRateMatrix(eigenIndex);
+    saveEigenSystem(eigenIndex, inEigenVectors, inInverseEigenVectors, inEigenValues);
 }
     
 #define UNROLL
 
 BEAGLE_CPU_EIGEN_TEMPLATE
-void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::updateTransitionMatrices(int eigenIndex,
+void EigenDecompositionCube<BEAGLE_CPU_EIGEN_GENERIC>::calcTransitionMatrices(int eigenIndex,
                                                       const int* probabilityIndices,
                                                       const int* firstDerivativeIndices,
                                                       const int* secondDerivativeIndices,
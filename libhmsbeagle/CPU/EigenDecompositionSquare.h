@@ -22,6 +22,9 @@ class EigenDecompositionSquare: public EigenDecomposition<BEAGLE_CPU_EIGEN_GENER
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kCategoryCount;
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::matrixTmp;
 	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::kFlags;
+	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::gMatrixCache;
+	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::clearRateMatrix;
+	using EigenDecomposition<BEAGLE_CPU_EIGEN_GENERIC>::saveEigenSystem;
 
 protected:
     REALTYPE** gEMatrices; // kStateCount^2 flattened array
@@ -42,7 +45,8 @@ public:
                               const double* inInverseEigenVectors,
                               const double* inEigenValues);
 
-    virtual void updateTransitionMatrices(int eigenIndex,
+protected:
+    virtual void calcTransitionMatrices(int eigenIndex,
                                  const int* probabilityIndices,
                                  const int* firstDerivativeIndices,
                                  const int* secondDerivativeIndices,
@@ -104,10 +104,13 @@ void EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>::setEigenDecomposition(i
 	beagleMemCpy(gIMatrices[eigenIndex],inInverseEigenVectors,len);
     if (kFlags & BEAGLE_FLAG_INVEVEC_TRANSPOSED) // TODO: optimize, might not need to transpose here
         transposeSquareMatrix(gIMatrices[eigenIndex], kStateCount);
+    gMatrixCache.invalidateEigen(eigenIndex);
+    clearRateMatrix(eigenIndex);
+    saveEigenSystem(eigenIndex, inEigenVectors, inInverseEigenVectors, inEigenValues);
 }
 
 BEAGLE_CPU_EIGEN_TEMPLATE
-void EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>::updateTransitionMatrices(int eigenIndex,
+void EigenDecompositionSquare<BEAGLE_CPU_EIGEN_GENERIC>::calcTransitionMatrices(int eigenIndex,
                                                         const int* probabilityIndices,
                                                         const int* firstDerivativeIndices,
                                                         const int* secondDerivativeIndices,
@@ -10,6 +10,10 @@
 
 #include <cstring>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define DOUBLE_PRECISION (sizeof(REALTYPE) == 8)
 
 template<typename T, typename F> 
@@ -25,6 +29,22 @@ inline void beagleMemCpy( F* to, const F* from, unsigned int length )
 	memcpy( to, from, length*sizeof(F) );
 }
 
+// narrows double to float with SSE2 conversions where available, as client input to
+// single-precision buffers does
+inline void beagleMemCpy( float* to, const double* from, unsigned int length )
+{
+	unsigned int m = 0;
+#ifdef __SSE2__
+	for(; m + 4 <= length; m += 4) {
+		__m128 low = _mm_cvtpd_ps(_mm_loadu_pd(from + m));
+		__m128 high = _mm_cvtpd_ps(_mm_loadu_pd(from + m + 2));
+		_mm_storeu_ps(to + m, _mm_movelh_ps(low, high));
+	}
+#endif
+	for(; m < length; m++)
+		to[m] = (float) from[m];
+}
+
 /*#define MEMCNV(to, from, length, toType)    { \
                                                 int m; \
                                                 for(m = 0; m < length; m++) { \
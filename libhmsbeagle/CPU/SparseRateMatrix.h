@@ -0,0 +1,158 @@
+/*
+ * SparseRateMatrix.h
+ *
+ * Applies the exponential of a sparse rate matrix to vectors by uniformization,
+ * so that large state spaces never need a dense transition matrix.
+ */
+
+#ifndef SPARSERATEMATRIX_H_
+#define SPARSERATEMATRIX_H_
+
+#include <cmath>
+#include <vector>
+
+namespace beagle {
+namespace cpu {
+
+class SparseRateMatrix {
+
+public:
+	SparseRateMatrix(int stateCount) : kStateCount(stateCount), kUniformRate(0.0) {}
+
+    // sets the rate matrix from its off-diagonal non-zero entries; diagonal entries are
+    // ignored and taken as minus the row sums
+    //
+    // returns false if an index is out of range or a rate is negative
+    bool setRateMatrix(int nonZeroCount,
+                       const int* rowIndices,
+                       const int* columnIndices,
+                       const double* rates) {
+        std::vector<double> exitRates(kStateCount, 0.0);
+        std::vector<int> rowCounts(kStateCount, 0);
+        for (int n = 0; n < nonZeroCount; n++) {
+            const int i = rowIndices[n];
+            const int j = columnIndices[n];
+            if (i < 0 || i >= kStateCount || j < 0 || j >= kStateCount || rates[n] < 0)
+                return false;
+            if (i != j) {
+                exitRates[i] += rates[n];
+                rowCounts[i]++;
+            }
+        }
+
+        kUniformRate = 0.0;
+        for (int i = 0; i < kStateCount; i++) {
+            if (exitRates[i] > kUniformRate)
+                kUniformRate = exitRates[i];
+        }
+
+        // R = I + Q / kUniformRate in compressed rows, diagonal first
+        gRowStarts.assign(kStateCount + 1, 0);
+        for (int i = 0; i < kStateCount; i++)
+            gRowStarts[i + 1] = gRowStarts[i] + rowCounts[i] + 1;
+        gColumns.assign(gRowStarts[kStateCount], 0);
+        gValues.assign(gRowStarts[kStateCount], 0.0);
+        std::vector<int> next(gRowStarts.begin(), gRowStarts.end() - 1);
+        for (int i = 0; i < kStateCount; i++) {
+            gColumns[next[i]] = i;
+            gValues[next[i]] = (kUniformRate > 0 ? 1.0 - exitRates[i] / kUniformRate : 1.0);
+            next[i]++;
+        }
+        for (int n = 0; n < nonZeroCount; n++) {
+            const int i = rowIndices[n];
+            if (i != columnIndices[n]) {
+                gColumns[next[i]] = columnIndices[n];
+                gValues[next[i]] = rates[n] / kUniformRate;
+                next[i]++;
+            }
+        }
+        return true;
+    }
+
+    // recovers the off-diagonal non-zero entries given to setRateMatrix
+    void getRates(std::vector<int>* outRowIndices,
+                  std::vector<int>* outColumnIndices,
+                  std::vector<double>* outRates) const {
+        outRowIndices->clear();
+        outColumnIndices->clear();
+        outRates->clear();
+        if (gRowStarts.empty())
+            return;
+        for (int i = 0; i < kStateCount; i++) {
+            for (int n = gRowStarts[i] + 1; n < gRowStarts[i + 1]; n++) {
+                outRowIndices->push_back(i);
+                outColumnIndices->push_back(gColumns[n]);
+                outRates->push_back(kUniformRate > 0 ? gValues[n] * kUniformRate : 0.0);
+            }
+        }
+    }
+
+    // computes the Poisson weights with which applyExponential sums powers of R for a
+    // distance, splitting long distances into steps so that no weight underflows
+    void getWeights(double distance,
+                    std::vector<double>* weights,
+                    int* steps) const {
+        const double maxStepRate = 32.0; // exp(-maxStepRate) stays well above the smallest double
+        const double truncationError = 1e-14;
+        const double totalRate = kUniformRate * distance;
+        *steps = (int) ceil(totalRate / maxStepRate);
+        if (*steps < 1)
+            *steps = 1;
+        const double rate = totalRate / *steps;
+
+        weights->clear();
+        double weight = exp(-rate);
+        double remaining = 1.0 - weight;
+        weights->push_back(weight);
+        for (int k = 1; remaining > truncationError && weight > 0.0; k++) {
+            weight *= rate / k;
+            remaining -= weight;
+            weights->push_back(weight);
+        }
+    }
+
+    // out = exp(Q distance) in, for weights and steps from getWeights; work holds
+    // 2 * stateCount doubles and out may not alias in
+    template <typename REALTYPE>
+    void applyExponential(const std::vector<double>& weights,
+                          int steps,
+                          const REALTYPE* in,
+                          double* out,
+                          double* work) const {
+        double* power = work;
+        double* nextPower = work + kStateCount;
+        for (int i = 0; i < kStateCount; i++)
+            out[i] = in[i];
+        for (int s = 0; s < steps; s++) {
+            for (int i = 0; i < kStateCount; i++) {
+                power[i] = out[i];
+                out[i] *= weights[0];
+            }
+            for (size_t k = 1; k < weights.size(); k++) {
+                for (int i = 0; i < kStateCount; i++) {
+                    double sum = 0.0;
+                    for (int n = gRowStarts[i]; n < gRowStarts[i + 1]; n++)
+                        sum += gValues[n] * power[gColumns[n]];
+                    nextPower[i] = sum;
+                }
+                for (int i = 0; i < kStateCount; i++)
+                    out[i] += weights[k] * nextPower[i];
+                double* swap = power;
+                power = nextPower;
+                nextPower = swap;
+            }
+        }
+    }
+
+private:
+    int kStateCount;
+    double kUniformRate;         /// largest exit rate
+    std::vector<int> gRowStarts; /// compressed rows of R = I + Q / kUniformRate
+    std::vector<int> gColumns;
+    std::vector<double> gValues;
+};
+
+}
+}
+
+#endif /* SPARSERATEMATRIX_H_ */
@@ -35,6 +35,8 @@
 #endif
 
 #include "libhmsbeagle/BeagleImpl.h"
+#include "libhmsbeagle/MatrixExponential.h"
+#include "libhmsbeagle/TransitionMatrixCache.h"
 #include "libhmsbeagle/GPU/GPUImplDefs.h"
 #include "libhmsbeagle/GPU/GPUInterface.h"
 #include "libhmsbeagle/GPU/KernelLauncher.h"
@@ -134,6 +136,11 @@ private:
     GPUPtr* dPartials;
     GPUPtr* dMatrices;
     
+    TransitionMatrixCache gMatrixCache;
+    GPUPtr* dCachedMatrices; // capacity x {matrices, first derivatives, second derivatives}
+    
+    MatrixExponential** hRateMatrices; // exponentiated on the host when set in place of an eigen system
+    
     GPUPtr* dCompactBuffers;
     GPUPtr* dTipPartialsBuffers;
     
@@ -181,11 +188,17 @@ public:
     int setTipStates(int tipIndex,
                      const int* inStates);
 
+    int setTipStateMasks(int tipIndex,
+                         const int* inStateMasks);
+
     int setTipPartials(int tipIndex,
                        const double* inPartials);
     
     int setPartials(int bufferIndex,
                     const double* inPartials);
+
+    int setPartialsBuffer(int bufferIndex,
+                          const double* inPartials);
     
     int getPartials(int bufferIndex,
 				    int scaleIndex,
@@ -196,6 +209,9 @@ public:
                               const double* inInverseEigenVectors,
                               const double* inEigenValues);
     
+    int setRateMatrix(int eigenIndex,
+                      const double* inRateMatrix);
+    
     int setStateFrequencies(int stateFrequenciesIndex,
                             const double* inStateFrequencies);    
     
@@ -235,10 +251,37 @@ public:
                                  const double* edgeLengths,
                                  int count);
     
+    int setTransitionMatrixCacheSize(int cacheSize);
+    
+    int getTransitionMatrixCacheStatistics(long* outHits,
+                                           long* outMisses);
+    
     int updatePartials(const int* operations,
                        int operationCount,
                        int cumulativeScalingIndex);
     
+    int setSparseRateMatrix(int eigenIndex,
+                            int nonZeroCount,
+                            const int* rowIndices,
+                            const int* columnIndices,
+                            const double* rates);
+    
+    int updatePartialsByEdgeLengths(int eigenIndex,
+                                    const int* operations,
+                                    int operationCount,
+                                    const double* edgeLengths,
+                                    int cumulativeScalingIndex);
+
+    int updateMatricesAndPartials(const int* operations,
+                                  int operationCount,
+                                  const int* eigenIndices,
+                                  const double* edgeLengths,
+                                  int cumulativeScalingIndex);
+    
+    int setDirtyTracking(int enable);
+
+    int setExponentScalers(int enable);
+
     int waitForPartials(const int* destinationPartials,
                         int destinationPartialsCount);
     
@@ -264,6 +307,12 @@ public:
                                     const int* cumulativeScaleIndices,
                                     int count,
                                     double* outSumLogLikelihood);
+
+    int calculateRootLogLikelihoodsByOperation(const int* operation,
+                                               int categoryWeightsIndex,
+                                               int stateFrequenciesIndex,
+                                               int cumulativeScaleIndex,
+                                               double* outSumLogLikelihood);
     
     int calculateEdgeLogLikelihoods(const int* parentBufferIndices,
                                     const int* childBufferIndices,
@@ -278,13 +327,77 @@ public:
                                     double* outSumFirstDerivative,
                                     double* outSumSecondDerivative);
 
+    int calculateIndependentEdgeLogLikelihoods(const int* parentBufferIndices,
+                                               const int* childBufferIndices,
+                                               const int* probabilityIndices,
+                                               const int* firstDerivativeIndices,
+                                               const int* secondDerivativeIndices,
+                                               const int* categoryWeightsIndices,
+                                               const int* stateFrequenciesIndices,
+                                               const int* cumulativeScaleIndices,
+                                               int count,
+                                               double* outLogLikelihoods,
+                                               double* outFirstDerivatives,
+                                               double* outSecondDerivatives);
+
+    int projectEdgePartials(int parentBufferIndex,
+                            int childBufferIndex,
+                            int eigenIndex,
+                            int categoryWeightsIndex,
+                            int stateFrequenciesIndex,
+                            int cumulativeScaleIndex);
+
+    int calculateProjectedEdgeLogLikelihoods(double edgeLength,
+                                             double* outSumLogLikelihood,
+                                             double* outSumFirstDerivative,
+                                             double* outSumSecondDerivative);
+
+    int optimizeEdgeLengths(const int* parentBufferIndices,
+                            const int* childBufferIndices,
+                            int eigenIndex,
+                            int categoryWeightsIndex,
+                            int stateFrequenciesIndex,
+                            const int* cumulativeScaleIndices,
+                            int count,
+                            double minEdgeLength,
+                            double maxEdgeLength,
+                            double tolerance,
+                            int maxIterations,
+                            double* inOutEdgeLengths,
+                            double* outLogLikelihoods);
+
     int getSiteLogLikelihoods(double* outLogLikelihoods);
     
     int getSiteDerivatives(double* outFirstDerivatives,
                            double* outSecondDerivatives);
 
+    int setSiteBuffers(double* outLogLikelihoods,
+                       double* outFirstDerivatives,
+                       double* outSecondDerivatives);
+
+    int saveInstance(const char* fileName);
+
+    int restoreInstance(const char* fileName);
+
+    int cloneInstance(BeagleImpl* sourceInstance);
+
+    int setTipData(TipData* tipData);
+
+    int setKernelCounting(int enable);
+
+    int getKernelCounters(BeagleKernelCounters* outCounters);
+
+    int resetKernelCounters();
+
 private:
     char* getInstanceName();
+    
+    void calcRateMatrixTransitionMatrices(int eigenIndex,
+                                          const int* probabilityIndices,
+                                          const int* firstDerivativeIndices,
+                                          const int* secondDerivativeIndices,
+                                          const double* edgeLengths,
+                                          int count);
 
 };
 
@@ -35,6 +35,7 @@
 #include <cassert>
 #include <iostream>
 #include <cstring>
+#include <vector>
 
 #include "libhmsbeagle/beagle.h"
 #include "libhmsbeagle/GPU/GPUImplDefs.h"
@@ -94,6 +95,10 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::BeagleGPUImpl() {
     dPartials = NULL;
     dMatrices = NULL;
     
+    dCachedMatrices = NULL;
+    
+    hRateMatrices = NULL;
+    
     dCompactBuffers = NULL;
     dTipPartialsBuffers = NULL;
     
@@ -133,6 +138,9 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::~BeagleGPUImpl() {
         // TODO: free subpointers
         gpu->FreeMemory(dMatrices[0]);
         
+        for (int i = 0; i < gMatrixCache.getCapacity() * 3; i++)
+            gpu->FreeMemory(dCachedMatrices[i]);
+        
         if (kFlags & BEAGLE_FLAG_SCALING_DYNAMIC) {
             gpu->FreePinnedHostMemory(hRescalingTrigger);
             for (int i = 0; i < kScaleBufferCount; i++) {
@@ -147,8 +155,7 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::~BeagleGPUImpl() {
         
 		for (int i = 0; i < kBufferCount; i++) {        
 			if (i < kTipCount) { // For the tips
-				if (i < kCompactBufferCount)
-					gpu->FreeMemory(dCompactBuffers[i]);
+				gpu->FreeMemory(dCompactBuffers[i]);
 				if (i < kTipPartialsBufferCount)
 					gpu->FreeMemory(dTipPartialsBuffers[i]);
 			} else {
@@ -195,6 +202,7 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::~BeagleGPUImpl() {
 
         free(dPartials);
         free(dMatrices);
+        free(dCachedMatrices);
 
         free(dCompactBuffers);
         free(dTipPartialsBuffers);
@@ -217,6 +225,12 @@ BeagleGPUImpl<BEAGLE_GPU_GENERIC>::~BeagleGPUImpl() {
         
     }
     
+    if (hRateMatrices != NULL) {
+        for (int i = 0; i < kEigenDecompCount; i++)
+            delete hRateMatrices[i];
+        free(hRateMatrices);
+    }
+    
     if (kernels)
         delete kernels;        
     if (gpu) 
@@ -251,6 +265,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     kStateCount = stateCount;
     kPatternCount = patternCount;
     kEigenDecompCount = eigenDecompositionCount;
+    hRateMatrices = (MatrixExponential**) calloc(kEigenDecompCount, sizeof(MatrixExponential*));
     kMatrixCount = matrixCount;
     kCategoryCount = categoryCount;
     kScaleBufferCount = scaleBufferCount;
@@ -457,7 +472,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
                                              kMatrixCount * kMatrixSize * kCategoryCount + // dMatrices
                                              kBufferCount + // dBranchLengths
                                              kMatrixCount * kCategoryCount * 2) + // dDistanceQueue
-    sizeof(int) * kCompactBufferCount * kPaddedPatternCount + // dCompactBuffers
+    sizeof(int) * kTipCount * kPaddedPatternCount + // dCompactBuffers
     sizeof(GPUPtr) * ptrQueueLength;  // dPtrQueue
     
 #ifdef CUDA
@@ -557,13 +572,13 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
     // Internal nodes have 0s so partials are used
     dStates = (GPUPtr*) calloc(sizeof(GPUPtr), kBufferCount); 
     
-    dCompactBuffers = (GPUPtr*) malloc(sizeof(GPUPtr) * kCompactBufferCount); 
+    // Every tip gets a compact buffer so that setTipPartials can store one-hot tips as states
+    dCompactBuffers = (GPUPtr*) malloc(sizeof(GPUPtr) * kTipCount); 
     dTipPartialsBuffers = (GPUPtr*) malloc(sizeof(GPUPtr) * kTipPartialsBufferCount);
     
     for (int i = 0; i < kBufferCount; i++) {        
         if (i < kTipCount) { // For the tips
-            if (i < kCompactBufferCount)
-                dCompactBuffers[i] = gpu->AllocateMemory(kPaddedPatternCount * sizeof(int));
+            dCompactBuffers[i] = gpu->AllocateMemory(kPaddedPatternCount * sizeof(int));
             if (i < kTipPartialsBufferCount)
                 dTipPartialsBuffers[i] = gpu->AllocateMemory(kPartialsSize * sizeof(Real));
         } else {
@@ -571,7 +586,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::createInstance(int tipCount,
         }
     }
     
-    kLastCompactBufferIndex = kCompactBufferCount - 1;
+    kLastCompactBufferIndex = kTipCount - 1;
     kLastTipPartialsBufferIndex = kTipPartialsBufferCount - 1;
         
     // No execution has more no kBufferCount events
@@ -681,7 +696,7 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipStates(int tipIndex,
         hStatesCache[i] = kPaddedStateCount;
 
     if (dStates[tipIndex] == 0) {
-        assert(kLastCompactBufferIndex >= 0 && kLastCompactBufferIndex < kCompactBufferCount);
+        assert(kLastCompactBufferIndex >= 0 && kLastCompactBufferIndex < kTipCount);
         dStates[tipIndex] = dCompactBuffers[kLastCompactBufferIndex--];
     }
     // Copy to GPU device
@@ -694,6 +709,43 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipStates(int tipIndex,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipStateMasks(int tipIndex,
+                                    const int* inStateMasks) {
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::setTipStateMasks\n");
+#endif
+
+    if (tipIndex < 0 || tipIndex >= kTipCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    if (kStateCount > 32)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    // The GPU kernels have no ambiguity lookup, so masks are expanded into tip partials
+    double* tmpPartials = (double*) malloc(sizeof(double) * kPatternCount * kStateCount);
+    if (tmpPartials == NULL)
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+
+    const unsigned int allStates = (kStateCount == 32 ? 0xFFFFFFFFu : (1u << kStateCount) - 1);
+    for (int i = 0; i < kPatternCount; i++) {
+        unsigned int mask = ((unsigned int) inStateMasks[i]) & allStates;
+        if (mask == 0)
+            mask = allStates;
+        for (int j = 0; j < kStateCount; j++)
+            tmpPartials[i * kStateCount + j] = ((mask >> j) & 1u) ? 1.0 : 0.0;
+    }
+
+    int returnCode = setTipPartials(tipIndex, tmpPartials);
+    free(tmpPartials);
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::setTipStateMasks\n");
+#endif
+
+    return returnCode;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipPartials(int tipIndex,
                                   const double* inPartials) {
@@ -704,6 +756,47 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipPartials(int tipIndex,
     if (tipIndex < 0 || tipIndex >= kTipCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
 
+    // Tips whose sites are all one-hot (or all ones, i.e. missing) are stored as compact
+    //  states instead, which also selects the faster states kernels
+    int* tmpStates = (int*) malloc(sizeof(int) * kPatternCount);
+    if (tmpStates == NULL)
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    bool isCompact = true;
+    for (int i = 0; i < kPatternCount && isCompact; i++) {
+        const double* site = inPartials + i * kStateCount;
+        int state = -1;
+        int ones = 0;
+        for (int j = 0; j < kStateCount; j++) {
+            if (site[j] == 1.0) {
+                state = j;
+                ones++;
+            } else if (site[j] != 0.0) {
+                isCompact = false;
+            }
+        }
+        if (ones == kStateCount)
+            tmpStates[i] = kStateCount;
+        else if (ones == 1)
+            tmpStates[i] = state;
+        else
+            isCompact = false;
+    }
+    if (isCompact) {
+        if (dPartials[tipIndex] != 0) {
+            dTipPartialsBuffers[++kLastTipPartialsBufferIndex] = dPartials[tipIndex];
+            dPartials[tipIndex] = 0;
+        }
+        int returnCode = setTipStates(tipIndex, tmpStates);
+        free(tmpStates);
+        return returnCode;
+    }
+    free(tmpStates);
+
+    if (dStates[tipIndex] != 0) {
+        dCompactBuffers[++kLastCompactBufferIndex] = dStates[tipIndex];
+        dStates[tipIndex] = 0;
+    }
+
     const double* inPartialsOffset = inPartials;
     Real* tmpRealPartialsOffset = hPartialsCache;
     for (int i = 0; i < kPatternCount; i++) {
@@ -739,6 +832,13 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipPartials(int tipIndex,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPartialsBuffer(int bufferIndex,
+                                                         const double* inPartials) {
+    // Partials live in device memory, so the client memory is always copied
+    return setPartials(bufferIndex, inPartials);
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPartials(int bufferIndex,
                                const double* inPartials) {
@@ -899,6 +999,10 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setEigenDecomposition(int eigenIndex,
     gpu->PrintfDeviceVector(dIevc[eigenIndex], kPaddedStateCount * kPaddedStateCount, r);
 #endif
     
+    gMatrixCache.invalidateEigen(eigenIndex);
+    delete hRateMatrices[eigenIndex];
+    hRateMatrices[eigenIndex] = NULL;
+    
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\tLeaving  BeagleGPUImpl::setEigenDecomposition\n");
 #endif
@@ -906,6 +1010,20 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setEigenDecomposition(int eigenIndex,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setRateMatrix(int eigenIndex,
+                                                 const double* inRateMatrix) {
+    if (eigenIndex < 0 || eigenIndex >= kEigenDecompCount)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    
+    if (hRateMatrices[eigenIndex] == NULL)
+        hRateMatrices[eigenIndex] = new MatrixExponential(kStateCount);
+    hRateMatrices[eigenIndex]->setRateMatrix(inRateMatrix);
+    gMatrixCache.invalidateEigen(eigenIndex);
+    
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setStateFrequencies(int stateFrequenciesIndex,
                                        const double* inStateFrequencies) {
@@ -942,6 +1060,12 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setCategoryWeights(int categoryWeightsInd
     
     if (categoryWeightsIndex < 0 || categoryWeightsIndex >= kEigenDecompCount)
         return BEAGLE_ERROR_OUT_OF_RANGE;
+
+    // The device kernels do not skip zero-weight categories
+    for (int l = 0; l < kCategoryCount; l++) {
+        if (inCategoryWeights[l] == 0.0)
+            return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
     
 //#ifdef DOUBLE_PRECISION
 //	const double* tmpWeights = inCategoryWeights;
@@ -987,6 +1111,12 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setPatternWeights(const double* inPattern
 #ifdef BEAGLE_DEBUG_FLOW
 	fprintf(stderr, "\tEntering BeagleGPUImpl::setPatternWeights\n");
 #endif
+
+    // The device kernels do not skip zero-weight patterns
+    for (int k = 0; k < kPatternCount; k++) {
+        if (inPatternWeights[k] == 0.0)
+            return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    }
 	
 //#ifdef DOUBLE_PRECISION
 //	const double* tmpWeights = inPatternWeights;
@@ -1209,6 +1339,46 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updateTransitionMatrices(int eigenIndex,
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr,"\tEntering BeagleGPUImpl::updateTransitionMatrices\n");
 #endif
+    
+    const int derivativeCount = (firstDerivativeIndices == NULL ? 0 :
+                                 (secondDerivativeIndices == NULL ? 1 : 2));
+    const size_t matrixBytes = sizeof(Real) * kMatrixSize * kCategoryCount;
+    std::vector<int> missProbability, missFirst, missSecond;
+    std::vector<double> missLengths;
+    
+    if (gMatrixCache.getCapacity() > 0 && count > 0) {
+        gMatrixCache.checkCategoryRates(hCategoryRates, kCategoryCount);
+        for (int i = 0; i < count; i++) {
+            int slot = gMatrixCache.find(eigenIndex, edgeLengths[i], derivativeCount);
+            if (slot >= 0) {
+                gpu->MemcpyDeviceToDevice(dMatrices[probabilityIndices[i]],
+                                          dCachedMatrices[slot * 3], matrixBytes);
+                if (derivativeCount > 0)
+                    gpu->MemcpyDeviceToDevice(dMatrices[firstDerivativeIndices[i]],
+                                              dCachedMatrices[slot * 3 + 1], matrixBytes);
+                if (derivativeCount > 1)
+                    gpu->MemcpyDeviceToDevice(dMatrices[secondDerivativeIndices[i]],
+                                              dCachedMatrices[slot * 3 + 2], matrixBytes);
+            } else {
+                missProbability.push_back(probabilityIndices[i]);
+                if (derivativeCount > 0)
+                    missFirst.push_back(firstDerivativeIndices[i]);
+                if (derivativeCount > 1)
+                    missSecond.push_back(secondDerivativeIndices[i]);
+                missLengths.push_back(edgeLengths[i]);
+            }
+        }
+        count = (int) missLengths.size();
+        if (count > 0) {
+            probabilityIndices = &missProbability[0];
+            if (derivativeCount > 0)
+                firstDerivativeIndices = &missFirst[0];
+            if (derivativeCount > 1)
+                secondDerivativeIndices = &missSecond[0];
+            edgeLengths = &missLengths[0];
+        }
+    }
+    
     if (count > 0) {
         // TODO: improve performance of calculation of derivatives
         int totalCount = 0;
@@ -1216,7 +1386,10 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updateTransitionMatrices(int eigenIndex,
         int indexOffset =  gpu->AlignMemOffset(kMatrixSize * kCategoryCount * sizeof(Real)) / sizeof(Real);
         int categoryOffset = kMatrixSize;
         
-        if (firstDerivativeIndices == NULL && secondDerivativeIndices == NULL) {
+        if (hRateMatrices[eigenIndex] != NULL) {
+            calcRateMatrixTransitionMatrices(eigenIndex, probabilityIndices, firstDerivativeIndices,
+                                             secondDerivativeIndices, edgeLengths, count);
+        } else if (firstDerivativeIndices == NULL && secondDerivativeIndices == NULL) {
             for (int i = 0; i < count; i++) {        
                 for (int j = 0; j < kCategoryCount; j++) {
                     hPtrQueue[totalCount] = probabilityIndices[i] * indexOffset + j * categoryOffset;
@@ -1286,6 +1459,20 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updateTransitionMatrices(int eigenIndex,
     #ifdef BEAGLE_DEBUG_SYNCH    
         gpu->Synchronize();
     #endif
+        
+        if (gMatrixCache.getCapacity() > 0) {
+            for (int i = 0; i < count; i++) {
+                int slot = gMatrixCache.insert(eigenIndex, edgeLengths[i], derivativeCount);
+                gpu->MemcpyDeviceToDevice(dCachedMatrices[slot * 3],
+                                          dMatrices[probabilityIndices[i]], matrixBytes);
+                if (derivativeCount > 0)
+                    gpu->MemcpyDeviceToDevice(dCachedMatrices[slot * 3 + 1],
+                                              dMatrices[firstDerivativeIndices[i]], matrixBytes);
+                if (derivativeCount > 1)
+                    gpu->MemcpyDeviceToDevice(dCachedMatrices[slot * 3 + 2],
+                                              dMatrices[secondDerivativeIndices[i]], matrixBytes);
+            }
+        }
     }
 #ifdef BEAGLE_DEBUG_FLOW
     fprintf(stderr, "\tLeaving  BeagleGPUImpl::updateTransitionMatrices\n");
@@ -1294,6 +1481,73 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updateTransitionMatrices(int eigenIndex,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+void BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calcRateMatrixTransitionMatrices(int eigenIndex,
+                                                                     const int* probabilityIndices,
+                                                                     const int* firstDerivativeIndices,
+                                                                     const int* secondDerivativeIndices,
+                                                                     const double* edgeLengths,
+                                                                     int count) {
+    // Exponentiate on the host and upload, as there is no Pade kernel
+    const MatrixExponential* exponential = hRateMatrices[eigenIndex];
+    const int matrixSize = kStateCount * kStateCount;
+    const int* indices[3] = {probabilityIndices, firstDerivativeIndices, secondDerivativeIndices};
+    std::vector<double> workspace(exponential->getWorkspaceSize());
+    std::vector<double> matrices(3 * kCategoryCount * matrixSize);
+    
+    for (int u = 0; u < count; u++) {
+        for (int l = 0; l < kCategoryCount; l++) {
+            double* matrix = &matrices[l * matrixSize];
+            exponential->getTransitionMatrix(edgeLengths[u], hCategoryRates[l], matrix,
+                                             (firstDerivativeIndices != NULL ?
+                                              &matrices[(kCategoryCount + l) * matrixSize] : NULL),
+                                             (secondDerivativeIndices != NULL ?
+                                              &matrices[(2 * kCategoryCount + l) * matrixSize] : NULL),
+                                             &workspace[0]);
+            for (int i = 0; i < matrixSize; i++) {
+                if (matrix[i] < 0)
+                    matrix[i] = 0;
+            }
+        }
+        for (int d = 0; d < 3; d++) {
+            if (indices[d] != NULL)
+                setTransitionMatrix(indices[d][u], &matrices[d * kCategoryCount * matrixSize], 0.0);
+        }
+    }
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTransitionMatrixCacheSize(int cacheSize) {
+    if (cacheSize < 0)
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    
+    for (int i = 0; i < gMatrixCache.getCapacity() * 3; i++)
+        gpu->FreeMemory(dCachedMatrices[i]);
+    free(dCachedMatrices);
+    dCachedMatrices = NULL;
+    gMatrixCache.setCapacity(0);
+    
+    if (cacheSize > 0) {
+        dCachedMatrices = (GPUPtr*) malloc(sizeof(GPUPtr) * cacheSize * 3);
+        if (dCachedMatrices == NULL)
+            return BEAGLE_ERROR_OUT_OF_MEMORY;
+        for (int i = 0; i < cacheSize * 3; i++)
+            dCachedMatrices[i] = gpu->AllocateMemory(sizeof(Real) * kMatrixSize * kCategoryCount);
+        gMatrixCache.setCapacity(cacheSize);
+    }
+    
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getTransitionMatrixCacheStatistics(long* outHits,
+                                                                      long* outMisses) {
+    *outHits = gMatrixCache.getHits();
+    *outMisses = gMatrixCache.getMisses();
+    
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updatePartials(const int* operations,
                                   int operationCount,
@@ -1448,6 +1702,60 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updatePartials(const int* operations,
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setSparseRateMatrix(int /*eigenIndex*/,
+                                                       int /*nonZeroCount*/,
+                                                       const int* /*rowIndices*/,
+                                                       const int* /*columnIndices*/,
+                                                       const double* /*rates*/) {
+    // There is no sparse exponential kernel
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updatePartialsByEdgeLengths(int /*eigenIndex*/,
+                                                               const int* /*operations*/,
+                                                               int /*operationCount*/,
+                                                               const double* /*edgeLengths*/,
+                                                               int /*cumulativeScalingIndex*/) {
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::updateMatricesAndPartials(const int* operations,
+                                                             int operationCount,
+                                                             const int* eigenIndices,
+                                                             const double* edgeLengths,
+                                                             int cumulativeScalingIndex) {
+    // The partials kernels read matrices from device memory, so they are calculated into the
+    //  child matrix buffers of each operation first
+    for (int op = 0; op < operationCount; op++) {
+        const int probabilityIndices[2] = {operations[op * BEAGLE_OP_COUNT + 4],
+                                           operations[op * BEAGLE_OP_COUNT + 6]};
+        int returnCode = updateTransitionMatrices(eigenIndices[op], probabilityIndices, NULL, NULL,
+                                                  edgeLengths + 2 * op, 2);
+        if (returnCode != BEAGLE_SUCCESS)
+            return returnCode;
+    }
+    return updatePartials(operations, operationCount, cumulativeScalingIndex);
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setDirtyTracking(int enable) {
+    // Operations are always recomputed on the device
+    if (enable)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setExponentScalers(int enable) {
+    // The device kernels only rescale by raw or log factors
+    if (enable)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    return BEAGLE_SUCCESS;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::waitForPartials(const int* /*destinationPartials*/,
                                    int /*destinationPartialsCount*/) {
@@ -1773,6 +2081,24 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoods(const int* bu
     return returnCode;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateRootLogLikelihoodsByOperation(const int* operation,
+                                                                          int categoryWeightsIndex,
+                                                                          int stateFrequenciesIndex,
+                                                                          int cumulativeScaleIndex,
+                                                                          double* outSumLogLikelihood) {
+    // The kernels integrate partials held on the device, so the root partials are always stored
+    if (operation[0] == BEAGLE_OP_NONE)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+
+    int returnCode = updatePartials(operation, 1, cumulativeScaleIndex);
+    if (returnCode != BEAGLE_SUCCESS)
+        return returnCode;
+
+    return calculateRootLogLikelihoods(&operation[0], &categoryWeightsIndex, &stateFrequenciesIndex,
+                                       &cumulativeScaleIndex, 1, outSumLogLikelihood);
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateEdgeLogLikelihoods(const int* parentBufferIndices,
                                                const int* childBufferIndices,
@@ -2079,6 +2405,88 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateEdgeLogLikelihoods(const int* pa
     return returnCode;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateIndependentEdgeLogLikelihoods(const int* parentBufferIndices,
+                                                                              const int* childBufferIndices,
+                                                                              const int* probabilityIndices,
+                                                                              const int* firstDerivativeIndices,
+                                                                              const int* secondDerivativeIndices,
+                                                                              const int* categoryWeightsIndices,
+                                                                              const int* stateFrequenciesIndices,
+                                                                              const int* cumulativeScaleIndices,
+                                                                              int count,
+                                                                              double* outLogLikelihoods,
+                                                                              double* outFirstDerivatives,
+                                                                              double* outSecondDerivatives) {
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tEntering BeagleGPUImpl::calculateIndependentEdgeLogLikelihoods\n");
+#endif
+
+    // Each edge is queued through the single-edge kernels, one after another on the device
+    const int noScaling = BEAGLE_OP_NONE;
+    int returnCode = BEAGLE_SUCCESS;
+    for (int e = 0; e < count; e++) {
+        double firstDerivative, secondDerivative;
+        int edgeCode = calculateEdgeLogLikelihoods(&parentBufferIndices[e], &childBufferIndices[e],
+                                                   &probabilityIndices[e],
+                                                   (firstDerivativeIndices != NULL ? &firstDerivativeIndices[e] : NULL),
+                                                   (firstDerivativeIndices != NULL && secondDerivativeIndices != NULL ?
+                                                    &secondDerivativeIndices[e] : NULL),
+                                                   &categoryWeightsIndices[e], &stateFrequenciesIndices[e],
+                                                   (cumulativeScaleIndices != NULL ? &cumulativeScaleIndices[e] : &noScaling),
+                                                   1, &outLogLikelihoods[e], &firstDerivative, &secondDerivative);
+        if (firstDerivativeIndices != NULL && outFirstDerivatives != NULL)
+            outFirstDerivatives[e] = firstDerivative;
+        if (firstDerivativeIndices != NULL && secondDerivativeIndices != NULL && outSecondDerivatives != NULL)
+            outSecondDerivatives[e] = secondDerivative;
+        if (edgeCode == BEAGLE_ERROR_FLOATING_POINT)
+            returnCode = edgeCode;
+        else if (edgeCode != BEAGLE_SUCCESS)
+            return edgeCode;
+    }
+
+#ifdef BEAGLE_DEBUG_FLOW
+    fprintf(stderr, "\tLeaving  BeagleGPUImpl::calculateIndependentEdgeLogLikelihoods\n");
+#endif
+
+    return returnCode;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::projectEdgePartials(int /*parentBufferIndex*/,
+                                                           int /*childBufferIndex*/,
+                                                           int /*eigenIndex*/,
+                                                           int /*categoryWeightsIndex*/,
+                                                           int /*stateFrequenciesIndex*/,
+                                                           int /*cumulativeScaleIndex*/) {
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::calculateProjectedEdgeLogLikelihoods(double /*edgeLength*/,
+                                                                            double* /*outSumLogLikelihood*/,
+                                                                            double* /*outSumFirstDerivative*/,
+                                                                            double* /*outSumSecondDerivative*/) {
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::optimizeEdgeLengths(const int* /*parentBufferIndices*/,
+                                                           const int* /*childBufferIndices*/,
+                                                           int /*eigenIndex*/,
+                                                           int /*categoryWeightsIndex*/,
+                                                           int /*stateFrequenciesIndex*/,
+                                                           const int* /*cumulativeScaleIndices*/,
+                                                           int /*count*/,
+                                                           double /*minEdgeLength*/,
+                                                           double /*maxEdgeLength*/,
+                                                           double /*tolerance*/,
+                                                           int /*maxIterations*/,
+                                                           double* /*inOutEdgeLengths*/,
+                                                           double* /*outLogLikelihoods*/) {
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
 BEAGLE_GPU_TEMPLATE
 int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getSiteLogLikelihoods(double* outLogLikelihoods) {
 
@@ -2121,6 +2529,54 @@ int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getSiteDerivatives(double* outFirstDeriva
     return BEAGLE_SUCCESS;
 }
 
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setSiteBuffers(double* outLogLikelihoods,
+                                                      double* outFirstDerivatives,
+                                                      double* outSecondDerivatives) {
+    // Site values are reduced on the device and have to be copied back regardless
+    if (outLogLikelihoods != NULL || outFirstDerivatives != NULL || outSecondDerivatives != NULL)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::saveInstance(const char* /*fileName*/) {
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::restoreInstance(const char* /*fileName*/) {
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::cloneInstance(BeagleImpl* /*sourceInstance*/) {
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setTipData(TipData* /*tipData*/) {
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::setKernelCounting(int enable) {
+    // Kernels run asynchronously on the device, so host timers would only see them queued
+    if (enable != 0)
+        return BEAGLE_ERROR_NO_IMPLEMENTATION;
+    return BEAGLE_SUCCESS;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::getKernelCounters(BeagleKernelCounters* /*outCounters*/) {
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
+BEAGLE_GPU_TEMPLATE
+int BeagleGPUImpl<BEAGLE_GPU_GENERIC>::resetKernelCounters() {
+    return BEAGLE_ERROR_NO_IMPLEMENTATION;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // BeagleGPUImplFactory public methods
 
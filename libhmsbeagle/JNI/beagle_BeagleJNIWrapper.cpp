@@ -158,6 +158,48 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_createInstance
 	return instance;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    cloneInstance
+ * Signature: (ILbeagle/InstanceDetails;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_cloneInstance
+    (JNIEnv *env, jobject obj, jint instance, jobject outInstanceDetails)
+{
+    BeagleInstanceDetails instanceDetails;
+
+    jint clone = (jint)beagleCloneInstance(instance, &instanceDetails);
+
+	// the clone is finalized on failure here, as the caller never learns its index
+	if (clone >= 0) {
+		jclass objClass = env->FindClass("beagle/InstanceDetails");
+		if (objClass == NULL) {
+			printf("NULL returned in FindClass: can't find class: beagle/InstanceDetails\n");
+			beagleFinalizeInstance(clone);
+			return BEAGLE_ERROR_GENERAL;
+		}
+
+		jmethodID setResourceNumberMethodID = env->GetMethodID(objClass, "setResourceNumber", "(I)V");
+		if (setResourceNumberMethodID == NULL) {
+			printf("NULL returned in FindClass: can't find 'setResourceNumber' method in class: beagle/InstanceDetails\n");
+			beagleFinalizeInstance(clone);
+			return BEAGLE_ERROR_GENERAL;
+		}
+
+		jmethodID setFlagsMethodID = env->GetMethodID(objClass, "setFlags", "(J)V");
+		if (setFlagsMethodID == NULL) {
+			printf("NULL returned in FindClass: can't find 'setFlags' method in class: beagle/InstanceDetails\n");
+			beagleFinalizeInstance(clone);
+			return BEAGLE_ERROR_GENERAL;
+		}
+
+		env->CallVoidMethod(outInstanceDetails, setResourceNumberMethodID, instanceDetails.resourceNumber);
+		env->CallVoidMethod(outInstanceDetails, setFlagsMethodID, instanceDetails.flags);
+	}
+
+	return clone;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    finalize
@@ -202,6 +244,22 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipStates
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipStateMasks
+ * Signature: (II[I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipStateMasks
+(JNIEnv *env, jobject obj, jint instance, jint tipIndex, jintArray inTipStateMasks)
+{
+    jint *tipStateMasks = env->GetIntArrayElements(inTipStateMasks, NULL);
+
+	jint errCode = (jint)beagleSetTipStateMasks(instance, tipIndex, (int *)tipStateMasks);
+
+    env->ReleaseIntArrayElements(inTipStateMasks, tipStateMasks, JNI_ABORT);
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getTipStates
@@ -237,6 +295,74 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipPartials
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    createTipData
+ * Signature: (III)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_createTipData
+(JNIEnv *env, jobject obj, jint tipCount, jint stateCount, jint patternCount)
+{
+	jint tipData = (jint)beagleCreateTipData(tipCount, stateCount, patternCount);
+    return tipData;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipDataStates
+ * Signature: (II[I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipDataStates
+(JNIEnv *env, jobject obj, jint tipData, jint tipIndex, jintArray inTipStates)
+{
+    jint *tipStates = env->GetIntArrayElements(inTipStates, NULL);
+    
+	jint errCode = (jint)beagleSetTipDataStates(tipData, tipIndex, (int *)tipStates);
+    
+    env->ReleaseIntArrayElements(inTipStates, tipStates, JNI_ABORT);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipDataPartials
+ * Signature: (II[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipDataPartials
+(JNIEnv *env, jobject obj, jint tipData, jint tipIndex, jdoubleArray inPartials)
+{
+    jdouble *partials = env->GetDoubleArrayElements(inPartials, NULL);
+    
+	jint errCode = (jint)beagleSetTipDataPartials(tipData, tipIndex, (double *)partials);
+    
+    env->ReleaseDoubleArrayElements(inPartials, partials, JNI_ABORT);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipData
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipData
+(JNIEnv *env, jobject obj, jint instance, jint tipData)
+{
+	jint errCode = (jint)beagleSetTipData(instance, tipData);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    finalizeTipData
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_finalizeTipData
+(JNIEnv *env, jobject obj, jint tipData)
+{
+	jint errCode = (jint)beagleFinalizeTipData(tipData);
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    setPartials
@@ -291,6 +417,23 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setEigenDecomposition
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setRateMatrix
+ * Signature: (II[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setRateMatrix
+(JNIEnv *env, jobject obj, jint instance, jint eigenIndex, jdoubleArray inRateMatrix)
+{
+    jdouble *rateMatrix = env->GetDoubleArrayElements(inRateMatrix, NULL);
+
+	jint errCode = (jint)beagleSetRateMatrix(instance, eigenIndex, (double *)rateMatrix);
+
+    env->ReleaseDoubleArrayElements(inRateMatrix, rateMatrix, JNI_ABORT);
+
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    setStateFrequencies
@@ -433,6 +576,37 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updateTransitionMatrices
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTransitionMatrixCacheSize
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTransitionMatrixCacheSize
+  (JNIEnv *env, jobject obj, jint instance, jint cacheSize)
+{
+    jint errCode = (jint)beagleSetTransitionMatrixCacheSize(instance, cacheSize);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getTransitionMatrixCacheStatistics
+ * Signature: (I[J)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getTransitionMatrixCacheStatistics
+  (JNIEnv *env, jobject obj, jint instance, jlongArray outStatistics)
+{
+    long hits;
+    long misses;
+
+    jint errCode = (jint)beagleGetTransitionMatrixCacheStatistics(instance, &hits, &misses);
+
+    jlong statistics[2] = { (jlong)hits, (jlong)misses };
+    env->SetLongArrayRegion(outStatistics, 0, 2, statistics);
+
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    updatePartials
@@ -450,6 +624,91 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartials
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setSparseRateMatrix
+ * Signature: (III[I[I[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setSparseRateMatrix
+  (JNIEnv *env, jobject obj, jint instance, jint eigenIndex, jint nonZeroCount, jintArray inRowIndices, jintArray inColumnIndices, jdoubleArray inRates)
+{
+    jint *rowIndices = env->GetIntArrayElements(inRowIndices, NULL);
+    jint *columnIndices = env->GetIntArrayElements(inColumnIndices, NULL);
+    jdouble *rates = env->GetDoubleArrayElements(inRates, NULL);
+
+    jint errCode = (jint)beagleSetSparseRateMatrix(instance, eigenIndex, nonZeroCount, (int *)rowIndices, (int *)columnIndices, (double *)rates);
+
+    env->ReleaseDoubleArrayElements(inRates, rates, JNI_ABORT);
+    env->ReleaseIntArrayElements(inColumnIndices, columnIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inRowIndices, rowIndices, JNI_ABORT);
+
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    updatePartialsByEdgeLengths
+ * Signature: (II[II[DI)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartialsByEdgeLengths
+  (JNIEnv *env, jobject obj, jint instance, jint eigenIndex, jintArray inOperations, jint operationCount, jdoubleArray inEdgeLengths, jint cumulativeScalingIndex)
+{
+    jint *operations = env->GetIntArrayElements(inOperations, NULL);
+    jdouble *edgeLengths = env->GetDoubleArrayElements(inEdgeLengths, NULL);
+
+    jint errCode = (jint)beagleUpdatePartialsByEdgeLengths(instance, eigenIndex, (BeagleOperation*)operations, operationCount, (double *)edgeLengths, cumulativeScalingIndex);
+
+    env->ReleaseDoubleArrayElements(inEdgeLengths, edgeLengths, JNI_ABORT);
+    env->ReleaseIntArrayElements(inOperations, operations, JNI_ABORT);
+
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    updateMatricesAndPartials
+ * Signature: (I[II[I[DI)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updateMatricesAndPartials
+  (JNIEnv *env, jobject obj, jint instance, jintArray inOperations, jint operationCount, jintArray inEigenIndices, jdoubleArray inEdgeLengths, jint cumulativeScalingIndex)
+{
+    jint *operations = env->GetIntArrayElements(inOperations, NULL);
+    jint *eigenIndices = env->GetIntArrayElements(inEigenIndices, NULL);
+    jdouble *edgeLengths = env->GetDoubleArrayElements(inEdgeLengths, NULL);
+
+    jint errCode = (jint)beagleUpdateMatricesAndPartials(instance, (BeagleOperation*)operations, operationCount, (int *)eigenIndices, (double *)edgeLengths, cumulativeScalingIndex);
+
+    env->ReleaseDoubleArrayElements(inEdgeLengths, edgeLengths, JNI_ABORT);
+    env->ReleaseIntArrayElements(inEigenIndices, eigenIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inOperations, operations, JNI_ABORT);
+
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setDirtyTracking
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setDirtyTracking
+  (JNIEnv *env, jobject obj, jint instance, jint enable)
+{
+    jint errCode = (jint)beagleSetDirtyTracking(instance, enable);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setExponentScalers
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setExponentScalers
+  (JNIEnv *env, jobject obj, jint instance, jint enable)
+{
+    jint errCode = (jint)beagleSetExponentScalers(instance, enable);
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    waitForPartials
@@ -522,6 +781,41 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_copyScaleFactors
 }
 
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    optimizeEdgeLengths
+ * Signature: (I[I[IIII[IIDDDI[D[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_optimizeEdgeLengths
+  (JNIEnv *env, jobject obj, jint instance, jintArray inParentBufferIndices, jintArray inChildBufferIndices,
+        jint eigenIndex, jint categoryWeightsIndex, jint stateFrequenciesIndex, jintArray inScalingIndices,
+        jint count, jdouble minEdgeLength, jdouble maxEdgeLength, jdouble tolerance, jint maxIterations,
+        jdoubleArray inOutEdgeLengths, jdoubleArray outLogLikelihoods)
+{
+    jint *parentBufferIndices = env->GetIntArrayElements(inParentBufferIndices, NULL);
+    jint *childBufferIndices = env->GetIntArrayElements(inChildBufferIndices, NULL);
+    jint *scalingIndices = (inScalingIndices != NULL ? env->GetIntArrayElements(inScalingIndices, NULL) : NULL);
+    jdouble *edgeLengths = env->GetDoubleArrayElements(inOutEdgeLengths, NULL);
+    jdouble *logLikelihoods = env->GetDoubleArrayElements(outLogLikelihoods, NULL);
+
+    jint errCode = (jint)beagleOptimizeEdgeLengths(instance, (int *)parentBufferIndices, (int *)childBufferIndices,
+                                                   eigenIndex, categoryWeightsIndex, stateFrequenciesIndex,
+                                                   (int *)scalingIndices, count, minEdgeLength, maxEdgeLength,
+                                                   tolerance, maxIterations, (double *)edgeLengths,
+                                                   (double *)logLikelihoods);
+
+    // not using JNI_ABORT flag here because we want the values to be copied back...
+    env->ReleaseDoubleArrayElements(outLogLikelihoods, logLikelihoods, 0);
+    env->ReleaseDoubleArrayElements(inOutEdgeLengths, edgeLengths, 0);
+
+    if (scalingIndices != NULL)
+        env->ReleaseIntArrayElements(inScalingIndices, scalingIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inChildBufferIndices, childBufferIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inParentBufferIndices, parentBufferIndices, JNI_ABORT);
+
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    calculateRootLogLikelihoods
@@ -558,6 +852,31 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoods
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateRootLogLikelihoodsByOperation
+ * Signature: (I[IIII[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoodsByOperation
+  (JNIEnv *env, jobject obj, jint instance, jintArray inOperation, jint categoryWeightsIndex,
+   jint stateFrequenciesIndex, jint cumulativeScaleIndex, jdoubleArray outSumLogLikelihood)
+{
+    jint *operation = env->GetIntArrayElements(inOperation, NULL);
+    jdouble *sumLogLikelihood = env->GetDoubleArrayElements(outSumLogLikelihood, NULL);
+
+    jint errCode = (jint)beagleCalculateRootLogLikelihoodsByOperation(instance, (BeagleOperation*)operation,
+                                                                       categoryWeightsIndex,
+                                                                       stateFrequenciesIndex,
+                                                                       cumulativeScaleIndex,
+                                                                       (double *)sumLogLikelihood);
+
+    // not using JNI_ABORT flag here because we want the values to be copied back...
+    env->ReleaseDoubleArrayElements(outSumLogLikelihood, sumLogLikelihood, 0);
+    env->ReleaseIntArrayElements(inOperation, operation, JNI_ABORT);
+
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    calculateEdgeLogLikelihoods
@@ -614,6 +933,109 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateEdgeLogLikelihoods
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateIndependentEdgeLogLikelihoods
+ * Signature: (I[I[I[I[I[I[I[I[II[D[D[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateIndependentEdgeLogLikelihoods
+  (JNIEnv *env, jobject obj, jint instance, jintArray inParentBufferIndices, jintArray inChildBufferIndices,
+        jintArray inProbabilityIndices, jintArray inFirstDerivativeIndices, jintArray inSecondDerivativeIndices,
+        jintArray inCategoryWeightsIndices, jintArray inStateFrequenciesIndices, jintArray inScalingIndices,
+        jint count, jdoubleArray outLogLikelihoods, jdoubleArray outFirstDerivatives, jdoubleArray outSecondDerivatives)
+{
+    jint *parentBufferIndices = env->GetIntArrayElements(inParentBufferIndices, NULL);
+    jint *childBufferIndices = env->GetIntArrayElements(inChildBufferIndices, NULL);
+    jint *probabilityIndices = env->GetIntArrayElements(inProbabilityIndices, NULL);
+    // derivatives and scaling are optional, so their arrays may be null
+    jint *firstDerivativeIndices = (inFirstDerivativeIndices != NULL ?
+                                    env->GetIntArrayElements(inFirstDerivativeIndices, NULL) : NULL);
+    jint *secondDerivativeIndices = (inSecondDerivativeIndices != NULL ?
+                                     env->GetIntArrayElements(inSecondDerivativeIndices, NULL) : NULL);
+    jint *weightsIndices = env->GetIntArrayElements(inCategoryWeightsIndices, NULL);
+    jint *frequenciesIndices = env->GetIntArrayElements(inStateFrequenciesIndices, NULL);
+    jint *scalingIndices = (inScalingIndices != NULL ? env->GetIntArrayElements(inScalingIndices, NULL) : NULL);
+
+    jdouble *logLikelihoods = env->GetDoubleArrayElements(outLogLikelihoods, NULL);
+    jdouble *firstDerivatives = (outFirstDerivatives != NULL ?
+                                 env->GetDoubleArrayElements(outFirstDerivatives, NULL) : NULL);
+    jdouble *secondDerivatives = (outSecondDerivatives != NULL ?
+                                  env->GetDoubleArrayElements(outSecondDerivatives, NULL) : NULL);
+
+    jint errCode = (jint)beagleCalculateIndependentEdgeLogLikelihoods(instance, (int *)parentBufferIndices,
+                                                                      (int *)childBufferIndices,
+                                                                      (int *)probabilityIndices,
+                                                                      (int *)firstDerivativeIndices,
+                                                                      (int *)secondDerivativeIndices,
+                                                                      (int *)weightsIndices,
+                                                                      (int *)frequenciesIndices,
+                                                                      (int *)scalingIndices,
+                                                                      count,
+                                                                      (double *)logLikelihoods,
+                                                                      (double *)firstDerivatives,
+                                                                      (double *)secondDerivatives);
+
+    // not using JNI_ABORT flag here because we want the values to be copied back...
+    if (secondDerivatives != NULL)
+        env->ReleaseDoubleArrayElements(outSecondDerivatives, secondDerivatives, 0);
+    if (firstDerivatives != NULL)
+        env->ReleaseDoubleArrayElements(outFirstDerivatives, firstDerivatives, 0);
+    env->ReleaseDoubleArrayElements(outLogLikelihoods, logLikelihoods, 0);
+
+    if (scalingIndices != NULL)
+        env->ReleaseIntArrayElements(inScalingIndices, scalingIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inStateFrequenciesIndices, frequenciesIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inCategoryWeightsIndices, weightsIndices, JNI_ABORT);
+    if (secondDerivativeIndices != NULL)
+        env->ReleaseIntArrayElements(inSecondDerivativeIndices, secondDerivativeIndices, JNI_ABORT);
+    if (firstDerivativeIndices != NULL)
+        env->ReleaseIntArrayElements(inFirstDerivativeIndices, firstDerivativeIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inProbabilityIndices, probabilityIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inChildBufferIndices, childBufferIndices, JNI_ABORT);
+    env->ReleaseIntArrayElements(inParentBufferIndices, parentBufferIndices, JNI_ABORT);
+
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    projectEdgePartials
+ * Signature: (IIIIIII)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_projectEdgePartials
+  (JNIEnv *env, jobject obj, jint instance, jint parentBufferIndex, jint childBufferIndex, jint eigenIndex,
+        jint categoryWeightsIndex, jint stateFrequenciesIndex, jint cumulativeScaleIndex)
+{
+    jint errCode = (jint)beagleProjectEdgePartials(instance, parentBufferIndex, childBufferIndex, eigenIndex,
+                                                   categoryWeightsIndex, stateFrequenciesIndex, cumulativeScaleIndex);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateProjectedEdgeLogLikelihoods
+ * Signature: (ID[D[D[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateProjectedEdgeLogLikelihoods
+  (JNIEnv *env, jobject obj, jint instance, jdouble edgeLength, jdoubleArray outSumLogLikelihoods,
+        jdoubleArray outSumFirstDerivatives, jdoubleArray outSumSecondDerivatives)
+{
+    jdouble *sumLogLikelihoods = env->GetDoubleArrayElements(outSumLogLikelihoods, NULL);
+    jdouble *sumFirstDerivatives = env->GetDoubleArrayElements(outSumFirstDerivatives, NULL);
+    jdouble *sumSecondDerivatives = env->GetDoubleArrayElements(outSumSecondDerivatives, NULL);
+
+    jint errCode = (jint)beagleCalculateProjectedEdgeLogLikelihoods(instance, edgeLength, (double *)sumLogLikelihoods,
+                                                                    (double *)sumFirstDerivatives,
+                                                                    (double *)sumSecondDerivatives);
+
+    // not using JNI_ABORT flag here because we want the values to be copied back...
+    env->ReleaseDoubleArrayElements(outSumSecondDerivatives, sumSecondDerivatives, 0);
+    env->ReleaseDoubleArrayElements(outSumFirstDerivatives, sumFirstDerivatives, 0);
+    env->ReleaseDoubleArrayElements(outSumLogLikelihoods, sumLogLikelihoods, 0);
+
+    return errCode;
+}
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getSiteLogLikelihoods
@@ -631,6 +1053,86 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getSiteLogLikelihoods
     return errCode;
 }
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    saveInstance
+ * Signature: (ILjava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_saveInstance
+  (JNIEnv *env, jobject obj, jint instance, jstring inFileName)
+{
+    const char *fileName = env->GetStringUTFChars(inFileName, NULL);
+    jint errCode = (jint)beagleSaveInstance(instance, fileName);
+    env->ReleaseStringUTFChars(inFileName, fileName);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    restoreInstance
+ * Signature: (ILjava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_restoreInstance
+  (JNIEnv *env, jobject obj, jint instance, jstring inFileName)
+{
+    const char *fileName = env->GetStringUTFChars(inFileName, NULL);
+    jint errCode = (jint)beagleRestoreInstance(instance, fileName);
+    env->ReleaseStringUTFChars(inFileName, fileName);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setKernelCounting
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setKernelCounting
+  (JNIEnv *env, jobject obj, jint instance, jint enable)
+{
+    jint errCode = (jint)beagleSetKernelCounting(instance, enable);
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getKernelCounters
+ * Signature: (I[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getKernelCounters
+  (JNIEnv *env, jobject obj, jint instance, jdoubleArray outCounters)
+{
+    BeagleKernelCounters counters[BEAGLE_KERNEL_CLASS_COUNT];
+
+    jint errCode = (jint)beagleGetKernelCounters(instance, counters);
+
+    if (errCode == BEAGLE_SUCCESS) {
+        // five values per kernel class, in the order of BeagleKernelCounters
+        jdouble values[5 * BEAGLE_KERNEL_CLASS_COUNT];
+        for (int i = 0; i < BEAGLE_KERNEL_CLASS_COUNT; i++) {
+            values[5 * i] = (jdouble)counters[i].callCount;
+            values[5 * i + 1] = counters[i].seconds;
+            values[5 * i + 2] = counters[i].elementCount;
+            values[5 * i + 3] = counters[i].flopCount;
+            values[5 * i + 4] = counters[i].byteCount;
+        }
+        env->SetDoubleArrayRegion(outCounters, 0, 5 * BEAGLE_KERNEL_CLASS_COUNT, values);
+    }
+
+    return errCode;
+}
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    resetKernelCounters
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_resetKernelCounters
+  (JNIEnv *env, jobject obj, jint instance)
+{
+    jint errCode = (jint)beagleResetKernelCounters(instance);
+    return errCode;
+}
+
 //void __attribute__ ((constructor)) beagle_jni_library_initialize(void) {
 //	
 //}
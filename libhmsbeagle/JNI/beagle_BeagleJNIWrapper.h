@@ -39,6 +39,14 @@ JNIEXPORT jobjectArray JNICALL Java_beagle_BeagleJNIWrapper_getResourceList
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_createInstance
   (JNIEnv *, jobject, jint, jint, jint, jint, jint, jint, jint, jint, jint, jintArray, jint, jlong, jlong, jobject);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    cloneInstance
+ * Signature: (ILbeagle/InstanceDetails;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_cloneInstance
+  (JNIEnv *, jobject, jint, jobject);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    finalize
@@ -63,6 +71,14 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setPatternWeights
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipStates
   (JNIEnv *, jobject, jint, jint, jintArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipStateMasks
+ * Signature: (II[I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipStateMasks
+  (JNIEnv *, jobject, jint, jint, jintArray);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getTipStates
@@ -79,6 +95,46 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getTipStates
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipPartials
   (JNIEnv *, jobject, jint, jint, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    createTipData
+ * Signature: (III)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_createTipData
+  (JNIEnv *, jobject, jint, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipDataStates
+ * Signature: (II[I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipDataStates
+  (JNIEnv *, jobject, jint, jint, jintArray);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipDataPartials
+ * Signature: (II[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipDataPartials
+  (JNIEnv *, jobject, jint, jint, jdoubleArray);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTipData
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTipData
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    finalizeTipData
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_finalizeTipData
+  (JNIEnv *, jobject, jint);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    setPartials
@@ -103,6 +159,14 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getPartials
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setEigenDecomposition
   (JNIEnv *, jobject, jint, jint, jdoubleArray, jdoubleArray, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setRateMatrix
+ * Signature: (II[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setRateMatrix
+  (JNIEnv *, jobject, jint, jint, jdoubleArray);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    setStateFrequencies
@@ -159,6 +223,22 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_convolveTransitionMatrices
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updateTransitionMatrices
   (JNIEnv *, jobject, jint, jint, jintArray, jintArray, jintArray, jdoubleArray, jint);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setTransitionMatrixCacheSize
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setTransitionMatrixCacheSize
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getTransitionMatrixCacheStatistics
+ * Signature: (I[J)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getTransitionMatrixCacheStatistics
+  (JNIEnv *, jobject, jint, jlongArray);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    updatePartials
@@ -167,6 +247,46 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updateTransitionMatrices
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartials
   (JNIEnv *, jobject, jint, jintArray, jint, jint);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setSparseRateMatrix
+ * Signature: (III[I[I[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setSparseRateMatrix
+  (JNIEnv *, jobject, jint, jint, jint, jintArray, jintArray, jdoubleArray);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    updatePartialsByEdgeLengths
+ * Signature: (II[II[DI)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updatePartialsByEdgeLengths
+  (JNIEnv *, jobject, jint, jint, jintArray, jint, jdoubleArray, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    updateMatricesAndPartials
+ * Signature: (I[II[I[DI)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_updateMatricesAndPartials
+  (JNIEnv *, jobject, jint, jintArray, jint, jintArray, jdoubleArray, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setDirtyTracking
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setDirtyTracking
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setExponentScalers
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setExponentScalers
+  (JNIEnv *, jobject, jint, jint);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    waitForPartials
@@ -215,6 +335,14 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_copyScaleFactors
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoods
   (JNIEnv *, jobject, jint, jintArray, jintArray, jintArray, jintArray, jint, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateRootLogLikelihoodsByOperation
+ * Signature: (I[IIII[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoodsByOperation
+  (JNIEnv *, jobject, jint, jintArray, jint, jint, jint, jdoubleArray);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    calculateEdgeLogLikelihoods
@@ -223,6 +351,38 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateRootLogLikelihoods
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateEdgeLogLikelihoods
   (JNIEnv *, jobject, jint, jintArray, jintArray, jintArray, jintArray, jintArray, jintArray, jintArray, jintArray, jint, jdoubleArray, jdoubleArray, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateIndependentEdgeLogLikelihoods
+ * Signature: (I[I[I[I[I[I[I[I[II[D[D[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateIndependentEdgeLogLikelihoods
+  (JNIEnv *, jobject, jint, jintArray, jintArray, jintArray, jintArray, jintArray, jintArray, jintArray, jintArray, jint, jdoubleArray, jdoubleArray, jdoubleArray);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    projectEdgePartials
+ * Signature: (IIIIIII)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_projectEdgePartials
+  (JNIEnv *, jobject, jint, jint, jint, jint, jint, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    calculateProjectedEdgeLogLikelihoods
+ * Signature: (ID[D[D[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateProjectedEdgeLogLikelihoods
+  (JNIEnv *, jobject, jint, jdouble, jdoubleArray, jdoubleArray, jdoubleArray);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    optimizeEdgeLengths
+ * Signature: (I[I[IIII[IIDDDI[D[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_optimizeEdgeLengths
+  (JNIEnv *, jobject, jint, jintArray, jintArray, jint, jint, jint, jintArray, jint, jdouble, jdouble, jdouble, jint, jdoubleArray, jdoubleArray);
+
 /*
  * Class:     beagle_BeagleJNIWrapper
  * Method:    getSiteLogLikelihoods
@@ -231,6 +391,46 @@ JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_calculateEdgeLogLikelihoods
 JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getSiteLogLikelihoods
   (JNIEnv *, jobject, jint, jdoubleArray);
 
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    saveInstance
+ * Signature: (ILjava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_saveInstance
+  (JNIEnv *, jobject, jint, jstring);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    restoreInstance
+ * Signature: (ILjava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_restoreInstance
+  (JNIEnv *, jobject, jint, jstring);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    setKernelCounting
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_setKernelCounting
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    getKernelCounters
+ * Signature: (I[D)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_getKernelCounters
+  (JNIEnv *, jobject, jint, jdoubleArray);
+
+/*
+ * Class:     beagle_BeagleJNIWrapper
+ * Method:    resetKernelCounters
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_beagle_BeagleJNIWrapper_resetKernelCounters
+  (JNIEnv *, jobject, jint);
+
 #ifdef __cplusplus
 }
 #endif
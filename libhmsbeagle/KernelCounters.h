@@ -0,0 +1,156 @@
+/*
+ *  KernelCounters.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_kernel_counters__
+#define __beagle_kernel_counters__
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#include "libhmsbeagle/beagle.h"
+
+namespace beagle {
+
+/*
+ * Call counts, wall time and estimated work of the kernels of one instance, by
+ *  BeagleKernelClasses. Counting is off until enabled, and costs a branch per kernel
+ *  call while off. Work is recorded in units of one pattern and category, or of one
+ *  transition matrix and category, and converted to elements, flops and bytes by a
+ *  simple model of the reference kernels for the state count and precision.
+ */
+class KernelCounters {
+public:
+    KernelCounters() : kEnabled(false) {
+        reset();
+    }
+
+    void setEnabled(bool enabled) { kEnabled = enabled; }
+
+    bool isEnabled() const { return kEnabled; }
+
+    void reset() {
+        memset(gCounters, 0, sizeof(gCounters));
+    }
+
+    // copies BEAGLE_KERNEL_CLASS_COUNT entries
+    void get(BeagleKernelCounters* outCounters) const {
+        memcpy(outCounters, gCounters, sizeof(gCounters));
+    }
+
+    // returns the time to pass to record, or 0 while counting is off
+    double start() const {
+        return (kEnabled ? getTime() : 0.0);
+    }
+
+    // records one call of a kernel class started at startTime
+    void record(int kernelClass,
+                double startTime,
+                double units,
+                int stateCount,
+                int realSize) {
+        if (!kEnabled)
+            return;
+        const double seconds = getTime() - startTime;
+        const double s = stateCount;
+        double elements = units * s;
+        double flops;
+        double reals;
+        double ints = 0.0;
+        switch (kernelClass) {
+            case BEAGLE_KERNEL_TRANSITION_MATRICES:
+                elements = units * s * s;       // a matrix per unit, each entry a sum over the eigenvalues
+                flops = elements * 3.0 * s;
+                reals = elements;
+                break;
+            case BEAGLE_KERNEL_STATES_STATES:
+                flops = units * s;              // a product of two matrix entries per state
+                reals = units * s;
+                ints = 2.0 * units;
+                break;
+            case BEAGLE_KERNEL_STATES_PARTIALS:
+                flops = units * (2.0 * s * s + s);
+                reals = 2.0 * units * s;
+                ints = units;
+                break;
+            case BEAGLE_KERNEL_PARTIALS_PARTIALS:
+                flops = units * (4.0 * s * s + s);
+                reals = 3.0 * units * s;
+                break;
+            case BEAGLE_KERNEL_RESCALE:
+                flops = 2.0 * units * s;        // a search for the largest value, then a division
+                reals = 2.0 * units * s;
+                break;
+            case BEAGLE_KERNEL_ROOT:
+                flops = 2.0 * units * s;
+                reals = units * s;
+                break;
+            case BEAGLE_KERNEL_EDGE:
+                flops = units * (2.0 * s * s + 2.0 * s);
+                reals = 2.0 * units * s;
+                break;
+            default:                            // the edge, and two derivatives with it
+                flops = 3.0 * units * (2.0 * s * s + 2.0 * s);
+                reals = 2.0 * units * s;
+                break;
+        }
+        BeagleKernelCounters& counters = gCounters[kernelClass];
+        counters.callCount++;
+        counters.seconds += seconds;
+        counters.elementCount += elements;
+        counters.flopCount += flops;
+        counters.byteCount += reals * realSize + ints * sizeof(int);
+    }
+
+    // seconds since an arbitrary origin, from a monotonic clock where there is one
+    static double getTime() {
+#ifdef _WIN32
+        LARGE_INTEGER count;
+        LARGE_INTEGER frequency;
+        QueryPerformanceCounter(&count);
+        QueryPerformanceFrequency(&frequency);
+        return (double) count.QuadPart / (double) frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec + now.tv_nsec * 1.0e-9;
+#else
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        return now.tv_sec + now.tv_usec * 1.0e-6;
+#endif
+    }
+
+private:
+    bool kEnabled;
+    BeagleKernelCounters gCounters[BEAGLE_KERNEL_CLASS_COUNT];
+};
+
+}
+
+#endif // __beagle_kernel_counters__
@@ -0,0 +1,211 @@
+/*
+ *  MatrixExponential.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_matrix_exponential__
+#define __beagle_matrix_exponential__
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace beagle {
+
+/*
+ * Computes P(t) = exp(Q r t) for a rate matrix Q by diagonal Pade approximation with scaling
+ *  and squaring (Moler and Van Loan, 2003). The powers of Q are formed once in setRateMatrix,
+ *  so each edge length and rate only costs one linear solve and the squarings. A const
+ *  instance may be shared between threads as long as each thread uses its own workspace.
+ */
+class MatrixExponential {
+public:
+    MatrixExponential(int stateCount)
+        : kStateCount(stateCount),
+          kMatrixSize(stateCount * stateCount),
+          gPowers((PADE_DEGREE + 1) * stateCount * stateCount),
+          kNorm(0.0) {}
+
+    // sets the rate matrix, stored row-major with rows summing to zero
+    void setRateMatrix(const double* inRateMatrix) {
+        double* identity = &gPowers[0];
+        memset(identity, 0, sizeof(double) * kMatrixSize);
+        for (int i = 0; i < kStateCount; i++)
+            identity[i * kStateCount + i] = 1.0;
+        memcpy(&gPowers[kMatrixSize], inRateMatrix, sizeof(double) * kMatrixSize);
+        for (int k = 2; k <= PADE_DEGREE; k++)
+            multiply(&gPowers[(k - 1) * kMatrixSize], inRateMatrix, &gPowers[k * kMatrixSize]);
+
+        kNorm = 0.0;
+        for (int i = 0; i < kStateCount; i++) {
+            double rowSum = 0.0;
+            for (int j = 0; j < kStateCount; j++)
+                rowSum += fabs(inRateMatrix[i * kStateCount + j]);
+            if (rowSum > kNorm)
+                kNorm = rowSum;
+        }
+    }
+
+    // returns the rate matrix last set
+    const double* getRateMatrix() const {
+        return &gPowers[kMatrixSize];
+    }
+
+    // number of doubles of scratch space needed by getTransitionMatrix
+    int getWorkspaceSize() const {
+        return 3 * kMatrixSize;
+    }
+
+    // calculates the kStateCount x kStateCount row-major transition matrix for a distance of
+    // rate * edgeLength, and its first and second derivatives with respect to edgeLength
+    // unless outFirstDerivative or outSecondDerivative are NULL
+    void getTransitionMatrix(double edgeLength,
+                             double rate,
+                             double* outMatrix,
+                             double* outFirstDerivative,
+                             double* outSecondDerivative,
+                             double* workspace) const {
+        const double distance = rate * edgeLength;
+        double* numerator = workspace;
+        double* denominator = workspace + kMatrixSize;
+        double* scratch = workspace + 2 * kMatrixSize;
+
+        int squarings = 0;
+        if (kNorm * fabs(distance) > 0.5)
+            squarings = (int) ceil(log(kNorm * fabs(distance) / 0.5) / log(2.0));
+        const double scaledDistance = ldexp(distance, -squarings);
+
+        // N = sum c_k A^k and D = sum (-1)^k c_k A^k with A = Q * scaledDistance
+        memset(numerator, 0, sizeof(double) * kMatrixSize);
+        memset(denominator, 0, sizeof(double) * kMatrixSize);
+        double coefficient = 1.0;
+        double scale = 1.0;
+        for (int k = 0; k <= PADE_DEGREE; k++) {
+            if (k > 0) {
+                coefficient *= (double) (PADE_DEGREE - k + 1) / (k * (2 * PADE_DEGREE - k + 1));
+                scale *= scaledDistance;
+            }
+            const double term = coefficient * scale;
+            const double signedTerm = (k % 2 ? -term : term);
+            const double* power = &gPowers[k * kMatrixSize];
+            for (int i = 0; i < kMatrixSize; i++) {
+                numerator[i] += term * power[i];
+                denominator[i] += signedTerm * power[i];
+            }
+        }
+
+        solve(denominator, numerator);
+
+        double* result = numerator;
+        for (int s = 0; s < squarings; s++) {
+            multiply(result, result, scratch);
+            double* swap = result;
+            result = scratch;
+            scratch = swap;
+        }
+        memcpy(outMatrix, result, sizeof(double) * kMatrixSize);
+
+        // dP/dt = r Q P and d2P/dt2 = r^2 Q^2 P
+        if (outFirstDerivative != NULL) {
+            multiply(&gPowers[kMatrixSize], outMatrix, outFirstDerivative);
+            for (int i = 0; i < kMatrixSize; i++)
+                outFirstDerivative[i] *= rate;
+        }
+        if (outSecondDerivative != NULL) {
+            multiply(&gPowers[2 * kMatrixSize], outMatrix, outSecondDerivative);
+            for (int i = 0; i < kMatrixSize; i++)
+                outSecondDerivative[i] *= rate * rate;
+        }
+    }
+
+private:
+    enum { PADE_DEGREE = 7 };
+
+    // C = A * B, with the inner loop running over contiguous rows of B and C
+    void multiply(const double* A,
+                  const double* B,
+                  double* C) const {
+        memset(C, 0, sizeof(double) * kMatrixSize);
+        for (int i = 0; i < kStateCount; i++) {
+            double* rowC = C + i * kStateCount;
+            for (int k = 0; k < kStateCount; k++) {
+                const double a = A[i * kStateCount + k];
+                const double* rowB = B + k * kStateCount;
+                for (int j = 0; j < kStateCount; j++)
+                    rowC[j] += a * rowB[j];
+            }
+        }
+    }
+
+    // overwrites B with A^-1 B by Gaussian elimination with partial pivoting, destroying A
+    void solve(double* A,
+               double* B) const {
+        const int n = kStateCount;
+        for (int k = 0; k < n; k++) {
+            int pivot = k;
+            for (int i = k + 1; i < n; i++) {
+                if (fabs(A[i * n + k]) > fabs(A[pivot * n + k]))
+                    pivot = i;
+            }
+            if (pivot != k) {
+                for (int j = 0; j < n; j++) {
+                    double tmp = A[k * n + j];
+                    A[k * n + j] = A[pivot * n + j];
+                    A[pivot * n + j] = tmp;
+                    tmp = B[k * n + j];
+                    B[k * n + j] = B[pivot * n + j];
+                    B[pivot * n + j] = tmp;
+                }
+            }
+            const double inverse = 1.0 / A[k * n + k];
+            for (int i = k + 1; i < n; i++) {
+                const double factor = A[i * n + k] * inverse;
+                if (factor == 0.0)
+                    continue;
+                for (int j = k + 1; j < n; j++)
+                    A[i * n + j] -= factor * A[k * n + j];
+                for (int j = 0; j < n; j++)
+                    B[i * n + j] -= factor * B[k * n + j];
+            }
+        }
+        for (int k = n - 1; k >= 0; k--) {
+            const double inverse = 1.0 / A[k * n + k];
+            for (int j = 0; j < n; j++)
+                B[k * n + j] *= inverse;
+            for (int i = 0; i < k; i++) {
+                const double factor = A[i * n + k];
+                if (factor == 0.0)
+                    continue;
+                for (int j = 0; j < n; j++)
+                    B[i * n + j] -= factor * B[k * n + j];
+            }
+        }
+    }
+
+    int kStateCount;
+    int kMatrixSize;
+    std::vector<double> gPowers; /// I, Q, Q^2, ..., Q^PADE_DEGREE
+    double kNorm;                /// infinity norm of Q
+};
+
+}
+
+#endif // __beagle_matrix_exponential__
@@ -0,0 +1,82 @@
+/*
+ *  SharedBuffer.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_shared_buffer__
+#define __beagle_shared_buffer__
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+namespace beagle {
+
+/*
+ * Reference count on a read-only buffer that several instances, or the tip data store,
+ *  point to. An instance about to write to a shared buffer takes a private copy first,
+ *  and the last holder to let go of the buffer frees it, unless the buffer is client
+ *  memory, which is never written or freed.
+ */
+class SharedBuffer {
+public:
+    // the holder creating the count holds the first reference
+    SharedBuffer(bool clientMemory = false) : kReferences(1), kClientMemory(clientMemory) {}
+
+    void retain() {
+#ifdef WIN32
+        InterlockedIncrement(&kReferences);
+#else
+        __sync_add_and_fetch(&kReferences, 1);
+#endif
+    }
+
+    // drops one reference; returns true if it was the last, when the caller frees the buffer
+    bool release() {
+#ifdef WIN32
+        return (InterlockedDecrement(&kReferences) == 0);
+#else
+        return (__sync_sub_and_fetch(&kReferences, 1) == 0);
+#endif
+    }
+
+    // true if the caller holds the only reference, which no one else can then take
+    bool isUnique() const {
+        return (kReferences == 1);
+    }
+
+    // true if the buffer belongs to the client rather than to the holders
+    bool isClientMemory() const {
+        return kClientMemory;
+    }
+
+private:
+#ifdef WIN32
+    volatile LONG kReferences;
+#else
+    volatile long kReferences;
+#endif
+    bool kClientMemory;
+};
+
+}
+
+#endif // __beagle_shared_buffer__
@@ -0,0 +1,202 @@
+/*
+ *  TipData.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_tip_data__
+#define __beagle_tip_data__
+
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <vector>
+
+#include "libhmsbeagle/SharedBuffer.h"
+
+#define BEAGLE_TIP_DATA_PATTERN_MODULUS 4 // Tip states are padded for pattern moduli dividing this
+
+namespace beagle {
+
+/*
+ * Tip states and partials of one alignment, set once and referenced by any number of
+ *  instances. Tip states are held padded, with missing data as stateCount, so that
+ *  instances can point at them directly. Tip partials are held as set; the buffers an
+ *  implementation converts them into are kept here by layout, for the next instance
+ *  with the same layout to point at. Every buffer has a SharedBuffer count, of which
+ *  the store holds one reference until the tip is set again or the store is deleted.
+ *  Nothing here is locked: a store is only ever used from one thread at a time.
+ */
+class TipData {
+public:
+    // the buffers of one tip in the layout of an implementation
+    struct ConvertedTip {
+        void* partials;
+        SharedBuffer* sharedPartials;
+        int* states;
+        SharedBuffer* sharedStates;
+        std::vector<int> ambiguousPatterns;
+        std::vector<int> ambiguousCodes;
+        std::vector<int> ambiguityMasks;
+    };
+
+    TipData(int tipCount,
+            int stateCount,
+            int patternCount)
+        : kTipCount(tipCount), kStateCount(stateCount), kPatternCount(patternCount),
+          gStates(tipCount, (int*) NULL), gSharedStates(tipCount, (SharedBuffer*) NULL),
+          gPartials(tipCount) {
+        kPaddedPatternCount = patternCount;
+        const int remainder = patternCount % BEAGLE_TIP_DATA_PATTERN_MODULUS;
+        if (remainder != 0)
+            kPaddedPatternCount += BEAGLE_TIP_DATA_PATTERN_MODULUS - remainder;
+    }
+
+    ~TipData() {
+        for (int i = 0; i < kTipCount; i++)
+            clearTip(i);
+    }
+
+    int getTipCount() const { return kTipCount; }
+
+    int getStateCount() const { return kStateCount; }
+
+    int getPatternCount() const { return kPatternCount; }
+
+    int getPaddedPatternCount() const { return kPaddedPatternCount; }
+
+    // inStates 0 to stateCount - 1, anything else is missing
+    void setTipStates(int tipIndex,
+                      const int* inStates) {
+        clearTip(tipIndex);
+        int* states = (int*) mallocAligned(sizeof(int) * kPaddedPatternCount);
+        for (int k = 0; k < kPatternCount; k++)
+            states[k] = (inStates[k] >= 0 && inStates[k] < kStateCount ? inStates[k] : kStateCount);
+        for (int k = kPatternCount; k < kPaddedPatternCount; k++)
+            states[k] = kStateCount;
+        gStates[tipIndex] = states;
+        gSharedStates[tipIndex] = new SharedBuffer();
+    }
+
+    // inPartials stateCount x patternCount
+    void setTipPartials(int tipIndex,
+                        const double* inPartials) {
+        clearTip(tipIndex);
+        gPartials[tipIndex].assign(inPartials, inPartials + kPatternCount * kStateCount);
+    }
+
+    // returns NULL unless the tip was set from states
+    int* getTipStates(int tipIndex,
+                      SharedBuffer** outSharedBuffer) const {
+        *outSharedBuffer = gSharedStates[tipIndex];
+        return gStates[tipIndex];
+    }
+
+    // returns NULL unless the tip was set from partials
+    const double* getTipPartials(int tipIndex) const {
+        return (gPartials[tipIndex].empty() ? NULL : &gPartials[tipIndex][0]);
+    }
+
+    // returns the partials of a tip converted for layout, or NULL if not converted yet
+    const ConvertedTip* getConvertedTip(const std::vector<long>& layout,
+                                        int tipIndex) const {
+        std::map<std::vector<long>, std::vector<ConvertedTip> >::const_iterator it = gConvertedTips.find(layout);
+        if (it == gConvertedTips.end() || !isConverted(it->second[tipIndex]))
+            return NULL;
+        return &it->second[tipIndex];
+    }
+
+    // keeps the buffers an implementation converted the partials of a tip into, taking a
+    // reference to each
+    void setConvertedTip(const std::vector<long>& layout,
+                         int tipIndex,
+                         const ConvertedTip& tip) {
+        std::vector<ConvertedTip>& tips = gConvertedTips[layout];
+        if (tips.empty()) {
+            ConvertedTip empty = {NULL, NULL, NULL, NULL};
+            tips.assign(kTipCount, empty);
+        }
+        releaseConvertedTip(&tips[tipIndex]);
+        tips[tipIndex] = tip;
+        if (tip.sharedPartials != NULL)
+            tip.sharedPartials->retain();
+        if (tip.sharedStates != NULL)
+            tip.sharedStates->retain();
+    }
+
+private:
+    static bool isConverted(const ConvertedTip& tip) {
+        return (tip.partials != NULL || tip.states != NULL);
+    }
+
+    static void releaseBuffer(void* buffer,
+                              SharedBuffer* sharedBuffer) {
+        if (sharedBuffer != NULL && sharedBuffer->release()) {
+            if (!sharedBuffer->isClientMemory())
+                free(buffer);
+            delete sharedBuffer;
+        }
+    }
+
+    static void releaseConvertedTip(ConvertedTip* tip) {
+        releaseBuffer(tip->partials, tip->sharedPartials);
+        releaseBuffer(tip->states, tip->sharedStates);
+        ConvertedTip empty = {NULL, NULL, NULL, NULL};
+        *tip = empty;
+    }
+
+    // drops the references of the store to the buffers of a tip
+    void clearTip(int tipIndex) {
+        releaseBuffer(gStates[tipIndex], gSharedStates[tipIndex]);
+        gStates[tipIndex] = NULL;
+        gSharedStates[tipIndex] = NULL;
+        gPartials[tipIndex].clear();
+        for (std::map<std::vector<long>, std::vector<ConvertedTip> >::iterator it = gConvertedTips.begin();
+             it != gConvertedTips.end(); ++it)
+            releaseConvertedTip(&it->second[tipIndex]);
+    }
+
+    // as BeagleCPUImpl::mallocAligned, so that instances may free the buffers
+    static void* mallocAligned(size_t size) {
+        void* ptr = NULL;
+#if defined (__APPLE__) || defined(WIN32)
+        ptr = malloc(size);
+#else
+        if (posix_memalign(&ptr, 32, size) != 0)
+            ptr = NULL;
+#endif
+        if (ptr == NULL)
+            throw std::bad_alloc();
+        return ptr;
+    }
+
+    int kTipCount;
+    int kStateCount;
+    int kPatternCount;
+    int kPaddedPatternCount;
+    std::vector<int*> gStates;
+    std::vector<SharedBuffer*> gSharedStates;
+    std::vector< std::vector<double> > gPartials;
+    std::map<std::vector<long>, std::vector<ConvertedTip> > gConvertedTips; /// by layout, per tip
+};
+
+}
+
+#endif // __beagle_tip_data__
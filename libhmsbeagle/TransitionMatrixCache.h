@@ -0,0 +1,153 @@
+/*
+ *  TransitionMatrixCache.h
+ *  BEAGLE
+ *
+ * Copyright 2009 Phylogenetic Likelihood Working Group
+ *
+ * This file is part of BEAGLE.
+ *
+ * BEAGLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * BEAGLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with BEAGLE.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __beagle_transition_matrix_cache__
+#define __beagle_transition_matrix_cache__
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace beagle {
+
+/*
+ * Host-side index of a least-recently-used cache of transition matrices. Entries are
+ *  keyed by eigen decomposition, edge length and the number of derivative matrices
+ *  computed with them, for the category rates last passed to checkCategoryRates.
+ *  Implementations keep the matrices themselves in slots 0 to capacity - 1.
+ */
+class TransitionMatrixCache {
+public:
+    TransitionMatrixCache() : kCapacity(0), kClock(0), kHits(0), kMisses(0) {}
+
+    // resizes the cache, dropping all entries
+    void setCapacity(int capacity) {
+        kCapacity = capacity;
+        gSlotKeys.assign(capacity, Key());
+        gSlotUses.assign(capacity, 0);
+        invalidateAll();
+    }
+
+    int getCapacity() const { return kCapacity; }
+
+    long getHits() const { return kHits; }
+
+    long getMisses() const { return kMisses; }
+
+    // returns the slot holding the entry, or -1 on a miss
+    int find(int eigenIndex,
+             double edgeLength,
+             int derivativeCount) {
+        std::map<Key, int>::iterator it = gSlots.find(Key(eigenIndex, edgeLength, derivativeCount));
+        if (it == gSlots.end()) {
+            kMisses++;
+            return -1;
+        }
+        kHits++;
+        gSlotUses[it->second] = ++kClock;
+        return it->second;
+    }
+
+    // returns the slot to store a new entry in, evicting the least recently used one
+    int insert(int eigenIndex,
+               double edgeLength,
+               int derivativeCount) {
+        const Key key(eigenIndex, edgeLength, derivativeCount);
+        std::map<Key, int>::iterator it = gSlots.find(key);
+        int slot;
+        if (it != gSlots.end()) {
+            slot = it->second;
+        } else {
+            slot = 0;
+            for (int i = 1; i < kCapacity; i++) {
+                if (gSlotUses[i] < gSlotUses[slot])
+                    slot = i;
+            }
+            if (gSlotUses[slot] != 0)
+                gSlots.erase(gSlotKeys[slot]);
+            gSlotKeys[slot] = key;
+            gSlots[key] = slot;
+        }
+        gSlotUses[slot] = ++kClock;
+        return slot;
+    }
+
+    // drops the entries of an eigen decomposition that has been replaced
+    void invalidateEigen(int eigenIndex) {
+        for (int i = 0; i < kCapacity; i++) {
+            if (gSlotUses[i] != 0 && gSlotKeys[i].eigenIndex == eigenIndex) {
+                gSlots.erase(gSlotKeys[i]);
+                gSlotUses[i] = 0;
+            }
+        }
+    }
+
+    void invalidateAll() {
+        gSlots.clear();
+        for (int i = 0; i < kCapacity; i++)
+            gSlotUses[i] = 0;
+    }
+
+    // drops all entries if the category rates differ from those they were computed with
+    void checkCategoryRates(const double* categoryRates,
+                            int categoryCount) {
+        if (gCategoryRates.size() != (size_t) categoryCount ||
+            !std::equal(gCategoryRates.begin(), gCategoryRates.end(), categoryRates)) {
+            gCategoryRates.assign(categoryRates, categoryRates + categoryCount);
+            invalidateAll();
+        }
+    }
+
+private:
+    struct Key {
+        int eigenIndex;
+        int derivativeCount;
+        double edgeLength;
+
+        Key() : eigenIndex(-1), derivativeCount(0), edgeLength(0.0) {}
+
+        Key(int eigen, double length, int derivatives)
+            : eigenIndex(eigen), derivativeCount(derivatives), edgeLength(length) {}
+
+        bool operator<(const Key& other) const {
+            if (eigenIndex != other.eigenIndex)
+                return eigenIndex < other.eigenIndex;
+            if (derivativeCount != other.derivativeCount)
+                return derivativeCount < other.derivativeCount;
+            return edgeLength < other.edgeLength;
+        }
+    };
+
+    int kCapacity;
+    long kClock;
+    long kHits;
+    long kMisses;
+    std::map<Key, int> gSlots;
+    std::vector<Key> gSlotKeys;
+    std::vector<long> gSlotUses; /// clock of the last use of each slot, 0 if empty
+    std::vector<double> gCategoryRates;
+};
+
+}
+
+#endif // __beagle_transition_matrix_cache__
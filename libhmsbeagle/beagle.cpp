@@ -46,6 +46,7 @@
 
 #include "libhmsbeagle/beagle.h"
 #include "libhmsbeagle/BeagleImpl.h"
+#include "libhmsbeagle/TipData.h"
 
 #include "libhmsbeagle/plugin/Plugin.h"
 
@@ -82,6 +83,28 @@ double debugGetTime() {
 //@CHANGED make this a std::vector<BeagleImpl *> and use at to reference.
 std::vector<beagle::BeagleImpl*> *instances = NULL;
 
+/// the factory, resource and arguments each instance was created with, so that
+/// beagleCloneInstance can create another one alike
+struct InstanceArguments {
+    beagle::BeagleImplFactory* factory;
+    int resource;
+    int tipCount;
+    int partialsBufferCount;
+    int compactBufferCount;
+    int stateCount;
+    int patternCount;
+    int eigenBufferCount;
+    int matrixBufferCount;
+    int categoryCount;
+    int scaleBufferCount;
+    long preferenceFlags;
+    long requirementFlags;
+};
+std::vector<InstanceArguments> *instanceArguments = NULL;
+
+/// tip data stores, referenced by any number of instances
+std::vector<beagle::TipData*> *tipDataStores = NULL;
+
 /// returns an initialized instance or NULL if the index refers to an invalid instance
 namespace beagle {
 BeagleImpl* getBeagleInstance(int instanceIndex);
@@ -93,6 +116,15 @@ BeagleImpl* getBeagleInstance(int instanceIndex) {
     return (*instances)[instanceIndex];
 }
 
+/// returns a tip data store or NULL if the index refers to an invalid or finalized one
+TipData* getTipData(int tipDataIndex);
+
+TipData* getTipData(int tipDataIndex) {
+    if (tipDataStores == NULL || tipDataIndex < 0 || tipDataIndex >= (int) tipDataStores->size())
+        return NULL;
+    return (*tipDataStores)[tipDataIndex];
+}
+
 }	// end namespace beagle
 
 
@@ -216,6 +248,15 @@ void beagle_library_finalize(void) {
 	// Destroy instances
 	if (instances && loaded) {
 		delete instances;
+		delete instanceArguments;
+	}
+
+	// Destroy tip data stores; instances still referencing their data keep it
+	if (tipDataStores && loaded) {
+		for (size_t i = 0; i < tipDataStores->size(); i++)
+			delete (*tipDataStores)[i];
+		delete tipDataStores;
+		tipDataStores = NULL;
 	}
 	loaded = 0;
 }
@@ -332,6 +373,8 @@ int beagleCreateInstance(int tipCount,
     try {
         if (instances == NULL)
             instances = new std::vector<beagle::BeagleImpl*>;
+        if (instanceArguments == NULL)
+            instanceArguments = new std::vector<InstanceArguments>;
 
         if (rsrcList == NULL)
             beagleGetResourceList();
@@ -377,6 +420,10 @@ int beagleCreateInstance(int tipCount,
         }
         
         beagle::BeagleImpl* bestBeagle = NULL;
+        InstanceArguments arguments = {NULL, 0, tipCount, partialsBufferCount, compactBufferCount,
+                                       stateCount, patternCount, eigenBufferCount,
+                                       matrixBufferCount, categoryCount, scaleBufferCount,
+                                       preferenceFlags, requirementFlags};
 
         possibleResources->sort(compareOnFirst); // Attempt in rank order, lowest score wins
 
@@ -455,8 +502,11 @@ int beagleCreateInstance(int tipCount,
                                                                 requirementFlags,
                                                                 &errorCode);
             
-            if (bestBeagle != NULL)
+            if (bestBeagle != NULL) {
+                arguments.factory = factory;
+                arguments.resource = resource;
                 break; 
+            }
         }
         
         delete possibleResourceImplementations;
@@ -464,6 +514,7 @@ int beagleCreateInstance(int tipCount,
         if (bestBeagle != NULL) {
             int instance = instances->size();
             instances->push_back(bestBeagle);
+            instanceArguments->push_back(arguments);
             
             int returnValue = bestBeagle->getInstanceDetails(returnInfo);
             if (returnValue == BEAGLE_SUCCESS) {
@@ -492,6 +543,70 @@ int beagleCreateInstance(int tipCount,
 
 }
 
+int beagleCloneInstance(int instance,
+                        BeagleInstanceDetails* returnInfo) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+
+        const InstanceArguments arguments = (*instanceArguments)[instance];
+        int errorCode = BEAGLE_ERROR_NO_RESOURCE;
+        beagle::BeagleImpl* clone = arguments.factory->createImpl(arguments.tipCount,
+                                                                  arguments.partialsBufferCount,
+                                                                  arguments.compactBufferCount,
+                                                                  arguments.stateCount,
+                                                                  arguments.patternCount,
+                                                                  arguments.eigenBufferCount,
+                                                                  arguments.matrixBufferCount,
+                                                                  arguments.categoryCount,
+                                                                  arguments.scaleBufferCount,
+                                                                  arguments.resource,
+                                                                  ResourceMap[arguments.resource],
+                                                                  arguments.preferenceFlags,
+                                                                  arguments.requirementFlags,
+                                                                  &errorCode);
+        if (clone == NULL)
+            return errorCode;
+
+        try {
+            errorCode = clone->cloneInstance(beagleInstance);
+        }
+        catch (...) {
+            delete clone;
+            throw;
+        }
+        if (errorCode != BEAGLE_SUCCESS) {
+            delete clone;
+            return errorCode;
+        }
+
+        int cloneInstance = instances->size();
+        instances->push_back(clone);
+        instanceArguments->push_back(arguments);
+
+        int returnValue = clone->getInstanceDetails(returnInfo);
+        if (returnValue == BEAGLE_SUCCESS) {
+            returnInfo->resourceName = rsrcList->list[returnInfo->resourceNumber].name;
+            returnInfo->implDescription = (char*) "none";
+
+            returnValue = cloneInstance;
+        }
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleFinalizeInstance(int instance) {
     DEBUG_FINALIZE_TIME();
     try {
@@ -536,6 +651,29 @@ int beagleSetTipStates(int instance,
     }
 }
 
+int beagleSetTipStateMasks(int instance,
+                     int tipIndex,
+                     const int* inStateMasks) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->setTipStateMasks(tipIndex, inStateMasks);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleSetTipPartials(int instance,
                    int tipIndex,
                    const double* inPartials) {
@@ -559,6 +697,119 @@ int beagleSetTipPartials(int instance,
     }
 }
 
+int beagleCreateTipData(int tipCount,
+                        int stateCount,
+                        int patternCount) {
+    try {
+        if (tipCount <= 0 || stateCount <= 0 || patternCount <= 0)
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        if (tipDataStores == NULL)
+            tipDataStores = new std::vector<beagle::TipData*>;
+        tipDataStores->push_back(new beagle::TipData(tipCount, stateCount, patternCount));
+        return tipDataStores->size() - 1;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetTipDataStates(int tipData,
+                           int tipIndex,
+                           const int* inStates) {
+    try {
+        beagle::TipData* store = beagle::getTipData(tipData);
+        if (store == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (tipIndex < 0 || tipIndex >= store->getTipCount())
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        store->setTipStates(tipIndex, inStates);
+        return BEAGLE_SUCCESS;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetTipDataPartials(int tipData,
+                             int tipIndex,
+                             const double* inPartials) {
+    try {
+        beagle::TipData* store = beagle::getTipData(tipData);
+        if (store == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        if (tipIndex < 0 || tipIndex >= store->getTipCount())
+            return BEAGLE_ERROR_OUT_OF_RANGE;
+        store->setTipPartials(tipIndex, inPartials);
+        return BEAGLE_SUCCESS;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetTipData(int instance,
+                     int tipData) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        beagle::TipData* store = beagle::getTipData(tipData);
+        if (store == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->setTipData(store);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleFinalizeTipData(int tipData) {
+    try {
+        beagle::TipData* store = beagle::getTipData(tipData);
+        if (store == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        delete store;
+        (*tipDataStores)[tipData] = NULL;
+        return BEAGLE_SUCCESS;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleSetPartials(int instance,
                 int bufferIndex,
                 const double* inPartials) {
@@ -582,6 +833,29 @@ int beagleSetPartials(int instance,
     }
 }
 
+int beagleSetPartialsBuffer(int instance,
+                            int bufferIndex,
+                            const double* inPartials) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->setPartialsBuffer(bufferIndex, inPartials);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleGetPartials(int instance, int bufferIndex, int scaleIndex, double* outPartials) {
     DEBUG_START_TIME();
     try {
@@ -629,6 +903,29 @@ int beagleSetEigenDecomposition(int instance,
     }
 }
 
+int beagleSetRateMatrix(int instance,
+                        int eigenIndex,
+                        const double* inRateMatrix) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->setRateMatrix(eigenIndex, inRateMatrix);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleSetStateFrequencies(int instance,
                               int stateFrequenciesIndex,
                               const double* inStateFrequencies) {
@@ -799,6 +1096,51 @@ int beagleUpdateTransitionMatrices(int instance,
 //    }
 }
 
+int beagleSetTransitionMatrixCacheSize(int instance,
+                                 int cacheSize) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->setTransitionMatrixCacheSize(cacheSize);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleGetTransitionMatrixCacheStatistics(int instance,
+                                       long* outHits,
+                                       long* outMisses) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->getTransitionMatrixCacheStatistics(outHits, outMisses);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleUpdatePartials(const int instance,
                    const BeagleOperation* operations,
                    int operationCount,
@@ -823,6 +1165,111 @@ int beagleUpdatePartials(const int instance,
 //    }
 }
 
+int beagleSetSparseRateMatrix(int instance,
+                        int eigenIndex,
+                        int nonZeroCount,
+                        const int* rowIndices,
+                        const int* columnIndices,
+                        const double* rates) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->setSparseRateMatrix(eigenIndex, nonZeroCount, rowIndices,
+                                                           columnIndices, rates);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleUpdatePartialsByEdgeLengths(int instance,
+                                int eigenIndex,
+                                const BeagleOperation* operations,
+                                int operationCount,
+                                const double* edgeLengths,
+                                int cumulativeScaleIndex) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->updatePartialsByEdgeLengths(eigenIndex, (const int*)operations,
+                                                                   operationCount, edgeLengths,
+                                                                   cumulativeScaleIndex);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleUpdateMatricesAndPartials(int instance,
+                                    const BeagleOperation* operations,
+                                    int operationCount,
+                                    const int* eigenIndices,
+                                    const double* edgeLengths,
+                                    int cumulativeScaleIndex) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->updateMatricesAndPartials((const int*)operations, operationCount,
+                                                                 eigenIndices, edgeLengths,
+                                                                 cumulativeScaleIndex);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleSetDirtyTracking(int instance,
+                     int enable) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->setDirtyTracking(enable);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleWaitForPartials(const int instance,
                     const int* destinationPartials,
                     int destinationPartialsCount) {
@@ -847,6 +1294,28 @@ int beagleWaitForPartials(const int instance,
 //    }
 }
 
+int beagleSetExponentScalers(int instance,
+                             int enable) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->setExponentScalers(enable);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleAccumulateScaleFactors(int instance,
 						   const int* scalingIndices,
 						   int count,
@@ -996,6 +1465,36 @@ int beagleCalculateRootLogLikelihoods(int instance,
 
 }
 
+int beagleCalculateRootLogLikelihoodsByOperation(int instance,
+                                                 const BeagleOperation* operation,
+                                                 int categoryWeightsIndex,
+                                                 int stateFrequenciesIndex,
+                                                 int cumulativeScaleIndex,
+                                                 double* outSumLogLikelihood) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->calculateRootLogLikelihoodsByOperation((const int*)operation,
+                                                                              categoryWeightsIndex,
+                                                                              stateFrequenciesIndex,
+                                                                              cumulativeScaleIndex,
+                                                                              outSumLogLikelihood);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleCalculateEdgeLogLikelihoods(int instance,
                                       const int* parentBufferIndices,
                                       const int* childBufferIndices,
@@ -1036,6 +1535,144 @@ int beagleCalculateEdgeLogLikelihoods(int instance,
 //    }
 }
 
+int beagleCalculateIndependentEdgeLogLikelihoods(int instance,
+                                                 const int* parentBufferIndices,
+                                                 const int* childBufferIndices,
+                                                 const int* probabilityIndices,
+                                                 const int* firstDerivativeIndices,
+                                                 const int* secondDerivativeIndices,
+                                                 const int* categoryWeightsIndices,
+                                                 const int* stateFrequenciesIndices,
+                                                 const int* cumulativeScaleIndices,
+                                                 int count,
+                                                 double* outLogLikelihoods,
+                                                 double* outFirstDerivatives,
+                                                 double* outSecondDerivatives) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->calculateIndependentEdgeLogLikelihoods(parentBufferIndices,
+                                                                                 childBufferIndices,
+                                                                                 probabilityIndices,
+                                                                                 firstDerivativeIndices,
+                                                                                 secondDerivativeIndices,
+                                                                                 categoryWeightsIndices,
+                                                                                 stateFrequenciesIndices,
+                                                                                 cumulativeScaleIndices,
+                                                                                 count, outLogLikelihoods,
+                                                                                 outFirstDerivatives,
+                                                                                 outSecondDerivatives);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleProjectEdgePartials(int instance,
+                              int parentBufferIndex,
+                              int childBufferIndex,
+                              int eigenIndex,
+                              int categoryWeightsIndex,
+                              int stateFrequenciesIndex,
+                              int cumulativeScaleIndex) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->projectEdgePartials(parentBufferIndex, childBufferIndex, eigenIndex,
+                                                              categoryWeightsIndex, stateFrequenciesIndex,
+                                                              cumulativeScaleIndex);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleCalculateProjectedEdgeLogLikelihoods(int instance,
+                                               double edgeLength,
+                                               double* outSumLogLikelihood,
+                                               double* outSumFirstDerivative,
+                                               double* outSumSecondDerivative) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->calculateProjectedEdgeLogLikelihoods(edgeLength, outSumLogLikelihood,
+                                                                               outSumFirstDerivative,
+                                                                               outSumSecondDerivative);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleOptimizeEdgeLengths(int instance,
+                              const int* parentBufferIndices,
+                              const int* childBufferIndices,
+                              int eigenIndex,
+                              int categoryWeightsIndex,
+                              int stateFrequenciesIndex,
+                              const int* cumulativeScaleIndices,
+                              int count,
+                              double minEdgeLength,
+                              double maxEdgeLength,
+                              double tolerance,
+                              int maxIterations,
+                              double* inOutEdgeLengths,
+                              double* outLogLikelihoods) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->optimizeEdgeLengths(parentBufferIndices, childBufferIndices,
+                                                              eigenIndex, categoryWeightsIndex,
+                                                              stateFrequenciesIndex, cumulativeScaleIndices,
+                                                              count, minEdgeLength, maxEdgeLength,
+                                                              tolerance, maxIterations, inOutEdgeLengths,
+                                                              outLogLikelihoods);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
 int beagleGetSiteLogLikelihoods(int instance,
                                 double* outLogLikelihoods) {
     DEBUG_START_TIME();
@@ -1059,3 +1696,93 @@ int beagleGetSiteDerivatives(int instance,
     return returnValue;
 }
 
+int beagleSetSiteBuffers(int instance,
+                         double* outLogLikelihoods,
+                         double* outFirstDerivatives,
+                         double* outSecondDerivatives) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->setSiteBuffers(outLogLikelihoods, outFirstDerivatives,
+                                                     outSecondDerivatives);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleSaveInstance(int instance,
+                       const char* fileName) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->saveInstance(fileName);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+int beagleRestoreInstance(int instance,
+                          const char* fileName) {
+    DEBUG_START_TIME();
+    try {
+        beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+        if (beagleInstance == NULL)
+            return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+        int returnValue = beagleInstance->restoreInstance(fileName);
+        DEBUG_END_TIME();
+        return returnValue;
+    }
+    catch (std::bad_alloc &) {
+        return BEAGLE_ERROR_OUT_OF_MEMORY;
+    }
+    catch (std::out_of_range &) {
+        return BEAGLE_ERROR_OUT_OF_RANGE;
+    }
+    catch (...) {
+        return BEAGLE_ERROR_UNIDENTIFIED_EXCEPTION;
+    }
+}
+
+
+int beagleSetKernelCounting(int instance,
+                            int enable) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->setKernelCounting(enable);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleGetKernelCounters(int instance,
+                            BeagleKernelCounters* outCounters) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->getKernelCounters(outCounters);
+    DEBUG_END_TIME();
+    return returnValue;
+}
+
+int beagleResetKernelCounters(int instance) {
+    DEBUG_START_TIME();
+    beagle::BeagleImpl* beagleInstance = beagle::getBeagleInstance(instance);
+    if (beagleInstance == NULL)
+        return BEAGLE_ERROR_UNINITIALIZED_INSTANCE;
+    int returnValue = beagleInstance->resetKernelCounters();
+    DEBUG_END_TIME();
+    return returnValue;
+}
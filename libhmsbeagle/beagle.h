@@ -152,7 +152,7 @@ enum BeagleFlags {
     BEAGLE_FLAG_SCALING_MANUAL      = 1 << 6,    /**< Manual scaling */
     BEAGLE_FLAG_SCALING_AUTO        = 1 << 7,    /**< Auto-scaling on (deprecated, may not work correctly) */
     BEAGLE_FLAG_SCALING_ALWAYS      = 1 << 8,    /**< Scale at every updatePartials (deprecated, may not work correctly) */
-    BEAGLE_FLAG_SCALING_DYNAMIC     = 1 << 25,   /**< Manual scaling with dynamic checking (deprecated, may not work correctly) */
+    BEAGLE_FLAG_SCALING_DYNAMIC     = 1 << 25,   /**< Manual scaling with dynamic checking: operations rescale only patterns near underflow and keep the cumulative scale buffer up to date */
     
     BEAGLE_FLAG_SCALERS_RAW         = 1 << 9,    /**< Save raw scalers */
     BEAGLE_FLAG_SCALERS_LOG         = 1 << 10,   /**< Save log scalers */
@@ -176,7 +176,11 @@ enum BeagleFlags {
     
     BEAGLE_FLAG_FRAMEWORK_CUDA      = 1 << 22,   /**< Use CUDA implementation with GPU resources */
     BEAGLE_FLAG_FRAMEWORK_OPENCL    = 1 << 23,   /**< Use OpenCL implementation with GPU resources */
-    BEAGLE_FLAG_FRAMEWORK_CPU       = 1 << 27    /**< Use CPU implementation */
+    BEAGLE_FLAG_FRAMEWORK_CPU       = 1 << 27,   /**< Use CPU implementation */
+    
+    BEAGLE_FLAG_MEMORY_MAPPED       = 1 << 28,   /**< Back partials and scale buffers with a memory-mapped scratch file */
+    BEAGLE_FLAG_TRAVERSAL_BLOCKED   = 1 << 29,   /**< Compute whole operation lists one cache-sized pattern block at a time */
+    BEAGLE_FLAG_PARTIALS_PATTERN_MAJOR = 1 << 30 /**< Store partials as [pattern][category][state] instead of [category][pattern][state] */
 };
 
 /**
@@ -191,6 +195,41 @@ enum BeagleOpCodes {
 	BEAGLE_OP_NONE     = -1	/**< Specify no use for indexed buffer */
 };
 
+/**
+ * @anchor BEAGLE_KERNEL_CLASSES
+ *
+ * @brief Kernel classes
+ *
+ * This enumerates the classes of computation that beagleGetKernelCounters reports on.
+ */
+enum BeagleKernelClasses {
+    BEAGLE_KERNEL_TRANSITION_MATRICES = 0, /**< Transition matrices from eigen-decompositions */
+    BEAGLE_KERNEL_STATES_STATES       = 1, /**< Partials from two compact tips */
+    BEAGLE_KERNEL_STATES_PARTIALS     = 2, /**< Partials from a compact tip and partials */
+    BEAGLE_KERNEL_PARTIALS_PARTIALS   = 3, /**< Partials from two sets of partials */
+    BEAGLE_KERNEL_RESCALE             = 4, /**< Rescaling of partials */
+    BEAGLE_KERNEL_ROOT                = 5, /**< Root log likelihoods */
+    BEAGLE_KERNEL_EDGE                = 6, /**< Edge log likelihoods */
+    BEAGLE_KERNEL_DERIVATIVES         = 7, /**< Edge log likelihoods with derivatives */
+    BEAGLE_KERNEL_CLASS_COUNT         = 8  /**< Number of kernel classes */
+};
+
+/**
+ * @brief Counters of one kernel class
+ *
+ * Elements are the values a kernel computes or integrates: stateCount per pattern and rate
+ * category, or stateCount squared per transition matrix and rate category. Flops and bytes
+ * are estimated from these by a model of the reference kernels, for comparing throughput
+ * between runs rather than as exact measures.
+ */
+typedef struct {
+    long   callCount;    /**< Number of kernel calls */
+    double seconds;      /**< Wall time spent in the kernels */
+    double elementCount; /**< Number of elements processed */
+    double flopCount;    /**< Estimated number of floating-point operations */
+    double byteCount;    /**< Estimated number of bytes read and written */
+} BeagleKernelCounters;
+
 /**
  * @brief Information about a specific instance
  */
@@ -305,6 +344,25 @@ BEAGLE_DLLEXPORT int beagleCreateInstance(int tipCount,
                          long requirementFlags,
                          BeagleInstanceDetails* returnInfo);
 
+/**
+ * @brief Create a copy of an instance that shares its read-only data
+ *
+ * This function creates a new instance on the same resource and implementation as an
+ * existing one, holding everything that has been set on or calculated in it. Partials
+ * buffers, tip states and pattern weights are not copied but shared between the two
+ * instances until either writes to them, when the writer takes a private copy; the other
+ * buffers are copied. Chains of a Metropolis-coupled MCMC can thus be created from one
+ * instance without holding the data once per chain. Either instance may be finalized first.
+ *
+ * @param instance      Instance number to copy (input)
+ * @param returnInfo    Pointer to return implementation and resource details
+ *
+ * @return the unique identifier of the new instance (<0 if failed, see @ref
+ * BEAGLE_RETURN_CODES "BeagleReturnCodes")
+ */
+BEAGLE_DLLEXPORT int beagleCloneInstance(int instance,
+                                         BeagleInstanceDetails* returnInfo);
+
 /**
  * @brief Finalize this instance
  *
@@ -344,6 +402,26 @@ BEAGLE_DLLEXPORT int beagleSetTipStates(int instance,
                        int tipIndex,
                        const int* inStates);
 
+/**
+ * @brief Set the compact state representation for tip node from state bitmasks
+ *
+ * This function copies a compact representation of possibly ambiguous states into an instance
+ * buffer. Each element of inStateMasks has bit i set if state i is compatible with the
+ * observation at that site, so IUPAC ambiguity codes can be given without resorting to tip
+ * partials. A mask with a single bit set is an ordinary state, and a mask with no bits or all
+ * bits set is missing data. The inStateMasks array should be patternCount in length. Masks
+ * are limited to instances with at most 32 states.
+ *
+ * @param instance      Instance number (input)
+ * @param tipIndex      Index of destination compactBuffer (input)
+ * @param inStateMasks  Pointer to state bitmasks (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTipStateMasks(int instance,
+                           int tipIndex,
+                           const int* inStateMasks);
+
 /**
  * @brief Set an instance partials buffer for tip node
  *
@@ -362,6 +440,89 @@ BEAGLE_DLLEXPORT int beagleSetTipPartials(int instance,
                          int tipIndex,
                          const double* inPartials);
 
+/**
+ * @brief Create a store of tip data that instances can share
+ *
+ * This function creates a store for the tip states or partials of one alignment. The data
+ * are set in the store once with beagleSetTipDataStates and beagleSetTipDataPartials and
+ * then given to any number of instances with beagleSetTipData, which reference the data of
+ * the store instead of holding copies of them. An instance that later sets a tip itself
+ * takes a private copy of that tip only. The store keeps its data until it is finalized,
+ * and instances keep the data they reference until they are finalized.
+ *
+ * @param tipCount      Number of tips in the store (input)
+ * @param stateCount    Number of states in the data (input)
+ * @param patternCount  Number of site patterns in the data (input)
+ *
+ * @return the unique tip data identifier (<0 if failed, see @ref BEAGLE_RETURN_CODES
+ * "BeagleReturnCodes")
+ */
+BEAGLE_DLLEXPORT int beagleCreateTipData(int tipCount,
+                                         int stateCount,
+                                         int patternCount);
+
+/**
+ * @brief Set the states of a tip in a tip data store
+ *
+ * As beagleSetTipStates, for every instance that is given the store afterwards.
+ *
+ * @param tipData   Tip data number (input)
+ * @param tipIndex  Index of the tip (input)
+ * @param inStates  Pointer to compact states, patternCount in length (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTipDataStates(int tipData,
+                                            int tipIndex,
+                                            const int* inStates);
+
+/**
+ * @brief Set the partials of a tip in a tip data store
+ *
+ * As beagleSetTipPartials, for every instance that is given the store afterwards. The first
+ * instance of each implementation and layout to be given the store converts the partials,
+ * and later ones share the result.
+ *
+ * @param tipData       Tip data number (input)
+ * @param tipIndex      Index of the tip (input)
+ * @param inPartials    Pointer to partials, stateCount * patternCount in length (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTipDataPartials(int tipData,
+                                              int tipIndex,
+                                              const double* inPartials);
+
+/**
+ * @brief Set the tips of an instance from a tip data store
+ *
+ * This function points every tip set in a store at the data of the store. The store must
+ * have the state and pattern counts of the instance and no more tips. Tips set in the
+ * store later do not change the instance until this function is called again. The store
+ * keeps the partials converted by each instance it is given and is not locked, so the
+ * instances sharing a store must be given it from a single thread, not concurrently with
+ * each other or with the other tip data functions on the same store.
+ *
+ * @param instance  Instance number (input)
+ * @param tipData   Tip data number (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTipData(int instance,
+                                      int tipData);
+
+/**
+ * @brief Finalize a tip data store
+ *
+ * This function releases the references of a store to its data. Data still referenced by
+ * instances are freed with the last of them.
+ *
+ * @param tipData   Tip data number (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleFinalizeTipData(int tipData);
+
 /**
  * @brief Set an instance partials buffer
  *
@@ -378,6 +539,28 @@ BEAGLE_DLLEXPORT int beagleSetPartials(int instance,
                       int bufferIndex,
                       const double* inPartials);
 
+/**
+ * @brief Use client memory as an instance partials buffer
+ *
+ * This function sets a partials buffer from an array laid out as for beagleSetPartials, but
+ * where the instance is double precision and keeps its partials unpadded, and inPartials is
+ * aligned to 32 bytes, the buffer points at the array instead of copying it. The instance
+ * then reads the array in place and never writes to or frees it; setting or computing the
+ * buffer again first gives the instance a private copy. The array must stay valid until
+ * then, in this instance and in any instance cloned from it. Later changes to the array are
+ * read without another call, except that with dirty tracking the call has to be repeated.
+ * Otherwise the array is copied as by beagleSetPartials.
+ *
+ * @param instance      Instance number in which to set a partialsBuffer (input)
+ * @param bufferIndex   Index of destination partialsBuffer (input)
+ * @param inPartials    Pointer to partials values to use (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetPartialsBuffer(int instance,
+                                             int bufferIndex,
+                                             const double* inPartials);
+
 /**
  * @brief Get partials from an instance buffer
  *
@@ -416,6 +599,27 @@ BEAGLE_DLLEXPORT int beagleSetEigenDecomposition(int instance,
                                 const double* inInverseEigenVectors,
                                 const double* inEigenValues);
 
+/**
+ * @brief Set a rate matrix in place of an eigen-decomposition buffer
+ *
+ * This function copies an infinitesimal rate matrix into an eigen-decomposition buffer.
+ * Until beagleSetEigenDecomposition is next called for the buffer,
+ * beagleUpdateTransitionMatrices computes the transition probabilities and their derivatives
+ * for this buffer by Pade approximation with scaling and squaring instead of from an
+ * eigen-decomposition. The rate matrix need not be reversible, and no eigen-decomposition is
+ * needed on the client side.
+ *
+ * @param instance              Instance number (input)
+ * @param eigenIndex            Index of eigen-decomposition buffer (input)
+ * @param inRateMatrix          Flattened matrix (stateCount x stateCount) of instantaneous rates,
+ *                               with row i holding the rates away from state i (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetRateMatrix(int instance,
+                        int eigenIndex,
+                        const double* inRateMatrix);
+
 /**
  * @brief Set a state frequency buffer
  *
@@ -434,7 +638,15 @@ BEAGLE_DLLEXPORT int beagleSetStateFrequencies(int instance,
 /**
  * @brief Set a category weights buffer
  *
- * This function copies a category weights array into an instance buffer.
+ * This function copies a category weights array into an instance buffer. On the CPU, a
+ * category weighted zero in every category weights buffer is inactive and
+ * beagleUpdatePartials leaves its partials as they were. Once this function gives such a
+ * category a non-zero weight again, its partials in every internal partialsBuffer are
+ * stale: with dirty tracking on (see beagleSetDirtyTracking) this function marks all of
+ * those buffers changed, so that the next beagleUpdatePartials over the full traversal
+ * recomputes them; without it, the caller must update every internal partialsBuffer
+ * again before the next likelihood is calculated. The GPU implementations do not skip
+ * categories and return BEAGLE_ERROR_NO_IMPLEMENTATION for a zero weight.
  *
  * @param instance              Instance number (input)
  * @param categoryWeightsIndex  Index of category weights buffer (input)
@@ -461,7 +673,14 @@ BEAGLE_DLLEXPORT int beagleSetCategoryRates(int instance,
 /**
  * @brief Set pattern weights
  *
- * This function sets the vector of pattern weights for an instance.
+ * This function sets the vector of pattern weights for an instance. On the CPU,
+ * runs of patterns weighted zero are skipped when partials are updated and site
+ * likelihoods are not meaningful for them. A pattern given a non-zero weight again
+ * needs its partials recomputed, as for categories in beagleSetCategoryWeights: with
+ * dirty tracking on this function marks every internal partialsBuffer changed, and
+ * without it the caller must update them again before the next likelihood is
+ * calculated. The GPU implementations do not skip patterns and return
+ * BEAGLE_ERROR_NO_IMPLEMENTATION for a zero weight.
  *
  * @param instance              Instance number (input)
  * @param inPatternWeights      Array containing patternCount weights (input)
@@ -523,6 +742,42 @@ BEAGLE_DLLEXPORT int beagleUpdateTransitionMatrices(int instance,
                                    const double* edgeLengths,
                                    int count);
 
+/**
+ * @brief Set the size of the transition matrix cache
+ *
+ * This function sets how many sets of transition matrices beagleUpdateTransitionMatrices keeps
+ * for reuse. Each entry holds the matrices of all rate categories, and their derivatives if
+ * requested, for one combination of eigen-decomposition buffer and edge length. A later
+ * request with the same eigen-decomposition buffer, edge length and derivative indices is
+ * copied from the cache instead of being exponentiated again, and the least recently used
+ * entry is evicted when the cache is full. Entries are dropped when their eigen-decomposition
+ * buffer or the category rates change. A size of zero (the default) turns the cache off.
+ * Resizing the cache drops all entries.
+ *
+ * @param instance  Instance number (input)
+ * @param cacheSize Number of entries to keep (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetTransitionMatrixCacheSize(int instance,
+                                       int cacheSize);
+
+/**
+ * @brief Get transition matrix cache statistics
+ *
+ * This function returns the number of edge lengths beagleUpdateTransitionMatrices has found
+ * in and missed from the transition matrix cache since the instance was created.
+ *
+ * @param instance  Instance number (input)
+ * @param outHits   Pointer to destination for number of cache hits (output)
+ * @param outMisses Pointer to destination for number of cache misses (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetTransitionMatrixCacheStatistics(int instance,
+                                             long* outHits,
+                                             long* outMisses);
+
 /**
  * @brief Set a finite-time transition probability matrix
  *
@@ -615,6 +870,106 @@ BEAGLE_DLLEXPORT int beagleUpdatePartials(const int instance,
                          int operationCount,
                          int cumulativeScaleIndex);
 
+/**
+ * @brief Set a sparse rate matrix
+ *
+ * This function copies the off-diagonal non-zero entries of an infinitesimal rate matrix into
+ * an instance buffer for use by beagleUpdatePartialsByEdgeLengths. Diagonal entries are
+ * ignored and taken as minus the row sums. The buffer index shares its range with the
+ * eigen-decomposition buffers.
+ *
+ * @param instance          Instance number (input)
+ * @param eigenIndex        Index of rate matrix buffer (input)
+ * @param nonZeroCount      Number of entries (input)
+ * @param rowIndices        List of row (from state) indices of entries (input)
+ * @param columnIndices     List of column (to state) indices of entries (input)
+ * @param rates             List of non-negative rates of entries (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetSparseRateMatrix(int instance,
+                              int eigenIndex,
+                              int nonZeroCount,
+                              const int* rowIndices,
+                              const int* columnIndices,
+                              const double* rates);
+
+/**
+ * @brief Calculate partials from edge lengths without transition matrices
+ *
+ * This function calculates a list of partials as beagleUpdatePartials does, but applies the
+ * exponential of a sparse rate matrix, scaled by each edge length and category rate, directly
+ * to the child partials by uniformization. Dense transition matrices are never formed, which
+ * makes state spaces of several hundred states affordable when the rate matrix is sparse. The
+ * child transition matrix indices of the operations are ignored. Only manual scaling is
+ * supported.
+ *
+ * @param instance                  Instance number (input)
+ * @param eigenIndex                Index of rate matrix buffer set by beagleSetSparseRateMatrix (input)
+ * @param operations                BeagleOperation list specifying operations (input)
+ * @param operationCount            Number of operations (input)
+ * @param edgeLengths               List of child 1 and child 2 edge lengths for each operation
+ *                                   (2 x operationCount) (input)
+ * @param cumulativeScaleIndex      Index number of scaleBuffer to store accumulated factors (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleUpdatePartialsByEdgeLengths(int instance,
+                                      int eigenIndex,
+                                      const BeagleOperation* operations,
+                                      int operationCount,
+                                      const double* edgeLengths,
+                                      int cumulativeScaleIndex);
+
+/**
+ * @brief Calculate transition matrices and partials in one pass
+ *
+ * This function calculates a list of partials as beagleUpdatePartials does, but takes an
+ * eigen decomposition index for each operation and the edge lengths of both children in place
+ * of transition matrices. The matrices of each operation are calculated just before they are
+ * applied and, where the implementation allows, are neither written to nor read back from the
+ * transition matrix buffers, which saves a beagleUpdateTransitionMatrices call per update. The
+ * child transition matrix indices of the operations name the buffers an implementation without
+ * this fusion calculates the matrices into. Auto scaling is not supported.
+ *
+ * @param instance                  Instance number (input)
+ * @param operations                BeagleOperation list specifying operations (input)
+ * @param operationCount            Number of operations (input)
+ * @param eigenIndices              Index of eigen-decomposition buffer for each operation (input)
+ * @param edgeLengths               List of child 1 and child 2 edge lengths for each operation
+ *                                   (2 x operationCount) (input)
+ * @param cumulativeScaleIndex      Index number of scaleBuffer to store accumulated factors (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleUpdateMatricesAndPartials(int instance,
+                                      const BeagleOperation* operations,
+                                      int operationCount,
+                                      const int* eigenIndices,
+                                      const double* edgeLengths,
+                                      int cumulativeScaleIndex);
+
+/**
+ * @brief Turn automatic skipping of unchanged operations on or off
+ *
+ * With dirty tracking on, the instance keeps a version for every partials buffer, transition
+ * matrix and scale buffer. beagleUpdatePartials then skips each operation whose children,
+ * matrices and scale buffers are unchanged since it last computed the destination, and
+ * beagleUpdateTransitionMatrices skips matrices whose edge length, eigen decomposition and
+ * category rates are unchanged. A client may therefore pass a full traversal every time and
+ * only the changed path to the root is computed. The scale factors of a skipped operation are
+ * still added to the cumulative scale buffer. Operations are never skipped under
+ * BEAGLE_FLAG_SCALING_AUTO, BEAGLE_FLAG_SCALING_ALWAYS or BEAGLE_FLAG_SCALING_DYNAMIC.
+ * Changing the setting forgets all recorded versions.
+ *
+ * @param instance  Instance number (input)
+ * @param enable    Non-zero to turn dirty tracking on, zero to turn it off (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetDirtyTracking(int instance,
+                           int enable);
+
 /**
  * @brief Block until all calculations that write to the specified partials have completed.
  *
@@ -635,6 +990,27 @@ BEAGLE_DLLEXPORT int beagleWaitForPartials(const int instance,
                           const int* destinationPartials,
                           int destinationPartialsCount);
 
+/**
+ * @brief Store scale factors as powers of two
+ *
+ * With exponent scalers on, each rescaled pattern is divided by the smallest power of two
+ * above its largest partial, which is exact, and scale buffers hold one 16-bit exponent per
+ * pattern instead of a raw or log factor. Exponents are accumulated and removed as
+ * integers and only converted to logs when likelihoods are integrated;
+ * beagleGetScaleFactors returns them as logs. Cumulative exponents are 16-bit too; one that
+ * leaves that range is not wrapped but marked as overflowed until the buffer is reset, so
+ * that beagleAccumulateScaleFactors, beagleRemoveScaleFactors and any likelihood
+ * integrated with it return BEAGLE_ERROR_FLOATING_POINT. Changing the setting resets all
+ * scale buffers. Only available under BEAGLE_FLAG_SCALING_MANUAL.
+ *
+ * @param instance  Instance number (input)
+ * @param enable    Non-zero to store exponents, zero to store factors as set by the flags (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetExponentScalers(int instance,
+                                              int enable);
+
 /**
  * @brief Accumulate scale factors
  *
@@ -734,12 +1110,40 @@ BEAGLE_DLLEXPORT int beagleCalculateRootLogLikelihoods(int instance,
                                       int count,
                                       double* outSumLogLikelihood);
 
+/**
+ * @brief Calculate root partials and integrate them in one pass
+ *
+ * This function computes the partials of a single operation, as beagleUpdatePartials does with
+ * cumulativeScaleIndex, and integrates them as beagleCalculateRootLogLikelihoods does, one block
+ * of site patterns at a time so that the root partials are integrated while still in cache. If
+ * the destinationPartials of the operation is BEAGLE_OP_NONE, the root partials are not stored.
+ * Auto and always scaling are not supported.
+ *
+ * @param instance                 Instance number (input)
+ * @param operation                BeagleOperation computing the root partials (input)
+ * @param categoryWeightsIndex     Index of the weights to apply to the rate categories (input)
+ * @param stateFrequenciesIndex    Index of the state frequencies (input)
+ * @param cumulativeScaleIndex     Index of the scaleBuffer of accumulated factors, which any factors
+ *                                  the operation writes are added to, or BEAGLE_OP_NONE (input)
+ * @param outSumLogLikelihood      Pointer to destination for resulting log likelihood (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateRootLogLikelihoodsByOperation(int instance,
+                                      const BeagleOperation* operation,
+                                      int categoryWeightsIndex,
+                                      int stateFrequenciesIndex,
+                                      int cumulativeScaleIndex,
+                                      double* outSumLogLikelihood);
+
 /**
  * @brief Calculate site log likelihoods and derivatives along an edge
  *
  * This function integrates a list of partials at a parent and child node with respect
  * to a set of partials-weights and state frequencies to return the log likelihood
- * and first and second derivative sums
+ * and first and second derivative sums. A count above 1 is not available under
+ * BEAGLE_FLAG_SCALING_AUTO or BEAGLE_FLAG_SCALING_ALWAYS, which keep a single cumulative
+ * scale buffer, and returns BEAGLE_ERROR_NO_IMPLEMENTATION there.
  *
  * @param instance                  Instance number (input)
  * @param parentBufferIndices       List of indices of parent partialsBuffers (input)
@@ -775,6 +1179,147 @@ BEAGLE_DLLEXPORT int beagleCalculateEdgeLogLikelihoods(int instance,
                                       double* outSumFirstDerivative,
                                       double* outSumSecondDerivative);
 
+/**
+ * @brief Calculate log likelihoods and derivatives along several independent edges
+ *
+ * This function evaluates each entry of the index lists as a separate edge, as
+ * beagleCalculateEdgeLogLikelihoods does for count = 1, and returns one sum per edge. It
+ * suits tree searches that score many candidate edges at once. The CPU implementation
+ * spreads the edges over threads when built with OpenMP and does not support auto or
+ * always scaling. Site log likelihoods and derivatives are left unchanged.
+ *
+ * @param instance                  Instance number (input)
+ * @param parentBufferIndices       List of indices of parent partialsBuffers (input)
+ * @param childBufferIndices        List of indices of child partialsBuffers (input)
+ * @param probabilityIndices        List indices of transition probability matrices (input)
+ * @param firstDerivativeIndices    List indices of first derivative matrices, or NULL (input)
+ * @param secondDerivativeIndices   List indices of second derivative matrices, or NULL (input)
+ * @param categoryWeightsIndices    List of weights to apply to each edge (input)
+ * @param stateFrequenciesIndices   List of state frequencies for each edge (input)
+ * @param cumulativeScaleIndices    List of scaleBuffers containing accumulated factors to apply to
+ *                                   each edge, or NULL (input)
+ * @param count                     Number of edges (input)
+ * @param outLogLikelihoods         Destination for the log likelihood of each edge (output)
+ * @param outFirstDerivatives       Destination for the first derivative of each edge, or NULL
+ *                                   (output)
+ * @param outSecondDerivatives      Destination for the second derivative of each edge, or NULL
+ *                                   (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateIndependentEdgeLogLikelihoods(int instance,
+                                                                  const int* parentBufferIndices,
+                                                                  const int* childBufferIndices,
+                                                                  const int* probabilityIndices,
+                                                                  const int* firstDerivativeIndices,
+                                                                  const int* secondDerivativeIndices,
+                                                                  const int* categoryWeightsIndices,
+                                                                  const int* stateFrequenciesIndices,
+                                                                  const int* cumulativeScaleIndices,
+                                                                  int count,
+                                                                  double* outLogLikelihoods,
+                                                                  double* outFirstDerivatives,
+                                                                  double* outSecondDerivatives);
+
+/**
+ * @brief Project the partials at either end of an edge onto an eigenbasis
+ *
+ * This function multiplies the parent partials by the state frequencies and the
+ * eigenvectors, and the child partials by the inverse eigenvectors, once. Until the next
+ * call, beagleCalculateProjectedEdgeLogLikelihoods evaluates the edge for any length
+ * from the eigenvalues alone. The category rates, category weights and scale factors in
+ * effect now are kept with the projection. The buffer must hold an Eigen decomposition
+ * rather than a rate matrix. Auto and always scaling are not supported.
+ *
+ * @param instance                  Instance number (input)
+ * @param parentBufferIndex         Index of the parent partialsBuffer (input)
+ * @param childBufferIndex          Index of the child partialsBuffer (input)
+ * @param eigenIndex                Index of the Eigen decomposition buffer (input)
+ * @param categoryWeightsIndex      Index of the category weights (input)
+ * @param stateFrequenciesIndex     Index of the state frequencies (input)
+ * @param cumulativeScaleIndex      Index of the scaleBuffer containing accumulated factors to
+ *                                   apply, or BEAGLE_OP_NONE (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleProjectEdgePartials(int instance,
+                                               int parentBufferIndex,
+                                               int childBufferIndex,
+                                               int eigenIndex,
+                                               int categoryWeightsIndex,
+                                               int stateFrequenciesIndex,
+                                               int cumulativeScaleIndex);
+
+/**
+ * @brief Calculate the log likelihood and derivatives of the projected edge
+ *
+ * This function evaluates the edge last given to beagleProjectEdgePartials for a new
+ * edge length, in time proportional to the number of patterns times the number of
+ * states. Site values are available through beagleGetSiteLogLikelihoods and
+ * beagleGetSiteDerivatives afterwards.
+ *
+ * @param instance                  Instance number (input)
+ * @param edgeLength                Length of the edge (input)
+ * @param outSumLogLikelihood       Pointer to destination for resulting log likelihood (output)
+ * @param outSumFirstDerivative     Pointer to destination for resulting first derivative, or
+ *                                   NULL (output)
+ * @param outSumSecondDerivative    Pointer to destination for resulting second derivative, or
+ *                                   NULL (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleCalculateProjectedEdgeLogLikelihoods(int instance,
+                                                                double edgeLength,
+                                                                double* outSumLogLikelihood,
+                                                                double* outSumFirstDerivative,
+                                                                double* outSumSecondDerivative);
+
+/**
+ * @brief Optimize the lengths of edges by Newton-Raphson iteration
+ *
+ * This function finds, for each edge in turn, the length that maximizes the log likelihood
+ * between its parent and child partials, keeping every other length fixed. The partials are
+ * projected onto the eigenbasis once per edge, as by beagleProjectEdgePartials, so each
+ * iteration costs time proportional to the number of patterns times the number of states and
+ * no transition matrices are written. Iteration stops once a step is no longer than tolerance
+ * or after maxIterations steps. The buffer must hold an Eigen decomposition rather than a
+ * rate matrix. Auto and always scaling are not supported.
+ *
+ * @param instance                  Instance number (input)
+ * @param parentBufferIndices       List of indices of parent partialsBuffers (input)
+ * @param childBufferIndices        List of indices of child partialsBuffers (input)
+ * @param eigenIndex                Index of the Eigen decomposition buffer (input)
+ * @param categoryWeightsIndex      Index of the category weights (input)
+ * @param stateFrequenciesIndex     Index of the state frequencies (input)
+ * @param cumulativeScaleIndices    List of scaleBuffers containing accumulated factors to apply to
+ *                                   each edge, or NULL (input)
+ * @param count                     Number of edges (input)
+ * @param minEdgeLength             Lower bound on the edge lengths (input)
+ * @param maxEdgeLength             Upper bound on the edge lengths (input)
+ * @param tolerance                 Largest change in length still taken as converged (input)
+ * @param maxIterations             Largest number of Newton-Raphson steps per edge (input)
+ * @param inOutEdgeLengths          Starting edge lengths, replaced by the optimal ones
+ *                                   (input and output)
+ * @param outLogLikelihoods         Destination for the log likelihood of each edge at its optimal
+ *                                   length (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleOptimizeEdgeLengths(int instance,
+                                               const int* parentBufferIndices,
+                                               const int* childBufferIndices,
+                                               int eigenIndex,
+                                               int categoryWeightsIndex,
+                                               int stateFrequenciesIndex,
+                                               const int* cumulativeScaleIndices,
+                                               int count,
+                                               double minEdgeLength,
+                                               double maxEdgeLength,
+                                               double tolerance,
+                                               int maxIterations,
+                                               double* inOutEdgeLengths,
+                                               double* outLogLikelihoods);
+
 /**
  * @brief Get site log likelihoods for last beagleCalculateRootLogLikelihoods or
  *         beagleCalculateEdgeLogLikelihoods call
@@ -803,6 +1348,103 @@ BEAGLE_DLLEXPORT int beagleGetSiteLogLikelihoods(int instance,
 BEAGLE_DLLEXPORT int beagleGetSiteDerivatives(int instance,
                                     double* outFirstDerivatives,
                                     double* outSecondDerivatives);    
+
+/**
+ * @brief Register client buffers for the site log likelihoods and derivatives
+ *
+ * This function has later root and edge integrations write the site log likelihoods, and
+ * the site derivatives, straight into client buffers of patternCount doubles each, so that
+ * they can be read after every evaluation without a beagleGetSiteLogLikelihoods or
+ * beagleGetSiteDerivatives copy. The buffers must stay valid until others are registered,
+ * NULL is registered in their place, or the instance is finalized. Only available on
+ * double-precision instances that keep site values in host memory.
+ *
+ * @param instance               Instance number (input)
+ * @param outLogLikelihoods      Buffer for the site log likelihoods, or NULL (output)
+ * @param outFirstDerivatives    Buffer for the site first derivatives, or NULL (output)
+ * @param outSecondDerivatives   Buffer for the site second derivatives, or NULL (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetSiteBuffers(int instance,
+                                          double* outLogLikelihoods,
+                                          double* outFirstDerivatives,
+                                          double* outSecondDerivatives);
+
+/**
+ * @brief Save the complete state of an instance to a file
+ *
+ * This function writes every tip, partials, scale and transition matrix buffer, along with
+ * the Eigen decompositions, rate matrices, category rates and weights, state frequencies and
+ * pattern weights, to a binary file. Buffers are written in the memory layout of the
+ * implementation, so the file can only be restored into an instance created with the same
+ * arguments and implementation, on a machine of the same byte order. Only CPU
+ * implementations support checkpoints.
+ *
+ * @param instance      Instance number (input)
+ * @param fileName      Path of the file to write (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSaveInstance(int instance,
+                                        const char* fileName);
+
+/**
+ * @brief Restore the state of an instance from a file written by beagleSaveInstance
+ *
+ * This function memory-maps the file and copies it into the buffers of the instance, which
+ * then computes as the saved instance did. BEAGLE_ERROR_GENERAL is returned if the file
+ * cannot be read or was written by an instance of different dimensions, flags or
+ * implementation, in which case nothing is restored; if the file is cut short, the
+ * instance is left partly restored.
+ *
+ * @param instance      Instance number (input)
+ * @param fileName      Path of the file to read (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleRestoreInstance(int instance,
+                                           const char* fileName);
+
+/**
+ * @brief Turn kernel counting on or off
+ *
+ * This function sets whether an instance records, per kernel class, the number of kernel
+ * calls, the wall time spent in them and estimates of the work done. Counting is off by
+ * default; turning it off keeps the counts recorded so far. Matrix-free partials updates
+ * are not counted. Only CPU implementations count kernels.
+ *
+ * @param instance      Instance number (input)
+ * @param enable        1 to count kernels, 0 to stop (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleSetKernelCounting(int instance,
+                                             int enable);
+
+/**
+ * @brief Get the kernel counters of an instance
+ *
+ * This function copies the counters recorded since the instance was created or its counters
+ * were last reset into outCounters, which should hold BEAGLE_KERNEL_CLASS_COUNT entries
+ * indexed by BeagleKernelClasses.
+ *
+ * @param instance      Instance number (input)
+ * @param outCounters   Pointer to destination for the counters (output)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleGetKernelCounters(int instance,
+                                             BeagleKernelCounters* outCounters);
+
+/**
+ * @brief Reset the kernel counters of an instance to zero
+ *
+ * @param instance      Instance number (input)
+ *
+ * @return error code
+ */
+BEAGLE_DLLEXPORT int beagleResetKernelCounters(int instance);
     
 /* using C calling conventions so that C programs can successfully link the beagle library
  * (closing brace)